@@ -11,6 +11,7 @@
 #include <mutex>
 #include <nlohmann/json.hpp>
 #include <nu/runtime.hpp>
+#include <nu/utils/task.hpp>
 #include <string>
 
 #include "States.hpp"
@@ -67,39 +68,52 @@ class BackEndHandler : public BackEndServiceIf {
 
  private:
   States _states;
+
+  // The fan-outs are coroutines, so outstanding calls hold no thread.
+  nu::Task<> RemovePostsCo(int64_t user_id, int start, int stop);
+  nu::Task<> ComposePostCo(const std::string &username, int64_t user_id,
+                           const std::string &text,
+                           const std::vector<int64_t> &media_ids,
+                           const std::vector<std::string> &media_types,
+                           PostType::type post_type);
 };
 
 BackEndHandler::BackEndHandler(States states) : _states(std::move(states)) {}
 
 void BackEndHandler::RemovePosts(int64_t user_id, int start, int stop) {
-  auto posts_future = _states.user_timeline_service.run_async(
+  RemovePostsCo(user_id, start, stop).get();
+}
+
+nu::Task<> BackEndHandler::RemovePostsCo(int64_t user_id, int start,
+                                         int stop) {
+  auto posts_task = _states.user_timeline_service.run_co(
       &UserTimelineService::ReadUserTimeline, user_id, start, stop);
-  auto followers_future = _states.social_graph_service.run_async(
+  auto followers_task = _states.social_graph_service.run_co(
       &SocialGraphService::GetFollowers, user_id);
-  auto posts = std::move(posts_future.get());
-  auto followers = std::move(followers_future.get());
+  auto posts = co_await std::move(posts_task);
+  auto followers = co_await std::move(followers_task);
 
-  std::vector<nu::Future<bool>> remove_post_futures;
-  std::vector<nu::Future<void>> remove_from_timeline_futures;
-  std::vector<nu::Future<void>> remove_short_url_futures;
+  std::vector<nu::Task<bool>> remove_post_tasks;
+  std::vector<nu::Task<>> remove_from_timeline_tasks;
+  std::vector<nu::Task<>> remove_short_url_tasks;
 
   for (auto post : posts) {
-    remove_post_futures.emplace_back(_states.post_storage_service.run_async(
+    remove_post_tasks.emplace_back(_states.post_storage_service.run_co(
         &PostStorageService::RemovePost, post.post_id));
 
-    remove_from_timeline_futures.emplace_back(
-        _states.user_timeline_service.run_async(
-            &UserTimelineService::RemovePost, user_id, post.post_id,
-            post.timestamp));
+    remove_from_timeline_tasks.emplace_back(
+        _states.user_timeline_service.run_co(&UserTimelineService::RemovePost,
+                                             user_id, post.post_id,
+                                             post.timestamp));
     for (auto mention : post.user_mentions) {
-      remove_from_timeline_futures.emplace_back(
-          _states.home_timeline_service.run_async(
+      remove_from_timeline_tasks.emplace_back(
+          _states.home_timeline_service.run_co(
               &HomeTimelineService::RemovePost, mention.user_id, post.post_id,
               post.timestamp));
     }
     for (auto user_id : followers) {
-      remove_from_timeline_futures.emplace_back(
-          _states.home_timeline_service.run_async(
+      remove_from_timeline_tasks.emplace_back(
+          _states.home_timeline_service.run_co(
               &HomeTimelineService::RemovePost, user_id, post.post_id,
               post.timestamp));
     }
@@ -108,9 +122,19 @@ void BackEndHandler::RemovePosts(int64_t user_id, int start, int stop) {
     for (auto &url : post.urls) {
       shortened_urls.emplace_back(std::move(url.shortened_url));
     }
-    remove_short_url_futures.emplace_back(_states.url_shorten_service.run_async(
+    remove_short_url_tasks.emplace_back(_states.url_shorten_service.run_co(
         &UrlShortenService::RemoveUrls, shortened_urls));
   }
+
+  for (auto &task : remove_post_tasks) {
+    co_await task;
+  }
+  for (auto &task : remove_from_timeline_tasks) {
+    co_await task;
+  }
+  for (auto &task : remove_short_url_tasks) {
+    co_await task;
+  }
 }
 
 void BackEndHandler::ComposePost(const std::string &username, int64_t user_id,
@@ -118,32 +142,42 @@ void BackEndHandler::ComposePost(const std::string &username, int64_t user_id,
                                  const std::vector<int64_t> &media_ids,
                                  const std::vector<std::string> &media_types,
                                  const PostType::type post_type) {
-  auto text_service_return_future =
-      _states.text_service.run_async(&TextService::ComposeText, text);
+  ComposePostCo(username, user_id, text, media_ids, media_types, post_type)
+      .get();
+}
+
+// The arguments are references, which stay valid as ComposePost() waits.
+nu::Task<> BackEndHandler::ComposePostCo(
+    const std::string &username, int64_t user_id, const std::string &text,
+    const std::vector<int64_t> &media_ids,
+    const std::vector<std::string> &media_types,
+    const PostType::type post_type) {
+  auto text_service_return_task =
+      _states.text_service.run_co(&TextService::ComposeText, text);
 
-  auto unique_id_future = _states.unique_id_service.run_async(
+  auto unique_id_task = _states.unique_id_service.run_co(
       &UniqueIdService::ComposeUniqueId, post_type);
 
-  auto medias_future = _states.media_service.run_async(
-      &MediaService::ComposeMedia, media_types, media_ids);
+  auto medias_task = _states.media_service.run_co(&MediaService::ComposeMedia,
+                                                  media_types, media_ids);
 
-  auto creator_future = _states.user_service.run_async(
+  auto creator_task = _states.user_service.run_co(
       &UserService::ComposeCreatorWithUserId, user_id, username);
 
   Post post;
   auto timestamp = rdtsc();
   post.timestamp = timestamp;
 
-  auto unique_id = unique_id_future.get();
-  auto write_user_timeline_future = _states.user_timeline_service.run_async(
+  auto unique_id = co_await unique_id_task;
+  auto write_user_timeline_task = _states.user_timeline_service.run_co(
       &UserTimelineService::WriteUserTimeline, unique_id, user_id, timestamp);
 
-  auto &text_service_return = text_service_return_future.get();
+  auto &text_service_return = co_await text_service_return_task;
   std::vector<int64_t> user_mention_ids;
   for (auto &item : text_service_return.user_mentions) {
     user_mention_ids.emplace_back(item.user_id);
   }
-  auto write_home_timeline_future = _states.home_timeline_service.run_async(
+  auto write_home_timeline_task = _states.home_timeline_service.run_co(
       &HomeTimelineService::WriteHomeTimeline, unique_id, user_id, timestamp,
       user_mention_ids);
 
@@ -151,16 +185,16 @@ void BackEndHandler::ComposePost(const std::string &username, int64_t user_id,
   post.urls = std::move(text_service_return.urls);
   post.user_mentions = std::move(text_service_return.user_mentions);
   post.post_id = unique_id;
-  post.media = std::move(medias_future.get());
-  post.creator = std::move(creator_future.get());
+  post.media = std::move(co_await medias_task);
+  post.creator = std::move(co_await creator_task);
   post.post_type = post_type;
 
-  auto post_future = _states.post_storage_service.run_async(
+  auto post_task = _states.post_storage_service.run_co(
       &PostStorageService::StorePost, post);
 
-  write_user_timeline_future.get();
-  post_future.get();
-  write_home_timeline_future.get();
+  co_await write_user_timeline_task;
+  co_await post_task;
+  co_await write_home_timeline_task;
 }
 
 void BackEndHandler::ReadUserTimeline(std::vector<Post> &_return,
@@ -1,9 +1,11 @@
 #include <thread.h>
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
 #include <iostream>
 #include <random>
+#include <span>
 #include <vector>
 
 #include "nu/ctrl_client.hpp"
@@ -16,6 +18,8 @@ constexpr uint32_t kNumThreads = 18;
 constexpr uint32_t kTargetMops = 2;
 constexpr uint64_t kPerfDurationUs = 10 * kOneSecond;
 constexpr uint32_t kNumProclets = 65566;
+constexpr uint32_t kNumBulkProclets = 65536;
+constexpr uint32_t kBulkBatchSize = 256;
 
 namespace nu {
 
@@ -75,7 +79,8 @@ class PerfAcquireMigrationDestAdapter : public PerfAdapter {
 
   bool serve_req(PerfThreadState *state, const PerfRequest *req) {
     Resource resource{0, 0};
-    auto [dest_guard, _] = client_->acquire_migration_dest(false, resource);
+    auto [dest_guard, _] = client_->acquire_migration_dest(
+        false, resource, /* preferred_ip = */ 0);
     BUG_ON(!dest_guard);
     return true;
   }
@@ -128,6 +133,8 @@ class PerfUpdateLocationAdapter : public PerfAdapter {
 class Test {
  public:
   void run() {
+    bench_bulk();
+
     {
       rt::Preempt p;
       rt::PreemptGuard g(&p);
@@ -162,6 +169,66 @@ class Test {
   }
 
  private:
+  void destroy_all(const std::vector<ProcletID> &ids) {
+    auto *client = get_runtime()->controller_client();
+    for (auto id : ids) {
+      client->destroy_proclet({.start = id, .end = id + kMinProcletHeapSize});
+    }
+  }
+
+  // Cold-start creation and resolution of many proclets, one by one vs.
+  // batched.
+  void bench_bulk() {
+    auto *client = get_runtime()->controller_client();
+    std::vector<ProcletID> ids;
+    ids.reserve(kNumBulkProclets);
+
+    auto start_us = microtime();
+    for (uint32_t i = 0; i < kNumBulkProclets; i++) {
+      auto optional = client->allocate_proclet(
+          kMinProcletHeapSize, /* ip_hint = */ 0, kNullProcletID);
+      BUG_ON(!optional);
+      ids.push_back(optional->first);
+    }
+    auto end_us = microtime();
+    std::cout << "allocate_proclet() us = " << end_us - start_us << std::endl;
+
+    start_us = microtime();
+    for (auto id : ids) {
+      BUG_ON(!client->resolve_proclet(id));
+    }
+    end_us = microtime();
+    std::cout << "resolve_proclet() us = " << end_us - start_us << std::endl;
+
+    start_us = microtime();
+    for (uint32_t i = 0; i < kNumBulkProclets; i += kBulkBatchSize) {
+      auto ips = client->resolve_proclets(
+          std::span(ids).subspan(i, std::min(kBulkBatchSize,
+                                             kNumBulkProclets - i)));
+      BUG_ON(std::ranges::count(ips, 0));
+    }
+    end_us = microtime();
+    std::cout << "resolve_proclets() us = " << end_us - start_us << std::endl;
+
+    destroy_all(ids);
+    ids.clear();
+
+    start_us = microtime();
+    while (ids.size() < kNumBulkProclets) {
+      auto num = std::min<uint32_t>(kBulkBatchSize,
+                                    kNumBulkProclets - ids.size());
+      auto proclets = client->allocate_proclets(
+          kMinProcletHeapSize, num, /* ip_hint = */ 0, kNullProcletID);
+      BUG_ON(proclets.size() != num);
+      for (const auto &[id, _] : proclets) {
+        ids.push_back(id);
+      }
+    }
+    end_us = microtime();
+    std::cout << "allocate_proclets() us = " << end_us - start_us << std::endl;
+
+    destroy_all(ids);
+  }
 };
 
 }  // namespace nu
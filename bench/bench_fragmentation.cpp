@@ -73,6 +73,16 @@ struct Test {
     rt::PreemptGuard g(&p);
     return get_runtime()->proclet_manager()->get_mem_usage();
   }
+  uint64_t get_wasted_bytes() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    uint64_t wasted_bytes = 0;
+    for (auto *base : get_runtime()->proclet_manager()->get_all_proclets()) {
+      auto *header = reinterpret_cast<ProcletHeader *>(base);
+      wasted_bytes += header->slab.get_wasted_bytes();
+    }
+    return wasted_bytes;
+  }
 };
 }  // namespace nu
 
@@ -150,14 +160,15 @@ void gen_commands(std::vector<Command> *commands) {
   }
 }
 
-uint64_t run_on_local_hash_table(std::vector<Command> *commands) {
-  auto padding =
-      (2ULL << bsr_64(sizeof(LocalHashTable))) - sizeof(LocalHashTable);
-  size_t mem_usage_start;
+// Returns the memory usage and the wasted bytes within it.
+std::pair<uint64_t, uint64_t> run_on_local_hash_table(
+    std::vector<Command> *commands) {
+  size_t mem_usage_start, wasted_bytes_start;
   {
     rt::Preempt p;
     rt::PreemptGuard g(&p);
     mem_usage_start = get_runtime()->runtime_slab()->get_usage();
+    wasted_bytes_start = get_runtime()->runtime_slab()->get_wasted_bytes();
   }
   LocalHashTable local_hash_table;
 
@@ -183,20 +194,27 @@ uint64_t run_on_local_hash_table(std::vector<Command> *commands) {
     thread.Join();
   }
 
-  size_t mem_usage_end;
+  size_t mem_usage_end, wasted_bytes_end;
   {
     rt::Preempt p;
     rt::PreemptGuard g(&p);
     mem_usage_end = get_runtime()->runtime_slab()->get_usage();
+    wasted_bytes_end = get_runtime()->runtime_slab()->get_wasted_bytes();
   }
 
-  return mem_usage_end - mem_usage_start - padding;
+  // The padding of the table's own allocation is not part of the usage.
+  auto padding = SlabAllocator::get_usable_size(sizeof(LocalHashTable)) -
+                 sizeof(LocalHashTable);
+  return std::make_pair(mem_usage_end - mem_usage_start - padding,
+                        wasted_bytes_end - wasted_bytes_start - padding);
 }
 
-uint64_t run_on_dis_hash_table(std::vector<Command> *commands) {
+std::pair<uint64_t, uint64_t> run_on_dis_hash_table(
+    std::vector<Command> *commands) {
   // To make the mem usage counting work, we must only use one remote server.
   auto test = make_proclet<nu::Test>();
   auto mem_usage_start = test.run(&nu::Test::get_mem_usage);
+  auto wasted_bytes_start = test.run(&nu::Test::get_wasted_bytes);
   auto dis_hash_table =
       make_dis_hash_table<Key, Val, decltype(kFarmHashKeytoU64)>();
 
@@ -223,7 +241,16 @@ uint64_t run_on_dis_hash_table(std::vector<Command> *commands) {
   }
 
   auto mem_usage_end = test.run(&nu::Test::get_mem_usage);
-  return mem_usage_end - mem_usage_start;
+  auto wasted_bytes_end = test.run(&nu::Test::get_wasted_bytes);
+  return std::make_pair(mem_usage_end - mem_usage_start,
+                        wasted_bytes_end - wasted_bytes_start);
+}
+
+void print_usage(std::pair<uint64_t, uint64_t> usage) {
+  // Flip slab_internal::kEnableFineClasses for the power-of-2 baseline.
+  std::cout << "fine_classes = " << slab_internal::kEnableFineClasses
+            << ", mem_usage = " << usage.first
+            << ", wasted_bytes = " << usage.second << std::endl;
 }
 
 void do_work() {
@@ -232,12 +259,10 @@ void do_work() {
   gen_commands(commands);
   if (use_local) {
     std::cout << "run_on_local_hash_table..." << std::endl;
-    auto local_hashtable_mem_usage = run_on_local_hash_table(commands);
-    std::cout << local_hashtable_mem_usage << std::endl;
+    print_usage(run_on_local_hash_table(commands));
   } else {
     std::cout << "run_on_dis_hash_table..." << std::endl;
-    auto dis_hash_table_mem_usage = run_on_dis_hash_table(commands);
-    std::cout << dis_hash_table_mem_usage << std::endl;
+    print_usage(run_on_dis_hash_table(commands));
   }
 }
 
@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <runtime/runtime.h>
+}
+#include <runtime.h>
+#include <thread.h>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/spin_lock.hpp"
+#include "nu/utils/swiss_hash_map.hpp"
+#include "nu/utils/sync_hash_map.hpp"
+#include "nu/utils/zipf.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kNumThreads = 16;
+constexpr uint64_t kNumKeys = 1 << 20;
+constexpr uint64_t kNumSlots = 2 * kNumKeys;
+constexpr uint64_t kNumOpsPerThread = 4 << 20;
+constexpr uint64_t kNumSampledKeys = 1 << 22;
+constexpr uint32_t kGetPercentage = 95;
+constexpr double kZipfParams[] = {0, 0.99};
+
+struct Val {
+  uint64_t data[2];
+};
+
+using SyncMap = SyncHashMap<kNumSlots, uint64_t, Val, std::hash<uint64_t>,
+                            std::equal_to<uint64_t>,
+                            std::allocator<std::pair<const uint64_t, Val>>,
+                            SpinLock>;
+using SwissMap = SwissHashMap<kNumSlots, uint64_t, Val, std::hash<uint64_t>,
+                              std::equal_to<uint64_t>,
+                              std::allocator<std::pair<const uint64_t, Val>>,
+                              SpinLock>;
+
+// Keys are scrambled so that the popular ones do not share buckets.
+uint64_t to_key(uint64_t idx) { return idx * 0x9E3779B97F4A7C15ULL; }
+
+template <typename Map>
+void bench(const char *name, double zipf_param,
+           const std::vector<uint64_t> &sampled_keys) {
+  auto map = std::make_unique<Map>();
+  for (uint64_t i = 0; i < kNumKeys; i++) {
+    map->put(to_key(i), Val{{i, i}});
+  }
+
+  std::vector<rt::Thread> threads;
+  auto start_us = microtime();
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, tid = i] {
+      uint64_t pos = tid * (kNumSampledKeys / kNumThreads);
+      for (uint64_t j = 0; j < kNumOpsPerThread; j++) {
+        auto key = sampled_keys[pos++ % kNumSampledKeys];
+        if (j % 100 < kGetPercentage) {
+          auto val = map->get_copy(key);
+          BUG_ON(!val);
+        } else {
+          map->put(key, Val{{j, j}});
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  auto end_us = microtime();
+
+  auto mops = static_cast<double>(kNumThreads * kNumOpsPerThread) /
+              (end_us - start_us);
+  std::cout << name << " (zipf " << zipf_param << "): " << mops << " MOPS"
+            << std::endl;
+}
+
+void do_work() {
+  std::mt19937 mt(0);
+
+  for (auto zipf_param : kZipfParams) {
+    zipf_distribution zipf(kNumKeys, zipf_param);
+    std::vector<uint64_t> sampled_keys(kNumSampledKeys);
+    for (auto &key : sampled_keys) {
+      key = to_key(zipf(mt));
+    }
+
+    bench<SyncMap>("SyncHashMap", zipf_param, sampled_keys);
+    bench<SwissMap>("SwissHashMap", zipf_param, sampled_keys);
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <net/ip.h>
+#include <runtime/net.h>
+#include <runtime/runtime.h>
+}
+#include <runtime.h>
+#include <sync.h>
+
+#include "nu/migrator.hpp"
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/splitmix64.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kHeapSize = 1ULL << 30;
+constexpr uint64_t kNumEntries = kHeapSize / sizeof(uint64_t);
+constexpr uint64_t kNumLookups = 64 << 20;
+constexpr uint64_t kTimeoutUs = 30 * kOneSecond;
+constexpr uint32_t kNumRuns = 5;
+// Just below and at the smallest capacity class backed by huge pages.
+constexpr uint64_t kSmallPageCapacity =
+    ProcletManager::kMinHugePageHeapSize / 2;
+constexpr uint64_t kHugePageCapacity = ProcletManager::kMinHugePageHeapSize;
+
+static_assert(kSmallPageCapacity >= 2 * kHeapSize);
+
+namespace nu {
+class Test {
+ public:
+  Test() : table_(kNumEntries) {
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      table_[i] = i;
+    }
+  }
+
+  // Returns the lookup throughput in MOPS.
+  double lookup() {
+    SplitMix64 rng(get_cfg_ip());
+    uint64_t sum = 0;
+    auto start_us = microtime();
+    for (uint64_t i = 0; i < kNumLookups; i++) {
+      sum += table_[rng.next() % kNumEntries];
+    }
+    auto end_us = microtime();
+    rt::access_once(sum_) = sum;
+    return static_cast<double>(kNumLookups) / (end_us - start_us);
+  }
+
+  bool huge_pages() {
+    return get_runtime()->get_current_proclet_header()->huge_pages;
+  }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  void migrate() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+ private:
+  std::vector<uint64_t> table_;
+  uint64_t sum_;
+};
+}  // namespace nu
+
+// The migration time spans from raising the pressure till the proclet is
+// observed on its new node.
+void bench(const char *mode, uint64_t capacity) {
+  std::vector<double> mopss;
+  std::vector<uint64_t> migration_times_us;
+  bool huge_pages = false;
+
+  for (uint32_t k = 0; k < kNumRuns; k++) {
+    auto proclet = make_proclet<Test>(false, capacity);
+    huge_pages = proclet.run(&Test::huge_pages);
+    mopss.push_back(proclet.run(&Test::lookup));
+
+    auto src_ip = proclet.run(&Test::get_ip);
+    auto start_us = microtime();
+    proclet.run(&Test::migrate);
+    while (proclet.run(&Test::get_ip) == src_ip &&
+           microtime() - start_us < kTimeoutUs) {
+      delay_us(100);
+    }
+    migration_times_us.push_back(microtime() - start_us);
+    mopss.push_back(proclet.run(&Test::lookup));
+    delay_ms(100);
+  }
+
+  auto avg = [](const auto &v) {
+    return std::accumulate(v.begin(), v.end(),
+                           static_cast<std::decay_t<decltype(v[0])>>(0)) /
+           v.size();
+  };
+  std::cout << mode << ": huge_pages = " << huge_pages
+            << ", lookup_mops = " << avg(mopss)
+            << ", migration_time_us = " << avg(migration_times_us)
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    bench("4KB", kSmallPageCapacity);
+    bench("2MB", kHugePageCapacity);
+  });
+}
@@ -1,48 +1,276 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <numeric>
+#include <tuple>
 #include <vector>
 
 extern "C" {
 #include <base/time.h>
 #include <net/ip.h>
+#include <runtime/net.h>
 #include <runtime/runtime.h>
 }
 #include <runtime.h>
+#include <sync.h>
 
+#include "nu/migrator.hpp"
 #include "nu/pressure_handler.hpp"
 #include "nu/proclet.hpp"
 #include "nu/runtime.hpp"
+#include "nu/utils/time.hpp"
 
 using namespace nu;
 
-constexpr uint32_t kObjSize = 128 << 10;
+constexpr uint64_t kHeapSize = 1ULL << 30;
+constexpr uint64_t kProcletCapacity = 2 * kHeapSize;
+constexpr uint32_t kWriteMBs = 200;
+constexpr uint32_t kWriteIntervalUs = 100;
+constexpr uint64_t kWriteStridePages = 7919;
+constexpr uint64_t kTimeoutUs = 30 * kOneSecond;
 constexpr uint32_t kNumRuns = 5;
+constexpr uint64_t kChunkSize = 4000;
+constexpr uint32_t kFreeBlockChunks = 256;
+constexpr uint32_t kLiveBlockPercent = 25;
+constexpr uint32_t kNumStormProclets = 256;
+constexpr uint64_t kStormDurationUs = 2 * kOneSecond;
 
 namespace nu {
 class Test {
  public:
-  void run() {
-    {
-      rt::Preempt p;
-      rt::PreemptGuard g(&p);
-      get_runtime()->pressure_handler()->mock_set_pressure();
+  Test(uint64_t heap_size) : heap_(heap_size), stop_(false) {
+    for (uint64_t i = 0; i < heap_.size(); i += kPageSize) {
+      heap_[i] = 1;
     }
-    delay_ms(1000);
+  }
+
+  // Keeps dirtying pages at @write_mbs until stop() is invoked.
+  void write(uint32_t write_mbs) {
+    auto num_pages_per_interval =
+        write_mbs * kOneMB / (kOneSecond / kWriteIntervalUs) / kPageSize;
+    auto num_pages = heap_.size() / kPageSize;
+    uint64_t page_idx = 0;
+
+    while (!rt::access_once(stop_)) {
+      for (uint64_t i = 0; i < num_pages_per_interval; i++) {
+        heap_[page_idx * kPageSize]++;
+        page_idx = (page_idx + kWriteStridePages) % num_pages;
+      }
+      Time::sleep(kWriteIntervalUs);
+    }
+  }
+
+  void stop() { rt::access_once(stop_) = true; }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  void migrate(bool pre_copy, bool post_copy, bool compression) {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_pre_copy(pre_copy);
+    get_runtime()->migrator()->set_post_copy(post_copy);
+    get_runtime()->migrator()->set_compression(compression);
+    get_runtime()->pressure_handler()->mock_set_pressure();
   }
 
  private:
-  uint8_t heap[kObjSize];
+  std::vector<uint8_t> heap_;
+  bool stop_;
+};
+
+// Fills its heap with chunks, then frees most of them in blocks of
+// kFreeBlockChunks, which leaves large free runs behind.
+class FragmentedTest {
+ public:
+  FragmentedTest(uint64_t heap_size) {
+    auto num_chunks = heap_size / kChunkSize;
+    for (uint64_t i = 0; i < num_chunks; i++) {
+      chunks_.emplace_back(std::make_unique<std::byte[]>(kChunkSize));
+    }
+    for (uint64_t i = 0; i < num_chunks; i++) {
+      if ((i / kFreeBlockChunks) % 100 >= kLiveBlockPercent) {
+        chunks_[i].reset();
+      }
+    }
+  }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  std::pair<uint64_t, uint64_t> get_heap_and_skipped_bytes() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    auto *header = get_runtime()->get_current_proclet_header();
+    return std::make_pair(header->heap_size(),
+                          header->slab.get_free_run_bytes());
+  }
+
+  void migrate(bool sparse_copy) {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_pre_copy(false);
+    get_runtime()->migrator()->set_post_copy(false);
+    get_runtime()->migrator()->set_sparse_copy(sparse_copy);
+    get_runtime()->migrator()->set_compression(false);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+ private:
+  std::vector<std::unique_ptr<std::byte[]>> chunks_;
+};
+
+// One of the many small proclets on a node that all get migrated at once.
+class StormTest {
+ public:
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  void migrate(bool location_push) {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_pre_copy(false);
+    get_runtime()->migrator()->set_post_copy(false);
+    get_runtime()->migrator()->set_location_push(location_push);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
 };
 }  // namespace nu
 
+// Measured from the client side: the total migration time spans from raising
+// the pressure till the proclet is observed on its new node; the downtime is
+// the longest gap between two consecutive completed invocations.
+void bench(const char *mode, bool pre_copy, bool post_copy,
+           bool compression) {
+  std::vector<uint64_t> downtimes_us;
+  std::vector<uint64_t> total_times_us;
+
+  for (uint32_t k = 0; k < kNumRuns; k++) {
+    auto proclet = make_proclet<Test>(std::tuple(kHeapSize), false,
+                                      kProcletCapacity);
+    auto writer = proclet.run_async(&Test::write, kWriteMBs);
+    auto src_ip = proclet.run(&Test::get_ip);
+
+    auto start_us = microtime();
+    proclet.run(&Test::migrate, pre_copy, post_copy, compression);
+    auto last_us = start_us;
+    uint64_t downtime_us = 0;
+    while (true) {
+      auto ip = proclet.run(&Test::get_ip);
+      auto now_us = microtime();
+      downtime_us = std::max(downtime_us, now_us - last_us);
+      last_us = now_us;
+      if (ip != src_ip || now_us - start_us > kTimeoutUs) {
+        break;
+      }
+    }
+    downtimes_us.push_back(downtime_us);
+    total_times_us.push_back(last_us - start_us);
+
+    proclet.run(&Test::stop);
+    writer.get();
+    delay_ms(100);
+  }
+
+  auto avg = [](const std::vector<uint64_t> &v) {
+    return std::accumulate(v.begin(), v.end(), static_cast<uint64_t>(0)) /
+           v.size();
+  };
+  std::cout << mode << ": downtime_us = " << avg(downtimes_us)
+            << ", total_time_us = " << avg(total_times_us) << std::endl;
+}
+
+// Stop-and-copy of a heap that is mostly free, with or without skipping the
+// free runs. The skipped bytes are reported by the destination.
+void bench_fragmented(const char *mode, bool sparse_copy) {
+  std::vector<uint64_t> total_times_us;
+  uint64_t heap_bytes = 0;
+  uint64_t skipped_bytes = 0;
+
+  for (uint32_t k = 0; k < kNumRuns; k++) {
+    auto proclet = make_proclet<FragmentedTest>(std::tuple(kHeapSize), false,
+                                                kProcletCapacity);
+    auto src_ip = proclet.run(&FragmentedTest::get_ip);
+
+    auto start_us = microtime();
+    proclet.run(&FragmentedTest::migrate, sparse_copy);
+    while (proclet.run(&FragmentedTest::get_ip) == src_ip &&
+           microtime() - start_us < kTimeoutUs) {
+      delay_us(kWriteIntervalUs);
+    }
+    total_times_us.push_back(microtime() - start_us);
+
+    auto [heap, skipped] =
+        proclet.run(&FragmentedTest::get_heap_and_skipped_bytes);
+    heap_bytes += heap;
+    skipped_bytes += skipped;
+    delay_ms(100);
+  }
+
+  std::cout << mode << ": total_time_us = "
+            << std::accumulate(total_times_us.begin(), total_times_us.end(),
+                               static_cast<uint64_t>(0)) /
+                   kNumRuns
+            << ", heap_bytes = " << heap_bytes / kNumRuns
+            << ", skipped_bytes = " << skipped_bytes / kNumRuns << std::endl;
+}
+
+// Invokes the proclets of a node round-robin while all of them get migrated
+// away, and reports the tail latency of the invocations. Without location
+// pushes, the first invocation of each migrated proclet bounces off its old
+// node.
+void bench_storm(const char *mode, bool location_push) {
+  std::vector<uint64_t> latencies_us;
+
+  for (uint32_t k = 0; k < kNumRuns; k++) {
+    std::vector<Proclet<StormTest>> proclets;
+    proclets.emplace_back(make_proclet<StormTest>());
+    auto src_ip = proclets.front().run(&StormTest::get_ip);
+    while (proclets.size() < kNumStormProclets) {
+      proclets.emplace_back(make_proclet<StormTest>(
+          /* pinned = */ false, /* capacity = */ std::nullopt, src_ip));
+    }
+    // Warm up the location cache, and get into the callers of every proclet.
+    for (auto &proclet : proclets) {
+      proclet.run(&StormTest::get_ip);
+    }
+
+    proclets.front().run(&StormTest::migrate, location_push);
+    auto start_us = microtime();
+    for (uint32_t i = 0; microtime() - start_us < kStormDurationUs; i++) {
+      auto call_start_us = microtime();
+      proclets[i % kNumStormProclets].run(&StormTest::get_ip);
+      latencies_us.push_back(microtime() - call_start_us);
+    }
+
+    proclets.clear();
+    delay_ms(100);
+  }
+
+  std::sort(latencies_us.begin(), latencies_us.end());
+  auto percentile = [&](double p) {
+    return latencies_us[static_cast<uint64_t>(p * (latencies_us.size() - 1))];
+  };
+  std::cout << mode << ": p50_us = " << percentile(0.5)
+            << ", p99_us = " << percentile(0.99)
+            << ", p999_us = " << percentile(0.999)
+            << ", max_us = " << latencies_us.back() << std::endl;
+}
+
 int main(int argc, char **argv) {
   return runtime_main_init(argc, argv, [](int, char **) {
-    for (uint32_t k = 0; k < kNumRuns; k++) {
-      auto proclet = make_proclet<Test>();
-      proclet.run(&Test::run);
-      delay_ms(100);
-    }
+    bench("stop-and-copy", /* pre_copy = */ false, /* post_copy = */ false,
+          /* compression = */ false);
+    bench("pre-copy", /* pre_copy = */ true, /* post_copy = */ false,
+          /* compression = */ false);
+    bench("post-copy", /* pre_copy = */ false, /* post_copy = */ true,
+          /* compression = */ false);
+    // Compression only kicks in if it beats the link rate measured above.
+    bench("stop-and-copy + compression", /* pre_copy = */ false,
+          /* post_copy = */ false, /* compression = */ true);
+    bench("pre-copy + compression", /* pre_copy = */ true,
+          /* post_copy = */ false, /* compression = */ true);
+    bench_fragmented("fragmented dense-copy", /* sparse_copy = */ false);
+    bench_fragmented("fragmented sparse-copy", /* sparse_copy = */ true);
+    bench_storm("storm redirect-only", /* location_push = */ false);
+    bench_storm("storm location-push", /* location_push = */ true);
   });
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <memory>
@@ -8,10 +9,11 @@
 using namespace nu;
 using namespace std;
 
-constexpr static uint32_t kNumThreads = 184;
+constexpr static uint32_t kNumThreads = 64;
 constexpr static uint32_t kObjSize = 100;
-constexpr static uint32_t kBufSize = 102400;
-constexpr static uint32_t kNumInvocationsPerThread = 1000;
+constexpr static uint64_t kBufSizes[] = {64 << 10, 256 << 10, 1 << 20, 4 << 20,
+                                         16 << 20};
+constexpr static uint64_t kNumBytesPerThread = 1ULL << 30;
 
 struct Obj {
   uint8_t data[kObjSize];
@@ -24,7 +26,11 @@ class Worker {
   void foo(Buf buf) {}
 };
 
-void do_work() {
+// The calls are issued from threads outside of any proclet, the only callers
+// whose large arguments are sent without being copied.
+void do_work(uint64_t buf_size) {
+  auto num_invocations_per_thread =
+      std::max(static_cast<uint64_t>(1), kNumBytesPerThread / buf_size);
   std::vector<Proclet<Worker>> workers;
 
   for (uint32_t i = 0; i < kNumThreads; i++) {
@@ -33,10 +39,10 @@ void do_work() {
 
   std::vector<rt::Thread> ths;
   for (uint32_t i = 0; i < kNumThreads; i++) {
-    ths.emplace_back([worker = std::move(workers[i])]() mutable {
+    ths.emplace_back([&, worker = std::move(workers[i])]() mutable {
       Buf buf;
-      buf.resize(kBufSize / kObjSize);
-      for (uint32_t j = 0; j < kNumInvocationsPerThread; j++) {
+      buf.resize(buf_size / kObjSize);
+      for (uint64_t j = 0; j < num_invocations_per_thread; j++) {
         worker.run(&Worker::foo, buf);
       }
     });
@@ -49,12 +55,17 @@ void do_work() {
   auto t1 = microtime();
   auto us = t1 - t0;
   auto size =
-      static_cast<uint64_t>(kBufSize) * kNumInvocationsPerThread * kNumThreads;
+      buf_size / kObjSize * kObjSize * num_invocations_per_thread * kNumThreads;
   auto mbs = size / us;
 
-  std::cout << t1 - t0 << " us, " << mbs << " MB/s" << std::endl;
+  std::cout << buf_size << " B: " << t1 - t0 << " us, " << mbs << " MB/s"
+            << std::endl;
 }
 
 int main(int argc, char **argv) {
-  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+  return runtime_main_init(argc, argv, [](int, char **) {
+    for (auto buf_size : kBufSizes) {
+      do_work(buf_size);
+    }
+  });
 }
@@ -1,14 +1,18 @@
 extern "C" {
 #include <base/log.h>
+#include <base/time.h>
 #include <net/ip.h>
+#include <runtime/timer.h>
 #include <unistd.h>
 }
 
 #include <runtime.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "nu/utils/rpc.hpp"
 
@@ -18,6 +22,12 @@ using namespace std::chrono;
 using sec = duration<double>;
 
 constexpr uint32_t kPort = 8080;
+constexpr uint64_t kSweepLoads[] = {10'000,  50'000,    100'000,  200'000,
+                                    500'000, 1'000'000, 2'000'000};
+constexpr uint64_t kSweepDurationUs = 1'000'000;
+constexpr uint64_t kServerReportIntervalUs = 1'000'000;
+
+using Histogram = nu::rpc_internal::RPCBatchController::Histogram;
 
 void ServerHandler(std::span<std::byte> args, nu::RPCReturner *returner) {
   auto buf = std::make_unique<std::byte[]>(args.size());
@@ -27,10 +37,24 @@ void ServerHandler(std::span<std::byte> args, nu::RPCReturner *returner) {
                    [b = std::move(buf)]() mutable {});
 }
 
+// Reports the requests served per second along with the handler threads they
+// took, which shows how many requests each spawn covered once reads coalesce.
 void RunServer() {
   nu::RPCServerListener listener(kPort, &ServerHandler);
-  rt::Preempt p;
-  rt::PreemptGuardAndPark gp(&p);
+  auto last = listener.GetStats();
+  while (true) {
+    timer_sleep(kServerReportIntervalUs);
+    auto stats = listener.GetStats();
+    auto reqs = stats.requests - last.requests;
+    auto spawns = stats.handler_spawns - last.handler_spawns;
+    if (reqs) {
+      std::cout << "served " << reqs << " reqs/s with " << spawns
+                << " handler spawns/s ("
+                << static_cast<double>(reqs) / std::max<uint64_t>(spawns, 1)
+                << " reqs per spawn)" << std::endl;
+    }
+    last = stats;
+  }
 }
 
 void RunClient(netaddr raddr, int threads, int samples, size_t buflen) {
@@ -69,6 +93,70 @@ void RunClient(netaddr raddr, int threads, int samples, size_t buflen) {
   std::cout << "transferred " << reqs_per_second << " reqs/s" << std::endl;
 }
 
+Histogram SumHistograms(nu::RPCClient *c) {
+  Histogram sum = {};
+  for (const auto &h : c->GetBatchSizeHistograms()) {
+    for (size_t i = 0; i < h.size(); i++) sum[i] += h[i];
+  }
+  return sum;
+}
+
+// Offers each load of kSweepLoads in turn, with @threads workers issuing paced
+// calls, and reports the latency and batch sizes each load ends up with.
+void RunSweep(netaddr raddr, int threads, size_t buflen) {
+  std::unique_ptr<nu::RPCClient> c = nu::RPCClient::Dial(raddr);
+
+  for (auto load : kSweepLoads) {
+    std::vector<std::vector<uint64_t>> lats(threads);
+    std::vector<rt::Thread> workers;
+    auto hist_before = SumHistograms(c.get());
+    auto start_us = microtime();
+
+    for (int i = 0; i < threads; ++i) {
+      workers.emplace_back([&, i] {
+        auto buf = std::make_unique<std::byte[]>(buflen);
+        nu::RPCReturnBuffer return_buf;
+        // Workers take turns, so each one sends every threads / load seconds.
+        double interval_us = 1e6 * threads / load;
+        double next_us = start_us + interval_us * i / threads;
+        auto end_us = start_us + kSweepDurationUs;
+
+        while (next_us < end_us) {
+          auto now_us = microtime();
+          if (now_us < next_us) {
+            timer_sleep_until(next_us);
+            now_us = microtime();
+          }
+          BUG_ON(c->Call({buf.get(), buflen}, &return_buf) !=
+                 nu::RPCReturnCode::kOk);
+          lats[i].push_back(microtime() - now_us);
+          next_us += interval_us;
+        }
+      });
+    }
+    for (auto &t : workers) t.Join();
+    auto elapsed_us = microtime() - start_us;
+    auto hist_after = SumHistograms(c.get());
+
+    std::vector<uint64_t> all;
+    for (auto &l : lats) all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) -> uint64_t {
+      if (all.empty()) return 0;
+      return all[std::min(all.size() - 1, static_cast<size_t>(all.size() * p))];
+    };
+    std::cout << "offered " << load << " reqs/s, achieved "
+              << all.size() * 1'000'000 / elapsed_us << " reqs/s, p50 "
+              << pct(0.5) << " us, p99 " << pct(0.99) << " us" << std::endl;
+    std::cout << "\tbatch sizes:";
+    for (size_t i = 0; i < hist_after.size(); i++) {
+      std::cout << " [" << (1 << i) << ", " << (2 << i)
+                << ")=" << hist_after[i] - hist_before[i];
+    }
+    std::cout << std::endl;
+  }
+}
+
 int StringToAddr(const char *str, uint32_t *addr) {
   uint8_t a, b, c, d;
   if (sscanf(str, "%hhu.%hhu.%hhu.%hhu", &a, &b, &c, &d) != 4) return -EINVAL;
@@ -84,6 +172,8 @@ int main(int argc, char *argv[]) {
     std::cerr << "commands>" << std::endl;
     std::cerr << "\tserver - runs an RPC server" << std::endl;
     std::cerr << "\tclient - runs an RPC client" << std::endl;
+    std::cerr << "\tsweep - runs an RPC client over varying offered loads"
+              << std::endl;
     return -EINVAL;
   }
 
@@ -105,6 +195,18 @@ int main(int argc, char *argv[]) {
     threads = std::stoi(argv[4], nullptr, 0);
     samples = std::stoi(argv[5], nullptr, 0);
     buflen = std::stoul(argv[6], nullptr, 0);
+  } else if (cmd.compare("sweep") == 0) {
+    if (argc != 6) {
+      std::cerr << "usage: [cfg_file] " << cmd << " [ip_addr] [threads] "
+                << "[buflen]" << std::endl;
+      return -EINVAL;
+    }
+
+    int ret = StringToAddr(argv[3], &raddr.ip);
+    raddr.port = kPort;
+    if (ret) return -EINVAL;
+    threads = std::stoi(argv[4], nullptr, 0);
+    buflen = std::stoul(argv[5], nullptr, 0);
   } else if (cmd.compare("server") != 0) {
     std::cerr << "invalid command: " << cmd << std::endl;
     return -EINVAL;
@@ -116,6 +218,8 @@ int main(int argc, char *argv[]) {
       RunServer();
     } else if (cmd.compare("client") == 0) {
       RunClient(raddr, threads, samples, buflen);
+    } else if (cmd.compare("sweep") == 0) {
+      RunSweep(raddr, threads, buflen);
     }
   });
 }
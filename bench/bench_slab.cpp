@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <runtime/runtime.h>
+}
+#include <runtime.h>
+#include <thread.h>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/slab.hpp"
+#include "nu/utils/splitmix64.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kBufSize = 4ULL << 30;
+constexpr uint32_t kNumThreads = 16;
+constexpr uint32_t kNumRounds = 4096;
+// Each round allocates a burst of objects and then frees all of them.
+constexpr uint32_t kBurstSize = 256;
+constexpr uint64_t kMaxObjSize = 512;
+
+void bench(SlabAllocator *slab) {
+  std::vector<rt::Thread> threads;
+  auto start_us = microtime();
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&, tid = i] {
+      SplitMix64 rng(tid);
+      std::vector<void *> ptrs(kBurstSize);
+      for (uint32_t j = 0; j < kNumRounds; j++) {
+        for (auto &ptr : ptrs) {
+          ptr = slab->allocate(rng.next() % kMaxObjSize + 1);
+          BUG_ON(!ptr);
+        }
+        for (auto *ptr : ptrs) {
+          SlabAllocator::free(ptr);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  auto end_us = microtime();
+
+  auto stats = slab->get_cache_stats();
+  std::cout << "mops = "
+            << static_cast<double>(stats.num_allocs) / (end_us - start_us)
+            << ", miss_ratio = "
+            << static_cast<double>(stats.num_misses) / stats.num_allocs
+            << ", overflows = " << stats.num_overflows
+            << ", global_locks = " << stats.num_global_locks
+            << ", contended_locks = " << stats.num_contended_locks
+            << ", avg_miss_cycles = "
+            << (stats.num_misses ? stats.miss_cycles / stats.num_misses : 0)
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    auto buf = std::make_unique_for_overwrite<uint8_t[]>(kBufSize);
+    SlabAllocator slab(kRuntimeSlabId + 1, buf.get(), kBufSize);
+    bench(&slab);
+  });
+}
@@ -0,0 +1,112 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <net/ip.h>
+#include <runtime/runtime.h>
+}
+#include <runtime.h>
+
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/tracer.hpp"
+
+using namespace nu;
+
+constexpr static uint32_t kNumProclets = 1024;
+constexpr static uint32_t kNumThreads = 500;
+constexpr static uint64_t kRoundUs = 5 * kOneSecond;
+constexpr static uint32_t kNumRounds = 3;
+constexpr static uint32_t kSampleInterval = 100;  // i.e., a 1% sample rate.
+constexpr static double kMaxOverhead = 0.02;
+constexpr static auto kTracePath = "/tmp/nu_trace.json";
+
+struct AlignedCnt {
+  uint64_t cnt;
+  uint8_t pads[kCacheLineBytes - sizeof(cnt)];
+};
+
+AlignedCnt cnts[kNumThreads];
+bool stop;
+
+class Obj {
+ public:
+  void set_peer(WeakProclet<Obj> peer) { peer_ = std::move(peer); }
+  // Each call issues a nested one, so that the traces span two hops.
+  int foo() { return peer_.run(&Obj::bar); }
+  int bar() { return 0x88; }
+
+ private:
+  WeakProclet<Obj> peer_;
+};
+
+double measure_tput(std::vector<Proclet<Obj>> &proclets) {
+  std::vector<rt::Thread> threads;
+  rt::access_once(stop) = false;
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    cnts[i].cnt = 0;
+    threads.emplace_back([&, tid = i] {
+      std::mt19937 mt(tid);
+      std::uniform_int_distribution<uint32_t> dist(0, kNumProclets - 1);
+      while (!rt::access_once(stop)) {
+        auto ret = proclets[dist(mt)].run(&Obj::foo);
+        ACCESS_ONCE(ret);
+        cnts[tid].cnt++;
+      }
+    });
+  }
+
+  auto start_us = microtime();
+  timer_sleep(kRoundUs);
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < kNumThreads; i++) {
+    sum += rt::access_once(cnts[i].cnt);
+  }
+  auto us = microtime() - start_us;
+  rt::access_once(stop) = true;
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  return static_cast<double>(sum) / us;
+}
+
+void do_work() {
+  std::vector<Proclet<Obj>> proclets;
+  for (uint32_t i = 0; i < kNumProclets; i++) {
+    proclets.emplace_back(make_proclet<Obj>());
+  }
+  for (uint32_t i = 0; i < kNumProclets; i++) {
+    auto peer = proclets[(i + 1) % kNumProclets].get_weak();
+    proclets[i].run(&Obj::set_peer, peer);
+  }
+
+  auto *tracer = get_runtime()->tracer();
+  double off_tput = 0, on_tput = 0;
+  // Interleave the rounds to cancel out the drift of the environment.
+  for (uint32_t i = 0; i < kNumRounds; i++) {
+    tracer->set_sample_interval(0);
+    off_tput += measure_tput(proclets);
+    tracer->set_sample_interval(kSampleInterval);
+    on_tput += measure_tput(proclets);
+  }
+  tracer->set_sample_interval(0);
+
+  auto overhead = 1 - on_tput / off_tput;
+  std::cout << "off: " << off_tput / kNumRounds << " MOPS, "
+            << "on (1/" << kSampleInterval << "): " << on_tput / kNumRounds
+            << " MOPS, overhead: " << overhead * 100 << "%" << std::endl;
+  BUG_ON(!tracer->export_chrome_trace(kTracePath));
+  std::cout << "trace exported to " << kTracePath << std::endl;
+
+  if (overhead < kMaxOverhead) {
+    std::cout << "Passed" << std::endl;
+  } else {
+    std::cout << "Failed" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) { do_work(); });
+}
@@ -24,6 +24,7 @@ extern const int thread_link_offset;
 extern const int thread_monitor_cnt_offset;
 extern const int thread_owner_proclet_offset;
 extern const int thread_proclet_slab_offset;
+extern const int thread_trace_ctx_offset;
 
 /*
  * Low-level routines, these are helpful for bindings and synchronization
@@ -173,3 +174,8 @@ static inline void *thread_set_proclet_slab(void *proclet_slab)
 
        return old_proclet_slab;
 }
+
+static inline void *thread_get_trace_ctx(void)
+{
+       return (void *)((uint64_t)__self + thread_trace_ctx_offset);
+}
@@ -103,6 +103,8 @@ struct thread_nu_state {
 	uint32_t                monitor_cnt;
 	void                    *owner_proclet;
 	void                    *proclet_slab;
+	/* the trace id and span id of the call being served, opaque here */
+	uint64_t                trace_ctx[2];
 	struct rcu_context      rcu_ctxs[MAX_NUM_RCUS_HELD];
 	struct thread_tf	tf;
 };
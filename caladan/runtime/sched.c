@@ -27,6 +27,9 @@ const int thread_owner_proclet_offset =
 const int thread_proclet_slab_offset =
        offsetof(struct thread, nu_state) +
        offsetof(struct thread_nu_state, proclet_slab);
+const int thread_trace_ctx_offset =
+       offsetof(struct thread, nu_state) +
+       offsetof(struct thread_nu_state, trace_ctx);
 
 /* the current running thread, or NULL if there isn't one */
 __thread thread_t *__self;
@@ -1124,6 +1127,7 @@ static __always_inline thread_t *__thread_create(void)
 	th->nu_state.creator_ip = get_cfg_ip();
 	th->nu_state.proclet_slab = NULL;
 	th->nu_state.owner_proclet = NULL;
+	memset(th->nu_state.trace_ctx, 0, sizeof(th->nu_state.trace_ctx));
 
 	return th;
 }
@@ -1188,6 +1192,8 @@ thread_t *thread_nu_create_with_args(void *proclet_stack,
 	th->nu_state.proclet_slab = __self->nu_state.proclet_slab;
 	th->nu_state.monitor_cnt = __self->nu_state.monitor_cnt;
 	th->nu_state.owner_proclet = __self->nu_state.owner_proclet;
+	memcpy(th->nu_state.trace_ctx, __self->nu_state.trace_ctx,
+	       sizeof(__self->nu_state.trace_ctx));
 	th->nu_state.tf.rsp = nu_stack_init_to_rsp(proclet_stack);
 	th->nu_state.tf.rdi = (uint64_t)args;
 	/* just in case base pointers are enabled */
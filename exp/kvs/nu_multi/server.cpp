@@ -113,19 +113,13 @@ class Proxy {
       Req req;
       BUG_ON(c->ReadFull(&req, sizeof(req)) <= 0);
       Resp resp;
-      bool is_local;
-      auto optional_v = hash_table_.get(req.key, &is_local);
+      nu::NodeIP shard_ip;
+      auto optional_v = hash_table_.get_and_locate(req.key, &shard_ip);
       resp.found = optional_v.has_value();
       if (resp.found) {
         resp.val = *optional_v;
       }
-      auto id = hash_table_.get_shard_proclet_id(req.shard_id);
-      if (is_local) {
-        resp.latest_shard_ip = 0;
-      } else {
-        resp.latest_shard_ip =
-            nu::get_runtime()->rpc_client_mgr()->get_ip_by_proclet_id(id);
-      }
+      resp.latest_shard_ip = shard_ip;
       BUG_ON(c->WriteFull(&resp, sizeof(resp)) < 0);
     }
   }
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+struct CallGraphEdge {
+  ProcletID caller;
+  ProcletID callee;
+  uint64_t cnt;
+};
+
+struct ProcletHeader;
+
+// Samples the proclet invocations issued or served on this node. It's invoked
+// within arbitrary proclet contexts, so the sampled edges are kept in a
+// fixed-size open-addressing table instead of allocating memory; an edge that
+// fails to find a slot gets dropped till the next drain. Sampled invocations
+// are also charged to the per-node traffic of the local proclets involved.
+//
+// The caller must prevent the local proclets passed in from being migrated.
+class CallGraphSampler {
+ public:
+  constexpr static uint32_t kSampleInterval = 64;  // Be power of 2 for speed.
+  constexpr static uint32_t kNumSlots = 4096;      // Be power of 2 for speed.
+  constexpr static uint32_t kMaxNumProbes = 16;
+
+  CallGraphSampler();
+  void record_local(ProcletHeader *caller_header, ProcletHeader *callee_header);
+  void record_outgoing(ProcletHeader *caller_header, ProcletID callee);
+  void record_incoming(NodeIP caller_ip, ProcletHeader *callee_header);
+  // Returns the estimated invocation counts since the last drain.
+  std::vector<CallGraphEdge> drain();
+
+ private:
+  struct alignas(kCacheLineBytes) {
+    uint64_t invocations;
+  } cnts_[kNumCores];
+  CallGraphEdge slots_[kNumSlots];
+  SpinLock spin_;
+
+  bool sample();
+  void __record(ProcletID caller, ProcletID callee);
+  void __record_local(ProcletHeader *caller_header,
+                      ProcletHeader *callee_header);
+  void __record_outgoing(ProcletHeader *caller_header, ProcletID callee);
+  void __record_incoming(NodeIP caller_ip, ProcletHeader *callee_header);
+};
+
+// The controller-side view of the edges sampled by all nodes. Edges are
+// undirected and their weights decay over time so that the graph tracks the
+// latest communication pattern.
+class CallGraph {
+ public:
+  using Peers = std::unordered_map<ProcletID, float>;
+  constexpr static uint64_t kDecayIntervalUs = kOneSecond;
+  constexpr static float kDecayFactor = 0.5;
+  constexpr static float kMinWeight = 1;
+
+  CallGraph();
+  void add_edges(std::span<const CallGraphEdge> edges);
+  void remove_proclet(ProcletID id);
+  // Returns nullptr if the proclet has no peer.
+  const Peers *get_peers(ProcletID id);
+
+ private:
+  std::unordered_map<ProcletID, Peers> adjacency_;
+  uint64_t last_decay_us_;
+
+  void add_weight(ProcletID from, ProcletID to, float weight);
+  void decay();
+};
+
+}  // namespace nu
+
+#include "nu/impl/call_graph.ipp"
@@ -71,6 +71,7 @@ constexpr static uint64_t kStackAlignment = 16;
 constexpr static uint64_t kStackRedZoneSize = 128;
 constexpr static uint64_t kStackSize = 64ULL << 10;
 constexpr static uint64_t kPageSize = 4096;
+constexpr static uint64_t kHugePageSize = 2ULL << 20;
 constexpr static ProcletID kNullProcletID = 0;
 constexpr static uint64_t kMinProcletHeapVAddr = 0x300000000000ULL;
 constexpr static uint64_t kMaxProcletHeapVAddr = 0x400000000000ULL;
@@ -111,6 +112,7 @@ T &from_span(std::span<std::byte> span);
 template <typename T>
 const T &from_span(std::span<const std::byte> span);
 uint32_t str_to_ip(std::string ip_str);
+std::string ip_to_str(uint32_t ip);
 template <typename T>
 constexpr T div_round_up_unchecked(T dividend, T divisor);
 constexpr uint64_t round_up_to_power2(uint64_t x);
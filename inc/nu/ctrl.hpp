@@ -1,11 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <set>
+#include <span>
 #include <stack>
 #include <map>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <runtime/net.h>
@@ -13,14 +17,18 @@ extern "C" {
 }
 #include <net.h>
 
+#include "nu/call_graph.hpp"
 #include "nu/commons.hpp"
 #include "nu/rpc_client_mgr.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/md5.hpp"
 #include "nu/utils/mutex.hpp"
+#include "nu/utils/spin_lock.hpp"
 
 namespace nu {
 
+class PlacementPolicy;
+
 // This is a logical node instead of a physical node.
 struct NodeStatus {
   constexpr static float kEWMAWeight = 0.25;
@@ -58,9 +66,37 @@ struct ProcletHeapSegment {
   NodeIP prev_host;
 };
 
+// Maps proclets to the nodes hosting them. A proclet ID is the start address
+// of its heap segment, so the table has one slot per minimum-sized segment and
+// each lookup or update is a single atomic access that never contends with the
+// ones of other proclets.
+class ProcletLocationTable {
+ public:
+  constexpr static uint64_t kNumSlots =
+      (kMaxProcletHeapVAddr - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+
+  // Returns 0 if the proclet doesn't exist.
+  NodeIP get(ProcletID id) const;
+  // Returns the previous location, 0 if the proclet didn't exist.
+  NodeIP exchange(ProcletID id, NodeIP ip);
+  // Relocates the proclet only if it still exists, so that a proclet destroyed
+  // meanwhile is not brought back. Returns whether it got relocated.
+  bool update(ProcletID id, NodeIP ip);
+
+ private:
+  std::atomic<NodeIP> ips_[kNumSlots];
+
+  static uint64_t get_slot(ProcletID id);
+};
+
+// The proclet allocation, destruction, resolution and relocation paths only
+// lock the heap segment bucket involved, if any. The per-LP node states, the
+// call graph and the placement policy are guarded by a single mutex.
 class Controller {
  public:
   constexpr static bool kEnableBinaryVerification = true;
+  // Otherwise, proclets get placed in a round-robin manner.
+  constexpr static bool kEnableAffinityPlacement = true;
 
   Controller();
   ~Controller();
@@ -70,33 +106,52 @@ class Controller {
                                                              bool isol);
   void destroy_lp(lpid_t lpid, NodeIP requestor_ip);
   std::optional<std::pair<ProcletID, NodeIP>> allocate_proclet(
-      uint64_t capacity, lpid_t lpid, NodeIP ip_hint);
+      uint64_t capacity, lpid_t lpid, NodeIP ip_hint, ProcletID creator_id);
+  // Allocates up to @num proclets at once, fewer if it runs out of segments or
+  // nodes.
+  std::vector<std::pair<ProcletID, NodeIP>> allocate_proclets(
+      uint64_t capacity, uint32_t num, lpid_t lpid, NodeIP ip_hint,
+      ProcletID creator_id);
   void destroy_proclet(VAddrRange heap_segment);
   NodeIP resolve_proclet(ProcletID id);
   std::pair<NodeIP, Resource> acquire_migration_dest(lpid_t lpid,
                                                      NodeIP requestor_ip,
                                                      bool has_mem_pressure,
-                                                     Resource resource);
+                                                     Resource resource,
+                                                     NodeIP preferred_ip);
   bool acquire_node(lpid_t lpid, NodeIP ip);
   void release_node(lpid_t lpid, NodeIP ip);
   void update_location(ProcletID id, NodeIP proclet_srv_ip);
   std::vector<std::pair<NodeIP, Resource>> report_free_resource(
       lpid_t lpid, NodeIP ip, Resource free_resource);
+  void report_call_graph(std::span<const CallGraphEdge> edges);
+  void set_placement_policy(std::unique_ptr<PlacementPolicy> policy);
 
  private:
   constexpr static auto kNumProcletSegmentBuckets =
       bsr_64(kMaxProcletHeapSize) - bsr_64(kMinProcletHeapSize) + 1;
-  std::stack<ProcletHeapSegment>
-      free_proclet_heap_segments_[kNumProcletSegmentBuckets];
+  struct alignas(kCacheLineBytes) SegmentBucket {
+    std::stack<ProcletHeapSegment> segments;
+    SpinLock spin;
+  };
+
+  // Lock order: a lower bucket before the highest one, which refills others.
+  SegmentBucket free_proclet_heap_segments_[kNumProcletSegmentBuckets];
   std::stack<VAddrRange> free_stack_cluster_segments_;  // One segment per Node.
   std::set<lpid_t> free_lpids_;
   std::map<lpid_t, MD5Val> lpid_to_md5_;
   std::map<lpid_t, LPInfo> lpid_to_info_;
-  std::map<ProcletID, NodeIP> proclet_id_to_ip_;
+  ProcletLocationTable proclet_locations_;
+  CallGraph call_graph_;
+  std::unique_ptr<PlacementPolicy> placement_policy_;
   bool done_;
   Mutex mutex_;
 
+  void pop_proclet_heap_segments(uint64_t capacity, uint32_t num,
+                                 std::vector<ProcletHeapSegment> *segments);
+  void push_proclet_heap_segment(const ProcletHeapSegment &segment);
   NodeIP select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
+                                 ProcletID creator_id, uint64_t capacity,
                                  const ProcletHeapSegment &segment);
   bool update_node(std::set<Node>::iterator iter);
 };
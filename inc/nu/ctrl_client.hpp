@@ -1,7 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <span>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <net/ip.h>
@@ -12,6 +14,7 @@ extern "C" {
 
 #include <memory>
 
+#include "nu/call_graph.hpp"
 #include "nu/commons.hpp"
 #include "nu/ctrl_server.hpp"
 #include "nu/rpc_server.hpp"
@@ -46,16 +49,25 @@ class ControllerClient {
                                                              MD5Val md5,
                                                              bool isol);
   std::optional<std::pair<ProcletID, NodeIP>> allocate_proclet(
-      uint64_t capacity, NodeIP ip_hint);
+      uint64_t capacity, NodeIP ip_hint, ProcletID creator_id);
+  // Allocates up to @num proclets in one round trip, fewer if the controller
+  // runs out of heap segments or nodes.
+  std::vector<std::pair<ProcletID, NodeIP>> allocate_proclets(
+      uint64_t capacity, uint32_t num, NodeIP ip_hint, ProcletID creator_id);
   void destroy_proclet(VAddrRange heap_segment);
   NodeIP resolve_proclet(ProcletID id);
+  // Resolves @ids in one round trip, with 0 for the nonexistent ones.
+  std::vector<NodeIP> resolve_proclets(std::span<const ProcletID> ids);
   NodeGuard acquire_node();
   std::pair<NodeGuard, Resource> acquire_migration_dest(bool has_mem_pressure,
-                                                        Resource resource);
+                                                        Resource resource,
+                                                        NodeIP preferred_ip);
   void update_location(ProcletID id, NodeIP proclet_srv_ip);
   VAddrRange get_stack_cluster() const;
   std::vector<std::pair<NodeIP, Resource>> report_free_resource(
       Resource resource);
+  void report_call_graph(std::span<const CallGraphEdge> edges);
+  void report_metrics(const NodeMetricsSnapshot &snapshot);
   void destroy_lp();
 
  private:
@@ -10,9 +10,11 @@ extern "C" {
 
 #include <atomic>
 #include <memory>
+#include <span>
 
 #include "nu/commons.hpp"
 #include "nu/ctrl.hpp"
+#include "nu/metrics.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/utils/rpc.hpp"
 
@@ -37,6 +39,7 @@ struct RPCReqAllocateProclet {
   uint64_t capacity;
   lpid_t lpid;
   NodeIP ip_hint;
+  ProcletID creator_id;
 } __attribute__((packed));
 
 struct RPCRespAllocateProclet {
@@ -45,6 +48,16 @@ struct RPCRespAllocateProclet {
   NodeIP server_ip;
 } __attribute__((packed));
 
+// Responded with up to num std::pair<ProcletID, NodeIP>(s).
+struct RPCReqAllocateProclets {
+  RPCReqType rpc_type = kAllocateProclets;
+  uint64_t capacity;
+  uint32_t num;
+  lpid_t lpid;
+  NodeIP ip_hint;
+  ProcletID creator_id;
+} __attribute__((packed));
+
 struct RPCReqDestroyProclet {
   RPCReqType rpc_type = kDestroyProclet;
   VAddrRange heap_segment;
@@ -59,6 +72,13 @@ struct RPCRespResolveProclet {
   NodeIP ip;
 } __attribute__((packed));
 
+// Followed by num_ids ProcletID(s), and responded with as many NodeIP(s).
+struct RPCReqResolveProclets {
+  RPCReqType rpc_type = kResolveProclets;
+  uint32_t num_ids;
+  ProcletID ids[0];
+} __attribute__((packed));
+
 struct RPCReqUpdateLocation {
   RPCReqType rpc_type = kUpdateLocation;
   ProcletID id;
@@ -71,6 +91,7 @@ struct RPCReqAcquireMigrationDest {
   NodeIP src_ip;
   bool has_mem_pressure;
   Resource resource;
+  NodeIP preferred_ip;
 } __attribute__((packed));
 
 struct RPCRespAcquireMigrationDest {
@@ -101,6 +122,18 @@ struct RPCReqReportFreeResource {
   Resource resource;
 } __attribute__((packed));
 
+// Followed by num_edges CallGraphEdge(s).
+struct RPCReqReportCallGraph {
+  RPCReqType rpc_type = kReportCallGraph;
+  uint64_t num_edges;
+} __attribute__((packed));
+
+struct RPCReqReportMetrics {
+  RPCReqType rpc_type = kReportMetrics;
+  NodeIP ip;
+  NodeMetricsSnapshot snapshot;
+} __attribute__((packed));
+
 struct RPCReqDestroyLP {
   RPCReqType rpc_type = kDestroyLP;
   lpid_t lpid;
@@ -120,15 +153,20 @@ class ControllerServer {
  private:
   std::unique_ptr<rt::TcpQueue> tcp_queue_;
   Controller ctrl_;
+  ClusterMetrics cluster_metrics_;
   std::atomic<uint64_t> num_register_node_;
   std::atomic<uint64_t> num_allocate_proclet_;
+  std::atomic<uint64_t> num_allocate_proclets_;
   std::atomic<uint64_t> num_destroy_proclet_;
   std::atomic<uint64_t> num_resolve_proclet_;
+  std::atomic<uint64_t> num_resolve_proclets_;
   std::atomic<uint64_t> num_acquire_migration_dest_;
   std::atomic<uint64_t> num_acquire_node_;
   std::atomic<uint64_t> num_release_node_;
   std::atomic<uint64_t> num_update_location_;
   std::atomic<uint64_t> num_report_free_resource_;
+  std::atomic<uint64_t> num_report_call_graph_;
+  std::atomic<uint64_t> num_report_metrics_;
   std::atomic<uint64_t> num_destroy_ip_;
   rt::Thread logging_thread_;
   rt::Thread tcp_queue_thread_;
@@ -141,9 +179,13 @@ class ControllerServer {
       const RPCReqRegisterNode &req);
   std::unique_ptr<RPCRespAllocateProclet> handle_allocate_proclet(
       const RPCReqAllocateProclet &req);
+  std::vector<std::pair<ProcletID, NodeIP>> handle_allocate_proclets(
+      const RPCReqAllocateProclets &req);
   void handle_destroy_proclet(const RPCReqDestroyProclet &req);
   std::unique_ptr<RPCRespResolveProclet> handle_resolve_proclet(
       const RPCReqResolveProclet &req);
+  std::vector<NodeIP> handle_resolve_proclets(
+      const RPCReqResolveProclets &req);
   RPCRespAcquireMigrationDest handle_acquire_migration_dest(
       const RPCReqAcquireMigrationDest &req);
   RPCRespAcquireNode handle_acquire_node(const RPCReqAcquireNode &req);
@@ -151,6 +193,8 @@ class ControllerServer {
   void handle_update_location(const RPCReqUpdateLocation &req);
   std::vector<std::pair<NodeIP, Resource>> handle_report_free_resource(
       const RPCReqReportFreeResource &req);
+  void handle_report_call_graph(std::span<const CallGraphEdge> edges);
+  void handle_report_metrics(const RPCReqReportMetrics &req);
   void handle_destroy_lp(const RPCReqDestroyLP &req);
   void tcp_loop(rt::TcpConn *c);
 };
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <optional>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -9,32 +12,61 @@ extern "C" {
 }
 
 #include "nu/proclet.hpp"
+#include "nu/utils/cond_var.hpp"
 #include "nu/utils/mutex.hpp"
+#include "nu/utils/rcu_lock.hpp"
+#include "nu/utils/read_skewed_lock.hpp"
 #include "nu/utils/spin_lock.hpp"
+#include "nu/utils/swiss_hash_map.hpp"
 #include "nu/utils/sync_hash_map.hpp"
+#include "nu/utils/thread.hpp"
 
 namespace nu {
 
+// The hash space is partitioned by key hash prefixes (extendible hashing). A
+// shard whose heap gets nearly full splits its prefix into two, handing the
+// upper half to a newly created shard while the table stays online. Each
+// table handle caches a versioned copy of the prefix-to-shard directory, which
+// is refreshed lazily once a shard rejects a key it no longer owns.
+//
+// Backend is the hash map type held by each shard, either SyncHashMap or
+// SwissHashMap; the latter suits small trivially-copyable pairs under
+// read-mostly loads.
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>, uint64_t NumBuckets = 32768>
+          typename KeyEqual = std::equal_to<K>, uint64_t NumBuckets = 32768,
+          template <size_t, typename...> class Backend = SyncHashMap>
 class DistributedHashTable {
  public:
   constexpr static uint32_t kDefaultPowerNumShards = 13;
+  constexpr static uint32_t kMaxPowerNumShards = 20;
   constexpr static uint64_t kNumBucketsPerShard = NumBuckets;
+  // A shard splits once this fraction of its heap has been used.
+  constexpr static float kShardSplitHeapUsageRatio = 0.75;
 
   using HashTableShard =
-      SyncHashMap<NumBuckets, K, V, Hash, std::equal_to<K>,
-                  std::allocator<std::pair<const K, V>>, Mutex>;
+      Backend<NumBuckets, K, V, Hash, std::equal_to<K>,
+              std::allocator<std::pair<const K, V>>, Mutex>;
 
   DistributedHashTable(const DistributedHashTable &);
   DistributedHashTable &operator=(const DistributedHashTable &);
   DistributedHashTable(DistributedHashTable &&);
   DistributedHashTable &operator=(DistributedHashTable &&);
   DistributedHashTable();
+  ~DistributedHashTable();
   template <typename K1>
   std::optional<V> get(K1 &&k);
   template <typename K1>
   std::optional<V> get(K1 &&k, bool *is_local);
+  // Also returns the shard that served the lookup, which follows the current
+  // directory rather than any index computed by the caller.
+  template <typename K1>
+  std::optional<V> get(K1 &&k, bool *is_local, ProcletID *shard_id);
+  // Also returns the IP of the node hosting the shard that served the lookup,
+  // or 0 if it is the local node. Meant for proxies steering clients, whose
+  // get_shard_idx() with the initial number of shards is only a cache key
+  // that stops matching the directory once shards split.
+  template <typename K1>
+  std::optional<V> get_and_locate(K1 &&k, NodeIP *shard_ip);
   template <typename K1, typename V1>
   void put(K1 &&k, V1 &&v);
   template <typename K1>
@@ -51,6 +83,15 @@ class DistributedHashTable {
   template <typename K1, typename RetT, typename... A0s, typename... A1s>
   Future<RetT> apply_async(K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...),
                            A1s &&... args);
+  // The batched versions group keys by shards and issue one invocation per
+  // shard, with all shards running in parallel. The results are returned in
+  // the same order as the input.
+  std::vector<std::optional<V>> multi_get(const std::vector<K> &keys);
+  void multi_put(const std::vector<std::pair<K, V>> &pairs);
+  std::vector<bool> multi_remove(const std::vector<K> &keys);
+  Future<std::vector<std::optional<V>>> multi_get_async(std::vector<K> keys);
+  Future<void> multi_put_async(std::vector<std::pair<K, V>> pairs);
+  Future<std::vector<bool>> multi_remove_async(std::vector<K> keys);
   template <typename RetT, typename... A0s, typename... A1s>
   RetT associative_reduce(
       bool clear, RetT init_val,
@@ -61,40 +102,190 @@ class DistributedHashTable {
       bool clear, RetT init_val,
       void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
       A1s &&... args);
+  // Shards do not split while get_all_pairs() or associative_reduce() runs,
+  // so that each pair is visited exactly once.
   std::vector<std::pair<K, V>> get_all_pairs();
+  // Splits the shard holding @k regardless of its heap usage, e.g., for
+  // spreading a hot shard's load.
+  template <typename K1>
+  void split_shard(K1 &&k);
+  uint32_t get_num_shards();
   template <typename K1>
   static uint32_t get_shard_idx(K1 &&k, uint32_t power_num_shards);
+  // @shard_id indexes the current directory, which has 2^power_num_shards
+  // entries after splits rather than the initial number of shards.
   ProcletID get_shard_proclet_id(uint32_t shard_id);
 
   template <class Archive>
-  void serialize(Archive &ar);
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
 
   // For debugging and performance analysis.
   template <typename K1>
   std::pair<std::optional<V>, uint32_t> get_with_ip(K1 &&k);
 
  private:
-  struct RefCnter {
-    std::vector<Proclet<HashTableShard>> shards;
+  class ShardManager;
+
+  class Shard {
+   public:
+    // The number of pairs shipped to the sibling per invocation while
+    // splitting.
+    constexpr static std::size_t kSplitChunkSize = 1024;
+
+    Shard(uint64_t prefix, uint32_t depth,
+          WeakProclet<ShardManager> shard_mgr);
+    // Invokes @f with the underlying map if all @key_hashes are owned by this
+    // shard. Returns false (or std::nullopt) otherwise.
+    template <typename F>
+    auto run(std::span<const uint64_t> key_hashes, F &&f);
+    template <typename F>
+    auto run(uint64_t key_hash, F &&f);
+    // Same as run(), but for @f modifying the pairs of the keys returned by
+    // @get_key(i), which get logged if they are being copied to a sibling.
+    template <typename G, typename F>
+    auto update(std::span<const uint64_t> key_hashes, G &&get_key, F &&f);
+    // Invokes @f with the underlying map, which is not being split.
+    template <typename F>
+    auto run_all(F &&f);
+    // Called after inserting pairs.
+    void maybe_request_split();
+    // The steps of handing the upper half of the prefix to @sibling, invoked
+    // by the shard manager in order. The shard keeps serving throughout,
+    // except that keys of the upper half are rejected between hand_over and
+    // the publishing of the new directory.
+    //
+    // Copies the pairs of the upper half in chunks, logging the keys modified
+    // meanwhile.
+    void split_copy(WeakProclet<Shard> sibling);
+    // Gives up the upper half and ships the latest pairs of the logged keys.
+    void split_hand_over(WeakProclet<Shard> sibling);
+    // Frees the pairs of the upper half.
+    void split_trim();
+
+   private:
+    constexpr static uint32_t kNoSplitRequested = ~0U;
+
+    uint64_t prefix_;
+    uint32_t depth_;
+    // The depth at which a split was last requested; another request waits
+    // for depth_ to change.
+    uint32_t split_requested_depth_;
+    WeakProclet<ShardManager> shard_mgr_;
+    ReadSkewedLock lock_;
+    HashTableShard map_;
+    // Set between split_copy and split_trim; run_all() waits for it to be
+    // cleared as the pairs of the upper half may be in both shards.
+    bool split_pending_;
+    Mutex split_mutex_;
+    CondVar split_cv_;
+    // Set during split_copy; only changed under the writer lock.
+    bool logging_;
+    Mutex log_mutex_;
+    std::vector<std::pair<K, uint64_t>> log_;
+
+    bool owns(uint64_t key_hash) const;
+    bool in_upper_half(uint64_t key_hash) const;
+    template <typename F>
+    void send_to(WeakProclet<Shard> &sibling, F &&fill);
+  };
+
+  struct ShardMap {
+    uint64_t version;
+    uint32_t power_num_shards;
+    // Indexed by the top power_num_shards bits of key hashes.
+    std::vector<WeakProclet<Shard>> shards;
+
+    template <class Archive>
+    void serialize(Archive &ar) {
+      ar(version, power_num_shards, shards);
+    }
+  };
+
+  // Owns all shards and the authoritative shard map.
+  class ShardManager {
+   public:
+    ~ShardManager();
+    ShardMap init(WeakProclet<ShardManager> self, uint32_t power_num_shards,
+                  bool pinned);
+    // Returns the shard map if it is newer than @version.
+    std::optional<ShardMap> get_shard_map(uint64_t version);
+    // Splits the shard @id in the background if its prefix is still of length
+    // @depth and it is not being split. The split runs here rather than in the
+    // shard, which is then never destroyed while waiting for it.
+    void request_split(ProcletID id, uint32_t depth);
+    // Splits the shard owning @key_hash, after any ongoing split of it.
+    void split_shard_of(uint64_t key_hash);
+    // Holds off splits until end_scan(), after waiting for the ongoing ones,
+    // and returns all shards, each owning its whole prefix meanwhile.
+    std::vector<WeakProclet<Shard>> begin_scan();
+    void end_scan();
+
+   private:
+    Mutex mutex_;
+    CondVar cond_var_;
+    WeakProclet<ShardManager> self_;
+    bool pinned_;
+    ShardMap shard_map_;
+    std::vector<Proclet<Shard>> shards_;
+    std::vector<std::pair<uint64_t, uint32_t>> shard_prefixes_and_depths_;
+    // In the same order as shards_.
+    std::vector<bool> shards_splitting_;
+    // The number of shards that have given up the upper halves of their
+    // prefixes, which are yet to be published.
+    uint32_t num_handing_over_;
+    // No split starts while this is nonzero.
+    uint32_t num_scans_;
+    // The number of threads spawned by request_split().
+    uint32_t num_split_threads_;
+
+    uint32_t get_shard_pos(ProcletID id);
+    void split_shard(ProcletID id, uint32_t depth);
+    // Called with mutex_ held, which is released during the transfer.
+    void __split_shard(uint32_t shard_pos);
+  };
+
+  struct ShardGroup {
+    WeakProclet<Shard> shard;
+    std::vector<uint32_t> idxes;
+    std::vector<uint64_t> key_hashes;
   };
 
   friend class Test;
-  uint32_t power_num_shards_;
-  uint32_t num_shards_;
-  Proclet<RefCnter> ref_cnter_;
-  std::vector<WeakProclet<HashTableShard>> shards_;
-
-  uint32_t get_shard_idx(uint64_t key_hash);
-  template <typename X, typename Y, typename H, typename Eq, uint64_t N>
-  friend DistributedHashTable<X, Y, H, Eq, N> make_dis_hash_table(
+  Proclet<ShardManager> shard_mgr_;
+  ShardMap *shard_map_;
+  mutable RCULock rcu_lock_;
+  Mutex refresh_mutex_;
+
+  static uint32_t hash_to_shard_idx(uint64_t key_hash,
+                                    uint32_t power_num_shards);
+  std::pair<uint64_t, WeakProclet<Shard>> locate_shard(uint64_t key_hash);
+  template <typename F>
+  auto run_on_shard(uint64_t key_hash, F &&f);
+  std::pair<uint64_t, std::vector<ShardGroup>> group_by_shard(
+      const std::vector<uint32_t> &idxes,
+      const std::function<const K &(uint32_t)> &get_key);
+  std::vector<WeakProclet<Shard>> get_all_shards();
+  // Invokes @f, which returns a Future<RetT>, with each shard while none of
+  // them splits, and collects the results.
+  template <typename RetT, typename F>
+  std::vector<RetT> run_on_all_shards(F &&f);
+  void refresh_shard_map(uint64_t stale_version);
+  ShardMap get_shard_map_copy() const;
+  template <typename X, typename Y, typename H, typename Eq, uint64_t N,
+            template <size_t, typename...> class B>
+  friend DistributedHashTable<X, Y, H, Eq, N, B> make_dis_hash_table(
       uint32_t power_num_shards, bool pinned);
 };
 
 template <typename K, typename V, typename Hash = std::hash<K>,
-          typename KeyEqual = std::equal_to<K>, uint64_t NumBuckets = 32768>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets> make_dis_hash_table(
+          typename KeyEqual = std::equal_to<K>, uint64_t NumBuckets = 32768,
+          template <size_t, typename...> class Backend = SyncHashMap>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>
+make_dis_hash_table(
     uint32_t power_num_shards = DistributedHashTable<
-        K, V, Hash, KeyEqual, NumBuckets>::kDefaultPowerNumShards,
+        K, V, Hash, KeyEqual, NumBuckets, Backend>::kDefaultPowerNumShards,
     bool pinned = false);
 
 }  // namespace nu
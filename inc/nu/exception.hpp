@@ -1,3 +1,5 @@
+#pragma once
+
 #include <exception>
 #include <stdexcept>
 
@@ -7,4 +9,10 @@ struct OutOfMemory : public std::exception {
   const char *what() const throw() { return "Out of memory"; }
 };
 
+// Thrown by invocations of a proclet that has been lost, e.g., the source of
+// its post-copy migration died before its heap fully arrived.
+struct ProcletLost : public std::exception {
+  const char *what() const throw() { return "Proclet lost"; }
+};
+
 }  // namespace nu
@@ -108,6 +108,10 @@ inline SlabAllocator *Caladan::thread_set_proclet_slab(
       ::thread_set_proclet_slab(proclet_slab));
 }
 
+inline TraceContext *Caladan::thread_get_trace_ctx() {
+  return reinterpret_cast<TraceContext *>(::thread_get_trace_ctx());
+}
+
 inline thread_t *Caladan::thread_create_with_buf(thread_fn_t fn, void **buf,
                                                  size_t len) {
   return ::thread_create_with_buf(fn, buf, len);
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace nu {
+
+inline bool CallGraphSampler::sample() {
+  return cnts_[read_cpu()].invocations++ % kSampleInterval == 0;
+}
+
+inline void CallGraphSampler::record_local(ProcletHeader *caller_header,
+                                           ProcletHeader *callee_header) {
+  if (unlikely(sample())) {
+    __record_local(caller_header, callee_header);
+  }
+}
+
+inline void CallGraphSampler::record_outgoing(ProcletHeader *caller_header,
+                                              ProcletID callee) {
+  if (unlikely(sample())) {
+    __record_outgoing(caller_header, callee);
+  }
+}
+
+inline void CallGraphSampler::record_incoming(NodeIP caller_ip,
+                                              ProcletHeader *callee_header) {
+  if (unlikely(sample())) {
+    __record_incoming(caller_ip, callee_header);
+  }
+}
+
+}  // namespace nu
@@ -0,0 +1,22 @@
+extern "C" {
+#include <base/compiler.h>
+#include <base/time.h>
+}
+
+namespace nu {
+
+inline void CallerSet::record(NodeIP ip) {
+  auto now_us = microtime();
+  for (auto &slot : slots_) {
+    if (slot.ip.load(std::memory_order_relaxed) == ip) {
+      if (unlikely(now_us - slot.last_us.load(std::memory_order_relaxed) >=
+                   kRefreshUs)) {
+        slot.last_us.store(now_us, std::memory_order_relaxed);
+      }
+      return;
+    }
+  }
+  insert(ip, now_us);
+}
+
+}  // namespace nu
@@ -20,4 +20,29 @@ inline bool NodeStatus::has_enough_resource(Resource resource) const {
   return has_enough_cpu_resource(resource) && has_enough_mem_resource(resource);
 }
 
+inline uint64_t ProcletLocationTable::get_slot(ProcletID id) {
+  BUG_ON(id < kMinProcletHeapVAddr || id >= kMaxProcletHeapVAddr);
+  return (id - kMinProcletHeapVAddr) / kMinProcletHeapSize;
+}
+
+inline NodeIP ProcletLocationTable::get(ProcletID id) const {
+  return ips_[get_slot(id)].load(std::memory_order_acquire);
+}
+
+inline NodeIP ProcletLocationTable::exchange(ProcletID id, NodeIP ip) {
+  return ips_[get_slot(id)].exchange(ip, std::memory_order_acq_rel);
+}
+
+inline bool ProcletLocationTable::update(ProcletID id, NodeIP ip) {
+  auto &slot = ips_[get_slot(id)];
+  auto old_ip = slot.load(std::memory_order_acquire);
+  do {
+    if (unlikely(!old_ip)) {
+      return false;
+    }
+  } while (!slot.compare_exchange_weak(old_ip, ip, std::memory_order_acq_rel,
+                                       std::memory_order_acquire));
+  return true;
+}
+
 }  // namespace nu
@@ -1,301 +1,1197 @@
+#include <algorithm>
+#include <experimental/scope>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+
 #include "nu/commons.hpp"
+#include "nu/rpc_client_mgr.hpp"
+#include "nu/utils/scoped_lock.hpp"
+#include "nu/utils/thread.hpp"
 
 namespace nu {
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::
-    DistributedHashTable(const DistributedHashTable &o) {
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    DistributedHashTable(const DistributedHashTable &o)
+    : shard_map_(nullptr) {
   *this = o;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>
-    &DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::operator=(
-        const DistributedHashTable &o) {
-  power_num_shards_ = o.power_num_shards_;
-  num_shards_ = o.num_shards_;
-  ref_cnter_ = o.ref_cnter_;
-  shards_ = o.shards_;
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend> &
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::operator=(
+    const DistributedHashTable &o) {
+  shard_mgr_ = o.shard_mgr_;
+  auto *shard_map =
+      o.shard_map_ ? new ShardMap(o.get_shard_map_copy()) : nullptr;
+  delete shard_map_;
+  shard_map_ = shard_map;
   return *this;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::
-    DistributedHashTable(DistributedHashTable &&o) {
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    DistributedHashTable(DistributedHashTable &&o)
+    : shard_map_(nullptr) {
   *this = std::move(o);
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>
-    &DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::operator=(
-        DistributedHashTable &&o) {
-  power_num_shards_ = o.power_num_shards_;
-  num_shards_ = o.num_shards_;
-  ref_cnter_ = std::move(o.ref_cnter_);
-  shards_ = std::move(o.shards_);
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend> &
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::operator=(
+    DistributedHashTable &&o) {
+  shard_mgr_ = std::move(o.shard_mgr_);
+  std::swap(shard_map_, o.shard_map_);
   return *this;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-inline DistributedHashTable<K, V, Hash, KeyEqual,
-                            NumBuckets>::DistributedHashTable()
-    : power_num_shards_(0), num_shards_(0) {}
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    DistributedHashTable() : shard_map_(nullptr) {}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ~DistributedHashTable() {
+  delete shard_map_;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::Shard(uint64_t prefix, uint32_t depth,
+                 WeakProclet<ShardManager> shard_mgr)
+    : prefix_(prefix),
+      depth_(depth),
+      split_requested_depth_(kNoSplitRequested),
+      shard_mgr_(std::move(shard_mgr)),
+      split_pending_(false),
+      logging_(false) {}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline bool DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::owns(uint64_t key_hash) const {
+  return !depth_ || (key_hash >> (64 - depth_)) == prefix_;
+}
+
+// Whether @key_hash goes to the sibling once the current prefix gets split.
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline bool DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::in_upper_half(uint64_t key_hash) const {
+  return (key_hash >> (63 - depth_)) & 1;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename F>
+inline auto
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::Shard::run(
+    std::span<const uint64_t> key_hashes, F &&f) {
+  using RetT = std::invoke_result_t<F, HashTableShard &>;
+
+  lock_.reader_lock();
+  bool owned =
+      std::all_of(key_hashes.begin(), key_hashes.end(),
+                  [&](uint64_t key_hash) { return owns(key_hash); });
+  if constexpr (std::is_void_v<RetT>) {
+    if (likely(owned)) {
+      f(map_);
+    }
+    lock_.reader_unlock();
+    return owned;
+  } else {
+    std::optional<RetT> ret;
+    if (likely(owned)) {
+      ret.emplace(f(map_));
+    }
+    lock_.reader_unlock();
+    return ret;
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename F>
+inline auto
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::Shard::run(
+    uint64_t key_hash, F &&f) {
+  return run(std::span<const uint64_t>(&key_hash, 1), std::forward<F>(f));
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename G, typename F>
+inline auto DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::update(std::span<const uint64_t> key_hashes, G &&get_key, F &&f) {
+  return run(key_hashes, [&](HashTableShard &map) {
+    // Runs under the reader lock, so the log is complete once logging_ gets
+    // cleared under the writer lock.
+    if (unlikely(logging_)) {
+      ScopedLock l(&log_mutex_);
+      for (uint64_t i = 0; i < key_hashes.size(); i++) {
+        if (in_upper_half(key_hashes[i])) {
+          log_.emplace_back(get_key(i), key_hashes[i]);
+        }
+      }
+    }
+    return f(map);
+  });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename F>
+inline auto DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::run_all(F &&f) {
+  ScopedLock l(&split_mutex_);
+  while (unlikely(split_pending_)) {
+    split_cv_.wait(&split_mutex_);
+  }
+  lock_.reader_lock();
+  auto ret = f(map_);
+  lock_.reader_unlock();
+  return ret;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::maybe_request_split() {
+  auto *slab = get_runtime()->get_current_proclet_slab();
+  auto capacity = slab->get_usage() + slab->get_remaining();
+  if (likely(slab->get_cur_usage() < kShardSplitHeapUsageRatio * capacity)) {
+    return;
+  }
+
+  auto depth = rt::access_once(depth_);
+  if (depth == kMaxPowerNumShards ||
+      rt::access_once(split_requested_depth_) == depth ||
+      __atomic_exchange_n(&split_requested_depth_, depth, __ATOMIC_ACQ_REL) ==
+          depth) {
+    return;
+  }
+
+  auto id = to_proclet_id(get_runtime()->get_current_proclet_header());
+  shard_mgr_.run(&ShardManager::request_split, id, depth);
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename F>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::send_to(WeakProclet<Shard> &sibling, F &&fill) {
+  std::vector<std::tuple<K, V, uint64_t>> pairs;
+  std::vector<std::pair<K, uint64_t>> removed_keys;
+  bool more;
+
+  do {
+    pairs.clear();
+    removed_keys.clear();
+    more = fill(&pairs, &removed_keys);
+    if (pairs.empty() && removed_keys.empty()) {
+      continue;
+    }
+    sibling.run(
+        +[](Shard &shard, std::vector<std::tuple<K, V, uint64_t>> pairs,
+            std::vector<std::pair<K, uint64_t>> removed_keys) {
+          for (auto &[k, v, key_hash] : pairs) {
+            shard.map_.put_with_hash(std::move(k), std::move(v), key_hash);
+          }
+          for (auto &[k, key_hash] : removed_keys) {
+            shard.map_.remove_with_hash(std::move(k), key_hash);
+          }
+        },
+        pairs, removed_keys);
+  } while (more);
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::split_copy(WeakProclet<Shard> sibling) {
+  {
+    ScopedLock l(&split_mutex_);
+    BUG_ON(split_pending_);
+    split_pending_ = true;
+  }
+  lock_.writer_lock();
+  logging_ = true;
+  lock_.writer_unlock();
+
+  // The prefix does not change until split_hand_over(), which the shard
+  // manager invokes after this one returns.
+  uint64_t cursor = 0;
+  send_to(sibling, [&](auto *pairs, auto *) {
+    return map_.get_pairs_if(
+        &cursor, kSplitChunkSize,
+        [&](uint64_t key_hash) { return in_upper_half(key_hash); }, pairs);
+  });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::split_hand_over(WeakProclet<Shard> sibling) {
+  lock_.writer_lock();
+  prefix_ <<= 1;
+  depth_++;
+  logging_ = false;
+  lock_.writer_unlock();
+
+  // No one logs any more, and the keys of the upper half are rejected, so
+  // their pairs here are the latest ones.
+  auto log = std::move(log_);
+  auto it = log.begin();
+  send_to(sibling, [&](auto *pairs, auto *removed_keys) {
+    for (; it != log.end() && pairs->size() + removed_keys->size() <
+                                  kSplitChunkSize;
+         ++it) {
+      auto &[k, key_hash] = *it;
+      auto v = map_.get_copy_with_hash(k, key_hash);
+      if (v) {
+        pairs->emplace_back(std::move(k), std::move(*v), key_hash);
+      } else {
+        removed_keys->emplace_back(std::move(k), key_hash);
+      }
+    }
+    return it != log.end();
+  });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    Shard::split_trim() {
+  map_.remove_if([&](uint64_t key_hash) { return !owns(key_hash); });
+
+  ScopedLock l(&split_mutex_);
+  split_pending_ = false;
+  split_cv_.signal_all();
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::ShardManager::
+    ~ShardManager() {
+  ScopedLock l(&mutex_);
+  while (num_split_threads_) {
+    cond_var_.wait(&mutex_);
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::ShardMap
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::init(WeakProclet<ShardManager> self,
+                       uint32_t power_num_shards, bool pinned) {
+  ScopedLock l(&mutex_);
+
+  self_ = std::move(self);
+  pinned_ = pinned;
+  num_handing_over_ = 0;
+  num_scans_ = 0;
+  num_split_threads_ = 0;
+  shard_map_.version = 0;
+  shard_map_.power_num_shards = power_num_shards;
+  for (uint64_t i = 0; i < (1ULL << power_num_shards); i++) {
+    shards_.emplace_back(
+        make_proclet<Shard>(std::tuple(i, power_num_shards, self_), pinned));
+    shard_prefixes_and_depths_.emplace_back(i, power_num_shards);
+    shards_splitting_.push_back(false);
+    shard_map_.shards.emplace_back(shards_.back().get_weak());
+  }
+  return shard_map_;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::optional<typename DistributedHashTable<
+    K, V, Hash, KeyEqual, NumBuckets, Backend>::ShardMap>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::get_shard_map(uint64_t version) {
+  ScopedLock l(&mutex_);
+
+  // The caller might have been rejected by a shard handing over, so it waits
+  // for the new directory instead of retrying against the same one.
+  while (shard_map_.version <= version && num_handing_over_) {
+    cond_var_.wait(&mutex_);
+  }
+  if (shard_map_.version > version) {
+    return shard_map_;
+  }
+  return std::nullopt;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+uint32_t DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::get_shard_pos(ProcletID id) {
+  auto it =
+      std::find_if(shards_.begin(), shards_.end(),
+                   [&](const auto &shard) { return shard.get_id() == id; });
+  BUG_ON(it == shards_.end());
+  return it - shards_.begin();
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::request_split(ProcletID id, uint32_t depth) {
+  ScopedLock l(&mutex_);
+  num_split_threads_++;
+  Thread([&, id, depth] {
+    split_shard(id, depth);
+    ScopedLock l(&mutex_);
+    if (!--num_split_threads_) {
+      cond_var_.signal_all();
+    }
+  }).detach();
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::split_shard(ProcletID id, uint32_t depth) {
+  mutex_.lock();
+  while (num_scans_) {
+    cond_var_.wait(&mutex_);
+  }
+  auto shard_pos = get_shard_pos(id);
+  if (shards_splitting_[shard_pos] ||
+      shard_prefixes_and_depths_[shard_pos].second != depth) {
+    mutex_.unlock();
+    return;
+  }
+  __split_shard(shard_pos);
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::split_shard_of(uint64_t key_hash) {
+  mutex_.lock();
+  while (true) {
+    auto &shard = shard_map_.shards[hash_to_shard_idx(
+        key_hash, shard_map_.power_num_shards)];
+    auto shard_pos = get_shard_pos(shard.get_id());
+    if (!num_scans_ && !shards_splitting_[shard_pos]) {
+      __split_shard(shard_pos);
+      return;
+    }
+    cond_var_.wait(&mutex_);
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::vector<WeakProclet<typename DistributedHashTable<
+    K, V, Hash, KeyEqual, NumBuckets, Backend>::Shard>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::begin_scan() {
+  ScopedLock l(&mutex_);
+  num_scans_++;
+  while (std::find(shards_splitting_.begin(), shards_splitting_.end(), true) !=
+         shards_splitting_.end()) {
+    cond_var_.wait(&mutex_);
+  }
+
+  std::vector<WeakProclet<Shard>> shards;
+  shards.reserve(shards_.size());
+  for (auto &shard : shards_) {
+    shards.emplace_back(shard.get_weak());
+  }
+  return shards;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::end_scan() {
+  ScopedLock l(&mutex_);
+  if (!--num_scans_) {
+    cond_var_.signal_all();
+  }
+}
+
+// Only marking the shard and publishing its sibling are done under mutex_;
+// creating the sibling and transferring the pairs are not, so that splits of
+// different shards and directory lookups proceed meanwhile.
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    ShardManager::__split_shard(uint32_t shard_pos) {
+  auto [prefix, depth] = shard_prefixes_and_depths_[shard_pos];
+  if (unlikely(depth == kMaxPowerNumShards)) {
+    mutex_.unlock();
+    return;
+  }
+  shards_splitting_[shard_pos] = true;
+  auto shard = shards_[shard_pos].get_weak();
+  mutex_.unlock();
+
+  auto sibling_prefix = (prefix << 1) | 1;
+  auto sibling = make_proclet<Shard>(
+      std::tuple(sibling_prefix, depth + 1, self_), pinned_);
+  shard.run(&Shard::split_copy, sibling.get_weak());
+
+  mutex_.lock();
+  num_handing_over_++;
+  mutex_.unlock();
+  shard.run(&Shard::split_hand_over, sibling.get_weak());
+
+  mutex_.lock();
+  // Other shards might have doubled the directory meanwhile.
+  auto &power_num_shards = shard_map_.power_num_shards;
+  auto &dir = shard_map_.shards;
+  if (depth == power_num_shards) {
+    std::vector<WeakProclet<Shard>> new_dir;
+    new_dir.reserve(dir.size() * 2);
+    for (auto &entry : dir) {
+      new_dir.push_back(entry);
+      new_dir.push_back(entry);
+    }
+    dir = std::move(new_dir);
+    power_num_shards++;
+  }
+  auto num_entries = 1ULL << (power_num_shards - depth - 1);
+  std::fill_n(dir.begin() + sibling_prefix * num_entries, num_entries,
+              sibling.get_weak());
+  shard_prefixes_and_depths_[shard_pos] = {prefix << 1, depth + 1};
+  shard_prefixes_and_depths_.emplace_back(sibling_prefix, depth + 1);
+  shards_.emplace_back(std::move(sibling));
+  shards_splitting_.push_back(false);
+  num_handing_over_--;
+  shard_map_.version++;
+  cond_var_.signal_all();
+  mutex_.unlock();
+
+  shard.run(&Shard::split_trim);
+  ScopedLock l(&mutex_);
+  shards_splitting_[shard_pos] = false;
+  cond_var_.signal_all();
+}
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 inline uint32_t
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_shard_idx(
-    uint64_t key_hash) {
-  return key_hash / (std::numeric_limits<uint64_t>::max() >> power_num_shards_);
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    hash_to_shard_idx(uint64_t key_hash, uint32_t power_num_shards) {
+  return power_num_shards ? key_hash >> (64 - power_num_shards) : 0;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline uint32_t
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_shard_idx(
-    K1 &&k, uint32_t power_num_shards) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_shard_idx(K1 &&k, uint32_t power_num_shards) {
   auto hash = Hash();
   auto key_hash = hash(std::forward<K1>(k));
-  return key_hash / (std::numeric_limits<uint64_t>::max() >> power_num_shards);
+  return hash_to_shard_idx(key_hash, power_num_shards);
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 inline ProcletID
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_shard_proclet_id(
-    uint32_t shard_id) {
-  return shards_[shard_id].id_;
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_shard_proclet_id(uint32_t shard_id) {
+  rcu_lock_.reader_lock();
+  auto &shards = load_acquire(&shard_map_)->shards;
+  BUG_ON(shard_id >= shards.size());
+  auto id = shards[shard_id].get_id();
+  rcu_lock_.reader_unlock();
+  return id;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline uint32_t
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_num_shards() {
+  return get_all_shards().size();
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::ShardMap
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_shard_map_copy() const {
+  rcu_lock_.reader_lock();
+  auto shard_map = *load_acquire(&shard_map_);
+  rcu_lock_.reader_unlock();
+  return shard_map;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline std::pair<uint64_t, WeakProclet<typename DistributedHashTable<
+    K, V, Hash, KeyEqual, NumBuckets, Backend>::Shard>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    locate_shard(uint64_t key_hash) {
+  rcu_lock_.reader_lock();
+  auto *shard_map = load_acquire(&shard_map_);
+  auto shard_idx = hash_to_shard_idx(key_hash, shard_map->power_num_shards);
+  auto ret = std::make_pair(shard_map->version, shard_map->shards[shard_idx]);
+  rcu_lock_.reader_unlock();
+  return ret;
+}
+
+// Keeps invoking @f with the shard believed to own @key_hash until it is not
+// rejected, refreshing the shard map in between.
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename F>
+inline auto DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    run_on_shard(uint64_t key_hash, F &&f) {
+  while (true) {
+    auto [version, shard] = locate_shard(key_hash);
+    auto ret = f(shard);
+    if constexpr (std::is_same_v<decltype(ret), bool>) {
+      if (likely(ret)) {
+        return;
+      }
+    } else {
+      if (likely(ret)) {
+        return std::move(*ret);
+      }
+    }
+    refresh_shard_map(version);
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    refresh_shard_map(uint64_t stale_version) {
+  ScopedLock l(&refresh_mutex_);
+
+  if (shard_map_->version > stale_version) {
+    return;
+  }
+  auto optional_shard_map =
+      shard_mgr_.run(&ShardManager::get_shard_map, stale_version);
+  if (!optional_shard_map) {
+    return;
+  }
+
+  auto *old_shard_map = shard_map_;
+  store_release(&shard_map_, new ShardMap(std::move(*optional_shard_map)));
+  rcu_lock_.writer_sync();
+  delete old_shard_map;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::pair<uint64_t, std::vector<typename DistributedHashTable<
+    K, V, Hash, KeyEqual, NumBuckets, Backend>::ShardGroup>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    group_by_shard(const std::vector<uint32_t> &idxes,
+                   const std::function<const K &(uint32_t)> &get_key) {
+  struct KeyLocation {
+    uint32_t shard_idx;
+    uint32_t idx;
+    uint64_t key_hash;
+  };
+
+  auto hash = Hash();
+  std::vector<KeyLocation> locs;
+  locs.reserve(idxes.size());
+  for (auto idx : idxes) {
+    locs.emplace_back(0, idx, hash(get_key(idx)));
+  }
+
+  std::vector<ShardGroup> groups;
+  rcu_lock_.reader_lock();
+  auto *shard_map = load_acquire(&shard_map_);
+  auto version = shard_map->version;
+  for (auto &loc : locs) {
+    loc.shard_idx =
+        hash_to_shard_idx(loc.key_hash, shard_map->power_num_shards);
+  }
+  std::sort(locs.begin(), locs.end(), [](const auto &x, const auto &y) {
+    return x.shard_idx < y.shard_idx;
+  });
+  for (auto &loc : locs) {
+    auto &shard = shard_map->shards[loc.shard_idx];
+    // The directory entries of the same shard are adjacent.
+    if (groups.empty() || groups.back().shard.get_id() != shard.get_id()) {
+      groups.emplace_back(shard);
+    }
+    groups.back().idxes.push_back(loc.idx);
+    groups.back().key_hashes.push_back(loc.key_hash);
+  }
+  rcu_lock_.reader_unlock();
+
+  return std::make_pair(version, std::move(groups));
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::vector<WeakProclet<typename DistributedHashTable<
+    K, V, Hash, KeyEqual, NumBuckets, Backend>::Shard>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_all_shards() {
+  rcu_lock_.reader_lock();
+  auto version = load_acquire(&shard_map_)->version;
+  rcu_lock_.reader_unlock();
+  refresh_shard_map(version);
+
+  std::vector<WeakProclet<Shard>> shards;
+  rcu_lock_.reader_lock();
+  for (auto &shard : load_acquire(&shard_map_)->shards) {
+    if (shards.empty() || shards.back().get_id() != shard.get_id()) {
+      shards.push_back(shard);
+    }
+  }
+  rcu_lock_.reader_unlock();
+  return shards;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline std::optional<V>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get(K1 &&k) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::get(K1 &&k) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  return shard.__run(&HashTableShard::template get_copy_with_hash<K>,
-                     std::forward<K1>(k), key_hash);
+  auto key_hash = hash(k);
+  return run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    return shard.__run(
+        +[](Shard &shard, K k, uint64_t key_hash) {
+          return shard.run(key_hash, [&](HashTableShard &map) {
+            return map.get_copy_with_hash(std::move(k), key_hash);
+          });
+        },
+        k, key_hash);
+  });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename K1>
+inline std::optional<V>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::get(
+    K1 &&k, bool *is_local) {
+  ProcletID shard_id;
+  return get(std::forward<K1>(k), is_local, &shard_id);
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline std::optional<V>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get(K1 &&k,
-                                                            bool *is_local) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::get(
+    K1 &&k, bool *is_local, ProcletID *shard_id) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  *is_local = shard.is_local();
-  return shard.__run(&HashTableShard::template get_copy_with_hash<K>,
-                     std::forward<K1>(k), key_hash);
+  auto key_hash = hash(k);
+  return run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    *is_local = shard.is_local();
+    *shard_id = shard.get_id();
+    return shard.__run(
+        +[](Shard &shard, K k, uint64_t key_hash) {
+          return shard.run(key_hash, [&](HashTableShard &map) {
+            return map.get_copy_with_hash(std::move(k), key_hash);
+          });
+        },
+        k, key_hash);
+  });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename K1>
+inline std::optional<V>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_and_locate(K1 &&k, NodeIP *shard_ip) {
+  bool is_local;
+  ProcletID shard_id;
+  auto ret = get(std::forward<K1>(k), &is_local, &shard_id);
+  *shard_ip = is_local
+                  ? 0
+                  : get_runtime()->rpc_client_mgr()->get_ip_by_proclet_id(
+                        shard_id);
+  return ret;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline std::pair<std::optional<V>, uint32_t>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_with_ip(K1 &&k) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_with_ip(K1 &&k) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  return shard.__run(
-      +[](HashTableShard &shard, K1 k, uint64_t key_hash) {
-        return std::make_pair(shard.get_copy_with_hash(std::move(k), key_hash),
-                              get_cfg_ip());
-      },
-      std::forward<K1>(k), key_hash);
+  auto key_hash = hash(k);
+  return run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    return shard.__run(
+        +[](Shard &shard, K k, uint64_t key_hash) {
+          return shard.run(key_hash, [&](HashTableShard &map) {
+            return std::make_pair(
+                map.get_copy_with_hash(std::move(k), key_hash), get_cfg_ip());
+          });
+        },
+        k, key_hash);
+  });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1, typename V1>
-inline void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::put(
-    K1 &&k, V1 &&v) {
+inline void
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::put(K1 &&k,
+                                                                     V1 &&v) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  shard.__run(&HashTableShard::template put_with_hash<K, V>,
-              std::forward<K1>(k), std::forward<V1>(v), key_hash);
+  auto key_hash = hash(k);
+  run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    return shard.__run(
+        +[](Shard &shard, K k, V v, uint64_t key_hash) {
+          auto put = shard.update(
+              std::span<const uint64_t>(&key_hash, 1),
+              [&](uint32_t) -> const K & { return k; },
+              [&](HashTableShard &map) {
+                map.put_with_hash(std::move(k), std::move(v), key_hash);
+              });
+          if (likely(put)) {
+            shard.maybe_request_split();
+          }
+          return put;
+        },
+        k, v, key_hash);
+  });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
-inline bool DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::remove(
+inline bool
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::remove(
     K1 &&k) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  return shard.__run(&HashTableShard::template remove_with_hash<K>,
-                     std::forward<K1>(k), key_hash);
+  auto key_hash = hash(k);
+  return run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    return shard.__run(
+        +[](Shard &shard, K k, uint64_t key_hash) {
+          return shard.update(
+              std::span<const uint64_t>(&key_hash, 1),
+              [&](uint32_t) -> const K & { return k; },
+              [&](HashTableShard &map) {
+                return map.remove_with_hash(std::move(k), key_hash);
+              });
+        },
+        k, key_hash);
+  });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1, typename RetT, typename... A0s, typename... A1s>
-inline RetT DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::apply(
+inline RetT
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::apply(
     K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...), A1s &&... args) {
   auto hash = Hash();
-  auto key_hash = hash(std::forward<K1>(k));
-  auto shard_idx = get_shard_idx(key_hash);
-  auto &shard = shards_[shard_idx];
-  return shard.__run(
-      +[](HashTableShard &shard, K k, uint64_t key_hash,
-          RetT (*fn)(std::pair<const K, V> &, A0s...), A0s... args) {
-        return shard.apply_with_hash(std::forward<K1>(k), key_hash, fn,
-                                     std::move(args)...);
-      },
-      std::forward<K1>(k), key_hash, fn, std::forward<A1s>(args)...);
+  auto key_hash = hash(k);
+  return run_on_shard(key_hash, [&](WeakProclet<Shard> &shard) {
+    return shard.__run(
+        +[](Shard &shard, K k, uint64_t key_hash,
+            RetT (*fn)(std::pair<const K, V> &, A0s...), A0s... args) {
+          return shard.update(
+              std::span<const uint64_t>(&key_hash, 1),
+              [&](uint32_t) -> const K & { return k; },
+              [&](HashTableShard &map) {
+                return map.apply_with_hash(std::move(k), key_hash, fn,
+                                           std::move(args)...);
+              });
+        },
+        k, key_hash, fn, args...);
+  });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline Future<std::optional<V>>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_async(K1 &&k) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::get_async(
+    K1 &&k) {
   return nu::async([&, k] { return get(std::move(k)); });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1, typename V1>
 inline Future<void>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::put_async(K1 &&k,
-                                                                  V1 &&v) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::put_async(
+    K1 &&k, V1 &&v) {
   return nu::async([&, k, v] { return put(std::move(k), std::move(v)); });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1>
 inline Future<bool>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::remove_async(K1 &&k) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    remove_async(K1 &&k) {
   return nu::async([&, k] { return remove(std::move(k)); });
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename K1, typename RetT, typename... A0s, typename... A1s>
 inline Future<RetT>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::apply_async(
-    K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...), A1s &&... args) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    apply_async(K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...),
+                A1s &&... args) {
   return nu::async([&, k, fn, ... args = std::forward<A1s>(args)]() mutable {
     return apply(std::move(k), fn, std::move(args)...);
   });
 }
 
+// The groups rejected due to a stale shard map are retried after refreshing
+// the map.
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::vector<std::optional<V>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::multi_get(
+    const std::vector<K> &keys) {
+  using Rets = std::vector<std::optional<V>>;
+
+  Rets all_rets(keys.size());
+  std::vector<uint32_t> idxes(keys.size());
+  std::iota(idxes.begin(), idxes.end(), 0);
+  while (!idxes.empty()) {
+    auto [version, groups] = group_by_shard(
+        idxes, [&](uint32_t i) -> const K & { return keys[i]; });
+    std::vector<Future<std::optional<Rets>>> futures;
+    for (auto &group : groups) {
+      std::vector<K> group_keys;
+      group_keys.reserve(group.idxes.size());
+      for (auto idx : group.idxes) {
+        group_keys.push_back(keys[idx]);
+      }
+      futures.emplace_back(group.shard.__run_async(
+          +[](Shard &shard, std::vector<K> keys,
+              std::vector<uint64_t> key_hashes) {
+            return shard.run(key_hashes, [&](HashTableShard &map) {
+              Rets rets;
+              rets.reserve(keys.size());
+              for (uint64_t i = 0; i < keys.size(); i++) {
+                rets.emplace_back(
+                    map.get_copy_with_hash(std::move(keys[i]), key_hashes[i]));
+              }
+              return rets;
+            });
+          },
+          std::move(group_keys), group.key_hashes));
+    }
+
+    idxes.clear();
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      auto &group_idxes = groups[i].idxes;
+      auto &optional_rets = futures[i].get();
+      if (unlikely(!optional_rets)) {
+        idxes.insert(idxes.end(), group_idxes.begin(), group_idxes.end());
+        continue;
+      }
+      for (uint64_t j = 0; j < group_idxes.size(); j++) {
+        all_rets[group_idxes[j]] = std::move((*optional_rets)[j]);
+      }
+    }
+    if (unlikely(!idxes.empty())) {
+      refresh_shard_map(version);
+    }
+  }
+  return all_rets;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::multi_put(
+    const std::vector<std::pair<K, V>> &pairs) {
+  std::vector<uint32_t> idxes(pairs.size());
+  std::iota(idxes.begin(), idxes.end(), 0);
+  while (!idxes.empty()) {
+    auto [version, groups] = group_by_shard(
+        idxes, [&](uint32_t i) -> const K & { return pairs[i].first; });
+    std::vector<Future<bool>> futures;
+    for (auto &group : groups) {
+      std::vector<std::pair<K, V>> group_pairs;
+      group_pairs.reserve(group.idxes.size());
+      for (auto idx : group.idxes) {
+        group_pairs.push_back(pairs[idx]);
+      }
+      futures.emplace_back(group.shard.__run_async(
+          +[](Shard &shard, std::vector<std::pair<K, V>> pairs,
+              std::vector<uint64_t> key_hashes) {
+            auto put = shard.update(
+                key_hashes,
+                [&](uint32_t i) -> const K & { return pairs[i].first; },
+                [&](HashTableShard &map) {
+                  for (uint64_t i = 0; i < pairs.size(); i++) {
+                    auto &[k, v] = pairs[i];
+                    map.put_with_hash(std::move(k), std::move(v),
+                                      key_hashes[i]);
+                  }
+                });
+            if (likely(put)) {
+              shard.maybe_request_split();
+            }
+            return put;
+          },
+          std::move(group_pairs), group.key_hashes));
+    }
+
+    idxes.clear();
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      if (unlikely(!futures[i].get())) {
+        auto &group_idxes = groups[i].idxes;
+        idxes.insert(idxes.end(), group_idxes.begin(), group_idxes.end());
+      }
+    }
+    if (unlikely(!idxes.empty())) {
+      refresh_shard_map(version);
+    }
+  }
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+std::vector<bool>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    multi_remove(const std::vector<K> &keys) {
+  // std::vector<bool> is not contiguous, thus not serializable as a whole.
+  using Rets = std::vector<uint8_t>;
+
+  std::vector<bool> all_rets(keys.size());
+  std::vector<uint32_t> idxes(keys.size());
+  std::iota(idxes.begin(), idxes.end(), 0);
+  while (!idxes.empty()) {
+    auto [version, groups] = group_by_shard(
+        idxes, [&](uint32_t i) -> const K & { return keys[i]; });
+    std::vector<Future<std::optional<Rets>>> futures;
+    for (auto &group : groups) {
+      std::vector<K> group_keys;
+      group_keys.reserve(group.idxes.size());
+      for (auto idx : group.idxes) {
+        group_keys.push_back(keys[idx]);
+      }
+      futures.emplace_back(group.shard.__run_async(
+          +[](Shard &shard, std::vector<K> keys,
+              std::vector<uint64_t> key_hashes) {
+            return shard.update(
+                key_hashes, [&](uint32_t i) -> const K & { return keys[i]; },
+                [&](HashTableShard &map) {
+                  Rets rets;
+                  rets.reserve(keys.size());
+                  for (uint64_t i = 0; i < keys.size(); i++) {
+                    rets.push_back(map.remove_with_hash(std::move(keys[i]),
+                                                        key_hashes[i]));
+                  }
+                  return rets;
+                });
+          },
+          std::move(group_keys), group.key_hashes));
+    }
+
+    idxes.clear();
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      auto &group_idxes = groups[i].idxes;
+      auto &optional_rets = futures[i].get();
+      if (unlikely(!optional_rets)) {
+        idxes.insert(idxes.end(), group_idxes.begin(), group_idxes.end());
+        continue;
+      }
+      for (uint64_t j = 0; j < group_idxes.size(); j++) {
+        all_rets[group_idxes[j]] = (*optional_rets)[j];
+      }
+    }
+    if (unlikely(!idxes.empty())) {
+      refresh_shard_map(version);
+    }
+  }
+  return all_rets;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline Future<std::vector<std::optional<V>>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    multi_get_async(std::vector<K> keys) {
+  return nu::async([&, keys = std::move(keys)] { return multi_get(keys); });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline Future<void>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    multi_put_async(std::vector<std::pair<K, V>> pairs) {
+  return nu::async([&, pairs = std::move(pairs)] { multi_put(pairs); });
+}
+
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+inline Future<std::vector<bool>>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    multi_remove_async(std::vector<K> keys) {
+  return nu::async([&, keys = std::move(keys)] { return multi_remove(keys); });
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 std::vector<std::pair<K, V>>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::get_all_pairs() {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    get_all_pairs() {
   std::vector<std::pair<K, V>> vec;
-  std::vector<Future<std::vector<std::pair<K, V>>>> futures;
-  for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
-        +[](HashTableShard &shard) { return shard.get_all_pairs(); }));
-  }
-  for (auto &future : futures) {
-    auto &vec_shard = future.get();
+  auto vecs = run_on_all_shards<std::vector<std::pair<K, V>>>(
+      [](WeakProclet<Shard> &shard) {
+        return shard.__run_async(+[](Shard &shard) {
+          return shard.run_all(
+              [](HashTableShard &map) { return map.get_all_pairs(); });
+        });
+      });
+  for (auto &vec_shard : vecs) {
     vec.insert(vec.end(), vec_shard.begin(), vec_shard.end());
   }
   return vec;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-template <typename RetT, typename... A0s, typename... A1s>
-RetT DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::associative_reduce(
-    bool clear, RetT init_val,
-    void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
-    void (*merge_fn)(RetT &, RetT &, A0s...), A1s &&... args) {
-  RetT reduced_val(std::move(init_val));
-  std::vector<Future<RetT>> futures;
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename RetT, typename F>
+std::vector<RetT>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    run_on_all_shards(F &&f) {
+  // Pairs that a split moves between the shards' invocations would otherwise
+  // be visited twice or not at all.
+  auto shards = shard_mgr_.run(&ShardManager::begin_scan);
+  auto cleaner = std::experimental::scope_exit(
+      [&] { shard_mgr_.run(&ShardManager::end_scan); });
 
-  for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
-        &HashTableShard::template associative_reduce<RetT>, clear, reduced_val,
-        reduce_fn, std::forward<A1s>(args)...));
+  std::vector<Future<RetT>> futures;
+  futures.reserve(shards.size());
+  for (auto &shard : shards) {
+    futures.emplace_back(f(shard));
   }
 
+  std::vector<RetT> rets;
+  rets.reserve(futures.size());
   for (auto &future : futures) {
-    merge_fn(reduced_val, future.get(), std::forward<A1s>(args)...);
+    rets.emplace_back(std::move(future.get()));
+  }
+  return rets;
+}
+
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename RetT, typename... A0s, typename... A1s>
+RetT DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    associative_reduce(
+        bool clear, RetT init_val,
+        void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
+        void (*merge_fn)(RetT &, RetT &, A0s...), A1s &&... args) {
+  RetT reduced_val(std::move(init_val));
+  auto all_reduced_vals =
+      run_on_all_shards<RetT>([&](WeakProclet<Shard> &shard) {
+        return shard.__run_async(
+            +[](Shard &shard, bool clear, RetT init_val,
+                void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
+                A0s... args) {
+              return shard.run_all([&](HashTableShard &map) {
+                return map.associative_reduce(clear, std::move(init_val),
+                                              reduce_fn, args...);
+              });
+            },
+            clear, reduced_val, reduce_fn, args...);
+      });
+
+  for (auto &partition : all_reduced_vals) {
+    merge_fn(reduced_val, partition, std::forward<A1s>(args)...);
   }
 
   return reduced_val;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <typename RetT, typename... A0s, typename... A1s>
 std::vector<RetT>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::associative_reduce(
-    bool clear, RetT init_val,
-    void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
-    A1s &&... args) {
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    associative_reduce(
+        bool clear, RetT init_val,
+        void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
+        A1s &&... args) {
   RetT reduced_val(std::move(init_val));
-  std::vector<Future<RetT>> futures;
+  auto all_reduced_vals =
+      run_on_all_shards<RetT>([&](WeakProclet<Shard> &shard) {
+        return shard.__run_async(
+            +[](Shard &shard, bool clear, RetT init_val,
+                void (*reduce_fn)(RetT &, std::pair<const K, V> &, A0s...),
+                A0s... args) {
+              return shard.run_all([&](HashTableShard &map) {
+                return map.associative_reduce(clear, std::move(init_val),
+                                              reduce_fn, args...);
+              });
+            },
+            clear, reduced_val, reduce_fn, args...);
+      });
 
-  for (uint32_t i = 0; i < num_shards_; i++) {
-    futures.emplace_back(shards_[i].__run_async(
-        &HashTableShard::template associative_reduce<RetT>, clear, reduced_val,
-        reduce_fn, std::forward<A1s>(args)...));
-  }
+  return all_reduced_vals;
+}
 
-  std::vector<RetT> all_reduced_vals;
-  all_reduced_vals.reserve(futures.size());
-  for (auto &future : futures) {
-    all_reduced_vals.emplace_back(std::move(future.get()));
-  }
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <typename K1>
+void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::
+    split_shard(K1 &&k) {
+  auto hash = Hash();
+  auto key_hash = hash(std::forward<K1>(k));
+  auto [version, _] = locate_shard(key_hash);
+  shard_mgr_.run(&ShardManager::split_shard_of, key_hash);
+  refresh_shard_map(version);
+}
 
-  return all_reduced_vals;
+template <typename K, typename V, typename Hash, typename KeyEqual,
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+template <class Archive>
+inline void
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::save(
+    Archive &ar) const {
+  ar(shard_mgr_);
+  ar(shard_map_ ? get_shard_map_copy() : ShardMap());
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
 template <class Archive>
-inline void DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>::serialize(
+inline void
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>::load(
     Archive &ar) {
-  ar(power_num_shards_);
-  ar(num_shards_);
-  ar(ref_cnter_);
-  ar(shards_);
+  ar(shard_mgr_);
+  auto *shard_map = new ShardMap();
+  ar(*shard_map);
+  delete shard_map_;
+  shard_map_ = shard_map;
 }
 
 template <typename K, typename V, typename Hash, typename KeyEqual,
-          uint64_t NumBuckets>
-DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets> make_dis_hash_table(
-    uint32_t power_num_shards, bool pinned) {
-  using TableType = DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets>;
+          uint64_t NumBuckets, template <size_t, typename...> class Backend>
+DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>
+make_dis_hash_table(uint32_t power_num_shards, bool pinned) {
+  using TableType =
+      DistributedHashTable<K, V, Hash, KeyEqual, NumBuckets, Backend>;
+  BUG_ON(power_num_shards > TableType::kMaxPowerNumShards);
+
   TableType table;
-  table.power_num_shards_ = power_num_shards;
-  table.num_shards_ = (1 << power_num_shards);
-  table.ref_cnter_ = make_proclet<typename TableType::RefCnter>();
-  table.shards_ = table.ref_cnter_.run(
-      +[](TableType::RefCnter &self, uint32_t num_shards, bool pinned) {
-        std::vector<WeakProclet<typename TableType::HashTableShard>>
-            weak_shards;
-        for (uint32_t i = 0; i < num_shards; i++) {
-          self.shards.emplace_back(
-              make_proclet<typename TableType::HashTableShard>(pinned));
-          weak_shards.emplace_back(self.shards.back().get_weak());
-        }
-        return weak_shards;
-      },
-      table.num_shards_, pinned);
+  table.shard_mgr_ = make_proclet<typename TableType::ShardManager>();
+  table.shard_map_ = new TableType::ShardMap(
+      table.shard_mgr_.run(&TableType::ShardManager::init,
+                           table.shard_mgr_.get_weak(), power_num_shards,
+                           pinned));
   return table;
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "nu/utils/promise.hpp"
 
 namespace nu {
@@ -14,7 +16,7 @@ inline Future<T, Deleter>::Future(Promise<T> *promise)
 template <typename T, typename Deleter>
 inline Future<T, Deleter>::Future(Future<T, Deleter> &&o) {
   if (promise_) {
-    get();
+    wait();
   }
   promise_ = std::move(o.promise_);
 }
@@ -23,7 +25,7 @@ template <typename T, typename Deleter>
 inline Future<T, Deleter> &Future<T, Deleter>::operator=(
     Future<T, Deleter> &&o) {
   if (promise_) {
-    get();
+    wait();
   }
   promise_ = std::move(o.promise_);
   return *this;
@@ -39,7 +41,7 @@ inline Future<void, Deleter>::Future(Promise<void> *promise)
 template <typename Deleter>
 inline Future<void, Deleter>::Future(Future<void, Deleter> &&o) {
   if (promise_) {
-    get();
+    wait();
   }
   promise_ = std::move(o.promise_);
 }
@@ -48,7 +50,7 @@ template <typename Deleter>
 inline Future<void, Deleter> &Future<void, Deleter>::operator=(
     Future<void, Deleter> &&o) {
   if (promise_) {
-    get();
+    wait();
   }
   promise_ = std::move(o.promise_);
   return *this;
@@ -57,14 +59,14 @@ inline Future<void, Deleter> &Future<void, Deleter>::operator=(
 template <typename T, typename Deleter>
 inline Future<T, Deleter>::~Future() {
   if (promise_) {
-    get();
+    wait();
   }
 }
 
 template <typename Deleter>
 inline Future<void, Deleter>::~Future() {
   if (promise_) {
-    get();
+    wait();
   }
 }
 
@@ -89,33 +91,42 @@ inline bool Future<void, Deleter>::is_ready() {
 }
 
 template <typename T, typename Deleter>
-T &Future<T, Deleter>::get_slow_path() {
+void Future<T, Deleter>::wait_slow_path() {
   promise_->spin_.lock();
   while (!is_ready()) {
     promise_->cv_.wait(&promise_->spin_);
   }
   promise_->spin_.unlock();
-  return promise_->t_;
 }
 
 template <typename T, typename Deleter>
-inline T &Future<T, Deleter>::get() {
-  if (is_ready()) {
-    return promise_->t_;
+inline void Future<T, Deleter>::wait() {
+  if (!is_ready()) {
+    wait_slow_path();
   }
+}
 
-  return get_slow_path();
+template <typename T, typename Deleter>
+inline T &Future<T, Deleter>::get() {
+  wait();
+  if (unlikely(promise_->exception_)) {
+    std::rethrow_exception(promise_->exception_);
+  }
+  return promise_->t_;
 }
 
 template <typename T, typename Deleter>
 inline T &Future<T, Deleter>::get_sync() {
   while (!is_ready())
     ;
+  if (unlikely(promise_->exception_)) {
+    std::rethrow_exception(promise_->exception_);
+  }
   return promise_->t_;
 }
 
 template <typename Deleter>
-void Future<void, Deleter>::get_slow_path() {
+void Future<void, Deleter>::wait_slow_path() {
   promise_->spin_.lock();
   while (!is_ready()) {
     promise_->cv_.wait(&promise_->spin_);
@@ -124,18 +135,154 @@ void Future<void, Deleter>::get_slow_path() {
 }
 
 template <typename Deleter>
-inline void Future<void, Deleter>::get() {
-  if (is_ready()) {
-    return;
+inline void Future<void, Deleter>::wait() {
+  if (!is_ready()) {
+    wait_slow_path();
   }
+}
 
-  get_slow_path();
+template <typename Deleter>
+inline void Future<void, Deleter>::get() {
+  wait();
+  if (unlikely(promise_->exception_)) {
+    std::rethrow_exception(promise_->exception_);
+  }
 }
 
 template <typename Deleter>
 inline void Future<void, Deleter>::get_sync() {
   while (!is_ready())
     ;
+  if (unlikely(promise_->exception_)) {
+    std::rethrow_exception(promise_->exception_);
+  }
+}
+
+template <typename T, typename Deleter>
+template <typename F>
+inline void Future<T, Deleter>::on_ready(F &&f) {
+  promise_->on_ready(std::forward<F>(f));
+}
+
+template <typename Deleter>
+template <typename F>
+inline void Future<void, Deleter>::on_ready(F &&f) {
+  promise_->on_ready(std::forward<F>(f));
+}
+
+// The callback owns this future, and thus the promise that stores the
+// callback; the promise is freed once the callback is done.
+template <typename T, typename Deleter>
+template <typename F>
+inline Future<std::invoke_result_t<std::decay_t<F>, T &>>
+Future<T, Deleter>::then(F &&f) && {
+  using U = std::invoke_result_t<std::decay_t<F>, T &>;
+
+  auto *promise = Promise<U>::create();
+  auto future = promise->get_future();
+  auto *src = promise_.get();
+  src->on_ready([self = std::move(*this), promise,
+                 f = std::forward<F>(f)]() mutable {
+    if (unlikely(self.promise_->exception_)) {
+      promise->set_exception(self.promise_->exception_);
+      return;
+    }
+    try {
+      if constexpr (std::is_void_v<U>) {
+        f(self.promise_->t_);
+      } else {
+        *promise->data() = f(self.promise_->t_);
+      }
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+      return;
+    }
+    promise->set_ready();
+  });
+  return future;
+}
+
+template <typename Deleter>
+template <typename F>
+inline Future<std::invoke_result_t<std::decay_t<F>>>
+Future<void, Deleter>::then(F &&f) && {
+  using U = std::invoke_result_t<std::decay_t<F>>;
+
+  auto *promise = Promise<U>::create();
+  auto future = promise->get_future();
+  auto *src = promise_.get();
+  src->on_ready([self = std::move(*this), promise,
+                 f = std::forward<F>(f)]() mutable {
+    if (unlikely(self.promise_->exception_)) {
+      promise->set_exception(self.promise_->exception_);
+      return;
+    }
+    try {
+      if constexpr (std::is_void_v<U>) {
+        f();
+      } else {
+        *promise->data() = f();
+      }
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+      return;
+    }
+    promise->set_ready();
+  });
+  return future;
+}
+
+template <typename T, typename Deleter>
+Future<void> when_all(std::vector<Future<T, Deleter>> &futures) {
+  struct State {
+    std::atomic<std::size_t> remaining;
+    Promise<void> *promise;
+  };
+
+  auto *promise = Promise<void>::create();
+  auto future = promise->get_future();
+  if (futures.empty()) {
+    promise->set_ready();
+    return future;
+  }
+
+  auto *state = new State{futures.size(), promise};
+  for (auto &f : futures) {
+    f.on_ready([state] {
+      if (state->remaining.fetch_sub(1) == 1) {
+        state->promise->set_ready();
+        delete state;
+      }
+    });
+  }
+  return future;
+}
+
+template <typename T, typename Deleter>
+Future<std::size_t> when_any(std::vector<Future<T, Deleter>> &futures) {
+  struct State {
+    std::atomic<std::size_t> remaining;
+    std::atomic<bool> done;
+    Promise<std::size_t> *promise;
+  };
+
+  BUG_ON(futures.empty());
+  auto *promise = Promise<std::size_t>::create();
+  auto future = promise->get_future();
+  // Outlives the promise, as the rest of the futures still get ready later.
+  auto *state = new State{futures.size(), false, promise};
+  for (std::size_t i = 0; i < futures.size(); i++) {
+    futures[i].on_ready([state, i] {
+      if (!state->done.exchange(true)) {
+        *state->promise->data() = i;
+        state->promise->set_ready();
+      }
+      if (state->remaining.fetch_sub(1) == 1) {
+        delete state;
+      }
+    });
+  }
+  return future;
 }
 
 template <typename F, typename Allocator>
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <bit>
+
+extern "C" {
+#include <base/time.h>
+}
+
+#include "nu/utils/caladan.hpp"
+
+namespace nu {
+
+inline uint32_t HdrHistogram::index_of(uint64_t val) {
+  val = std::min(val, kMaxValue);
+  auto shift = std::max(static_cast<uint32_t>(std::bit_width(val)),
+                        kSubBucketBits) -
+               kSubBucketBits;
+  return (shift << (kSubBucketBits - 1)) + static_cast<uint32_t>(val >> shift);
+}
+
+inline uint64_t HdrHistogram::lowest_of(uint32_t idx) {
+  constexpr uint32_t kHalf = 1 << (kSubBucketBits - 1);
+  if (idx < 2 * kHalf) {
+    return idx;
+  }
+  auto shift = idx / kHalf - 1;
+  return static_cast<uint64_t>(idx - shift * kHalf) << shift;
+}
+
+inline uint64_t HdrHistogram::width_of(uint32_t idx) {
+  constexpr uint32_t kHalf = 1 << (kSubBucketBits - 1);
+  return idx < 2 * kHalf ? 1 : 1ULL << (idx / kHalf - 1);
+}
+
+inline void HdrHistogram::record(uint64_t val, uint64_t cnt) {
+  counts_[index_of(val)] += cnt;
+  count_ += cnt;
+  sum_ += val * cnt;
+  max_ = std::max(max_, val);
+}
+
+inline void ConcurrentHdrHistogram::record(uint64_t val) {
+  auto idx = HdrHistogram::index_of(val);
+  Caladan::PreemptGuard g;
+  auto &shard = shards_[g.read_cpu()];
+  shard.counts[idx]++;
+  shard.sum += val;
+  if (unlikely(val > shard.max)) {
+    shard.max = val;
+  }
+}
+
+inline void ConcurrentHdrHistogram::record_tsc(uint64_t duration_tsc) {
+  record(duration_tsc * 1000 / cycles_per_us);
+}
+
+}  // namespace nu
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "nu/utils/caladan.hpp"
+
+namespace nu {
+
+inline void MetricCounters::add(MetricCounter counter, uint64_t delta) {
+  Caladan::PreemptGuard g;
+  add(g, counter, delta);
+}
+
+inline void MetricCounters::add(const Caladan::PreemptGuard &g,
+                                MetricCounter counter, uint64_t delta) {
+  per_cores_[g.read_cpu()].cnts[counter] += delta;
+}
+
+inline uint64_t MetricCounters::get(MetricCounter counter) const {
+  uint64_t sum = 0;
+  for (const auto &per_core : per_cores_) {
+    sum += rt::access_once(per_core.cnts[counter]);
+  }
+  return sum;
+}
+
+inline void ProcletMetricCounters::add(MetricCounter counter,
+                                       uint64_t delta) {
+  cnts_[counter].fetch_add(delta, std::memory_order_relaxed);
+}
+
+inline uint64_t ProcletMetricCounters::get(MetricCounter counter) const {
+  return cnts_[counter].load(std::memory_order_relaxed);
+}
+
+}  // namespace nu
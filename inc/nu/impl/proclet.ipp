@@ -5,35 +5,92 @@
 #include <sstream>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <base/assert.h>
 #include <runtime/net.h>
 }
 
+#include "nu/call_graph.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/exception.hpp"
+#include "nu/metrics.hpp"
 #include "nu/proclet_server.hpp"
 #include "nu/rem_shared_ptr.hpp"
 #include "nu/rem_unique_ptr.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/runtime.hpp"
+#include "nu/tracer.hpp"
 #include "nu/utils/future.hpp"
 
 namespace nu {
 
 struct ProcletHeader;
 
+template <typename S>
+concept ZeroCopyable =
+    (is_specialization_of_v<S, std::vector> &&
+     cereal::is_memcpy_safe<typename S::value_type>()) ||
+    is_specialization_of_v<S, std::basic_string>;
+
+// With @zero_copy, large contiguous states are not copied into the stream.
+// Instead, only their size tags are serialized, and their payloads are
+// recorded as segments to be transmitted in place. The bytes on the wire stay
+// the same as those produced by cereal, so this only saves the sender's copy:
+// the callee still deserializes the states out of the received request.
+template <typename S1>
+inline void serialize_one(auto *oa_sstream, bool zero_copy, S1 &&state) {
+  using D = std::decay_t<S1>;
+  auto &oa = oa_sstream->oa;
+
+  if constexpr (ZeroCopyable<D>) {
+    auto bytes = std::as_bytes(std::span(state.data(), state.size()));
+    if (zero_copy &&
+        bytes.size() >= ArchivePool<>::kOAStreamZeroCopyMinSize) {
+      oa << static_cast<uint64_t>(state.size());
+      oa_sstream->zero_copy_segments.emplace_back(
+          static_cast<uint64_t>(oa_sstream->ss.tellp()), bytes);
+      return;
+    }
+  }
+  oa << std::forward<S1>(state);
+}
+
 template <typename... S1s>
-inline void serialize(auto *oa_sstream, S1s &&... states) {
+inline void serialize(auto *oa_sstream, bool zero_copy, S1s &&... states) {
   auto &ss = oa_sstream->ss;
   auto *rpc_type = const_cast<RPCReqType *>(
       reinterpret_cast<const RPCReqType *>(ss.view().data()));
   *rpc_type = kProcletCall;
   ss.seekp(sizeof(RPCReqType));
+  get_runtime()->tracer()->save_call_ctx(oa_sstream->oa);
 
-  auto &oa = oa_sstream->oa;
-  ((oa << std::forward<S1s>(states)), ...);
+  ((serialize_one(oa_sstream, zero_copy, std::forward<S1s>(states))), ...);
+}
+
+inline uint64_t get_serialized_size(auto *oa_sstream) {
+  uint64_t size = oa_sstream->ss.tellp();
+  for (auto &[_, data] : oa_sstream->zero_copy_segments) {
+    size += data.size();
+  }
+  return size;
+}
+
+inline std::vector<iovec> scatter_states(auto *oa_sstream) {
+  auto states_view = oa_sstream->ss.view();
+  auto *states_data = const_cast<char *>(states_view.data());
+  uint64_t states_size = oa_sstream->ss.tellp();
+  std::vector<iovec> iovecs;
+  uint64_t prev = 0;
+
+  for (auto &[offset, data] : oa_sstream->zero_copy_segments) {
+    iovecs.emplace_back(states_data + prev, offset - prev);
+    iovecs.emplace_back(const_cast<std::byte *>(data.data()), data.size());
+    prev = offset;
+  }
+  iovecs.emplace_back(states_data + prev, states_size - prev);
+  return iovecs;
 }
 
 template <typename T>
@@ -45,9 +102,15 @@ void Proclet<T>::invoke_remote(MigrationGuard &&caller_guard, ProcletID id,
 
   auto *caller_header = get_runtime()->get_current_proclet_header();
   auto *oa_sstream = get_runtime()->archive_pool()->get_oa_sstream();
-  serialize(oa_sstream, std::forward<S1s>(states)...);
+  // The states owned by a proclet might be migrated away during the call, so
+  // only those outside of any proclet are safe to be transmitted in place.
+  serialize(oa_sstream, /* zero_copy = */ !caller_header,
+            std::forward<S1s>(states)...);
+  get_runtime()->metrics()->record(caller_header, kBytesSerialized,
+                                   get_serialized_size(oa_sstream));
   get_runtime()->detach();
   caller_guard.reset();
+  uint32_t num_retries = 0;
 
 retry:
   auto states_view = oa_sstream->ss.view();
@@ -59,16 +122,33 @@ retry:
   auto args_span = std::span(states_data, states_size);
 
   auto *client = get_runtime()->rpc_client_mgr()->get_by_proclet_id(id);
-  rc = client->Call(args_span, &return_buf);
+  if (oa_sstream->zero_copy_segments.empty()) {
+    rc = client->Call(args_span, &return_buf);
+  } else {
+    auto iovecs = scatter_states(oa_sstream);
+    rc = client->Call(std::span<const iovec>(iovecs), &return_buf);
+  }
   if (unlikely(rc == kErrWrongClient)) {
-    get_runtime()->rpc_client_mgr()->invalidate_cache(id, client);
+    get_runtime()->rpc_client_mgr()->invalidate_cache(id, client, return_buf);
+    get_runtime()->tracer()->record_forward(id);
+    num_retries++;
     goto retry;
   }
+  if (unlikely(rc == kErrLost)) {
+    get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
+    throw_lost(caller_header);
+  }
   assert(rc == kOk);
   get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
 
   optional_caller_guard =
       get_runtime()->attach_and_disable_migration(caller_header);
+  if (unlikely(num_retries)) {
+    // Only charge the caller if it hasn't been migrated away meanwhile.
+    get_runtime()->metrics()->record(
+        optional_caller_guard ? caller_header : nullptr, kWrongClientRetries,
+        num_retries);
+  }
   if (!optional_caller_guard) {
     Migrator::migrate_thread_and_ret_val<void>(
         std::move(return_buf), to_proclet_id(caller_header), nullptr, nullptr);
@@ -85,9 +165,15 @@ RetT Proclet<T>::invoke_remote_with_ret(MigrationGuard &&caller_guard,
 
   auto *caller_header = get_runtime()->get_current_proclet_header();
   auto *oa_sstream = get_runtime()->archive_pool()->get_oa_sstream();
-  serialize(oa_sstream, std::forward<S1s>(states)...);
+  // The states owned by a proclet might be migrated away during the call, so
+  // only those outside of any proclet are safe to be transmitted in place.
+  serialize(oa_sstream, /* zero_copy = */ !caller_header,
+            std::forward<S1s>(states)...);
+  get_runtime()->metrics()->record(caller_header, kBytesSerialized,
+                                   get_serialized_size(oa_sstream));
   get_runtime()->detach();
   caller_guard.reset();
+  uint32_t num_retries = 0;
 
 retry:
   auto states_view = oa_sstream->ss.view();
@@ -99,16 +185,33 @@ retry:
   auto args_span = std::span(states_data, states_size);
 
   auto *client = get_runtime()->rpc_client_mgr()->get_by_proclet_id(id);
-  rc = client->Call(args_span, &return_buf);
+  if (oa_sstream->zero_copy_segments.empty()) {
+    rc = client->Call(args_span, &return_buf);
+  } else {
+    auto iovecs = scatter_states(oa_sstream);
+    rc = client->Call(std::span<const iovec>(iovecs), &return_buf);
+  }
   if (unlikely(rc == kErrWrongClient)) {
-    get_runtime()->rpc_client_mgr()->invalidate_cache(id, client);
+    get_runtime()->rpc_client_mgr()->invalidate_cache(id, client, return_buf);
+    get_runtime()->tracer()->record_forward(id);
+    num_retries++;
     goto retry;
   }
+  if (unlikely(rc == kErrLost)) {
+    get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
+    throw_lost(caller_header);
+  }
   assert(rc == kOk);
   get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
 
   optional_caller_guard =
       get_runtime()->attach_and_disable_migration(caller_header);
+  if (unlikely(num_retries)) {
+    // Only charge the caller if it hasn't been migrated away meanwhile.
+    get_runtime()->metrics()->record(
+        optional_caller_guard ? caller_header : nullptr, kWrongClientRetries,
+        num_retries);
+  }
   if (!optional_caller_guard) {
     Migrator::migrate_thread_and_ret_val<RetT>(
         std::move(return_buf), to_proclet_id(caller_header), &ret, nullptr);
@@ -130,6 +233,159 @@ retry:
   return ret;
 }
 
+template <typename T>
+void Proclet<T>::throw_lost(ProcletHeader *caller_header) {
+  auto optional_caller_guard =
+      get_runtime()->attach_and_disable_migration(caller_header);
+  if (!optional_caller_guard) {
+    RPCReturnBuffer return_buf;
+    Migrator::migrate_thread_and_ret_val<void>(
+        std::move(return_buf), to_proclet_id(caller_header), nullptr, nullptr);
+  }
+  throw ProcletLost();
+}
+
+// The response completes the promise without any thread waiting for it. The
+// promise of a caller within a proclet lives in the caller's heap, so it gets
+// completed from within the caller, which might have been migrated meanwhile.
+template <typename T>
+template <typename RetT, typename... S1s>
+Future<RetT> Proclet<T>::invoke_remote_async(MigrationGuard &&caller_guard,
+                                             ProcletID id, S1s &&... states) {
+  auto *caller_header = caller_guard.header();
+  auto *promise = Promise<RetT>::create();
+  auto future = promise->get_future();
+
+  RuntimeSlabGuard slab_guard;
+  auto *oa_sstream = get_runtime()->archive_pool()->get_oa_sstream();
+  // The caller is free to drop the states before the request is sent.
+  serialize(oa_sstream, /* zero_copy = */ false,
+            std::forward<S1s>(states)...);
+  get_runtime()->metrics()->record(caller_header, kBytesSerialized,
+                                   get_serialized_size(oa_sstream));
+  call_remote_async(id, oa_sstream, to_proclet_id(caller_header), promise);
+  return future;
+}
+
+template <typename T>
+template <typename RetT>
+void Proclet<T>::call_remote_async(ProcletID id,
+                                   ArchivePool<>::OASStream *oa_sstream,
+                                   ProcletID caller_id,
+                                   Promise<RetT> *promise) {
+  auto states_view = oa_sstream->ss.view();
+  auto states_data = reinterpret_cast<const std::byte *>(states_view.data());
+  auto states_size = oa_sstream->ss.tellp();
+  auto args_span = std::span(states_data, states_size);
+
+  auto *client = get_runtime()->rpc_client_mgr()->get_by_proclet_id(id);
+  client->CallAsync(args_span, [id, client, oa_sstream, caller_id, promise](
+                                   RPCReturnCode rc,
+                                   RPCReturnBuffer &&return_buf) {
+    RuntimeSlabGuard slab_guard;
+
+    // Runs in the flow's completion worker, which may block, so the retry is
+    // issued right here as in invoke_remote().
+    if (unlikely(rc == kErrWrongClient)) {
+      get_runtime()->metrics()->record(nullptr, kWrongClientRetries);
+      get_runtime()->rpc_client_mgr()->invalidate_cache(id, client,
+                                                        return_buf);
+      call_remote_async(id, oa_sstream, caller_id, promise);
+      return;
+    }
+    get_runtime()->archive_pool()->put_oa_sstream(oa_sstream);
+    BUG_ON(rc != kOk && rc != kErrLost);
+    bool lost = rc != kOk;
+
+    if (caller_id) {
+      complete_in_caller(caller_id, promise, lost, std::move(return_buf));
+      return;
+    }
+    if (likely(!lost)) {
+      load_ret_val(promise, return_buf.get_mut_buf());
+    }
+    settle(promise, lost);
+  });
+}
+
+template <typename T>
+template <typename RetT>
+void Proclet<T>::complete_in_caller(ProcletID caller_id,
+                                    Promise<RetT> *promise, bool lost,
+                                    RPCReturnBuffer &&return_buf) {
+  // The coroutines awaiting the promise resume right in the completing thread,
+  // so it must not be the completion worker.
+  rt::Spawn([caller_id, promise, lost,
+             return_buf = std::move(return_buf)]() mutable {
+    if (likely(get_runtime()->run_within_proclet_env<ErasedType>(
+            to_proclet_header(caller_id), complete_locally<RetT>, promise,
+            lost, &return_buf))) {
+      return;
+    }
+
+    // The caller has been migrated away, so follow it.
+    auto buf = return_buf.get_buf();
+    std::vector<uint8_t> ret_val_bytes(
+        reinterpret_cast<const uint8_t *>(buf.data()),
+        reinterpret_cast<const uint8_t *>(buf.data()) + buf.size());
+    return_buf.Reset();
+    WeakProclet<ErasedType> caller(caller_id);
+    caller.run(
+        +[](ErasedType &, uintptr_t promise_addr, bool lost,
+            std::vector<uint8_t> ret_val_bytes) {
+          auto *promise = reinterpret_cast<Promise<RetT> *>(promise_addr);
+          if (likely(!lost)) {
+            load_ret_val(promise, std::as_writable_bytes(
+                                      std::span(ret_val_bytes)));
+          }
+          settle(promise, lost);
+        },
+        reinterpret_cast<uintptr_t>(promise), lost, std::move(ret_val_bytes));
+  });
+}
+
+template <typename T>
+template <typename RetT>
+void Proclet<T>::complete_locally(MigrationGuard *caller_guard, ErasedType *,
+                                  Promise<RetT> *promise, bool lost,
+                                  RPCReturnBuffer *return_buf) {
+  ProcletSlabGuard slab_guard(&caller_guard->header()->slab);
+
+  if (likely(!lost)) {
+    load_ret_val(promise, return_buf->get_mut_buf());
+  }
+  {
+    // This thread might not come back, as it goes along with the caller once
+    // the latter gets migrated.
+    RuntimeSlabGuard runtime_slab_guard;
+    return_buf->Reset();
+  }
+  caller_guard->enable_for([&] { settle(promise, lost); });
+}
+
+template <typename T>
+template <typename RetT>
+void Proclet<T>::load_ret_val(Promise<RetT> *promise,
+                              std::span<std::byte> buf) {
+  if constexpr (!std::is_same_v<RetT, void>) {
+    auto *ia_sstream = get_runtime()->archive_pool()->get_ia_sstream();
+    auto &[ret_ss, ia] = *ia_sstream;
+    ret_ss.span({reinterpret_cast<char *>(buf.data()), buf.size()});
+    ia >> *promise->data();
+    get_runtime()->archive_pool()->put_ia_sstream(ia_sstream);
+  }
+}
+
+template <typename T>
+template <typename RetT>
+void Proclet<T>::settle(Promise<RetT> *promise, bool lost) {
+  if (unlikely(lost)) {
+    promise->set_exception(std::make_exception_ptr(ProcletLost()));
+  } else {
+    promise->set_ready();
+  }
+}
+
 template <typename T>
 inline Proclet<T>::Proclet() : id_(kNullProcletID) {}
 
@@ -197,8 +453,8 @@ Proclet<T> Proclet<T>::__create(bool pinned, uint64_t capacity, NodeIP ip_hint,
   {
     RuntimeSlabGuard slab_guard;
 
-    auto optional =
-        get_runtime()->controller_client()->allocate_proclet(capacity, ip_hint);
+    auto optional = get_runtime()->controller_client()->allocate_proclet(
+        capacity, ip_hint, to_proclet_id(caller_header));
     if (unlikely(!optional)) {
       throw OutOfMemory();
     }
@@ -265,9 +521,28 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
           typename... S0s, typename... S1s>
 inline Future<RetT> Proclet<T>::__run_async(RetT (*fn)(T &, S0s...),
                                             S1s &&... states) {
-  return nu::async([&, fn, ... states = std::forward<S1s>(states)]() mutable {
-    return __run<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
-  });
+  if (is_local()) {
+    // The callee runs in the caller's thread on the fast path of __run(), so
+    // give it a thread of its own.
+    return nu::async([&, fn, ... states = std::forward<S1s>(states)]() mutable {
+      return __run<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
+    });
+  }
+
+  // Slow path: the callee proclet is remote, so no thread waits for it.
+  MigrationGuard caller_migration_guard;
+  auto *caller_header = caller_migration_guard.header();
+  if (caller_header) {
+    get_runtime()->call_graph_sampler()->record_outgoing(caller_header, id_);
+  }
+  get_runtime()->metrics()->record(caller_header, kRemoteCallsOut);
+  TraceScope trace_scope(kSlowPathCall, to_proclet_id(caller_header), id_,
+                         /* peer_ip = */ 0, /* may_start_trace = */ true);
+  auto *handler = ProcletServer::run_closure<MigrEn, CPUMon, CPUSamp, T, RetT,
+                                             decltype(fn), S1s...>;
+  return invoke_remote_async<RetT>(std::move(caller_migration_guard), id_,
+                                   handler, id_, fn,
+                                   std::forward<S1s>(states)...);
 }
 
 template <typename T>
@@ -296,6 +571,12 @@ RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
                                                       caller_migration_guard);
     if (optional_callee_migration_guard) {
       // Fast path: the callee proclet is actually local, use function call.
+      get_runtime()->call_graph_sampler()->record_local(caller_header,
+                                                        callee_header);
+      get_runtime()->metrics()->record_local_call(caller_header,
+                                                  callee_header);
+      TraceScope trace_scope(kFastPathCall, to_proclet_id(caller_header), id_,
+                             /* peer_ip = */ 0, /* may_start_trace = */ true);
 
       constexpr auto kHasRetVal = !std::is_same_v<RetT, void>;
       std::conditional_t<kHasRetVal, RetT, ErasedType> ret;
@@ -335,6 +616,12 @@ RetT Proclet<T>::__run(RetT (*fn)(T &, S0s...), S1s &&... states) {
   }
 
   // Slow path: the callee proclet is actually remote, use RPC.
+  if (caller_header) {
+    get_runtime()->call_graph_sampler()->record_outgoing(caller_header, id_);
+  }
+  get_runtime()->metrics()->record(caller_header, kRemoteCallsOut);
+  TraceScope trace_scope(kSlowPathCall, to_proclet_id(caller_header), id_,
+                         /* peer_ip = */ 0, /* may_start_trace = */ true);
   auto *handler = ProcletServer::run_closure<MigrEn, CPUMon, CPUSamp, T, RetT,
                                              decltype(fn), S1s...>;
   if constexpr (!std::is_same<RetT, void>::value) {
@@ -364,9 +651,13 @@ template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
           typename... A0s, typename... A1s>
 inline Future<RetT> Proclet<T>::__run_async(RetT (T::*md)(A0s...),
                                             A1s &&... args) {
-  return nu::async([&, md, ... args = std::forward<A1s>(args)]() mutable {
-    return __run<MigrEn, CPUMon, CPUSamp>(md, std::forward<A1s>(args)...);
-  });
+  MethodPtr<decltype(md)> method_ptr;
+  method_ptr.ptr = md;
+  return __run_async<MigrEn, CPUMon, CPUSamp>(
+      +[](T &t, decltype(method_ptr) method_ptr, A0s... args) {
+        return (t.*(method_ptr.ptr))(std::move(args)...);
+      },
+      method_ptr, std::forward<A1s>(args)...);
 }
 
 template <typename T>
@@ -394,6 +685,24 @@ inline RetT Proclet<T>::__run(RetT (T::*md)(A0s...), A1s &&... args) {
       method_ptr, std::forward<A1s>(args)...);
 }
 
+template <typename T>
+template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
+          typename... S0s, typename... S1s>
+inline Task<RetT> Proclet<T>::run_co(
+    RetT (*fn)(T &, S0s...),
+    S1s &&... states) requires ValidInvocationTypes<RetT, S0s...> {
+  return run_async<MigrEn, CPUMon, CPUSamp>(fn, std::forward<S1s>(states)...);
+}
+
+template <typename T>
+template <bool MigrEn, bool CPUMon, bool CPUSamp, typename RetT,
+          typename... A0s, typename... A1s>
+inline Task<RetT> Proclet<T>::run_co(
+    RetT (T::*md)(A0s...),
+    A1s &&... args) requires ValidInvocationTypes<RetT, A0s...> {
+  return run_async<MigrEn, CPUMon, CPUSamp>(md, std::forward<A1s>(args)...);
+}
+
 template <typename T>
 std::optional<Future<void>> Proclet<T>::update_ref_cnt(ProcletID id,
                                                        int delta) {
@@ -421,7 +730,12 @@ std::optional<Future<void>> Proclet<T>::update_ref_cnt(ProcletID id,
   return nu::async([&, id, delta]() mutable {
     MigrationGuard caller_migration_guard;
     auto *handler = ProcletServer::update_ref_cnt<T>;
-    invoke_remote(std::move(caller_migration_guard), id, handler, id, delta);
+    try {
+      invoke_remote(std::move(caller_migration_guard), id, handler, id,
+                    delta);
+    } catch (const ProcletLost &) {
+      // Nothing to release.
+    }
   });
 }
 
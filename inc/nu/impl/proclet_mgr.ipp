@@ -20,6 +20,10 @@ inline uint64_t ProcletHeader::stack_size() const {
   return thread_cnt.get() * kStackSize;
 }
 
+inline uint64_t ProcletHeader::page_size() const {
+  return huge_pages ? kHugePageSize : kPageSize;
+}
+
 inline uint64_t ProcletHeader::total_mem_size() const {
   return heap_size() + stack_size();
 }
@@ -36,6 +40,19 @@ inline SpinLock &ProcletHeader::migration_spin() {
   return proclet_migration_spin[global_idx()];
 }
 
+inline NodeIP &ProcletHeader::forward_ip() {
+  return proclet_forward_ips[global_idx()];
+}
+
+inline ProcletStats *ProcletHeader::get_stats() {
+  auto *s = stats.load(std::memory_order_acquire);
+  return likely(s) ? s : alloc_stats();
+}
+
+inline const ProcletStats *ProcletHeader::peek_stats() const {
+  return stats.load(std::memory_order_acquire);
+}
+
 inline VAddrRange ProcletHeader::range() const {
   auto start_addr = reinterpret_cast<uint64_t>(this);
   auto end_addr = start_addr + capacity;
@@ -66,6 +83,10 @@ inline bool ProcletManager::remove_for_destruction(void *proclet_base) {
   return __remove(proclet_base, kDestructing);
 }
 
+inline bool ProcletManager::remove_for_loss(void *proclet_base) {
+  return __remove(proclet_base, kLost);
+}
+
 inline bool ProcletManager::__remove(void *proclet_base,
                                      ProcletStatus new_status) {
   ScopedLock lock(&spin_);
@@ -6,11 +6,14 @@
 
 #include <net.h>
 
+#include "nu/call_graph.hpp"
 #include "nu/ctrl.hpp"
 #include "nu/ctrl_client.hpp"
+#include "nu/metrics.hpp"
 #include "nu/migrator.hpp"
 #include "nu/runtime.hpp"
 #include "nu/proclet_mgr.hpp"
+#include "nu/tracer.hpp"
 #include "nu/type_traits.hpp"
 
 namespace nu {
@@ -178,7 +181,7 @@ void ProcletServer::update_ref_cnt(ArchivePool<>::IASStream *ia_sstream,
   }
 
   if (proclet_not_found) {
-    get_runtime()->send_rpc_resp_wrong_client(returner);
+    get_runtime()->send_rpc_resp_wrong_client(proclet_header, returner);
   }
 }
 
@@ -238,6 +241,14 @@ void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
                                   ArchivePool<>::IASStream *ia_sstream,
                                   RPCReturner returner) {
   auto *callee_header = callee_guard->header();
+  auto caller_ip = returner.GetRemoteIP();
+  get_runtime()->call_graph_sampler()->record_incoming(caller_ip,
+                                                       callee_header);
+  callee_header->get_stats()->callers.record(caller_ip);
+  get_runtime()->metrics()->record(callee_header, kCallsIn);
+  TraceScope trace_scope(kServeCall, /* caller = */ 0,
+                         to_proclet_id(callee_header), caller_ip,
+                         /* may_start_trace = */ false);
   ProcletSlabGuard callee_slab_guard(&callee_header->slab);
 
   if constexpr (CPUMon) {
@@ -281,6 +292,8 @@ void ProcletServer::__run_closure(MigrationGuard *callee_guard, Cls *obj,
   auto *oa_sstream = get_runtime()->archive_pool()->get_oa_sstream();
   if constexpr (kNonVoidRetT) {
     oa_sstream->oa << std::move(ret);
+    get_runtime()->metrics()->record(callee_header, kBytesSerialized,
+                                     oa_sstream->ss.tellp());
   }
   get_runtime()->send_rpc_resp_ok(oa_sstream, ia_sstream, &returner);
 
@@ -307,7 +320,7 @@ void ProcletServer::run_closure(ArchivePool<>::IASStream *ia_sstream,
       ia_sstream, *returner);
 
   if (proclet_not_found) {
-    get_runtime()->send_rpc_resp_wrong_client(returner);
+    get_runtime()->send_rpc_resp_wrong_client(proclet_header, returner);
   }
 }
 
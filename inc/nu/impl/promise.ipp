@@ -42,19 +42,66 @@ inline Future<void, Deleter> Promise<void>::get_future() {
   return Future<void, Deleter>(this);
 }
 
+// The continuation may free the promise, so run it after the last access.
 template <typename T>
 inline void Promise<T>::set_ready() {
   spin_.lock();
   ready_ = true;
+  auto continuation = std::move(continuation_);
   cv_.signal_all();
   spin_.unlock();
+  if (continuation) {
+    continuation();
+  }
 }
 
 inline void Promise<void>::set_ready() {
   spin_.lock();
   ready_ = true;
+  auto continuation = std::move(continuation_);
   cv_.signal_all();
   spin_.unlock();
+  if (continuation) {
+    continuation();
+  }
+}
+
+template <typename T>
+inline void Promise<T>::set_exception(std::exception_ptr exception) {
+  exception_ = std::move(exception);
+  set_ready();
+}
+
+inline void Promise<void>::set_exception(std::exception_ptr exception) {
+  exception_ = std::move(exception);
+  set_ready();
+}
+
+template <typename T>
+template <typename F>
+inline void Promise<T>::on_ready(F &&f) {
+  spin_.lock();
+  if (ready_) {
+    spin_.unlock();
+    f();
+    return;
+  }
+  BUG_ON(continuation_);
+  continuation_ = std::forward<F>(f);
+  spin_.unlock();
+}
+
+template <typename F>
+inline void Promise<void>::on_ready(F &&f) {
+  spin_.lock();
+  if (ready_) {
+    spin_.unlock();
+    f();
+    return;
+  }
+  BUG_ON(continuation_);
+  continuation_ = std::forward<F>(f);
+  spin_.unlock();
 }
 
 template <typename T>
@@ -69,19 +116,46 @@ inline Promise<T> *Promise<T>::create(F &&f) {
   auto *promise = allocator.allocate(1);
   new (promise) Promise<T>();
   Thread([promise, f = std::forward<F>(f)]() mutable {
-    *promise->data() = f();
+    try {
+      *promise->data() = f();
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+      return;
+    }
     promise->set_ready();
   }).detach();
   return promise;
 }
 
+template <typename T>
+template <typename Allocator>
+inline Promise<T> *Promise<T>::create() {
+  Allocator allocator;
+  auto *promise = allocator.allocate(1);
+  new (promise) Promise<T>();
+  return promise;
+}
+
+template <typename Allocator>
+inline Promise<void> *Promise<void>::create() {
+  Allocator allocator;
+  auto *promise = allocator.allocate(1);
+  new (promise) Promise<void>();
+  return promise;
+}
+
 template <typename F, typename Allocator>
 inline Promise<void> *Promise<void>::create(F &&f) {
   Allocator allocator;
   auto *promise = allocator.allocate(1);
   new (promise) Promise<void>();
   Thread([promise, f = std::forward<F>(f)]() mutable {
-    f();
+    try {
+      f();
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+      return;
+    }
     promise->set_ready();
   }).detach();
   return promise;
@@ -4,48 +4,121 @@ namespace rpc_internal {
 
 class RPCServerWorker {
  public:
-  RPCServerWorker(std::unique_ptr<rt::TcpConn> c, nu::RPCHandler &handler,
-                  Counter &counter);
+  constexpr static uint32_t kMinReadBytes = 4 << 10;
+
+  RPCServerWorker(std::unique_ptr<RPCConn> c, nu::RPCHandler &handler,
+                  Counter &counter, RPCServerPools &pools);
   ~RPCServerWorker();
 
   // Sends the return results of an RPC.
   void Return(RPCReturnCode rc, RPCReturnBuffer &&buf,
-              std::size_t completion_data);
+              std::size_t completion_data, uint32_t redirect_ip = 0);
+  uint32_t GetRemoteIP() const;
+  RPCServerStats GetStats();
 
  private:
   // Internal worker threads for sending and receiving.
   void SendWorker();
   void ReceiveWorker();
+  // Prepares a request for its handler and appends it to @batch.
+  void Dispatch(std::size_t completion_data, std::span<std::byte> args,
+                RPCRecvChunk *chunk, std::unique_ptr<std::byte[]> heap_args,
+                RPCRequestList *batch);
+  // Hands the requests of @batch over to the handler threads.
+  void Submit(RPCRequestList *batch);
+  void SpawnHandler();
+  // The body of handler threads, which run pending requests until none is
+  // left.
+  void RunHandlers();
+  void Handle(RPCRequest *req);
+  RPCRecvChunk *GetChunk();
+  void PutChunk(RPCRecvChunk *chunk);
 
   struct completion {
     RPCReturnCode rc;
     RPCReturnBuffer buf;
     std::size_t completion_data;
+    uint32_t redirect_ip;
   };
 
   rt::Spin lock_;
-  std::unique_ptr<rt::TcpConn> c_;
+  std::unique_ptr<RPCConn> c_;
   nu::RPCHandler &handler_;
   bool close_;
   Counter &counter_;
+  RPCServerPools &pools_;
   rt::ThreadWaker wake_sender_;
   std::vector<completion> completions_;
   float credits_;
   unsigned int demand_;
+  rt::Spin dispatch_lock_;
+  RPCRequestList pending_;
+  // Handler threads that are not running a handler. Kept nonzero while
+  // requests are pending, as the running handlers might block on them.
+  uint32_t num_idle_handlers_;
+  RPCServerStats stats_;
   rt::Thread sender_;
   rt::Thread receiver_;
 };
 
+inline void RPCRequestList::push_back(RPCRequest *req) {
+  req->next = nullptr;
+  if (tail) {
+    tail->next = req;
+  } else {
+    head = req;
+  }
+  tail = req;
+  size++;
+}
+
+inline RPCRequest *RPCRequestList::pop_front() {
+  auto *req = head;
+  if (req) {
+    head = req->next;
+    if (!head) {
+      tail = nullptr;
+    }
+    size--;
+  }
+  return req;
+}
+
+inline void RPCRequestList::splice(RPCRequestList *o) {
+  if (!o->head) {
+    return;
+  }
+  if (tail) {
+    tail->next = o->head;
+  } else {
+    head = o->head;
+  }
+  tail = o->tail;
+  size += o->size;
+  *o = RPCRequestList();
+}
+
 inline void RPCServerWorker::Return(RPCReturnCode rc, RPCReturnBuffer &&buf,
-                                    std::size_t completion_data) {
+                                    std::size_t completion_data,
+                                    uint32_t redirect_ip) {
   rt::SpinGuard guard(&lock_);
-  completions_.emplace_back(rc, std::move(buf), completion_data);
+  completions_.emplace_back(rc, std::move(buf), completion_data, redirect_ip);
   wake_sender_.Wake();
 }
 
+inline uint32_t RPCServerWorker::GetRemoteIP() const {
+  return c_->RemoteAddr().ip;
+}
+
 inline void RPCFlow::Call(std::span<const std::byte> src, RPCCompletion *c) {
   rt::SpinGuard guard(&lock_);
-  reqs_.emplace(req_ctx{src, c});
+  reqs_.emplace(req_ctx{src, {}, c});
+  if (sent_count_ - recv_count_ < credits_) wake_sender_.Wake();
+}
+
+inline void RPCFlow::Call(std::span<const iovec> srcs, RPCCompletion *c) {
+  rt::SpinGuard guard(&lock_);
+  reqs_.emplace(req_ctx{{}, srcs, c});
   if (sent_count_ - recv_count_ < credits_) wake_sender_.Wake();
 }
 
@@ -69,6 +142,19 @@ inline void RPCReturner::Return(RPCReturnCode rc) {
   rpc_server->Return(rc, RPCReturnBuffer(), completion_data_);
 }
 
+inline void RPCReturner::ReturnWrongClient(uint32_t redirect_ip) {
+  auto rpc_server =
+      reinterpret_cast<rpc_internal::RPCServerWorker *>(rpc_server_);
+  rpc_server->Return(kErrWrongClient, RPCReturnBuffer(), completion_data_,
+                     redirect_ip);
+}
+
+inline uint32_t RPCReturner::GetRemoteIP() const {
+  auto rpc_server =
+      reinterpret_cast<rpc_internal::RPCServerWorker *>(rpc_server_);
+  return rpc_server->GetRemoteIP();
+}
+
 inline RPCReturnCode RPCClient::Call(std::span<const std::byte> args,
                                      RPCCallback &&callback) {
   RPCCompletion completion(std::move(callback));
@@ -84,6 +170,18 @@ inline RPCReturnCode RPCClient::Call(std::span<const std::byte> args,
   return completion.get_return_code();
 }
 
+inline void RPCClient::CallAsync(std::span<const std::byte> args,
+                                 RPCAsyncCallback &&callback) {
+  auto *completion = new RPCCompletion(std::move(callback));
+  rt::Preempt p;
+  if (!p.IsHeld()) {
+    rt::PreemptGuard guard(&p);
+    flows_[p.get_cpu()]->Call(args, completion);
+  } else {
+    flows_[p.get_cpu()]->Call(args, completion);
+  }
+}
+
 inline RPCReturnCode RPCClient::Call(std::span<const std::byte> args,
                                      RPCReturnBuffer *return_buf) {
   RPCCompletion completion(return_buf);
@@ -99,4 +197,19 @@ inline RPCReturnCode RPCClient::Call(std::span<const std::byte> args,
   return completion.get_return_code();
 }
 
+inline RPCReturnCode RPCClient::Call(std::span<const iovec> args,
+                                     RPCReturnBuffer *return_buf) {
+  RPCCompletion completion(return_buf);
+  {
+    rt::Preempt p;
+    if (!p.IsHeld()) {
+      rt::PreemptGuardAndPark guard(&p);
+      flows_[p.get_cpu()]->Call(args, &completion);
+    } else {
+      flows_[p.get_cpu()]->Call(args, &completion);
+    }
+  }
+  return completion.get_return_code();
+}
+
 }  // namespace nu
@@ -46,6 +46,14 @@ inline ResourceReporter *Runtime::resource_reporter() {
   return resource_reporter_;
 }
 
+inline CallGraphSampler *Runtime::call_graph_sampler() {
+  return call_graph_sampler_;
+}
+
+inline Tracer *Runtime::tracer() { return tracer_; }
+
+inline MetricsRegistry *Runtime::metrics() { return metrics_; }
+
 inline Caladan *Runtime::caladan() { return caladan_; }
 
 inline Migrator *Runtime::migrator() { return migrator_; }
@@ -0,0 +1,785 @@
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <tuple>
+
+#include "nu/commons.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+template <GeneralContainerBased Container>
+inline GeneralShard<Container>::GeneralShard(uint64_t seq, Key l_key,
+                                             bool has_prev, bool has_next,
+                                             std::size_t max_shard_size)
+    : seq_(seq),
+      has_prev_(has_prev),
+      has_next_(has_next),
+      max_shard_size_(max_shard_size),
+      container_(l_key) {}
+
+template <GeneralContainerBased Container>
+inline std::size_t GeneralShard<Container>::size() const {
+  return container_.size();
+}
+
+// Also accepts any batch while being empty, so that a shard never stays empty
+// due to a nearly full heap.
+template <GeneralContainerBased Container>
+inline bool GeneralShard<Container>::has_room_for(std::size_t size) const {
+  if (size > max_shard_size_) {
+    return false;
+  }
+  auto *slab = get_runtime()->get_current_proclet_slab();
+  auto capacity = slab->get_usage() + slab->get_remaining();
+  return slab->get_cur_usage() < kShardGrowHeapUsageRatio * capacity;
+}
+
+template <GeneralContainerBased Container>
+inline bool GeneralShard<Container>::owns(Key k) const {
+  auto &impl = container_.impl_;
+  auto l_key = impl.get_l_key();
+  return !(has_prev_ && k < l_key) &&
+         !(has_next_ && k >= l_key + static_cast<Key>(impl.size()));
+}
+
+template <GeneralContainerBased Container>
+inline bool GeneralShard<Container>::push_back(
+    uint64_t seq, std::vector<Val> &vals) requires PushBackAble<Impl> {
+  return container_
+      .push_back_batch_if(
+          [&](std::size_t size) {
+            return seq == seq_ && !has_next_ &&
+                   (!size || has_room_for(size + vals.size()));
+          },
+          vals)
+      .first;
+}
+
+template <GeneralContainerBased Container>
+inline bool GeneralShard<Container>::push_front(
+    uint64_t seq, std::vector<Val> &vals) requires PushFrontAble<Impl> {
+  return container_.template synchronized<bool>([&] {
+    auto &impl = container_.impl_;
+    if (seq != seq_ || has_prev_ ||
+        (!impl.empty() && !has_room_for(impl.size() + vals.size()))) {
+      return false;
+    }
+    for (auto &val : vals) {
+      impl.push_front(std::move(val));
+    }
+    return true;
+  });
+}
+
+template <GeneralContainerBased Container>
+inline std::optional<typename GeneralShard<Container>::PopResult>
+GeneralShard<Container>::try_pop_front(
+    uint64_t seq, std::size_t num) requires TryPopFrontAble<Impl> {
+  return container_.template synchronized<std::optional<PopResult>>(
+      [&]() -> std::optional<PopResult> {
+        if (unlikely(seq != seq_)) {
+          return std::nullopt;
+        }
+        auto &impl = container_.impl_;
+        auto vals = impl.try_pop_front(num);
+        return PopResult(std::move(vals), impl.empty() && has_next_);
+      });
+}
+
+template <GeneralContainerBased Container>
+inline std::optional<typename GeneralShard<Container>::PopResult>
+GeneralShard<Container>::try_pop_back(
+    uint64_t seq, std::size_t num) requires TryPopBackAble<Impl> {
+  return container_.template synchronized<std::optional<PopResult>>(
+      [&]() -> std::optional<PopResult> {
+        if (unlikely(seq != seq_)) {
+          return std::nullopt;
+        }
+        auto &impl = container_.impl_;
+        auto vals = impl.try_pop_back(num);
+        return PopResult(std::move(vals), impl.empty() && has_prev_);
+      });
+}
+
+template <GeneralContainerBased Container>
+inline std::optional<std::optional<typename GeneralShard<Container>::Val>>
+GeneralShard<Container>::get(uint64_t seq,
+                             Key k) requires SubscriptAble<Impl> {
+  using RetT = std::optional<std::optional<Val>>;
+
+  return container_.template synchronized<RetT>([&]() -> RetT {
+    if (unlikely(seq != seq_ || !owns(k))) {
+      return std::nullopt;
+    }
+    auto &impl = container_.impl_;
+    auto l_key = impl.get_l_key();
+    if (k < l_key || k >= l_key + static_cast<Key>(impl.size())) {
+      return std::optional<Val>();
+    }
+    return std::optional<Val>(impl[k]);
+  });
+}
+
+template <GeneralContainerBased Container>
+inline std::optional<bool> GeneralShard<Container>::set(
+    uint64_t seq, Key k, Val v) requires SubscriptAble<Impl> {
+  return container_.template synchronized<std::optional<bool>>(
+      [&]() -> std::optional<bool> {
+        if (unlikely(seq != seq_ || !owns(k))) {
+          return std::nullopt;
+        }
+        auto &impl = container_.impl_;
+        auto l_key = impl.get_l_key();
+        if (k < l_key || k >= l_key + static_cast<Key>(impl.size())) {
+          return false;
+        }
+        impl[k] = std::move(v);
+        return true;
+      });
+}
+
+template <GeneralContainerBased Container>
+template <typename... S0s, typename... S1s>
+inline bool GeneralShard<Container>::for_all(
+    uint64_t seq, void (*fn)(const Key &key, Val &val, S0s...),
+    S1s &&... states) {
+  return container_.template synchronized<bool>([&] {
+    if (unlikely(seq != seq_)) {
+      return false;
+    }
+    container_.impl_.for_all(fn, std::forward<S1s>(states)...);
+    return true;
+  });
+}
+
+template <GeneralContainerBased Container>
+template <typename RetT, typename... S0s, typename... S1s>
+inline std::optional<RetT> GeneralShard<Container>::compute(
+    uint64_t seq, RetT (*fn)(Impl &impl, S0s...), S1s &&... states) {
+  return container_.template synchronized<std::optional<RetT>>(
+      [&]() -> std::optional<RetT> {
+        if (unlikely(seq != seq_)) {
+          return std::nullopt;
+        }
+        return fn(container_.impl_, std::forward<S1s>(states)...);
+      });
+}
+
+template <GeneralContainerBased Container>
+inline GeneralShard<Container>::Key GeneralShard<Container>::seal_back() {
+  return container_.template synchronized<Key>([&] {
+    has_next_ = true;
+    auto &impl = container_.impl_;
+    return impl.get_l_key() + static_cast<Key>(impl.size());
+  });
+}
+
+template <GeneralContainerBased Container>
+inline GeneralShard<Container>::Key GeneralShard<Container>::seal_front() {
+  return container_.template synchronized<Key>([&] {
+    has_prev_ = true;
+    return container_.impl_.get_l_key();
+  });
+}
+
+template <GeneralContainerBased Container>
+inline void GeneralShard<Container>::unseal_back() {
+  container_.template synchronized<void>([&] { has_next_ = false; });
+}
+
+template <GeneralContainerBased Container>
+inline void GeneralShard<Container>::unseal_front() {
+  container_.template synchronized<void>([&] { has_prev_ = false; });
+}
+
+template <GeneralContainerBased Container>
+inline bool GeneralShard<Container>::retire() {
+  return container_.template synchronized<bool>([&] {
+    if (!container_.impl_.empty()) {
+      return false;
+    }
+    seq_ = std::numeric_limits<uint64_t>::max();
+    return true;
+  });
+}
+
+template <GeneralContainerBased Container>
+inline void GeneralShard<Container>::reincarnate(uint64_t seq, Key l_key,
+                                                 bool has_prev,
+                                                 bool has_next) {
+  container_.template synchronized<void>([&] {
+    seq_ = seq;
+    has_prev_ = has_prev;
+    has_next_ = has_next;
+    container_.impl_.rebase(l_key);
+  });
+}
+
+template <class Container>
+inline ShardedDataStructure<Container>::ShardedDataStructure(
+    const ShardedDataStructure &o)
+    : shard_map_(nullptr) {
+  *this = o;
+}
+
+template <class Container>
+inline ShardedDataStructure<Container> &
+ShardedDataStructure<Container>::operator=(const ShardedDataStructure &o) {
+  shard_mgr_ = o.shard_mgr_;
+  max_shard_size_ = o.max_shard_size_;
+  auto *shard_map =
+      o.shard_map_ ? new ShardMap(o.get_shard_map_copy()) : nullptr;
+  delete shard_map_;
+  shard_map_ = shard_map;
+  return *this;
+}
+
+template <class Container>
+inline ShardedDataStructure<Container>::ShardedDataStructure(
+    ShardedDataStructure &&o)
+    : shard_map_(nullptr) {
+  *this = std::move(o);
+}
+
+template <class Container>
+inline ShardedDataStructure<Container> &
+ShardedDataStructure<Container>::operator=(ShardedDataStructure &&o) {
+  shard_mgr_ = std::move(o.shard_mgr_);
+  max_shard_size_ = o.max_shard_size_;
+  std::swap(shard_map_, o.shard_map_);
+  return *this;
+}
+
+template <class Container>
+inline ShardedDataStructure<Container>::ShardedDataStructure()
+    : max_shard_size_(0), shard_map_(nullptr) {}
+
+template <class Container>
+inline ShardedDataStructure<Container>::~ShardedDataStructure() {
+  delete shard_map_;
+}
+
+template <class Container>
+ShardedDataStructure<Container>::ShardMap
+ShardedDataStructure<Container>::ShardManager::init(
+    std::size_t max_shard_size, bool pinned) {
+  updating_ = false;
+  pinned_ = pinned;
+  max_shard_size_ = max_shard_size;
+  next_seq_ = 0;
+  shard_map_.version = 0;
+  auto seq = next_seq_++;
+  auto shard = new_shard(seq, Key(), false, false);
+
+  ScopedLock l(&mutex_);
+  shards_.emplace_back(std::move(shard));
+  shard_map_.shards.emplace_back(seq, Key(), shards_.back().get_weak());
+  return shard_map_;
+}
+
+template <class Container>
+std::optional<typename ShardedDataStructure<Container>::ShardMap>
+ShardedDataStructure<Container>::ShardManager::get_shard_map(
+    uint64_t version) {
+  ScopedLock l(&mutex_);
+
+  if (shard_map_.version > version) {
+    return shard_map_;
+  }
+  return std::nullopt;
+}
+
+// Only called without mutex_ held by whoever has an update in flight, which
+// owns spare_shards_ meanwhile.
+template <class Container>
+Proclet<typename ShardedDataStructure<Container>::Shard>
+ShardedDataStructure<Container>::ShardManager::new_shard(uint64_t seq,
+                                                         Key l_key,
+                                                         bool has_prev,
+                                                         bool has_next) {
+  if (!spare_shards_.empty()) {
+    auto shard = std::move(spare_shards_.back());
+    spare_shards_.pop_back();
+    shard.run(&Shard::reincarnate, seq, l_key, has_prev, has_next);
+    return shard;
+  }
+  return make_proclet<Shard>(
+      std::tuple(seq, l_key, has_prev, has_next, max_shard_size_), pinned_);
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::wait_for_update(
+    ScopedLock<Mutex> *l) {
+  while (updating_) {
+    cond_var_.wait(&mutex_);
+  }
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::finish_update() {
+  updating_ = false;
+  cond_var_.signal_all();
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::grow_back(uint64_t seq) {
+  WeakProclet<Shard> tail;
+  uint64_t new_seq;
+  {
+    ScopedLock l(&mutex_);
+    wait_for_update(&l);
+    if (shard_map_.shards.back().seq != seq) {
+      return;
+    }
+    updating_ = true;
+    tail = shard_map_.shards.back().shard;
+    new_seq = next_seq_++;
+  }
+
+  auto l_key = tail.run(&Shard::seal_back);
+  auto shard = new_shard(new_seq, l_key, true, false);
+
+  ScopedLock l(&mutex_);
+  shards_.emplace_back(std::move(shard));
+  shard_map_.shards.emplace_back(new_seq, l_key, shards_.back().get_weak());
+  shard_map_.version++;
+  finish_update();
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::grow_front(uint64_t seq) {
+  WeakProclet<Shard> head;
+  uint64_t new_seq;
+  {
+    ScopedLock l(&mutex_);
+    wait_for_update(&l);
+    if (shard_map_.shards.front().seq != seq) {
+      return;
+    }
+    updating_ = true;
+    head = shard_map_.shards.front().shard;
+    new_seq = next_seq_++;
+  }
+
+  auto l_key = head.run(&Shard::seal_front);
+  auto shard = new_shard(new_seq, l_key, false, true);
+
+  ScopedLock l(&mutex_);
+  auto &infos = shard_map_.shards;
+  infos.front().l_key = l_key;
+  shards_.emplace(shards_.begin(), std::move(shard));
+  infos.emplace(infos.begin(), new_seq, l_key, shards_.front().get_weak());
+  shard_map_.version++;
+  finish_update();
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::shrink_front(
+    uint64_t seq) {
+  WeakProclet<Shard> head, next;
+  {
+    ScopedLock l(&mutex_);
+    wait_for_update(&l);
+    auto &infos = shard_map_.shards;
+    if (infos.size() == 1 || infos.front().seq != seq) {
+      return;
+    }
+    updating_ = true;
+    head = infos[0].shard;
+    next = infos[1].shard;
+  }
+
+  bool retired = head.run(&Shard::retire);
+  if (retired) {
+    next.run(&Shard::unseal_front);
+  }
+
+  ScopedLock l(&mutex_);
+  if (retired) {
+    spare_shards_.emplace_back(std::move(shards_.front()));
+    shards_.erase(shards_.begin());
+    shard_map_.shards.erase(shard_map_.shards.begin());
+    shard_map_.version++;
+  }
+  finish_update();
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::ShardManager::shrink_back(
+    uint64_t seq) {
+  WeakProclet<Shard> tail, prev;
+  {
+    ScopedLock l(&mutex_);
+    wait_for_update(&l);
+    auto &infos = shard_map_.shards;
+    if (infos.size() == 1 || infos.back().seq != seq) {
+      return;
+    }
+    updating_ = true;
+    tail = infos[infos.size() - 1].shard;
+    prev = infos[infos.size() - 2].shard;
+  }
+
+  bool retired = tail.run(&Shard::retire);
+  if (retired) {
+    prev.run(&Shard::unseal_back);
+  }
+
+  ScopedLock l(&mutex_);
+  if (retired) {
+    spare_shards_.emplace_back(std::move(shards_.back()));
+    shards_.pop_back();
+    shard_map_.shards.pop_back();
+    shard_map_.version++;
+  }
+  finish_update();
+}
+
+template <class Container>
+inline ShardedDataStructure<Container>::ShardMap
+ShardedDataStructure<Container>::get_shard_map_copy() const {
+  rcu_lock_.reader_lock();
+  auto shard_map = *load_acquire(&shard_map_);
+  rcu_lock_.reader_unlock();
+  return shard_map;
+}
+
+// Picks a shard by invoking @f with the cached shard map entries.
+template <class Container>
+template <typename F>
+inline std::pair<uint64_t, typename ShardedDataStructure<Container>::ShardInfo>
+ShardedDataStructure<Container>::locate_shard(F &&f) {
+  rcu_lock_.reader_lock();
+  auto *shard_map = load_acquire(&shard_map_);
+  auto ret =
+      std::make_pair(shard_map->version, ShardInfo(f(shard_map->shards)));
+  rcu_lock_.reader_unlock();
+  return ret;
+}
+
+template <class Container>
+inline std::pair<uint64_t, typename ShardedDataStructure<Container>::ShardInfo>
+ShardedDataStructure<Container>::locate_shard_of(Key k) {
+  return locate_shard([&](const std::vector<ShardInfo> &shards) {
+    auto it = std::upper_bound(
+        shards.begin(), shards.end(), k,
+        [](const Key &k, const ShardInfo &info) { return k < info.l_key; });
+    return it == shards.begin() ? *it : *std::prev(it);
+  });
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::refresh_shard_map(
+    uint64_t stale_version) {
+  ScopedLock l(&refresh_mutex_);
+
+  if (shard_map_->version > stale_version) {
+    return;
+  }
+  auto optional_shard_map =
+      shard_mgr_.run(&ShardManager::get_shard_map, stale_version);
+  if (!optional_shard_map) {
+    return;
+  }
+
+  auto *old_shard_map = shard_map_;
+  store_release(&shard_map_, new ShardMap(std::move(*optional_shard_map)));
+  rcu_lock_.writer_sync();
+  delete old_shard_map;
+}
+
+template <class Container>
+std::vector<typename ShardedDataStructure<Container>::ShardInfo>
+ShardedDataStructure<Container>::get_all_shards() {
+  rcu_lock_.reader_lock();
+  auto version = load_acquire(&shard_map_)->version;
+  rcu_lock_.reader_unlock();
+  refresh_shard_map(version);
+
+  return get_shard_map_copy().shards;
+}
+
+template <class Container>
+inline void ShardedDataStructure<Container>::push_back(
+    Val v) requires PushBackAble<Impl> {
+  std::vector<Val> vals;
+  vals.emplace_back(std::move(v));
+  push_back_batch(std::move(vals));
+}
+
+template <class Container>
+inline void ShardedDataStructure<Container>::push_front(
+    Val v) requires PushFrontAble<Impl> {
+  std::vector<Val> vals;
+  vals.emplace_back(std::move(v));
+  push_front_batch(std::move(vals));
+}
+
+// A batch rejected by a full tail shard is retried after the shard manager
+// puts a new shard after it.
+template <class Container>
+void ShardedDataStructure<Container>::push_back_batch(
+    std::vector<Val> vals) requires PushBackAble<Impl> {
+  for (std::size_t pos = 0; pos < vals.size(); pos += max_shard_size_) {
+    auto end = std::min(pos + max_shard_size_, vals.size());
+    std::vector<Val> chunk(std::make_move_iterator(vals.begin() + pos),
+                           std::make_move_iterator(vals.begin() + end));
+    while (true) {
+      auto [version, info] = locate_shard(
+          [](const std::vector<ShardInfo> &shards) { return shards.back(); });
+      if (likely(info.shard.__run(
+              +[](Shard &shard, uint64_t seq, std::vector<Val> vals) {
+                return shard.push_back(seq, vals);
+              },
+              info.seq, chunk))) {
+        break;
+      }
+      shard_mgr_.run(&ShardManager::grow_back, info.seq);
+      refresh_shard_map(version);
+    }
+  }
+}
+
+template <class Container>
+void ShardedDataStructure<Container>::push_front_batch(
+    std::vector<Val> vals) requires PushFrontAble<Impl> {
+  for (std::size_t pos = 0; pos < vals.size(); pos += max_shard_size_) {
+    auto end = std::min(pos + max_shard_size_, vals.size());
+    std::vector<Val> chunk(std::make_move_iterator(vals.begin() + pos),
+                           std::make_move_iterator(vals.begin() + end));
+    while (true) {
+      auto [version, info] = locate_shard(
+          [](const std::vector<ShardInfo> &shards) { return shards.front(); });
+      if (likely(info.shard.__run(
+              +[](Shard &shard, uint64_t seq, std::vector<Val> vals) {
+                return shard.push_front(seq, vals);
+              },
+              info.seq, chunk))) {
+        break;
+      }
+      shard_mgr_.run(&ShardManager::grow_front, info.seq);
+      refresh_shard_map(version);
+    }
+  }
+}
+
+// Moves on to the next shard once the head one is drained, which is recycled
+// by the shard manager.
+template <class Container>
+std::vector<typename ShardedDataStructure<Container>::Val>
+ShardedDataStructure<Container>::try_pop_front(
+    std::size_t num) requires TryPopFrontAble<Impl> {
+  std::vector<Val> all_vals;
+  while (all_vals.size() < num) {
+    auto [version, info] = locate_shard(
+        [](const std::vector<ShardInfo> &shards) { return shards.front(); });
+    auto optional_ret = info.shard.__run(
+        +[](Shard &shard, uint64_t seq, std::size_t num) {
+          return shard.try_pop_front(seq, num);
+        },
+        info.seq, num - all_vals.size());
+    if (unlikely(!optional_ret)) {
+      refresh_shard_map(version);
+      continue;
+    }
+
+    auto &[vals, drained] = *optional_ret;
+    all_vals.insert(all_vals.end(), std::make_move_iterator(vals.begin()),
+                    std::make_move_iterator(vals.end()));
+    if (!drained) {
+      break;
+    }
+    shard_mgr_.run(&ShardManager::shrink_front, info.seq);
+    refresh_shard_map(version);
+  }
+  return all_vals;
+}
+
+template <class Container>
+std::vector<typename ShardedDataStructure<Container>::Val>
+ShardedDataStructure<Container>::try_pop_back(
+    std::size_t num) requires TryPopBackAble<Impl> {
+  std::vector<Val> all_vals;
+  while (all_vals.size() < num) {
+    auto [version, info] = locate_shard(
+        [](const std::vector<ShardInfo> &shards) { return shards.back(); });
+    auto optional_ret = info.shard.__run(
+        +[](Shard &shard, uint64_t seq, std::size_t num) {
+          return shard.try_pop_back(seq, num);
+        },
+        info.seq, num - all_vals.size());
+    if (unlikely(!optional_ret)) {
+      refresh_shard_map(version);
+      continue;
+    }
+
+    auto &[vals, drained] = *optional_ret;
+    all_vals.insert(all_vals.end(), std::make_move_iterator(vals.begin()),
+                    std::make_move_iterator(vals.end()));
+    if (!drained) {
+      break;
+    }
+    shard_mgr_.run(&ShardManager::shrink_back, info.seq);
+    refresh_shard_map(version);
+  }
+  return all_vals;
+}
+
+template <class Container>
+std::optional<typename ShardedDataStructure<Container>::Val>
+ShardedDataStructure<Container>::get(Key k) requires SubscriptAble<Impl> {
+  while (true) {
+    auto [version, info] = locate_shard_of(k);
+    auto optional_ret = info.shard.__run(
+        +[](Shard &shard, uint64_t seq, Key k) { return shard.get(seq, k); },
+        info.seq, k);
+    if (likely(optional_ret)) {
+      return std::move(*optional_ret);
+    }
+    refresh_shard_map(version);
+  }
+}
+
+template <class Container>
+bool ShardedDataStructure<Container>::set(
+    Key k, Val v) requires SubscriptAble<Impl> {
+  while (true) {
+    auto [version, info] = locate_shard_of(k);
+    auto optional_ret = info.shard.__run(
+        +[](Shard &shard, uint64_t seq, Key k, Val v) {
+          return shard.set(seq, k, std::move(v));
+        },
+        info.seq, k, v);
+    if (likely(optional_ret)) {
+      return *optional_ret;
+    }
+    refresh_shard_map(version);
+  }
+}
+
+// The shards rejecting invocations have been recycled after being drained,
+// thus are skipped.
+template <class Container>
+template <typename... S0s, typename... S1s>
+void ShardedDataStructure<Container>::for_all(
+    void (*fn)(const Key &key, Val &val, S0s...), S1s &&... states) {
+  std::vector<Future<bool>> futures;
+  for (auto &info : get_all_shards()) {
+    futures.emplace_back(info.shard.__run_async(
+        +[](Shard &shard, uint64_t seq,
+            void (*fn)(const Key &key, Val &val, S0s...), S0s... states) {
+          return shard.for_all(seq, fn, std::move(states)...);
+        },
+        info.seq, fn, states...));
+  }
+  for (auto &future : futures) {
+    future.get();
+  }
+}
+
+template <class Container>
+template <typename RetT, typename... S0s, typename... S1s>
+std::vector<RetT> ShardedDataStructure<Container>::compute(
+    RetT (*fn)(Impl &impl, S0s...), S1s &&... states) {
+  std::vector<Future<std::optional<RetT>>> futures;
+  for (auto &info : get_all_shards()) {
+    futures.emplace_back(info.shard.__run_async(
+        +[](Shard &shard, uint64_t seq, RetT (*fn)(Impl &impl, S0s...),
+            S0s... states) {
+          return shard.compute(seq, fn, std::move(states)...);
+        },
+        info.seq, fn, states...));
+  }
+
+  std::vector<RetT> rets;
+  rets.reserve(futures.size());
+  for (auto &future : futures) {
+    auto &optional_ret = future.get();
+    if (optional_ret) {
+      rets.emplace_back(std::move(*optional_ret));
+    }
+  }
+  return rets;
+}
+
+template <class Container>
+std::vector<typename ShardedDataStructure<Container>::Val>
+ShardedDataStructure<Container>::get_all_data() {
+  auto all_shards_vals = compute(+[](Impl &impl) {
+    std::vector<Val> vals;
+    vals.reserve(impl.size());
+    impl.for_all(
+        +[](const Key &, Val &val, std::vector<Val> *vals) {
+          vals->push_back(val);
+        },
+        &vals);
+    return vals;
+  });
+
+  std::vector<Val> all_vals;
+  for (auto &vals : all_shards_vals) {
+    all_vals.insert(all_vals.end(), std::make_move_iterator(vals.begin()),
+                    std::make_move_iterator(vals.end()));
+  }
+  return all_vals;
+}
+
+template <class Container>
+std::size_t ShardedDataStructure<Container>::size() {
+  std::vector<Future<std::size_t>> futures;
+  for (auto &info : get_all_shards()) {
+    futures.emplace_back(info.shard.__run_async(
+        +[](Shard &shard) { return shard.size(); }));
+  }
+
+  std::size_t size = 0;
+  for (auto &future : futures) {
+    size += future.get();
+  }
+  return size;
+}
+
+template <class Container>
+inline bool ShardedDataStructure<Container>::empty() {
+  return !size();
+}
+
+template <class Container>
+inline uint32_t ShardedDataStructure<Container>::get_num_shards() {
+  return get_all_shards().size();
+}
+
+template <class Container>
+template <class Archive>
+inline void ShardedDataStructure<Container>::save(Archive &ar) const {
+  ar(shard_mgr_, max_shard_size_);
+  ar(shard_map_ ? get_shard_map_copy() : ShardMap());
+}
+
+template <class Container>
+template <class Archive>
+inline void ShardedDataStructure<Container>::load(Archive &ar) {
+  ar(shard_mgr_, max_shard_size_);
+  auto *shard_map = new ShardMap();
+  ar(*shard_map);
+  delete shard_map_;
+  shard_map_ = shard_map;
+}
+
+template <class Container>
+ShardedDataStructure<Container> make_sharded_ds(std::size_t max_shard_size,
+                                                bool pinned) {
+  using DSType = ShardedDataStructure<Container>;
+  BUG_ON(!max_shard_size);
+
+  DSType ds;
+  ds.shard_mgr_ = make_proclet<typename DSType::ShardManager>();
+  ds.max_shard_size_ = max_shard_size;
+  ds.shard_map_ = new DSType::ShardMap(ds.shard_mgr_.run(
+      &DSType::ShardManager::init, max_shard_size, pinned));
+  return ds;
+}
+
+}  // namespace nu
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
@@ -25,6 +26,19 @@ inline void SlabAllocator::init(SlabId_t slab_id, void *buf, uint64_t len,
   end_ = start_ + len;
   cur_ = const_cast<uint8_t *>(start_);
   global_free_bytes_ = 0;
+  num_free_runs_ = 0;
+  free_run_classes_ = 0;
+  std::fill(std::begin(num_carved_), std::end(num_carved_), 0);
+  for (auto &cache : cache_lists_) {
+    std::fill(std::begin(cache.num_live), std::end(cache.num_live), 0);
+    std::fill(std::begin(cache.live_bytes), std::end(cache.live_bytes), 0);
+    for (uint32_t i = 0; i < kNumSlabClasses; i++) {
+      cache.depths[i] = get_initial_depth(i);
+    }
+    std::fill(std::begin(cache.num_overflows), std::end(cache.num_overflows),
+              0);
+    cache.stats = SlabCacheStats{};
+  }
 }
 
 inline void *SlabAllocator::allocate(size_t size) {
@@ -41,13 +55,30 @@ inline void SlabAllocator::free(const void *ptr) {
   __free(ptr);
 }
 
-inline uint32_t SlabAllocator::get_slab_shift(uint64_t data_size) {
-  return data_size <= (1ULL << kMinSlabClassShift) ? kMinSlabClassShift - 1
-                                                   : bsr_64(data_size - 1);
+// Returns kNumSlabClasses if @data_size exceeds the largest class.
+inline uint32_t SlabAllocator::get_slab_class(uint64_t data_size) {
+  if (data_size <= (1ULL << kMinSlabClassShift)) {
+    return 0;
+  }
+  uint32_t shift = bsr_64(data_size - 1);
+  if (unlikely(shift >= kMaxSlabClassShift)) {
+    return kNumSlabClasses;
+  }
+  auto offset = (data_size - 1) - (1ULL << shift);
+  return slab_internal::kBaseClasses[shift] +
+         (offset >> slab_internal::get_spacing_shift(shift));
+}
+
+inline uint64_t SlabAllocator::get_class_size(uint32_t slab_class) {
+  return slab_internal::kClassSizes[slab_class];
 }
 
-inline uint64_t SlabAllocator::get_slab_size(uint32_t slab_shift) {
-  return (1ULL << (slab_shift + 1)) + sizeof(PtrHeader);
+inline uint64_t SlabAllocator::get_slab_size(uint32_t slab_class) {
+  return get_class_size(slab_class) + sizeof(PtrHeader);
+}
+
+inline uint64_t SlabAllocator::get_usable_size(size_t size) {
+  return get_class_size(get_slab_class(size));
 }
 
 inline void *SlabAllocator::get_base() const {
@@ -85,4 +116,17 @@ inline void SlabAllocator::deregister_slab_by_id(SlabId_t slab_id) {
 
 inline uint64_t SlabAllocator::FreePtrsLinkedList::size() { return size_; }
 
+template <typename F>
+inline void SlabAllocator::FreePtrsLinkedList::for_each(F &&f) const {
+  for (auto *batch = head_; batch;
+       batch = reinterpret_cast<Batch *>(batch->p[0])) {
+    f(batch);
+    for (uint32_t i = 1; i < kBatchSize; i++) {
+      if (batch->p[i]) {
+        f(batch->p[i]);
+      }
+    }
+  }
+}
+
 }  // namespace nu
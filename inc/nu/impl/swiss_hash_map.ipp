@@ -0,0 +1,774 @@
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+
+extern "C" {
+#include <base/assert.h>
+}
+
+#include "nu/cereal.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::Pair *
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::Slot::pair()
+    const {
+  return std::launder(
+      reinterpret_cast<Pair *>(const_cast<std::byte *>(storage)));
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                    Lock>::SwissHashMap() {
+  auto num_groups = std::bit_ceil(
+      std::max(static_cast<uint64_t>(1),
+               static_cast<uint64_t>(NSlots) / kNumPartitions / kGroupSize));
+  for (auto &partition : partitions_) {
+    partition.version = 0;
+    partition.num_groups = num_groups;
+    partition.num_full = partition.num_deleted = 0;
+    partition.groups = allocate_groups(num_groups);
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                    Lock>::~SwissHashMap() {
+  for (auto &partition : partitions_) {
+    destroy_pairs(partition.groups, partition.num_groups);
+    free_groups(partition.groups, partition.num_groups);
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                    Lock>::SwissHashMap(const SwissHashMap &o) noexcept
+    : SwissHashMap() {
+  SwissHashMap::operator=(o);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>
+    &SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::operator=(
+        const SwissHashMap &o) noexcept {
+  if (this == &o) {
+    return *this;
+  }
+
+  for (auto &partition : partitions_) {
+    ScopedLock l(&partition.lock);
+    begin_write(partition);
+    clear(partition);
+    end_write(partition);
+  }
+  for (auto &o_partition : o.partitions_) {
+    for (uint64_t i = 0; i < o_partition.num_groups; i++) {
+      auto &group = o_partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        if (group.tags[j] >= 0) {
+          auto &slot = group.slots[j];
+          put_with_hash(slot.pair()->first, slot.pair()->second, slot.key_hash);
+        }
+      }
+    }
+  }
+  return *this;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                    Lock>::SwissHashMap(SwissHashMap &&o) noexcept
+    : SwissHashMap() {
+  SwissHashMap::operator=(std::move(o));
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>
+    &SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::operator=(
+        SwissHashMap &&o) noexcept {
+  for (uint32_t i = 0; i < kNumPartitions; i++) {
+    auto &partition = partitions_[i];
+    auto &o_partition = o.partitions_[i];
+    std::swap(partition.num_groups, o_partition.num_groups);
+    std::swap(partition.num_full, o_partition.num_full);
+    std::swap(partition.num_deleted, o_partition.num_deleted);
+    std::swap(partition.groups, o_partition.groups);
+  }
+  return *this;
+}
+
+// The lowest bits select the partition, as the highest ones might have been
+// used for sharding already.
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::Partition &
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_partition(
+    uint64_t key_hash) {
+  return partitions_[key_hash & (kNumPartitions - 1)];
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline int8_t
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_tag(
+    uint64_t key_hash) {
+  return (key_hash >> kPowerNumPartitions) & 0x7F;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline uint64_t
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_group_idx(
+    uint64_t key_hash) {
+  return key_hash >> (kPowerNumPartitions + 7);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline int8_t &
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_tag_ref(
+    Group *groups, Slot *slot) {
+  auto offset = reinterpret_cast<uintptr_t>(slot) -
+                reinterpret_cast<uintptr_t>(groups);
+  auto &group = groups[offset / sizeof(Group)];
+  return group.tags[slot - group.slots];
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline uint32_t SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::match(const Group &group, int8_t tag) {
+  auto tags = _mm_load_si128(reinterpret_cast<const __m128i *>(group.tags));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), tags));
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline uint32_t SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::match_empty_or_deleted(const Group &group) {
+  // Full slots are the only ones carrying non-negative tags.
+  auto tags = _mm_load_si128(reinterpret_cast<const __m128i *>(group.tags));
+  return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), tags));
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::Group *
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::allocate_groups(
+    uint64_t num_groups) {
+  GroupAllocator group_allocator;
+  auto *groups = group_allocator.allocate(num_groups);
+  for (uint64_t i = 0; i < num_groups; i++) {
+    memset(groups[i].tags, kEmpty, sizeof(groups[i].tags));
+  }
+  return groups;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline void
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::free_groups(
+    Group *groups, uint64_t num_groups) {
+  if (groups) {
+    GroupAllocator group_allocator;
+    group_allocator.deallocate(groups, num_groups);
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline void
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::destroy_pairs(
+    Group *groups, uint64_t num_groups) {
+  if constexpr (!std::is_trivially_destructible_v<Pair>) {
+    for (uint64_t i = 0; i < num_groups; i++) {
+      auto &group = groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        if (group.tags[j] >= 0) {
+          std::destroy_at(group.slots[j].pair());
+        }
+      }
+    }
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline void
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::begin_write(
+    Partition &partition) {
+  store_release(&partition.version, partition.version + 1);
+  barrier();
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline void
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::end_write(
+    Partition &partition) {
+  barrier();
+  store_release(&partition.version, partition.version + 1);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+inline typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::Slot *
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::find(
+    Group *groups, uint64_t num_groups, const K1 &k, uint64_t key_hash) {
+  auto equaler = KeyEqual();
+  auto tag = get_tag(key_hash);
+  auto mask = num_groups - 1;
+  auto group_idx = get_group_idx(key_hash) & mask;
+
+  // Triangular probing visits every group once as num_groups is a power of 2.
+  for (uint64_t i = 0; i < num_groups;) {
+    auto &group = groups[group_idx];
+    for (auto bits = match(group, tag); bits; bits &= bits - 1) {
+      auto &slot = group.slots[__builtin_ctz(bits)];
+      if (slot.key_hash == key_hash && equaler(k, slot.pair()->first)) {
+        return &slot;
+      }
+    }
+    if (likely(match(group, kEmpty))) {
+      return nullptr;
+    }
+    group_idx = (group_idx + ++i) & mask;
+  }
+  return nullptr;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+inline typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                             Lock>::Slot *
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::find_free(
+    Group *groups, uint64_t num_groups, uint64_t key_hash) {
+  auto mask = num_groups - 1;
+  auto group_idx = get_group_idx(key_hash) & mask;
+
+  for (uint64_t i = 0; i < num_groups;) {
+    auto &group = groups[group_idx];
+    if (auto bits = match_empty_or_deleted(group)) {
+      return &group.slots[__builtin_ctz(bits)];
+    }
+    group_idx = (group_idx + ++i) & mask;
+  }
+  BUG();
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+inline bool SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                         Lock>::optimistic_get_copy(Partition &partition,
+                                                    const K1 &k,
+                                                    uint64_t key_hash,
+                                                    std::optional<V> *ret) {
+  rcu_lock_.reader_lock();
+  for (uint32_t i = 0; i < kMaxOptimisticReadTries; i++) {
+    auto version = load_acquire(&partition.version);
+    if (unlikely(version & 1)) {
+      cpu_relax();
+      continue;
+    }
+    auto *groups = load_acquire(&partition.groups);
+    auto num_groups = load_acquire(&partition.num_groups);
+    if (unlikely(load_acquire(&partition.version) != version)) {
+      continue;
+    }
+
+    auto *slot = find(groups, num_groups, k, key_hash);
+    if (slot) {
+      ret->emplace(slot->pair()->second);
+    } else {
+      ret->reset();
+    }
+    barrier();
+    if (likely(load_acquire(&partition.version) == version)) {
+      rcu_lock_.reader_unlock();
+      return true;
+    }
+  }
+  rcu_lock_.reader_unlock();
+  return false;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+inline std::optional<V>
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_copy(K1 &&k) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  return get_copy_with_hash(std::forward<K1>(k), key_hash);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+inline std::optional<V> SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                                     Lock>::get_copy_with_hash(K1 &&k,
+                                                               uint64_t
+                                                                   key_hash) {
+  auto &partition = get_partition(key_hash);
+  std::optional<V> ret;
+
+  if constexpr (kOptimisticReads) {
+    if (likely(optimistic_get_copy(partition, k, key_hash, &ret))) {
+      return ret;
+    }
+  }
+
+  ScopedLock l(&partition.lock);
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (slot) {
+    ret.emplace(slot->pair()->second);
+  }
+  return ret;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+std::optional<typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                                    Lock>::RetiredGroups>
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::reserve(
+    Partition &partition) {
+  auto capacity = partition.num_groups * kGroupSize;
+  auto used = partition.num_full + partition.num_deleted + 1;
+  if (likely(used * 100 <= capacity * kMaxLoadFactorPercent)) {
+    return std::nullopt;
+  }
+
+  // Grows if the full slots alone take more than half of the allowed load;
+  // otherwise only purges the deleted ones.
+  auto num_groups = partition.num_groups;
+  if ((partition.num_full + 1) * 200 > capacity * kMaxLoadFactorPercent) {
+    num_groups *= 2;
+  }
+
+  auto *groups = allocate_groups(num_groups);
+  for (uint64_t i = 0; i < partition.num_groups; i++) {
+    auto &group = partition.groups[i];
+    for (uint32_t j = 0; j < kGroupSize; j++) {
+      if (group.tags[j] >= 0) {
+        auto &slot = group.slots[j];
+        auto *new_slot = find_free(groups, num_groups, slot.key_hash);
+        new_slot->key_hash = slot.key_hash;
+        std::construct_at(new_slot->pair(), std::move(*slot.pair()));
+        get_tag_ref(groups, new_slot) = get_tag(slot.key_hash);
+      }
+    }
+  }
+
+  // The old pairs are kept alive till no optimistic reader can see them.
+  RetiredGroups retired{partition.groups, partition.num_groups};
+  begin_write(partition);
+  partition.groups = groups;
+  partition.num_groups = num_groups;
+  partition.num_deleted = 0;
+  end_write(partition);
+  return retired;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::retire(
+    std::optional<RetiredGroups> &retired) {
+  if (likely(!retired)) {
+    return;
+  }
+  if constexpr (kOptimisticReads) {
+    rcu_lock_.writer_sync();
+  }
+  destroy_pairs(retired->groups, retired->num_groups);
+  free_groups(retired->groups, retired->num_groups);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename F>
+typename SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::Slot *
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::insert(
+    Partition &partition, K1 &&k, uint64_t key_hash, F &&make_v,
+    std::optional<RetiredGroups> *retired) {
+  *retired = reserve(partition);
+
+  auto *slot = find_free(partition.groups, partition.num_groups, key_hash);
+  auto &tag = get_tag_ref(partition.groups, slot);
+
+  begin_write(partition);
+  slot->key_hash = key_hash;
+  std::construct_at(slot->pair(), std::forward<K1>(k), make_v());
+  partition.num_deleted -= (tag == kDeleted);
+  partition.num_full++;
+  tag = get_tag(key_hash);
+  end_write(partition);
+  return slot;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::erase(
+    Partition &partition, Slot *slot) {
+  auto &tag = get_tag_ref(partition.groups, slot);
+  auto offset = reinterpret_cast<uintptr_t>(slot) -
+                reinterpret_cast<uintptr_t>(partition.groups);
+  auto &group = partition.groups[offset / sizeof(Group)];
+
+  begin_write(partition);
+  std::destroy_at(slot->pair());
+  // Probes never go past a group that still has an empty slot, so no tombstone
+  // is needed there.
+  if (match(group, kEmpty)) {
+    tag = kEmpty;
+  } else {
+    tag = kDeleted;
+    partition.num_deleted++;
+  }
+  partition.num_full--;
+  end_write(partition);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::clear(
+    Partition &partition) {
+  destroy_pairs(partition.groups, partition.num_groups);
+  for (uint64_t i = 0; i < partition.num_groups; i++) {
+    auto &group = partition.groups[i];
+    memset(group.tags, kEmpty, sizeof(group.tags));
+  }
+  partition.num_full = partition.num_deleted = 0;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename V1>
+inline void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::put(
+    K1 k, V1 v) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  put_with_hash(std::move(k), std::move(v), key_hash);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename V1>
+void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                  Lock>::put_with_hash(K1 k, V1 v, uint64_t key_hash) {
+  auto &partition = get_partition(key_hash);
+  std::optional<RetiredGroups> retired;
+
+  partition.lock.lock();
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (slot) {
+    begin_write(partition);
+    slot->pair()->second = std::move(v);
+    end_write(partition);
+  } else {
+    insert(
+        partition, std::move(k), key_hash, [&] { return V(std::move(v)); },
+        &retired);
+  }
+  partition.lock.unlock();
+  retire(retired);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename... Args>
+inline bool
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::try_emplace(
+    K1 k, Args... args) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  return try_emplace_with_hash(std::move(k), key_hash, std::move(args)...);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename... Args>
+bool SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                  Lock>::try_emplace_with_hash(K1 k, uint64_t key_hash,
+                                               Args... args) {
+  auto &partition = get_partition(key_hash);
+  std::optional<RetiredGroups> retired;
+
+  partition.lock.lock();
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (!slot) {
+    insert(
+        partition, std::move(k), key_hash,
+        [&] { return V(std::move(args)...); }, &retired);
+  }
+  partition.lock.unlock();
+  retire(retired);
+  return !slot;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+inline bool SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::remove(
+    K1 &&k) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  return remove_with_hash(std::forward<K1>(k), key_hash);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+bool SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                  Lock>::remove_with_hash(K1 &&k, uint64_t key_hash) {
+  auto &partition = get_partition(key_hash);
+
+  ScopedLock l(&partition.lock);
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (!slot) {
+    return false;
+  }
+  erase(partition, slot);
+  return true;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename RetT, typename... A0s, typename... A1s>
+inline RetT SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::apply(
+    K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...), A1s &&... args) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  return apply_with_hash(std::forward<K1>(k), key_hash, fn,
+                         std::forward<A1s>(args)...);
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1, typename RetT, typename... A0s, typename... A1s>
+RetT SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                  Lock>::apply_with_hash(K1 &&k, uint64_t key_hash,
+                                         RetT (*fn)(std::pair<const K, V> &,
+                                                    A0s...),
+                                         A1s &&... args) {
+  auto &partition = get_partition(key_hash);
+  std::optional<RetiredGroups> retired;
+
+  partition.lock.lock();
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (!slot) {
+    slot = insert(
+        partition, std::forward<K1>(k), key_hash, [] { return V(); },
+        &retired);
+  }
+
+  begin_write(partition);
+  if constexpr (!std::is_same<RetT, void>::value) {
+    auto ret = fn(*slot->pair(), std::forward<A1s>(args)...);
+    end_write(partition);
+    partition.lock.unlock();
+    retire(retired);
+    return ret;
+  } else {
+    fn(*slot->pair(), std::forward<A1s>(args)...);
+    end_write(partition);
+    partition.lock.unlock();
+    retire(retired);
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename RetT, typename... A0s, typename... A1s>
+RetT SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                  Lock>::associative_reduce(bool clear, RetT init_val,
+                                            void (*reduce_fn)(
+                                                RetT &,
+                                                std::pair<const K, V> &,
+                                                A0s...),
+                                            A1s &&...args) {
+  RetT reduced_val(std::move(init_val));
+
+  for (auto &partition : partitions_) {
+    ScopedLock l(&partition.lock);
+    begin_write(partition);
+    for (uint64_t i = 0; i < partition.num_groups; i++) {
+      auto &group = partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        if (group.tags[j] >= 0) {
+          reduce_fn(reduced_val, *group.slots[j].pair(),
+                    std::forward<A1s>(args)...);
+        }
+      }
+    }
+    if (clear) {
+      this->clear(partition);
+    }
+    end_write(partition);
+  }
+  return reduced_val;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+std::vector<std::pair<K, V>>
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_all_pairs() {
+  return associative_reduce(
+      /* clear = */ false, /* init_val = */ std::vector<std::pair<K, V>>(),
+      /* reduce_fn = */
+      +[](std::vector<std::pair<K, V>> &reduced_val,
+          std::pair<const K, V> &pair) { reduced_val.push_back(pair); });
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename K1>
+std::optional<V>
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::get_and_remove(
+    K1 &&k) {
+  auto hasher = Hash();
+  auto key_hash = hasher(k);
+  auto &partition = get_partition(key_hash);
+
+  ScopedLock l(&partition.lock);
+  auto *slot = find(partition.groups, partition.num_groups, k, key_hash);
+  if (!slot) {
+    return std::nullopt;
+  }
+  auto ret = std::make_optional(std::move(slot->pair()->second));
+  erase(partition, slot);
+  return ret;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+std::vector<std::pair<uint64_t, K>>
+SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+             Lock>::get_all_hashes_and_keys() {
+  std::vector<std::pair<uint64_t, K>> hashes_and_keys;
+
+  for (auto &partition : partitions_) {
+    ScopedLock l(&partition.lock);
+    for (uint64_t i = 0; i < partition.num_groups; i++) {
+      auto &group = partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        if (group.tags[j] >= 0) {
+          auto &slot = group.slots[j];
+          hashes_and_keys.emplace_back(slot.key_hash, slot.pair()->first);
+        }
+      }
+    }
+  }
+  return hashes_and_keys;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename F>
+bool SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::
+    get_pairs_if(uint64_t *cursor, std::size_t max_num, F &&pred,
+                 std::vector<std::tuple<K, V, uint64_t>> *pairs) {
+  for (; *cursor < kNumPartitions && pairs->size() < max_num; ++*cursor) {
+    auto &partition = partitions_[*cursor];
+    ScopedLock l(&partition.lock);
+    for (uint64_t i = 0; i < partition.num_groups; i++) {
+      auto &group = partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        auto &slot = group.slots[j];
+        if (group.tags[j] >= 0 && pred(slot.key_hash)) {
+          auto *pair = slot.pair();
+          pairs->emplace_back(pair->first, pair->second, slot.key_hash);
+        }
+      }
+    }
+  }
+  return *cursor < kNumPartitions;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename F>
+uint64_t SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator,
+                      Lock>::remove_if(F &&pred) {
+  uint64_t num_removed = 0;
+
+  for (auto &partition : partitions_) {
+    ScopedLock l(&partition.lock);
+    for (uint64_t i = 0; i < partition.num_groups; i++) {
+      auto &group = partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        auto &slot = group.slots[j];
+        if (group.tags[j] >= 0 && pred(slot.key_hash)) {
+          erase(partition, &slot);
+          num_removed++;
+        }
+      }
+    }
+  }
+  return num_removed;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+uint64_t SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::size()
+    const {
+  uint64_t size = 0;
+  for (auto &partition : partitions_) {
+    size += rt::access_once(partition.num_full);
+  }
+  return size;
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <class Archive>
+inline void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::save(
+    Archive &ar) const {
+  ar(size());
+  for (auto &partition : partitions_) {
+    for (uint64_t i = 0; i < partition.num_groups; i++) {
+      auto &group = partition.groups[i];
+      for (uint32_t j = 0; j < kGroupSize; j++) {
+        if (group.tags[j] >= 0) {
+          auto &slot = group.slots[j];
+          ar(slot.key_hash, slot.pair()->first, slot.pair()->second);
+        }
+      }
+    }
+  }
+}
+
+template <size_t NSlots, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <class Archive>
+inline void SwissHashMap<NSlots, K, V, Hash, KeyEqual, Allocator, Lock>::load(
+    Archive &ar) {
+  uint64_t num_pairs;
+  ar(num_pairs);
+  for (uint64_t i = 0; i < num_pairs; i++) {
+    uint64_t key_hash;
+    K k;
+    V v;
+    ar(key_hash, k, v);
+    put_with_hash(std::move(k), std::move(v), key_hash);
+  }
+}
+
+}  // namespace nu
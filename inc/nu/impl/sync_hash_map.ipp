@@ -536,6 +536,76 @@ SyncHashMap<NBuckets, K, V, Hash, KeyEqual, Allocator,
   return hashes_and_keys;
 }
 
+template <size_t NBuckets, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename F>
+bool SyncHashMap<NBuckets, K, V, Hash, KeyEqual, Allocator, Lock>::
+    get_pairs_if(uint64_t *cursor, std::size_t max_num, F &&pred,
+                 std::vector<std::tuple<K, V, uint64_t>> *pairs) {
+  for (; *cursor < NBuckets && pairs->size() < max_num; ++*cursor) {
+    auto &bucket_head = bucket_heads_[*cursor];
+    auto *bucket_node = &bucket_head.node;
+    bucket_head.lock.lock();
+    if (bucket_node->pair) {
+      do {
+        if (pred(bucket_node->key_hash)) {
+          auto *pair = reinterpret_cast<Pair *>(bucket_node->pair);
+          pairs->emplace_back(pair->first, pair->second,
+                              bucket_node->key_hash);
+        }
+        bucket_node = bucket_node->next;
+      } while (bucket_node);
+    }
+    bucket_head.lock.unlock();
+  }
+  return *cursor < NBuckets;
+}
+
+template <size_t NBuckets, typename K, typename V, typename Hash,
+          typename KeyEqual, typename Allocator, typename Lock>
+template <typename F>
+uint64_t SyncHashMap<NBuckets, K, V, Hash, KeyEqual, Allocator,
+                     Lock>::remove_if(F &&pred) {
+  BucketNodeAllocator bucket_node_allocator;
+  auto allocator = Allocator();
+  uint64_t num_removed = 0;
+
+  for (size_t i = 0; i < NBuckets; i++) {
+    auto &bucket_head = bucket_heads_[i];
+    auto *bucket_node = &bucket_head.node;
+    BucketNode **prev_next = nullptr;
+    bucket_head.lock.lock();
+    while (bucket_node && bucket_node->pair) {
+      if (!pred(bucket_node->key_hash)) {
+        prev_next = &bucket_node->next;
+        bucket_node = bucket_node->next;
+        continue;
+      }
+      auto *pair = reinterpret_cast<Pair *>(bucket_node->pair);
+      if (!prev_next) {
+        // The head node is embedded, so the next one is moved into it and
+        // examined in the next iteration.
+        if (!bucket_node->next) {
+          bucket_node->pair = nullptr;
+        } else {
+          auto *next = bucket_node->next;
+          *bucket_node = *next;
+          bucket_node_allocator.deallocate(next, 1);
+        }
+      } else {
+        *prev_next = bucket_node->next;
+        bucket_node_allocator.deallocate(bucket_node, 1);
+        bucket_node = *prev_next;
+      }
+      std::destroy_at(pair);
+      allocator.deallocate(pair, 1);
+      num_removed++;
+    }
+    bucket_head.lock.unlock();
+  }
+  return num_removed;
+}
+
 template <size_t NBuckets, typename K, typename V, typename Hash,
           typename KeyEqual, typename Allocator, typename Lock>
 template <class Archive>
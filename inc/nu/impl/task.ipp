@@ -0,0 +1,132 @@
+#pragma once
+
+#include <exception>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/thread.hpp"
+
+namespace nu {
+
+namespace task_internal {
+
+template <typename T>
+inline PromiseBase<T>::PromiseBase() : promise_(Promise<T>::create()) {}
+
+template <typename T>
+inline std::suspend_never PromiseBase<T>::initial_suspend() noexcept {
+  return {};
+}
+
+// The frame is freed right after, which the waiters don't touch.
+template <typename T>
+inline std::suspend_never PromiseBase<T>::final_suspend() noexcept {
+  if (unlikely(exception_)) {
+    promise_->set_exception(std::move(exception_));
+  } else {
+    promise_->set_ready();
+  }
+  return {};
+}
+
+template <typename T>
+inline void PromiseBase<T>::unhandled_exception() {
+  exception_ = std::current_exception();
+}
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(this->promise_->get_future());
+}
+
+template <typename T>
+template <typename U>
+inline void TaskPromise<T>::return_value(U &&u) {
+  *this->promise_->data() = std::forward<U>(u);
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(promise_->get_future());
+}
+
+inline void TaskPromise<void>::return_void() {}
+
+}  // namespace task_internal
+
+template <typename F>
+inline FutureAwaiter<F>::FutureAwaiter(F &&future)
+    : future_(std::forward<F>(future)), raced_(false) {}
+
+template <typename F>
+inline bool FutureAwaiter<F>::await_ready() {
+  return future_.is_ready();
+}
+
+template <typename F>
+inline bool FutureAwaiter<F>::await_suspend(std::coroutine_handle<> handle) {
+  auto *header = get_runtime()->get_current_proclet_header();
+  future_.on_ready([this, handle, header] {
+    if (!raced_.exchange(true)) {
+      // Still within await_suspend(), which won't suspend the coroutine.
+      return;
+    }
+    if (header && get_runtime()->get_current_proclet_header() == header) {
+      handle.resume();
+    } else {
+      Thread([handle] { handle.resume(); }).detach();
+    }
+  });
+  return !raced_.exchange(true);
+}
+
+template <typename F>
+inline decltype(auto) FutureAwaiter<F>::await_resume() {
+  using Ret = decltype(future_.get());
+
+  if constexpr (std::is_reference_v<F> || std::is_void_v<Ret>) {
+    return future_.get();
+  } else {
+    return std::remove_reference_t<Ret>(std::move(future_.get()));
+  }
+}
+
+template <typename T, typename Deleter>
+inline FutureAwaiter<Future<T, Deleter> &> operator co_await(
+    Future<T, Deleter> &future) {
+  return FutureAwaiter<Future<T, Deleter> &>(future);
+}
+
+template <typename T, typename Deleter>
+inline FutureAwaiter<Future<T, Deleter>> operator co_await(
+    Future<T, Deleter> &&future) {
+  return FutureAwaiter<Future<T, Deleter>>(std::move(future));
+}
+
+template <typename T>
+inline Task<T>::Task(Future<T> &&future) : future_(std::move(future)) {}
+
+template <typename T>
+inline bool Task<T>::is_ready() {
+  return future_.is_ready();
+}
+
+template <typename T>
+inline decltype(auto) Task<T>::get() {
+  return future_.get();
+}
+
+template <typename T>
+inline Future<T> Task<T>::get_future() && {
+  return std::move(future_);
+}
+
+template <typename T>
+inline FutureAwaiter<Future<T> &> Task<T>::operator co_await() & {
+  return FutureAwaiter<Future<T> &>(future_);
+}
+
+template <typename T>
+inline FutureAwaiter<Future<T>> Task<T>::operator co_await() && {
+  return FutureAwaiter<Future<T>>(std::move(future_));
+}
+
+}  // namespace nu
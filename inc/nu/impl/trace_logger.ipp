@@ -17,13 +17,11 @@ inline std::pair<uint64_t, uint64_t> TraceLogger::add_trace(Fn &&fn) {
 }
 
 inline void TraceLogger::add_trace(uint64_t duration_tsc) {
-  int cpu_id = get_cpu();
-  auto bucket_id = std::min(
-      static_cast<uint32_t>(duration_tsc / cycles_per_us / kBucketIntervalUs),
-      kNumBuckets - 1);
-  ACCESS_ONCE(aligned_cnts_[cpu_id][bucket_id].cnt) =
-      aligned_cnts_[cpu_id][bucket_id].cnt + 1;
-  put_cpu();
+  histogram_.record_tsc(duration_tsc);
+}
+
+inline ConcurrentHdrHistogram &TraceLogger::get_histogram() {
+  return histogram_;
 }
 
 }  // namespace nu
@@ -0,0 +1,94 @@
+#pragma once
+
+extern "C" {
+#include <base/compiler.h>
+#include <base/time.h>
+#include <runtime/preempt.h>
+}
+
+#include "nu/runtime.hpp"
+#include "nu/utils/caladan.hpp"
+
+namespace nu {
+
+inline uint32_t Tracer::get_sample_interval() const {
+  return rt::access_once(sample_interval_);
+}
+
+inline bool Tracer::enabled() const {
+  return kEnableTracing && get_sample_interval();
+}
+
+inline TraceContext *Tracer::get_thread_ctx() {
+  return get_runtime()->caladan()->thread_get_trace_ctx();
+}
+
+inline double Tracer::now_us() const {
+  return epoch_us_ + static_cast<double>(rdtsc() - start_tsc) / cycles_per_us;
+}
+
+template <class Archive>
+inline void Tracer::save_call_ctx(Archive &oa) {
+  if constexpr (kEnableTracing) {
+    auto *ctx = likely(!enabled()) ? nullptr : get_thread_ctx();
+    bool sampled = ctx && ctx->trace_id;
+    oa << sampled;
+    if (unlikely(sampled)) {
+      oa << *ctx;
+    }
+  }
+}
+
+template <class Archive>
+inline bool Tracer::load_call_ctx(Archive &ia) {
+  if constexpr (kEnableTracing) {
+    bool sampled;
+    ia >> sampled;
+    if (unlikely(sampled)) {
+      ia >> *get_thread_ctx();
+    }
+    return sampled;
+  } else {
+    return false;
+  }
+}
+
+inline bool Tracer::sample_root() {
+  auto interval = get_sample_interval();
+  if (likely(!interval)) {
+    return false;
+  }
+  auto &calls = per_cores_[read_cpu()].calls;
+  if (likely(++calls < interval)) {
+    return false;
+  }
+  calls = 0;
+  return true;
+}
+
+inline TraceScope::TraceScope(TraceSpanKind kind, ProcletID caller,
+                              ProcletID callee, NodeIP peer_ip,
+                              bool may_start_trace) {
+  auto *tracer = get_runtime()->tracer();
+  active_ = false;
+  if (likely(!tracer->enabled())) {
+    return;
+  }
+  auto trace_id = tracer->get_thread_ctx()->trace_id;
+  active_ = trace_id || (may_start_trace && unlikely(tracer->sample_root()));
+  if (unlikely(active_)) {
+    span_.kind = kind;
+    span_.caller = caller;
+    span_.callee = callee;
+    span_.peer_ip = peer_ip;
+    begin();
+  }
+}
+
+inline TraceScope::~TraceScope() {
+  if (unlikely(active_)) {
+    end();
+  }
+}
+
+}  // namespace nu
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <net.h>
+#include <sync.h>
+#include <thread.h>
+
+#include "nu/commons.hpp"
+#include "nu/utils/caladan.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+struct ProcletHeader;
+
+enum MetricCounter : uint8_t {
+  kCallsIn,             // Served, for local and remote callers alike.
+  kLocalCallsOut,       // Issued to local proclets through the fast path.
+  kRemoteCallsOut,      // Issued to remote proclets through RPCs.
+  kBytesSerialized,     // Of the arguments and return values sent over RPCs.
+  kWrongClientRetries,  // RPCs resent since their callee had moved.
+  kNumMetricCounters
+};
+
+// Bumped on the core of the caller without any lock and summed up on reads,
+// which might therefore be slightly stale.
+class MetricCounters {
+ public:
+  MetricCounters();
+  void add(MetricCounter counter, uint64_t delta);
+  // Lets the caller bump several counters under one guard.
+  void add(const Caladan::PreemptGuard &g, MetricCounter counter,
+           uint64_t delta);
+  uint64_t get(MetricCounter counter) const;
+
+ private:
+  struct alignas(kCacheLineBytes) {
+    uint64_t cnts[kNumMetricCounters];
+  } per_cores_[kNumCores];
+};
+
+// The per-proclet counterpart, which trades the per-core slots for a compact
+// layout, as every proclet on the node has one.
+class ProcletMetricCounters {
+ public:
+  ProcletMetricCounters();
+  void add(MetricCounter counter, uint64_t delta);
+  uint64_t get(MetricCounter counter) const;
+
+ private:
+  std::atomic<uint64_t> cnts_[kNumMetricCounters];
+};
+
+// Bucket i counts the values within [2^(i-1), 2^i), and bucket 0 the zeros.
+class MetricHistogram {
+ public:
+  constexpr static uint32_t kNumBuckets = 32;
+  using Buckets = std::array<uint64_t, kNumBuckets>;
+
+  MetricHistogram();
+  void record(uint64_t val);
+  Buckets get_buckets() const;
+  uint64_t get_sum() const;
+
+ private:
+  struct alignas(kCacheLineBytes) {
+    uint64_t sum;
+    Buckets buckets;
+  } per_cores_[kNumCores];
+};
+
+// What a node reports to the controller. The counters are monotonic since the
+// node started, so they keep counting the proclets that have left it.
+struct NodeMetricsSnapshot {
+  uint64_t counters[kNumMetricCounters];
+  MetricHistogram::Buckets migration_downtime_us_buckets;
+  uint64_t migration_downtime_us_sum;
+  uint64_t num_proclets;
+  uint64_t heap_bytes;
+  float cpu_load;
+
+  void merge(const NodeMetricsSnapshot &o);
+  // Appends the snapshot in the Prometheus text format, with @labels (e.g.,
+  // "node=\"10.0.0.1\"") attached to every sample.
+  void render(std::ostringstream *oss, const std::string &labels) const;
+};
+
+// Serves the text rendered upon each request to whoever connects to the port,
+// e.g., curl or a Prometheus scraper. Each connection is served by its own
+// thread, so a client that never sends its request holds up no one else.
+class ScrapeEndpoint {
+ public:
+  constexpr static uint32_t kTCPListenBackLog = 16;
+  constexpr static uint32_t kMaxReqLen = 4096;
+
+  ScrapeEndpoint(uint16_t port, std::function<std::string()> render);
+  ~ScrapeEndpoint();
+
+ private:
+  std::function<std::string()> render_;
+  std::unique_ptr<rt::TcpQueue> tcp_queue_;
+  rt::Thread th_;
+  // The connections being served, aborted upon destruction.
+  std::set<rt::TcpConn *> conns_;
+  SpinLock spin_;
+  rt::WaitGroup wg_;
+
+  void serve(rt::TcpConn *c);
+};
+
+// The per-node registry. Besides the node-wide metrics, each proclet has its
+// own counters in its ProcletStats, which are reset whenever it lands on a
+// node.
+class MetricsRegistry {
+ public:
+  constexpr static uint16_t kPort = 9200;
+
+  MetricsRegistry();
+  // Charges @delta to the proclet of @header, if any, and to this node. The
+  // caller must prevent the proclet from being migrated.
+  void record(ProcletHeader *header, MetricCounter counter,
+              uint64_t delta = 1);
+  // Charges a fast-path call to both of its ends at once.
+  void record_local_call(ProcletHeader *caller_header,
+                         ProcletHeader *callee_header);
+  void record_migration(uint64_t downtime_us);
+  // Only aggregates the cheap per-proclet gauges.
+  NodeMetricsSnapshot take_snapshot();
+  // The node-wide metrics followed by the per-proclet ones.
+  std::string render();
+
+ private:
+  MetricCounters counters_;
+  MetricHistogram migration_downtimes_us_;
+  std::unique_ptr<ScrapeEndpoint> endpoint_;
+};
+
+// The controller-side view, which merges the latest snapshots of all nodes.
+class ClusterMetrics {
+ public:
+  constexpr static uint16_t kPort = 9201;
+
+  ClusterMetrics();
+  void update(NodeIP ip, const NodeMetricsSnapshot &snapshot);
+  // The cluster-wide metrics followed by the per-node ones.
+  std::string render();
+
+ private:
+  std::map<NodeIP, NodeMetricsSnapshot> snapshots_;
+  SpinLock spin_;
+  std::unique_ptr<ScrapeEndpoint> endpoint_;
+};
+
+}  // namespace nu
+
+#include "nu/impl/metrics.ipp"
@@ -2,9 +2,13 @@
 
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <span>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -19,6 +23,9 @@ extern "C" {
 #include "nu/ctrl_client.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/utils/archive_pool.hpp"
+#include "nu/utils/dirty_page_tracker.hpp"
+#include "nu/utils/hdr_histogram.hpp"
+#include "nu/utils/missing_page_handler.hpp"
 #include "nu/utils/rpc.hpp"
 #include "nu/utils/slab.hpp"
 
@@ -38,6 +45,13 @@ enum MigratorTCPOp_t {
   kDisablePoll,
   kRegisterCallBack,
   kDeregisterCallBack,
+  kCopyProcletExtents,
+  kCommitPreCopy,
+  kAbortPreCopy,
+  kPostCopyProclet,
+  kPostCopySession,
+  kCommitSparseCopy,
+  kCopyProcletCompressedExtents,
 };
 
 struct RPCReqForward {
@@ -49,6 +63,15 @@ struct RPCReqForward {
   uint8_t payload[0];
 };
 
+// Followed by num_ids ProcletID(s) that have just moved from src_ip to dest_ip.
+struct RPCReqPushLocations {
+  RPCReqType rpc_type = kPushLocations;
+  NodeIP src_ip;
+  NodeIP dest_ip;
+  uint32_t num_ids;
+  ProcletID ids[0];
+} __attribute__((packed));
+
 struct RPCReqMigrateThreadAndRetVal {
   RPCReqType rpc_type = kMigrateThreadAndRetVal;
   RPCReturnCode (*handler)(ProcletHeader *, void *, uint64_t, uint8_t *);
@@ -62,6 +85,35 @@ struct ProcletMigrationTask {
   ProcletHeader *header;
   uint64_t capacity;
   uint64_t size;
+  // The node hosting most of the proclet's peers, or 0 if none is preferred.
+  NodeIP peer_ip;
+};
+
+struct PreCopyState {
+  // The number of kCopyProcletExtents messages sent so far.
+  uint64_t num_copy_tasks;
+  // Whether the extents are sent compressed.
+  bool compress;
+  // The heap bytes below this address have been sent at least once.
+  uint64_t sent_end;
+  // The range [proclet_header, tracked_end) is being dirty-tracked.
+  uint64_t tracked_end;
+};
+
+struct PostCopyChunk {
+  uint64_t start_addr;
+  uint64_t len;
+};
+
+struct PostCopySession {
+  MissingPageHandler handler;
+  // Whether the destination has finished loading the proclet metadata.
+  bool loaded;
+  // Whether the source died before all pages arrived.
+  bool lost;
+
+  PostCopySession(VAddrRange range)
+      : handler(range), loaded(false), lost(false) {}
 };
 
 class MigratorConnManager;
@@ -107,8 +159,44 @@ class Migrator {
   constexpr static uint32_t kPort = 8002;
   constexpr static float kMigrationThrottleGBs = 0;
   constexpr static uint32_t kMigrationDelayUs = 0;
+  // Pre-copy keeps the proclet running while its heap is being copied, and
+  // only pauses it for transmitting the last (small) set of dirty pages.
+  constexpr static bool kEnablePreCopy = false;
+  constexpr static uint32_t kMaxPreCopyRounds = 8;
+  constexpr static uint64_t kPreCopyStopBytes = 4 * kOneMB;
+  // Pages are assigned to connections by stripes so that the newer copy of a
+  // page never overtakes the older one.
+  constexpr static uint64_t kPreCopyStripeSize = kOneMB;
+  // Post-copy (used under memory pressure only) resumes the proclet at the
+  // destination right after its metadata has been transmitted. The heap pages
+  // are then pushed in the background or fetched on demand upon faults, so
+  // that the source memory gets released gradually.
+  constexpr static bool kEnablePostCopy = false;
+  constexpr static uint64_t kPostCopyChunkSize = 256 * 1024;
+  // The source is considered dead if nothing arrives within this period.
+  constexpr static uint64_t kPostCopySourceTimeoutUs = 2 * kOneSecond;
+
+  // Stop-and-copy skips the heap pages that hold nothing but large runs of
+  // free objects, which the destination leaves unpopulated.
+  constexpr static bool kEnableSparseCopy = true;
+  constexpr static uint64_t kMinSparseExtentBytes = kOneMB;
+  // Heap copies get compressed (with zero pages elided) by the transmitting
+  // threads if a probe of the heap shows that they'd outpace the link. The
+  // link rate is measured from the uncompressed copies.
+  constexpr static bool kEnableCompression = true;
+  constexpr static uint64_t kMinCompressionHeapSize = 4 * kOneMB;
+  constexpr static uint32_t kNumCompressionProbeBlocks = 8;
+  constexpr static uint64_t kMinLinkRateSampleBytes = kOneMB;
+  constexpr static float kLinkRateEWMAWeight = 0.25;
+
+  // The new locations of the migrated proclets are pushed to the nodes that
+  // recently invoked them, instead of letting them find out by failed
+  // invocations.
+  constexpr static bool kEnableLocationPush = true;
 
   static_assert(kTransmitProcletNumThreads > 1);
+  static_assert(kPreCopyStripeSize % kPageSize == 0);
+  static_assert(kPostCopyChunkSize % kPageSize == 0);
 
   Migrator();
   ~Migrator();
@@ -119,6 +207,22 @@ class Migrator {
                                   uint64_t payload_len, const void *payload,
                                   ArchivePool<>::IASStream *ia_sstream);
   void forward_to_client(RPCReqForward &req);
+  void update_pushed_locations(const RPCReqPushLocations &req);
+  void set_pre_copy(bool enable);
+  bool is_pre_copy_enabled() const;
+  void set_post_copy(bool enable);
+  bool is_post_copy_enabled() const;
+  void set_sparse_copy(bool enable);
+  bool is_sparse_copy_enabled() const;
+  void set_compression(bool enable);
+  bool is_compression_enabled() const;
+  // Skips the probe and compresses whenever compression is enabled.
+  void set_forced_compression(bool enable);
+  bool is_compression_forced() const;
+  void set_location_push(bool enable);
+  bool is_location_push_enabled() const;
+  // How long the proclets migrated away were paused, in nanoseconds.
+  ConcurrentHdrHistogram &get_downtime_histogram();
   template <typename RetT>
   static void migrate_thread_and_ret_val(
       RPCReturnBuffer &&ret_val_buf, ProcletID dest_id, RetT *dest_ret_val_ptr,
@@ -136,34 +240,90 @@ class Migrator {
   bool callback_triggered_;
   std::unordered_set<uint32_t> delayed_srv_ips_;
   rt::Thread th_;
+  DirtyPageTracker dirty_page_tracker_;
+  bool pre_copy_;
+  bool post_copy_;
+  bool sparse_copy_;
+  bool compression_;
+  bool forced_compression_;
+  bool location_push_;
+  // In bytes per microsecond.
+  float link_rate_;
+  bool link_rate_measured_;
+  rt::Spin post_copy_spin_;
+  std::unordered_map<ProcletHeader *, std::unique_ptr<PostCopySession>>
+      post_copy_sessions_;
+  ConcurrentHdrHistogram downtime_histogram_;
 
   void run_background_loop();
   void handle_copy_proclet(rt::TcpConn *c);
+  void handle_copy_proclet_extents(rt::TcpConn *c, bool compressed);
+  void handle_post_copy_proclet(rt::TcpConn *c);
+  bool handle_post_copy_session(rt::TcpConn *c);
   void handle_load(rt::TcpConn *c);
   void handle_register_callback(rt::TcpConn *c);
   void handle_deregister_callback(rt::TcpConn *c);
   VAddrRange load_stack_cluster_mmap_task(rt::TcpConn *c);
   void transmit(rt::TcpConn *c, ProcletHeader *proclet_header,
-                struct list_head *head);
+                struct list_head *head,
+                std::optional<PreCopyState> &pre_copy_state, bool post_copy,
+                bool compress);
   void update_proclet_location(rt::TcpConn *c, ProcletHeader *proclet_header);
+  void push_locations(NodeIP dest_ip,
+                      std::map<NodeIP, std::vector<ProcletID>> &&caller_ids);
   void transmit_stack_cluster_mmap_task(rt::TcpConn *c);
   void transmit_proclet(rt::TcpConn *c, ProcletHeader *proclet_header);
+  uint64_t transmit_proclet_extents(rt::TcpConn *c,
+                                    ProcletHeader *proclet_header,
+                                    const std::vector<VAddrRange> &extents,
+                                    bool compress);
+  void transmit_compressed_extents(rt::TcpConn *c,
+                                   ProcletHeader *proclet_header,
+                                   const std::vector<VAddrRange> &extents);
+  void transmit_sparse_proclet(rt::TcpConn *c, ProcletHeader *proclet_header,
+                               bool compress);
+  bool should_compress(ProcletHeader *proclet_header);
+  void update_link_rate(uint64_t len, uint64_t us);
+  std::optional<PreCopyState> pre_copy_proclet(rt::TcpConn *c,
+                                               ProcletHeader *proclet_header,
+                                               bool compress);
+  std::vector<VAddrRange> collect_dirty_extents(ProcletHeader *proclet_header,
+                                                PreCopyState *state);
+  void commit_pre_copy(rt::TcpConn *c, ProcletHeader *proclet_header,
+                       PreCopyState *state);
+  VAddrRange get_post_copy_lazy_range(ProcletHeader *proclet_header);
+  void transmit_post_copy_proclet(rt::TcpConn *c,
+                                  ProcletHeader *proclet_header);
+  void push_post_copy_proclet(uint32_t dest_ip, ProcletHeader *proclet_header);
+  bool serve_post_copy_faults(rt::TcpConn *c, PostCopySession *session);
+  void finish_post_copy_session(ProcletHeader *proclet_header, bool lost);
+  void mark_proclet_loaded(ProcletHeader *proclet_header);
+  void abort_pre_copy(rt::TcpConn *c, ProcletHeader *proclet_header,
+                      const PreCopyState &state);
   void transmit_proclet_migration_tasks(
-      rt::TcpConn *c, bool has_mem_pressure,
+      rt::TcpConn *c, bool has_mem_pressure, bool post_copy,
       const std::vector<ProcletMigrationTask> &tasks);
   void transmit_mutexes(rt::TcpConn *c, std::vector<Mutex *> mutexes);
   void transmit_condvars(rt::TcpConn *c, std::vector<CondVar *> condvars);
   void transmit_time(rt::TcpConn *c, Time *time);
   void transmit_threads(rt::TcpConn *c, const std::vector<thread_t *> &threads);
   void transmit_one_thread(rt::TcpConn *c, thread_t *thread);
+  // Keeps the proclet from being destructed without stopping it, unlike
+  // try_mark_proclet_migrating(), so that its heap can be read while it runs.
+  bool try_pin_proclet(ProcletHeader *proclet_header);
+  void unpin_proclet(ProcletHeader *proclet_header);
   bool try_mark_proclet_migrating(ProcletHeader *proclet_header);
   void load(rt::TcpConn *c);
   bool load_proclet(rt::TcpConn *c, ProcletHeader *proclet_header,
                     uint64_t capacity);
-  std::pair<bool, std::vector<ProcletMigrationTask>>
+  void wait_for_copy_tasks(ProcletHeader *proclet_header,
+                           int64_t num_copy_tasks);
+  std::tuple<bool, bool, std::vector<ProcletMigrationTask>>
   load_proclet_migration_tasks(rt::TcpConn *c);
-  void populate_proclets(std::vector<ProcletMigrationTask> &tasks);
+  void populate_proclets(std::vector<ProcletMigrationTask> &tasks,
+                         bool post_copy);
   void depopulate_proclet(ProcletHeader *proclet_header);
+  void depopulate_free_runs(ProcletHeader *proclet_header);
   void load_mutexes(rt::TcpConn *c, ProcletHeader *proclet_header);
   void load_condvars(rt::TcpConn *c, ProcletHeader *proclet_header);
   void load_time_and_mark_proclet_present(rt::TcpConn *c,
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+#include "nu/call_graph.hpp"
+#include "nu/commons.hpp"
+#include "nu/ctrl.hpp"
+
+namespace nu {
+
+struct PlacementRequest {
+  uint64_t capacity;
+  // The proclet that issues the allocation, kNullProcletID if none.
+  ProcletID creator_id;
+};
+
+// Decides which node hosts a newly allocated proclet. Invoked with the
+// controller lock held.
+class PlacementPolicy {
+ public:
+  virtual ~PlacementPolicy() = default;
+  // Returns 0 if no node is eligible.
+  virtual NodeIP select(LPInfo *info, const PlacementRequest &req) = 0;
+};
+
+class RoundRobinPlacementPolicy : public PlacementPolicy {
+ public:
+  NodeIP select(LPInfo *info, const PlacementRequest &req) override;
+};
+
+// Co-locates the new proclet with the proclets its creator talks to the most,
+// i.e., the creator itself and the creator's peers on the call graph. Among the
+// nodes of similar affinity, it bin-packs by CPU and then by memory, i.e., it
+// picks the node that is left with the least free resource.
+class AffinityPlacementPolicy : public PlacementPolicy {
+ public:
+  // A node qualifies as co-locatable if its affinity is at least this fraction
+  // of the maximum one.
+  constexpr static float kAffinityTolerance = 0.9;
+  // The resource assumed to be taken by a new proclet; it's deducted from the
+  // chosen node until its next report so that bursty allocations spread out.
+  constexpr static float kEstimatedCores = 0.5;
+  constexpr static uint64_t kMaxEstimatedMemMBs = 1024;
+
+  AffinityPlacementPolicy(CallGraph *call_graph,
+                          const ProcletLocationTable *proclet_locations);
+  NodeIP select(LPInfo *info, const PlacementRequest &req) override;
+
+ private:
+  CallGraph *call_graph_;
+  const ProcletLocationTable *proclet_locations_;
+  // Used when no node has got enough resource for the new proclet.
+  RoundRobinPlacementPolicy fallback_;
+
+  std::map<NodeIP, float> compute_affinities(ProcletID creator_id);
+};
+
+}  // namespace nu
@@ -1,6 +1,7 @@
 #include <atomic>
 #include <climits>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <set>
 
@@ -10,6 +11,7 @@ extern "C" {
 #include <net.h>
 
 #include "nu/migrator.hpp"
+#include "nu/utils/peer_traffic.hpp"
 
 namespace nu {
 
@@ -18,6 +20,8 @@ using ResourcePressureInfo = struct resource_pressure_info;
 struct AuxHandlerState {
   MigratorConn conn;
   std::vector<iovec> tcp_write_task;
+  // Takes precedence over tcp_write_task if set.
+  std::move_only_function<void(rt::TcpConn *)> tcp_fn_task;
   bool pause = false;
   bool task_pending = false;
   bool done = false;
@@ -25,13 +29,22 @@ struct AuxHandlerState {
 
 struct Utility {
   Utility();
-  Utility(ProcletHeader *proclet_header, uint64_t mem_size, float cpu_load);
+  Utility(ProcletHeader *proclet_header, uint64_t mem_size, float cpu_load,
+          const PeerTrafficSummary &traffic);
 
   constexpr static uint32_t kFixedCostUs = 25;
   constexpr static uint32_t kNetBwGbps = 100;
+  // Otherwise, proclets get ranked and placed regardless of their peers.
+  constexpr static bool kEnableTrafficAwareness = true;
+  // How much the change in call locality scales the utility, in [0, 1).
+  constexpr static float kTrafficWeight = 0.5;
   ProcletHeader *header;
   float mem_pressure_util;
   float cpu_pressure_util;
+
+  // Returns the node that the proclet should be moved toward, or 0 if moving
+  // it away from this node turns more local calls into RPCs than the reverse.
+  static NodeIP get_peer_ip(const PeerTrafficSummary &traffic);
 };
 
 class PressureHandler {
@@ -49,6 +62,9 @@ class PressureHandler {
   void update_aux_handler_state(uint32_t handler_id, MigratorConn &&conn);
   void dispatch_aux_tcp_task(uint32_t handler_id,
                              std::vector<iovec> &&tcp_write_task);
+  void dispatch_aux_tcp_fn_task(
+      uint32_t handler_id,
+      std::move_only_function<void(rt::TcpConn *)> &&tcp_fn_task);
   void dispatch_aux_pause_task(uint32_t handler_id);
   void mock_set_pressure();
   void mock_clear_pressure();
@@ -3,10 +3,14 @@
 #include <cstdint>
 #include <optional>
 #include <functional>
+#include <span>
 
 #include "nu/commons.hpp"
 #include "nu/type_traits.hpp"
+#include "nu/utils/archive_pool.hpp"
 #include "nu/utils/future.hpp"
+#include "nu/utils/rpc.hpp"
+#include "nu/utils/task.hpp"
 
 namespace nu {
 
@@ -37,6 +41,8 @@ class Proclet {
   operator bool() const;
   bool operator==(const Proclet &) const;
   ProcletID get_id() const;
+  // The invocations below throw ProcletLost if the proclet has been lost; the
+  // asynchronous ones do so from Future::get().
   template <bool MigrEn = true, bool CPUMon = true, bool CPUSamp = true,
             typename RetT, typename... S0s, typename... S1s>
   Future<RetT> run_async(
@@ -55,6 +61,17 @@ class Proclet {
             typename RetT, typename... A0s, typename... A1s>
   RetT run(RetT (T::*md)(A0s...),
            A1s &&... args) requires ValidInvocationTypes<RetT, A0s...>;
+  // Awaitable counterparts of run_async(), for coroutines.
+  template <bool MigrEn = true, bool CPUMon = true, bool CPUSamp = true,
+            typename RetT, typename... S0s, typename... S1s>
+  Task<RetT> run_co(
+      RetT (*fn)(T &, S0s...),
+      S1s &&... states) requires ValidInvocationTypes<RetT, S0s...>;
+  template <bool MigrEn = true, bool CPUMon = true, bool CPUSamp = true,
+            typename RetT, typename... A0s, typename... A1s>
+  Task<RetT> run_co(
+      RetT (T::*md)(A0s...),
+      A1s &&... args) requires ValidInvocationTypes<RetT, A0s...>;
   void reset();
   std::optional<Future<void>> reset_async();
   WeakProclet<T> get_weak() const;
@@ -75,8 +92,11 @@ class Proclet {
   template <typename U>
   friend class RemPtr;
   template <typename K, typename V, typename Hash, typename KeyEqual,
-            uint64_t NumBuckets>
+            uint64_t NumBuckets,
+            template <size_t, typename...> class Backend>
   friend class DistributedHashTable;
+  template <class Container>
+  friend class ShardedDataStructure;
   friend class DistributedMemPool;
   friend int runtime_main_init(
       int argc, char **argv,
@@ -89,6 +109,29 @@ class Proclet {
   template <typename RetT, typename... S1s>
   static RetT invoke_remote_with_ret(MigrationGuard &&caller_guard,
                                      ProcletID id, S1s &&... states);
+  template <typename RetT, typename... S1s>
+  static Future<RetT> invoke_remote_async(MigrationGuard &&caller_guard,
+                                          ProcletID id, S1s &&... states);
+  template <typename RetT>
+  static void call_remote_async(ProcletID id,
+                                ArchivePool<>::OASStream *oa_sstream,
+                                ProcletID caller_id, Promise<RetT> *promise);
+  // Completes @promise, which lives in the heap of proclet @caller_id, from
+  // within that proclet, wherever it has been migrated to.
+  template <typename RetT>
+  static void complete_in_caller(ProcletID caller_id, Promise<RetT> *promise,
+                                 bool lost, RPCReturnBuffer &&return_buf);
+  template <typename RetT>
+  static void complete_locally(MigrationGuard *caller_guard, ErasedType *,
+                               Promise<RetT> *promise, bool lost,
+                               RPCReturnBuffer *return_buf);
+  template <typename RetT>
+  static void load_ret_val(Promise<RetT> *promise, std::span<std::byte> buf);
+  template <typename RetT>
+  static void settle(Promise<RetT> *promise, bool lost);
+  // Resumes the caller, wherever it has been migrated to, by throwing
+  // ProcletLost.
+  [[noreturn]] static void throw_lost(ProcletHeader *caller_header);
   template <typename... As>
   static Proclet __create(bool pinned, uint64_t capacity, NodeIP ip_hint,
                           As &&... args);
@@ -138,6 +181,8 @@ class WeakProclet : public Proclet<T> {
   void load(Archive &ar);
 
  private:
+  template <typename U>
+  friend class Proclet;
   template <typename U>
   friend class RemPtr;
   friend class Runtime;
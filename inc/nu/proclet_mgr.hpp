@@ -16,11 +16,14 @@ extern "C" {
 #include <sync.h>
 
 #include "nu/commons.hpp"
+#include "nu/metrics.hpp"
 #include "nu/utils/blocked_syncer.hpp"
+#include "nu/utils/caller_set.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/counter.hpp"
 #include "nu/utils/cpu_load.hpp"
 #include "nu/utils/mutex.hpp"
+#include "nu/utils/peer_traffic.hpp"
 #include "nu/utils/rcu_lock.hpp"
 #include "nu/utils/slab.hpp"
 #include "nu/utils/spin_lock.hpp"
@@ -33,6 +36,10 @@ enum ProcletStatus {
   kPopulating,
   kDepopulating,
   kCleaning,
+  // Migrated out in the post-copy mode, still serving its heap pages.
+  kPostCopying,
+  // Its post-copy source died before the heap fully arrived.
+  kLost,
   kMigrating,
   kPresent,
   kDestructing,
@@ -42,6 +49,23 @@ enum ProcletStatus {
 // even if the proclets are not present locally.
 extern uint8_t proclet_statuses[kMaxNumProclets];
 extern SpinLock proclet_migration_spin[kMaxNumProclets];
+// The node that each proclet has last been migrated to from this node, 0 if it
+// is present or has never left. Lets stale callers get redirected.
+extern NodeIP proclet_forward_ips[kMaxNumProclets];
+
+// The statistics that a proclet gathers on a node. Kept out of its header and
+// only allocated from the runtime slab once recorded, as most proclets never
+// get them; they are dropped once the proclet leaves the node.
+struct ProcletStats {
+  // Used for monitoring the invocations exchanged with each node.
+  PeerTraffic peer_traffic;
+
+  // The remote nodes to notify when the proclet migrates.
+  CallerSet callers;
+
+  // Used for reporting the metrics since the proclet landed on this node.
+  ProcletMetricCounters metrics;
+};
 
 struct ProcletHeader {
   ~ProcletHeader() = default;
@@ -49,9 +73,14 @@ struct ProcletHeader {
   // Used for monitoring cpu load.
   CPULoad cpu_load;
 
+  // Null until the first statistic is recorded.
+  std::atomic<ProcletStats *> stats;
+
   // Max heap size.
   uint64_t populate_size;
   uint64_t capacity;
+  // Whether the heap is backed by transparent huge pages.
+  bool huge_pages;
 
   // For synchronization.
   SpinLock spin_lock;
@@ -77,6 +106,9 @@ struct ProcletHeader {
   // Ref cnt related.
   int ref_cnt;
 
+  // Counted across nodes, as it's migrated along with the proclet.
+  uint64_t num_migrations;
+
   // Heap mem allocator. Must be the last field.
   Counter slab_ref_cnt;
   SlabAllocator slab;
@@ -85,16 +117,33 @@ struct ProcletHeader {
   uint64_t total_mem_size() const;
   uint64_t heap_size() const;
   uint64_t stack_size() const;
+  uint64_t page_size() const;
   uint8_t &status();
   uint8_t status() const;
   SpinLock &migration_spin();
+  NodeIP &forward_ip();
   VAddrRange range() const;
+  // Allocates the stats if absent.
+  ProcletStats *get_stats();
+  // Returns nullptr if nothing has been recorded yet.
+  const ProcletStats *peek_stats() const;
+
+ private:
+  ProcletStats *alloc_stats();
 };
 
 class ProcletManager {
  public:
+  // Proclets of large capacity classes get heaps backed by transparent huge
+  // pages to cut TLB misses and page population costs. Their heaps are then
+  // populated and depopulated in units of huge pages.
+  constexpr static bool kEnableHugePageHeaps = true;
+  constexpr static uint64_t kMinHugePageHeapSize = 1ULL << 32;
+
   ProcletManager();
 
+  // Must be invoked before the heap gets touched.
+  static void prepare(void *proclet_base, uint64_t capacity);
   static void setup(void *proclet_base, uint64_t capacity, bool migratable,
                     bool from_migration);
   void cleanup(void *proclet_base, bool for_migration);
@@ -104,6 +153,7 @@ class ProcletManager {
   void insert(void *proclet_base);
   bool remove_for_migration(void *proclet_base);
   bool remove_for_destruction(void *proclet_base);
+  bool remove_for_loss(void *proclet_base);
   std::vector<void *> get_all_proclets();
   uint64_t get_mem_usage();
   uint32_t get_num_present_proclets();
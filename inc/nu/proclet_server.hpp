@@ -11,6 +11,7 @@ extern "C" {
 
 #include "nu/utils/archive_pool.hpp"
 #include "nu/utils/counter.hpp"
+#include "nu/utils/hdr_histogram.hpp"
 #include "nu/utils/rpc.hpp"
 #include "nu/utils/trace_logger.hpp"
 
@@ -23,6 +24,8 @@ class ProcletServer {
   ProcletServer();
   ~ProcletServer();
   netaddr get_addr() const;
+  // The latencies of serving the calls from remote nodes.
+  ConcurrentHdrHistogram &get_latency_histogram();
   template <typename Cls>
   static void update_ref_cnt(ArchivePool<>::IASStream *ia_sstream,
                              RPCReturner *returner);
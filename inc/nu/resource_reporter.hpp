@@ -10,6 +10,8 @@ namespace nu {
 
 class ResourceReporter {
  public:
+  constexpr static uint64_t kMetricsReportIntervalUs = kOneSecond;
+
   ResourceReporter();
   ~ResourceReporter();
   std::vector<std::pair<NodeIP, Resource>> get_global_free_resources();
@@ -19,6 +21,7 @@ class ResourceReporter {
   rt::Thread th_;
   std::vector<std::pair<NodeIP, Resource>> global_free_resources_;
   rt::Spin spin_;
+  uint64_t last_metrics_report_us_;
 
   void report_resource();
 };
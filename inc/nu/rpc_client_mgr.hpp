@@ -8,6 +8,7 @@
 #include <sync.h>
 
 #include "nu/runtime_alloc.hpp"
+#include "nu/utils/hdr_histogram.hpp"
 #include "nu/utils/rcu_hash_map.hpp"
 #include "nu/utils/rpc.hpp"
 
@@ -23,7 +24,15 @@ class RPCClientMgr {
   NodeIP get_ip_by_proclet_id(ProcletID proclet_id);
   void remove_by_ip(NodeIP ip);
   void update_cache(ProcletID proclet_id, NodeIP ip);
-  void invalidate_cache(ProcletID proclet_id, RPCClient *old_client);
+  // Updates the cache unless it has already moved past @stale_ip.
+  void update_cache_if_stale(ProcletID proclet_id, NodeIP stale_ip,
+                             NodeIP ip);
+  // Handles the kErrWrongClient response @resp of @old_client by following
+  // the redirection it carries, or by invalidating the cache if there's none.
+  void invalidate_cache(ProcletID proclet_id, RPCClient *old_client,
+                        const RPCReturnBuffer &resp);
+  // The RTTs of the calls made through all the clients, in nanoseconds.
+  ConcurrentHdrHistogram &get_rtt_histogram();
 
  private:
   union NodeInfo {  // Supports atomic assignment.
@@ -45,6 +54,8 @@ class RPCClientMgr {
   rt::Mutex node_info_mutexes_[get_max_slab_id() + 1];
   std::unordered_map<NodeIP, NodeID> node_ip_to_node_id_map_;
   NodeID next_node_id_;
+  // Outlives the clients, whose flows record into it.
+  ConcurrentHdrHistogram rtt_histogram_;
   std::unique_ptr<RPCClient>
       rpc_clients_[std::numeric_limits<NodeID>::max() + 1];
   rt::Mutex mutex_;
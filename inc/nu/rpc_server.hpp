@@ -13,17 +13,22 @@ enum RPCReqEnum {
   kReserveConns,
   kForward,
   kMigrateThreadAndRetVal,
+  kPushLocations,
   // Controller
   kRegisterNode,
   kAllocateProclet,
+  kAllocateProclets,
   kDestroyProclet,
   kResolveProclet,
+  kResolveProclets,
   kAcquireMigrationDest,
   kAcquireNode,
   kReleaseNode,
   kUpdateLocation,
   kReportFreeResource,
   kDestroyLP,
+  kReportCallGraph,
+  kReportMetrics,
   // Proclet server,
   kProcletCall,
   kGCStack,
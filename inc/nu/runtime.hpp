@@ -28,6 +28,9 @@ class Migrator;
 class RPCServer;
 class PressureHandler;
 class ResourceReporter;
+class CallGraphSampler;
+class Tracer;
+class MetricsRegistry;
 template <typename T>
 class WeakProclet;
 class MigrationGuard;
@@ -61,6 +64,9 @@ class Runtime {
   ControllerServer *controller_server();
   ProcletServer *proclet_server();
   ResourceReporter *resource_reporter();
+  CallGraphSampler *call_graph_sampler();
+  Tracer *tracer();
+  MetricsRegistry *metrics();
   Caladan *caladan();
   void reserve_conns(uint32_t ip);
   void init_base();
@@ -104,7 +110,8 @@ class Runtime {
   void send_rpc_resp_ok(ArchivePool<>::OASStream *oa_sstream,
                         ArchivePool<>::IASStream *ia_sstream,
                         RPCReturner *returner);
-  void send_rpc_resp_wrong_client(RPCReturner *returner);
+  void send_rpc_resp_wrong_client(ProcletHeader *proclet_header,
+                                  RPCReturner *returner);
   void shutdown(RPCReturner *returner);
 
  private:
@@ -120,6 +127,9 @@ class Runtime {
   ProcletManager *proclet_manager_;
   PressureHandler *pressure_handler_;
   ResourceReporter *resource_reporter_;
+  CallGraphSampler *call_graph_sampler_;
+  Tracer *tracer_;
+  MetricsRegistry *metrics_;
   StackManager *stack_manager_;
 
   friend int runtime_main_init(int, char **, std::function<void(int, char **)>);
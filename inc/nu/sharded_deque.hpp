@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "nu/sharded_queue.hpp"
+
+namespace nu {
+
+// The values of a ShardedDeque shard, keyed by their positions relative to the
+// first value pushed, so the ones pushed to the front get negative keys.
+template <typename T>
+class DequeImpl : public QueueImpl<T, int64_t> {
+ public:
+  using Base = QueueImpl<T, int64_t>;
+  using Key = Base::Key;
+  using Val = Base::Val;
+
+  using Base::Base;
+  std::size_t push_front(Val v) {
+    this->data_.push_front(std::move(v));
+    this->l_key_--;
+    return this->data_.size();
+  }
+  Val back() const { return this->data_.back(); }
+  // The values are returned in the order they are popped.
+  std::vector<Val> try_pop_back(std::size_t num) {
+    auto &data = this->data_;
+    num = std::min(num, data.size());
+    std::vector<Val> vals(std::make_move_iterator(data.rbegin()),
+                          std::make_move_iterator(data.rbegin() + num));
+    data.erase(data.end() - num, data.end());
+    return vals;
+  }
+};
+
+template <typename T>
+using ShardedDeque = ShardedDataStructure<GeneralLockedContainer<DequeImpl<T>>>;
+
+template <typename T>
+ShardedDeque<T> make_sharded_deque(
+    std::size_t max_shard_size = ShardedDeque<T>::kDefaultMaxShardSize,
+    bool pinned = false) {
+  return make_sharded_ds<GeneralLockedContainer<DequeImpl<T>>>(max_shard_size,
+                                                               pinned);
+}
+
+}  // namespace nu
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "nu/container.hpp"
+#include "nu/proclet.hpp"
+#include "nu/utils/cond_var.hpp"
+#include "nu/utils/mutex.hpp"
+#include "nu/utils/rcu_lock.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+// A proclet holding a contiguous key range of a sharded data structure. Every
+// shard is an incarnation identified by a sequence number, which changes once
+// a drained shard is recycled, so that invocations routed by stale shard maps
+// are rejected. A shard accepts pushes at an end only if it has no neighbour
+// there, i.e., it is the head or the tail of the data structure.
+template <GeneralContainerBased Container>
+class GeneralShard {
+ public:
+  using Key = Container::Key;
+  using Val = Container::Val;
+  using Impl = Container::Implementation;
+  // The values popped and whether this shard has been drained, i.e., it is
+  // empty and its neighbour in the popped direction should be used instead.
+  using PopResult = std::pair<std::vector<Val>, bool>;
+  // A shard is full once this fraction of its heap has been used, even if it
+  // holds fewer than max_shard_size values.
+  constexpr static float kShardGrowHeapUsageRatio = 0.75;
+
+  GeneralShard(uint64_t seq, Key l_key, bool has_prev, bool has_next,
+               std::size_t max_shard_size);
+  std::size_t size() const;
+  // The calls below are rejected if @seq is not the current incarnation.
+  bool push_back(uint64_t seq, std::vector<Val> &vals)
+    requires PushBackAble<Impl>;
+  // Pushes @vals one by one, so the last one ends up at the front.
+  bool push_front(uint64_t seq, std::vector<Val> &vals)
+    requires PushFrontAble<Impl>;
+  std::optional<PopResult> try_pop_front(uint64_t seq, std::size_t num)
+    requires TryPopFrontAble<Impl>;
+  std::optional<PopResult> try_pop_back(uint64_t seq, std::size_t num)
+    requires TryPopBackAble<Impl>;
+  // Also rejected if @k is owned by a neighbour. Returns std::nullopt inside
+  // if @k is out of the data structure's range.
+  std::optional<std::optional<Val>> get(uint64_t seq, Key k)
+    requires SubscriptAble<Impl>;
+  std::optional<bool> set(uint64_t seq, Key k, Val v)
+    requires SubscriptAble<Impl>;
+  template <typename... S0s, typename... S1s>
+  bool for_all(uint64_t seq, void (*fn)(const Key &key, Val &val, S0s...),
+               S1s &&... states);
+  template <typename RetT, typename... S0s, typename... S1s>
+  std::optional<RetT> compute(uint64_t seq, RetT (*fn)(Impl &impl, S0s...),
+                              S1s &&... states);
+  // The calls below are made by the shard manager while it updates the shard
+  // map. Returns the key right after the last one.
+  Key seal_back();
+  // Returns the first key.
+  Key seal_front();
+  void unseal_back();
+  void unseal_front();
+  // Invalidates the current incarnation if it is still drained.
+  bool retire();
+  void reincarnate(uint64_t seq, Key l_key, bool has_prev, bool has_next);
+
+ private:
+  uint64_t seq_;
+  bool has_prev_;
+  bool has_next_;
+  std::size_t max_shard_size_;
+  Container container_;
+
+  bool has_room_for(std::size_t size) const;
+  bool owns(Key k) const;
+};
+
+// A sequence partitioned by key ranges into GeneralShard proclets. Pushes go
+// to the head or the tail shard; once it gets full, the shard manager seals
+// it and puts a new shard next to it, so the data structure grows without
+// moving data around. Shards drained by pops are recycled. Each handle caches
+// a versioned copy of the shard map, which is refreshed lazily once a shard
+// rejects an invocation.
+//
+// Container is a GeneralLockedContainer whose Impl keeps the key of its first
+// value (get_l_key() and rebase()) and provides the operations used, e.g.,
+// PushBackAble and TryPopFrontAble for a queue.
+template <class Container>
+class ShardedDataStructure {
+ public:
+  using Shard = GeneralShard<Container>;
+  using Key = Shard::Key;
+  using Val = Shard::Val;
+  using Impl = Shard::Impl;
+  constexpr static uint64_t kDefaultMaxShardBytes =
+      kDefaultProcletHeapSize / 4;
+  constexpr static std::size_t kDefaultMaxShardSize =
+      kDefaultMaxShardBytes / sizeof(Val) ? kDefaultMaxShardBytes / sizeof(Val)
+                                          : 1;
+
+  ShardedDataStructure(const ShardedDataStructure &);
+  ShardedDataStructure &operator=(const ShardedDataStructure &);
+  ShardedDataStructure(ShardedDataStructure &&);
+  ShardedDataStructure &operator=(ShardedDataStructure &&);
+  ShardedDataStructure();
+  ~ShardedDataStructure();
+  std::size_t size();
+  bool empty();
+  void push_back(Val v) requires PushBackAble<Impl>;
+  void push_front(Val v) requires PushFrontAble<Impl>;
+  // The batched versions issue one invocation per max_shard_size values.
+  void push_back_batch(std::vector<Val> vals) requires PushBackAble<Impl>;
+  void push_front_batch(std::vector<Val> vals) requires PushFrontAble<Impl>;
+  // Pops up to @num values, issuing one invocation per shard drained.
+  std::vector<Val> try_pop_front(std::size_t num)
+    requires TryPopFrontAble<Impl>;
+  std::vector<Val> try_pop_back(std::size_t num)
+    requires TryPopBackAble<Impl>;
+  std::optional<Val> get(Key k) requires SubscriptAble<Impl>;
+  // Returns false if @k is out of range.
+  bool set(Key k, Val v) requires SubscriptAble<Impl>;
+  // Invokes @fn on every value at its shard, with all shards running in
+  // parallel. @fn runs under the shard's lock, so it must not call back into
+  // the data structure.
+  template <typename... S0s, typename... S1s>
+  void for_all(void (*fn)(const Key &key, Val &val, S0s...),
+               S1s &&... states);
+  // Invokes @fn on every shard's Impl in parallel and returns the results in
+  // key order. Suits reducing the values where they are, so that only the
+  // reduced results are shipped to the caller.
+  template <typename RetT, typename... S0s, typename... S1s>
+  std::vector<RetT> compute(RetT (*fn)(Impl &impl, S0s...), S1s &&... states);
+  std::vector<Val> get_all_data();
+  uint32_t get_num_shards();
+
+  template <class Archive>
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
+
+ private:
+  class ShardManager;
+
+  struct ShardInfo {
+    uint64_t seq;
+    // Exact unless values have been pushed to or popped from the front.
+    Key l_key;
+    WeakProclet<Shard> shard;
+
+    template <class Archive>
+    void serialize(Archive &ar) {
+      ar(seq, l_key, shard);
+    }
+  };
+
+  struct ShardMap {
+    uint64_t version;
+    // Sorted by keys.
+    std::vector<ShardInfo> shards;
+
+    template <class Archive>
+    void serialize(Archive &ar) {
+      ar(version, shards);
+    }
+  };
+
+  // Owns all shards and the authoritative shard map.
+  class ShardManager {
+   public:
+    ShardMap init(std::size_t max_shard_size, bool pinned);
+    // Returns the shard map if it is newer than @version.
+    std::optional<ShardMap> get_shard_map(uint64_t version);
+    // Puts a new shard after the tail if it is still incarnation @seq.
+    void grow_back(uint64_t seq);
+    void grow_front(uint64_t seq);
+    // Recycles the head shard if it is still incarnation @seq and drained.
+    void shrink_front(uint64_t seq);
+    void shrink_back(uint64_t seq);
+
+   private:
+    // Protects the fields below, but is never held across shard invocations,
+    // so that the shard map can be fetched while it is being updated.
+    Mutex mutex_;
+    // Set while an update is in flight. Updates are serialized by waiting on
+    // cond_var_, since they rely on a stable shard map and spare shards.
+    bool updating_;
+    CondVar cond_var_;
+    bool pinned_;
+    std::size_t max_shard_size_;
+    uint64_t next_seq_;
+    ShardMap shard_map_;
+    // In the same order as shard_map_.shards.
+    std::vector<Proclet<Shard>> shards_;
+    // Drained shards kept for reuse, as stale handles might still invoke them.
+    std::vector<Proclet<Shard>> spare_shards_;
+
+    Proclet<Shard> new_shard(uint64_t seq, Key l_key, bool has_prev,
+                             bool has_next);
+    // Returns with mutex_ held by @l and no update in flight.
+    void wait_for_update(ScopedLock<Mutex> *l);
+    void finish_update();
+  };
+
+  Proclet<ShardManager> shard_mgr_;
+  std::size_t max_shard_size_;
+  ShardMap *shard_map_;
+  mutable RCULock rcu_lock_;
+  Mutex refresh_mutex_;
+
+  template <typename F>
+  std::pair<uint64_t, ShardInfo> locate_shard(F &&f);
+  std::pair<uint64_t, ShardInfo> locate_shard_of(Key k);
+  std::vector<ShardInfo> get_all_shards();
+  void refresh_shard_map(uint64_t stale_version);
+  ShardMap get_shard_map_copy() const;
+  template <class C>
+  friend ShardedDataStructure<C> make_sharded_ds(std::size_t max_shard_size,
+                                                 bool pinned);
+};
+
+template <class Container>
+ShardedDataStructure<Container> make_sharded_ds(
+    std::size_t max_shard_size =
+        ShardedDataStructure<Container>::kDefaultMaxShardSize,
+    bool pinned = false);
+
+}  // namespace nu
+
+#include "nu/impl/sharded_ds.ipp"
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "nu/sharded_ds.hpp"
+
+namespace nu {
+
+// The values of a ShardedQueue shard, keyed by the order they were pushed in.
+template <typename T, typename K = uint64_t>
+class QueueImpl {
+ public:
+  using Key = K;
+  using Val = T;
+
+  QueueImpl() : l_key_(0) {}
+  QueueImpl(Key l_key) : l_key_(l_key) {}
+  std::size_t size() const { return data_.size(); }
+  bool empty() const { return data_.empty(); }
+  std::size_t push_back(Val v) {
+    data_.push_back(std::move(v));
+    return data_.size();
+  }
+  void push_back_batch(std::vector<Val> vals) {
+    data_.insert(data_.end(), std::make_move_iterator(vals.begin()),
+                 std::make_move_iterator(vals.end()));
+  }
+  Val front() const { return data_.front(); }
+  std::vector<Val> try_pop_front(std::size_t num) {
+    num = std::min(num, data_.size());
+    std::vector<Val> vals(std::make_move_iterator(data_.begin()),
+                          std::make_move_iterator(data_.begin() + num));
+    data_.erase(data_.begin(), data_.begin() + num);
+    l_key_ += static_cast<Key>(num);
+    return vals;
+  }
+  Key get_l_key() const { return l_key_; }
+  Key rebase(Key new_l_key) { return std::exchange(l_key_, new_l_key); }
+  template <typename... S0s, typename... S1s>
+  void for_all(void (*fn)(const Key &key, Val &val, S0s...),
+               S1s &&... states) {
+    for (std::size_t i = 0; i < data_.size(); i++) {
+      fn(l_key_ + static_cast<Key>(i), data_[i], states...);
+    }
+  }
+
+  template <class Archive>
+  void serialize(Archive &ar) {
+    ar(l_key_, data_);
+  }
+
+ protected:
+  Key l_key_;
+  std::deque<T> data_;
+};
+
+template <typename T>
+using ShardedQueue = ShardedDataStructure<GeneralLockedContainer<QueueImpl<T>>>;
+
+template <typename T>
+ShardedQueue<T> make_sharded_queue(
+    std::size_t max_shard_size = ShardedQueue<T>::kDefaultMaxShardSize,
+    bool pinned = false) {
+  return make_sharded_ds<GeneralLockedContainer<QueueImpl<T>>>(max_shard_size,
+                                                               pinned);
+}
+
+}  // namespace nu
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "nu/sharded_ds.hpp"
+
+namespace nu {
+
+// The values of a ShardedVector shard, keyed by their indices.
+template <typename T>
+class VectorImpl {
+ public:
+  using Key = uint64_t;
+  using Val = T;
+
+  VectorImpl() : l_key_(0) {}
+  VectorImpl(Key l_key) : l_key_(l_key) {}
+  std::size_t size() const { return data_.size(); }
+  bool empty() const { return data_.empty(); }
+  std::size_t push_back(Val v) {
+    data_.push_back(std::move(v));
+    return data_.size();
+  }
+  void push_back_batch(std::vector<Val> vals) {
+    data_.insert(data_.end(), std::make_move_iterator(vals.begin()),
+                 std::make_move_iterator(vals.end()));
+  }
+  Val &operator[](Key k) { return data_[k - l_key_]; }
+  Key get_l_key() const { return l_key_; }
+  Key rebase(Key new_l_key) { return std::exchange(l_key_, new_l_key); }
+  template <typename... S0s, typename... S1s>
+  void for_all(void (*fn)(const Key &key, Val &val, S0s...),
+               S1s &&... states) {
+    for (std::size_t i = 0; i < data_.size(); i++) {
+      fn(l_key_ + i, data_[i], states...);
+    }
+  }
+
+  template <class Archive>
+  void serialize(Archive &ar) {
+    ar(l_key_, data_);
+  }
+
+ private:
+  Key l_key_;
+  std::vector<T> data_;
+};
+
+template <typename T>
+using ShardedVector =
+    ShardedDataStructure<GeneralLockedContainer<VectorImpl<T>>>;
+
+template <typename T>
+ShardedVector<T> make_sharded_vector(
+    std::size_t max_shard_size = ShardedVector<T>::kDefaultMaxShardSize,
+    bool pinned = false) {
+  return make_sharded_ds<GeneralLockedContainer<VectorImpl<T>>>(
+      max_shard_size, pinned);
+}
+
+}  // namespace nu
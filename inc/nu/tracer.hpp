@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+// Carried in the header of every proclet call and by the thread that issues or
+// serves it, so that the spans of a sampled request link up across proclets
+// and nodes. A zero trace id means that the request isn't sampled.
+struct TraceContext {
+  uint64_t trace_id;
+  uint64_t span_id;
+
+  template <class Archive>
+  void serialize(Archive &ar) {
+    ar(trace_id, span_id);
+  }
+};
+
+enum TraceSpanKind : uint8_t {
+  kFastPathCall,    // Into a local proclet, as seen by the caller.
+  kSlowPathCall,    // Into a remote proclet, as seen by the caller.
+  kServeCall,       // From a remote node, as seen by the callee.
+  kForwardCall,     // An instant: the callee has moved, the call is resent.
+  kMigrateProclet,  // The blackout window of migrating a proclet away.
+};
+
+struct TraceSpan {
+  uint64_t trace_id;
+  uint64_t span_id;
+  uint64_t parent_span_id;
+  // Microseconds since the epoch, so that spans ending on another node (after
+  // the thread has been migrated) and spans of different nodes line up.
+  double start_us;
+  double end_us;
+  ProcletID caller;
+  ProcletID callee;
+  NodeIP peer_ip;  // The other node involved, if any.
+  TraceSpanKind kind;
+};
+
+// Records the spans of sampled proclet calls into per-core ring buffers, which
+// are written with preemption disabled and without locks; the oldest spans get
+// overwritten. A call starts a new trace once every sample interval unless its
+// thread already serves a sampled one, in which case it always joins it. The
+// unsampled path costs a thread-local load plus a per-core counter bump.
+// Migrations are always recorded as long as tracing is enabled. While it is
+// disabled, a call only pays for a load of the sample interval and one byte in
+// its header; kEnableTracing compiles even that out.
+class Tracer {
+ public:
+  constexpr static bool kEnableTracing = true;
+  // Be power of 2 for speed.
+  constexpr static uint32_t kNumSpansPerCore = 4096;
+
+  Tracer();
+  // Samples one in every @interval new calls, or disables tracing if zero.
+  void set_sample_interval(uint32_t interval);
+  uint32_t get_sample_interval() const;
+  bool enabled() const;
+  // The context of the calling thread, which is inherited by the threads it
+  // creates and migrated along with it.
+  TraceContext *get_thread_ctx();
+  double now_us() const;
+  // Writes the context of the calling thread into the header of a call that it
+  // issues: a flag byte, followed by the context if the thread is sampled.
+  template <class Archive>
+  void save_call_ctx(Archive &oa);
+  // Reads the context written by save_call_ctx() into the calling thread's.
+  // Returns whether it is sampled, in which case the caller clears it after
+  // serving the call.
+  template <class Archive>
+  bool load_call_ctx(Archive &ia);
+  void record(const TraceSpan &span);
+  void record_forward(ProcletID callee);
+  void record_migration(ProcletID id, NodeIP dest_ip, double start_us);
+  // Writes the buffered spans of this node into @path in the Chrome trace event
+  // format, which Perfetto also loads. Each node is a process and each proclet
+  // a thread; remote calls are linked to their serving spans by flow events,
+  // so the files of multiple nodes can be merged by concatenating their
+  // "traceEvents" arrays. Best to be invoked once the traced workload is
+  // quiescent, since spans being written concurrently might be torn.
+  bool export_chrome_trace(const std::string &path);
+
+ private:
+  struct alignas(kCacheLineBytes) PerCore {
+    uint64_t calls;
+    uint64_t next_seq;
+    uint64_t head;
+    std::unique_ptr<TraceSpan[]> spans;
+  } per_cores_[kNumCores];
+  uint32_t sample_interval_;
+  double epoch_us_;
+
+  friend class TraceScope;
+  bool sample_root();
+  uint64_t new_span_id(uint32_t core);
+  void record_on_core(uint32_t core, const TraceSpan &span);
+};
+
+// Traces the enclosing scope as a span if the calling thread serves a sampled
+// request or, when @may_start_trace, if a new trace is sampled. The span
+// becomes the parent of those recorded by the scope, and the thread context
+// is restored at exit.
+class TraceScope {
+ public:
+  TraceScope(TraceSpanKind kind, ProcletID caller, ProcletID callee,
+             NodeIP peer_ip, bool may_start_trace);
+  ~TraceScope();
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  TraceSpan span_;
+  bool active_;
+
+  void begin();
+  void end();
+};
+
+}  // namespace nu
+
+#include "nu/impl/tracer.ipp"
@@ -2,9 +2,11 @@
 
 #include <cstddef>
 #include <memory>
+#include <span>
 #include <spanstream>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include "nu/utils/cached_pool.hpp"
 
@@ -15,6 +17,10 @@ class ArchivePool {
  public:
   constexpr static uint32_t kOAStreamPreallocBufSize = 128 - 1;
   constexpr static uint32_t kOAStreamMaxBufSize = 8192 - 1;
+  // Contiguous payloads no smaller than this may be transmitted in place
+  // instead of being copied into the stream, which only synchronous calls from
+  // outside of any proclet do.
+  constexpr static uint32_t kOAStreamZeroCopyMinSize = 16384;
 
   using CharAllocator =
       std::allocator_traits<Allocator>::template rebind_alloc<char>;
@@ -28,9 +34,16 @@ class ArchivePool {
     IASStream() : ss{std::span<char>()}, ia(ss) {}
   };
 
+  // A payload logically inserted at @offset of the stream.
+  struct ZeroCopySegment {
+    uint64_t offset;
+    std::span<const std::byte> data;
+  };
+
   struct OASStream {
     StringStream ss;
     cereal::BinaryOutputArchive oa;
+    std::vector<ZeroCopySegment> zero_copy_segments;
     OASStream() : ss(String(kOAStreamPreallocBufSize, '\0')), oa(ss) {}
   };
 
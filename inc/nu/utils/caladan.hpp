@@ -13,6 +13,7 @@ namespace nu {
 class SlabAllocator;
 class RCULock;
 struct ProcletHeader;
+struct TraceContext;
 
 class Caladan {
  public:
@@ -54,6 +55,7 @@ class Caladan {
   ProcletHeader *thread_get_owner_proclet(thread_t *th = thread_self());
   SlabAllocator *thread_get_proclet_slab();
   SlabAllocator *thread_set_proclet_slab(SlabAllocator *proclet_slab);
+  TraceContext *thread_get_trace_ctx();
   void *thread_get_runtime_stack_base();
   uint64_t thread_get_rsp(thread_t *th);
   uint32_t thread_get_creator_ip();
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+// The remote nodes that recently invoked a proclet, i.e., the ones that the
+// migrator tells about the proclet's new location. Every incoming invocation
+// is recorded, so a known caller is looked up without locking and its
+// timestamp only gets written once it turns stale. A new caller takes over the
+// least recently seen slot if all are taken.
+class CallerSet {
+ public:
+  constexpr static uint32_t kNumSlots = 8;
+  // A caller is recent if it has invoked the proclet within this period.
+  constexpr static uint64_t kRecentUs = 10 * kOneSecond;
+  constexpr static uint64_t kRefreshUs = 100 * kOneMilliSecond;
+
+  CallerSet();
+  void record(NodeIP ip);
+  std::vector<NodeIP> get_recent() const;
+
+ private:
+  struct Slot {
+    std::atomic<NodeIP> ip;
+    std::atomic<uint64_t> last_us;
+  };
+  Slot slots_[kNumSlots];
+  SpinLock spin_;
+
+  void insert(NodeIP ip, uint64_t now_us);
+};
+
+}  // namespace nu
+
+#include "nu/impl/caller_set.ipp"
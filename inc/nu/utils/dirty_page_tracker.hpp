@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "nu/commons.hpp"
+
+struct page_region;
+
+namespace nu {
+
+// Tracks the pages written within a virtual address range using
+// userfaultfd's asynchronous write-protection. Write faults are resolved by
+// the kernel itself (no fault handling thread is needed), and collecting the
+// dirty pages atomically re-arms the write-protection, so there is no window
+// where a write could go unnoticed.
+class DirtyPageTracker {
+ public:
+  constexpr static uint32_t kMaxRegionsPerScan = 512;
+
+  DirtyPageTracker();
+  ~DirtyPageTracker();
+  DirtyPageTracker(const DirtyPageTracker &) = delete;
+  DirtyPageTracker &operator=(const DirtyPageTracker &) = delete;
+  // Whether the running kernel supports the required features.
+  bool is_supported() const;
+  // Start tracking @range (page aligned). All pages are considered clean.
+  bool start(VAddrRange range);
+  // Return the (sorted) regions written within @range since the last call to
+  // start() or collect(), and mark them clean again. Not thread-safe, as the
+  // scans share one buffer.
+  std::vector<VAddrRange> collect(VAddrRange range);
+  // Stop tracking @range.
+  void stop(VAddrRange range);
+
+ private:
+  int uffd_;
+  int pagemap_fd_;
+  // Too large for the stacks of uthreads.
+  std::unique_ptr<page_region[]> regions_;
+};
+
+}  // namespace nu
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 namespace nu {
 
@@ -19,8 +21,18 @@ class Future {
   ~Future();
   operator bool() const;
   bool is_ready();
+  // Rethrows the exception that the promise has been fulfilled with, if any.
   T &get();
   T &get_sync();
+  // Runs @f once the future is ready, or right away if it already is. @f runs
+  // in the thread that fulfills the promise, so it must not block. A future
+  // takes at most one callback, including the ones of then() and when_*().
+  template <typename F>
+  void on_ready(F &&f);
+  // Returns a future of @f applied to the value, without a waiting thread.
+  // Consumes this future; @f runs as in on_ready().
+  template <typename F>
+  Future<std::invoke_result_t<std::decay_t<F>, T &>> then(F &&f) &&;
 
  private:
   std::unique_ptr<Promise<T>, Deleter> promise_;
@@ -28,7 +40,9 @@ class Future {
   friend class Promise;
 
   Future(Promise<T> *promise);
-  T &get_slow_path();
+  // Waits without rethrowing the exception, if any.
+  void wait();
+  void wait_slow_path();
 };
 
 template <typename Deleter>
@@ -44,6 +58,10 @@ class Future<void, Deleter> {
   bool is_ready();
   void get();
   void get_sync();
+  template <typename F>
+  void on_ready(F &&f);
+  template <typename F>
+  Future<std::invoke_result_t<std::decay_t<F>>> then(F &&f) &&;
 
  private:
   std::unique_ptr<Promise<void>, Deleter> promise_;
@@ -51,13 +69,23 @@ class Future<void, Deleter> {
   friend class Promise;
 
   Future(Promise<void> *promise);
-  void get_slow_path();
+  void wait();
+  void wait_slow_path();
 };
 
 template <typename F, typename Allocator = std::allocator<
                           Promise<std::invoke_result_t<std::decay_t<F>>>>>
 Future<std::invoke_result_t<std::decay_t<F>>> async(F &&f);
 
+// Returns a future that is ready once all of @futures are, which stay owned by
+// the caller.
+template <typename T, typename Deleter>
+Future<void> when_all(std::vector<Future<T, Deleter>> &futures);
+
+// Returns a future of the index of the first one of @futures that gets ready.
+template <typename T, typename Deleter>
+Future<std::size_t> when_any(std::vector<Future<T, Deleter>> &futures);
+
 }  // namespace nu
 
 #include "nu/impl/future.ipp"
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sync.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+// A log-linear histogram of nanosecond latencies in the style of HdrHistogram.
+// Values below 2^kSubBucketBits are counted exactly. Beyond that, every power
+// of 2 is split into 2^(kSubBucketBits - 1) equal buckets, so that a bucket is
+// at most 1/64 as wide as the values it holds and the reported values (the
+// bucket midpoints) are within 0.8% of the recorded ones. Values larger than
+// kMaxValue (~68.7s) are clamped to it. Not thread safe, see
+// ConcurrentHdrHistogram for that.
+class HdrHistogram {
+ public:
+  constexpr static uint32_t kSubBucketBits = 7;
+  constexpr static uint32_t kMaxValueBits = 36;
+  constexpr static uint64_t kMaxValue = (1ULL << kMaxValueBits) - 1;
+  constexpr static uint32_t kNumCounts = (kMaxValueBits - kSubBucketBits + 2)
+                                         << (kSubBucketBits - 1);
+
+  HdrHistogram();
+  void record(uint64_t val, uint64_t cnt = 1);
+  void merge(const HdrHistogram &o);
+  // Takes out an earlier snapshot of the same histogram, leaving the values
+  // recorded since then.
+  void subtract(const HdrHistogram &o);
+  void reset();
+  uint64_t get_count() const;
+  uint64_t get_sum() const;
+  uint64_t get_max() const;
+  double get_mean() const;
+  // The value below or at which @nth percent of the recorded values fall.
+  uint64_t get_nth(double nth) const;
+  static uint32_t index_of(uint64_t val);
+  static uint64_t lowest_of(uint32_t idx);
+  static uint64_t width_of(uint32_t idx);
+
+  template <class Archive>
+  void serialize(Archive &ar) {
+    ar(counts_, count_, sum_, max_);
+  }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t max_;
+  friend class ConcurrentHdrHistogram;
+
+  uint64_t value_of(uint32_t idx) const;
+};
+
+// Records into per-core shards with preemption disabled and without locks or
+// atomics, which is cheap enough for every RPC. Reads merge all the shards,
+// so they might miss the values being recorded concurrently.
+class ConcurrentHdrHistogram {
+ public:
+  ConcurrentHdrHistogram();
+  void record(uint64_t val);
+  void record_tsc(uint64_t duration_tsc);
+  HdrHistogram snapshot() const;
+  // The values recorded since the last call.
+  HdrHistogram interval_snapshot();
+
+ private:
+  struct alignas(kCacheLineBytes) Shard {
+    uint64_t sum;
+    uint64_t max;
+    uint64_t counts[HdrHistogram::kNumCounts];
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  HdrHistogram last_;
+  rt::Mutex mutex_;
+};
+
+}  // namespace nu
+
+#include "nu/impl/hdr_histogram.ipp"
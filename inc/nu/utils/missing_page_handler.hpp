@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+// Intercepts the first touch of every page within a virtual address range
+// using userfaultfd's missing mode. The faulting threads stay blocked until
+// the page content gets installed through install(), which makes it possible
+// to resume a proclet before its heap has fully arrived.
+class MissingPageHandler {
+ public:
+  constexpr static uint32_t kMaxFaultsPerPoll = 64;
+  constexpr static uint32_t kMaxNumAbortedRanges = 64;
+
+  // Start intercepting @range (page aligned). The existing content of @range
+  // is discarded.
+  MissingPageHandler(VAddrRange range);
+  // Stop intercepting. The pages that have not been installed so far will be
+  // zero-filled on their next touch, unless abort() has been called.
+  ~MissingPageHandler();
+  MissingPageHandler(const MissingPageHandler &) = delete;
+  MissingPageHandler &operator=(const MissingPageHandler &) = delete;
+  VAddrRange range() const;
+  // Appends the (page aligned) addresses of the pending faults to
+  // @fault_addrs, non-blocking. Returns false upon errors.
+  bool poll_faults(std::vector<uint64_t> *fault_addrs);
+  // Install the @len bytes at @src to @addr (both page aligned) and wake up
+  // the threads waiting for them. The pages already installed are skipped.
+  // Returns false upon errors.
+  bool install(uint64_t addr, const void *src, uint64_t len);
+  // Same as install(), but with zero-filled pages.
+  bool zero(uint64_t addr, uint64_t len);
+  // Gives up on the pages that have not arrived: the whole range becomes
+  // inaccessible and is freed, and the threads faulting on it (now or later)
+  // get terminated rather than seeing zero-filled pages. Stops intercepting.
+  void abort();
+
+ private:
+  int uffd_;
+  VAddrRange range_;
+
+  void close_uffd();
+  template <typename F>
+  bool fill(uint64_t addr, uint64_t len, F &&op);
+  static void register_aborted_range(VAddrRange range);
+};
+
+}  // namespace nu
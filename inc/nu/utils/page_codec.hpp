@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "nu/commons.hpp"
+
+namespace nu {
+
+struct PageBlockHeader {
+  // Bit i is set iff the i-th page of the block is all zeros.
+  uint32_t zero_pages;
+  // The payload carries the non-zero pages only, and is empty if there's none.
+  uint32_t payload_len;
+  // Otherwise the non-zero pages are stored as is.
+  bool compressed;
+};
+
+// Encodes memory in blocks of up to kBlockPages pages for the migration
+// stream. All-zero pages are elided, and the rest is LZ4-compressed unless it
+// turns out to be incompressible. Not thread safe; use one codec per thread.
+class PageCodec {
+ public:
+  constexpr static uint32_t kBlockPages = 16;
+  constexpr static uint64_t kBlockSize = kBlockPages * kPageSize;
+  constexpr static int kAcceleration = 1;
+  // LZ4's worst-case expansion of a block.
+  constexpr static uint32_t kMaxPayloadLen =
+      kBlockSize + kBlockSize / 255 + 16;
+  static_assert(kBlockPages <= 32);
+
+  PageCodec();
+  PageCodec(const PageCodec &) = delete;
+  PageCodec &operator=(const PageCodec &) = delete;
+  // Encodes the @len (<= kBlockSize) bytes at @src into @hdr and the returned
+  // payload, which stays valid until the next call.
+  std::span<const std::byte> encode(const std::byte *src, uint32_t len,
+                                    PageBlockHeader *hdr);
+  // A buffer that is large enough for the payload of any block.
+  std::byte *get_payload_buf();
+  // Decodes @payload into the @len bytes at @dst. Returns false if the payload
+  // is corrupted.
+  bool decode(const PageBlockHeader &hdr, const std::byte *payload,
+              std::byte *dst, uint32_t len);
+  // Returns the number of bytes that the non-zero pages of a block span.
+  static uint32_t get_non_zero_len(uint32_t zero_pages, uint32_t len);
+
+ private:
+  std::unique_ptr<std::byte[]> state_;
+  std::unique_ptr<std::byte[]> gather_buf_;
+  std::unique_ptr<std::byte[]> out_buf_;
+};
+
+}  // namespace nu
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "nu/commons.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+struct PeerTrafficSummary {
+  // The remote node that exchanges the most invocations, or 0 if none.
+  NodeIP top_remote_ip;
+  float top_remote;
+  float local;
+  float total;
+};
+
+// Counts the invocations that a proclet issues to or serves for each node. It
+// only sees sampled invocations, so a handful of slots suffices; a node that
+// finds no free slot takes over the least-used one.
+class PeerTraffic {
+ public:
+  constexpr static uint32_t kNumSlots = 8;
+  constexpr static uint64_t kDecayIntervalUs = kOneSecond;
+  constexpr static float kDecayFactor = 0.5;
+
+  PeerTraffic();
+  void record(NodeIP ip, uint32_t cnt);
+  PeerTrafficSummary summarize(NodeIP local_ip) const;
+
+ private:
+  struct Slot {
+    NodeIP ip;
+    float cnt;
+  };
+  Slot slots_[kNumSlots];
+  uint64_t last_decay_us_;
+  mutable SpinLock spin_;
+
+  void decay(uint64_t now_us);
+};
+
+}  // namespace nu
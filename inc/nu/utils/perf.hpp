@@ -6,6 +6,7 @@
 #include <utility>
 #include <vector>
 #include <optional>
+#include <string>
 
 extern "C" {
 #include <runtime/net.h>
@@ -13,6 +14,7 @@ extern "C" {
 #include <thread.h>
 
 #include "nu/commons.hpp"
+#include "nu/utils/hdr_histogram.hpp"
 
 namespace nu {
 
@@ -31,6 +33,19 @@ struct Trace {
   uint64_t duration_us;
 };
 
+// The latencies within one reporting interval of an open-loop run.
+struct PerfInterval {
+  uint64_t start_us;  // Since the start of the measured run.
+  uint64_t duration_us;
+  uint64_t num_reqs;
+  double mean_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+};
+
 struct PerfThreadState {
   virtual ~PerfThreadState() = default;
 };
@@ -42,9 +57,19 @@ class PerfAdapter {
   virtual bool serve_req(PerfThreadState *state, const PerfRequest *req) = 0;
 };
 
-// Closed-loop, possion arrival.
+// Poisson arrival. run() and run_multi_clients() are closed-loop: they
+// pre-generate all the requests, skip the ones that miss their deadlines by
+// miss_ddl_thresh_us, and keep a trace per request. run_open_loop() and
+// run_open_loop_multi_clients() generate the requests as they go, never skip
+// any and measure each latency from the intended send time rather than the
+// actual one, so that a stalled server is also charged for the requests
+// queued up behind (i.e., no coordinated omission). Their latencies only go
+// into histograms, which are reported per interval as well. Multi-client runs
+// merge the histograms of all clients.
 class Perf {
  public:
+  constexpr static uint64_t kDefaultIntervalUs = kOneSecond;
+
   Perf(PerfAdapter &adapter);
   void reset();
   void run(uint32_t num_threads, double target_mops, uint64_t duration_us,
@@ -53,11 +78,24 @@ class Perf {
                          uint32_t num_threads, double target_mops,
                          uint64_t duration_us, uint64_t warmup_us = 0,
                          uint64_t miss_ddl_thresh_us = 500);
+  void run_open_loop(uint32_t num_threads, double target_mops,
+                     uint64_t duration_us, uint64_t warmup_us = 0,
+                     uint64_t interval_us = kDefaultIntervalUs);
+  void run_open_loop_multi_clients(std::span<const netaddr> client_addrs,
+                                   uint32_t num_threads, double target_mops,
+                                   uint64_t duration_us, uint64_t warmup_us = 0,
+                                   uint64_t interval_us = kDefaultIntervalUs);
   uint64_t get_average_lat();
   uint64_t get_nth_lat(double nth);
   std::vector<Trace> get_timeseries_nth_lats(uint64_t interval_us, double nth);
   double get_real_mops() const;
   const std::vector<Trace> &get_traces() const;
+  // The latencies of the served requests, in nanoseconds.
+  const HdrHistogram &get_lat_histogram() const;
+  // Only kept by the open-loop runs, for this client alone.
+  const std::vector<PerfInterval> &get_intervals() const;
+  bool write_intervals_csv(const std::string &path) const;
+  bool write_intervals_json(const std::string &path) const;
 
  private:
   enum TraceFormat { kUnsorted, kSortedByDuration, kSortedByStart };
@@ -66,9 +104,22 @@ class Perf {
   std::vector<Trace> traces_;
   TraceFormat trace_format_;
   double real_mops_;
+  HdrHistogram lat_histogram_;
+  std::vector<PerfInterval> intervals_;
   friend class Test;
 
-  void tcp_barrier(std::span<const netaddr> participant_addrs);
+  using TcpConns = std::vector<std::unique_ptr<rt::TcpConn>>;
+
+  bool is_tcp_sink(std::span<const netaddr> participant_addrs);
+  // The sink, i.e., the first participant, gets connected to all the others.
+  TcpConns tcp_connect(std::span<const netaddr> participant_addrs);
+  void tcp_barrier(std::span<const netaddr> participant_addrs,
+                   const TcpConns &conns);
+  // Leaves the merged histogram of all participants in @histogram.
+  void tcp_merge(std::span<const netaddr> participant_addrs,
+                 const TcpConns &conns, HdrHistogram *histogram);
+  void tcp_close(std::span<const netaddr> participant_addrs,
+                 const TcpConns &conns);
   void create_thread_states(
       std::vector<std::unique_ptr<PerfThreadState>> *thread_states,
       uint32_t num_threads);
@@ -79,7 +130,15 @@ class Perf {
   std::vector<Trace> benchmark(
       std::vector<PerfRequestWithTime> *all_reqs,
       const std::vector<std::unique_ptr<PerfThreadState>> &thread_states,
-      uint32_t num_threads, std::optional<uint64_t> miss_ddl_thresh_us);
+      uint32_t num_threads, std::optional<uint64_t> miss_ddl_thresh_us,
+      HdrHistogram *lat_histogram);
+  // Records the latencies into @lat_histogram and, every @interval_us, reports
+  // the ones of the last interval into @intervals, if they're not nullptr.
+  void open_loop_benchmark(
+      const std::vector<std::unique_ptr<PerfThreadState>> &thread_states,
+      uint32_t num_threads, double target_mops, uint64_t duration_us,
+      uint64_t interval_us, HdrHistogram *lat_histogram,
+      std::vector<PerfInterval> *intervals);
 };
 
 }  // namespace nu
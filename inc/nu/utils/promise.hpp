@@ -1,5 +1,6 @@
 #pragma once
 
+#include <exception>
 #include <functional>
 #include <memory>
 
@@ -21,19 +22,29 @@ class Promise {
   Future<T, Deleter> get_future();
   template <typename F, typename Allocator = std::allocator<Promise>>
   static Promise *create(F &&f);
+  // Creates a promise that its producer fulfills by filling in data() and then
+  // calling set_ready(), instead of a thread running a function.
+  template <typename Allocator = std::allocator<Promise>>
+  static Promise *create();
+  T *data();
+  void set_ready();
+  // Fulfills the promise with @exception, which Future::get() rethrows.
+  void set_exception(std::exception_ptr exception);
 
  private:
   bool futurized_;
   bool ready_;
   SpinLock spin_;
   CondVar cv_;
+  std::move_only_function<void()> continuation_;
+  std::exception_ptr exception_;
   T t_;
   template <typename U, typename Deleter>
   friend class Future;
 
   Promise();
-  void set_ready();
-  T *data();
+  template <typename F>
+  void on_ready(F &&f);
 };
 
 template <>
@@ -46,17 +57,25 @@ class Promise<void> {
   Future<void, Deleter> get_future();
   template <typename F, typename Allocator = std::allocator<Promise>>
   static Promise *create(F &&f);
+  // Creates a promise that its producer fulfills by calling set_ready().
+  template <typename Allocator = std::allocator<Promise>>
+  static Promise *create();
+  void set_ready();
+  void set_exception(std::exception_ptr exception);
 
  private:
   bool futurized_;
   bool ready_;
   SpinLock spin_;
   CondVar cv_;
+  std::move_only_function<void()> continuation_;
+  std::exception_ptr exception_;
   template <typename U, typename Deleter>
   friend class Future;
 
   Promise();
-  void set_ready();
+  template <typename F>
+  void on_ready(F &&f);
 };
 }  // namespace nu
 
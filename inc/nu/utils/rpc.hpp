@@ -1,5 +1,9 @@
 #pragma once
 
+#include <sys/uio.h>
+
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <functional>
 #include <memory>
@@ -13,7 +17,9 @@
 #include <thread.h>
 
 #include "nu/commons.hpp"
+#include "nu/utils/cached_pool.hpp"
 #include "nu/utils/counter.hpp"
+#include "nu/utils/shm_conn.hpp"
 
 namespace nu {
 
@@ -68,7 +74,62 @@ class RPCReturnBuffer {
   std::move_only_function<void()> deleter_fn_;
 };
 
-enum RPCReturnCode { kErrWrongClient = -2, kErrTimeout = -1, kOk = 0 };
+// A kErrWrongClient response carries the IP of the node that the callee has
+// moved to (0 if unknown) as its return data. kErrLost means the callee is gone
+// for good, e.g., its post-copy migration source died.
+enum RPCReturnCode {
+  kErrLost = -3,
+  kErrWrongClient = -2,
+  kErrTimeout = -1,
+  kOk = 0
+};
+
+// RPCConn is the byte stream that carries RPCs: a Caladan TCP connection, or a
+// shared-memory one when both ends live on the same host. It is a concrete
+// type rather than an interface, so TCP streams pay no virtual call per send
+// or receive; unless kEnableShmTransport is set, they pay no branch either.
+class RPCConn {
+ public:
+  // Talk to the nodes on the same host through shared memory. Off by default:
+  // ShmConn has no doorbell, as a uthread cannot wait on a futex or an eventfd
+  // without blocking its kthread, so every idle flow keeps waking its core to
+  // poll the ring. Enabling it takes a wakeup that the Caladan scheduler can
+  // deliver, e.g., the iokernel polling the rings on behalf of parked
+  // uthreads.
+  constexpr static bool kEnableShmTransport = false;
+
+  RPCConn(rt::TcpConn *c) : tcp_c_(c) {}
+  RPCConn(ShmConn *c) : shm_c_(c) {}
+
+  ssize_t Read(void *buf, size_t len) {
+    return is_shm() ? shm_c_->Read(buf, len) : tcp_c_->Read(buf, len);
+  }
+  ssize_t ReadFull(void *buf, size_t len) {
+    return is_shm() ? shm_c_->ReadFull(buf, len) : tcp_c_->ReadFull(buf, len);
+  }
+  ssize_t WritevFull(std::span<const iovec> iov) {
+    return is_shm() ? shm_c_->WritevFull(iov) : tcp_c_->WritevFull(iov);
+  }
+  int Shutdown(int how) {
+    return is_shm() ? shm_c_->Shutdown(how) : tcp_c_->Shutdown(how);
+  }
+  void Abort() { is_shm() ? shm_c_->Abort() : tcp_c_->Abort(); }
+  netaddr RemoteAddr() const {
+    return is_shm() ? shm_c_->RemoteAddr() : tcp_c_->RemoteAddr();
+  }
+
+ private:
+  std::unique_ptr<rt::TcpConn> tcp_c_;
+  std::unique_ptr<ShmConn> shm_c_;
+
+  bool is_shm() const {
+    if constexpr (kEnableShmTransport) {
+      return static_cast<bool>(shm_c_);
+    } else {
+      return false;
+    }
+  }
+};
 
 class RPCReturner {
  public:
@@ -77,6 +138,10 @@ class RPCReturner {
   void Return(RPCReturnCode rc, std::span<const std::byte> buf,
               std::move_only_function<void()> deleter_fn = nullptr);
   void Return(RPCReturnCode rc);
+  // Returns kErrWrongClient, redirecting the caller to @redirect_ip.
+  void ReturnWrongClient(uint32_t redirect_ip);
+  // Returns the IP of the node that issued the RPC.
+  uint32_t GetRemoteIP() const;
 
  private:
   void *rpc_server_;
@@ -87,12 +152,65 @@ class RPCReturner {
 using RPCHandler = std::move_only_function<void(std::span<std::byte> args,
                                                 RPCReturner *rpc_returner)>;
 // A callback for each RPC request, invoked when the response data is ready.
-using RPCCallback = std::move_only_function<void(ssize_t len, rt::TcpConn *c)>;
+using RPCCallback = std::move_only_function<void(ssize_t len, RPCConn *c)>;
+// A callback for each asynchronous RPC request, invoked with the response by
+// the completion worker of the flow that receives it. It might block, but that
+// holds back the other asynchronous requests of the flow.
+using RPCAsyncCallback =
+    std::move_only_function<void(RPCReturnCode rc, RPCReturnBuffer &&buf)>;
 
 namespace rpc_internal {
 
 class RPCServerWorker;
 
+// A chunk of bytes received by an RPCServerWorker. Requests are parsed from it
+// in place, and it is recycled once all their handlers have returned.
+struct RPCRecvChunk {
+  constexpr static uint32_t kBytes = 64 << 10;
+
+  std::atomic<uint32_t> refs;
+  alignas(kCacheLineBytes) std::byte data[kBytes];
+};
+
+// A received request on its way to the handler.
+struct RPCRequest {
+  constexpr static uint32_t kInlineArgBytes = 256;
+
+  // Links the requests of an RPCRequestList.
+  RPCRequest *next;
+  std::size_t completion_data;
+  std::span<std::byte> args;
+  // Set if @args points into the chunk.
+  RPCRecvChunk *chunk;
+  // Set if @args is too large for both the chunk and @inline_args.
+  std::unique_ptr<std::byte[]> heap_args;
+  // Holds small arguments that are misaligned within the chunk.
+  alignas(std::max_align_t) std::byte inline_args[kInlineArgBytes];
+};
+
+// An intrusive FIFO of requests.
+struct RPCRequestList {
+  RPCRequest *head = nullptr;
+  RPCRequest *tail = nullptr;
+  uint32_t size = 0;
+
+  void push_back(RPCRequest *req);
+  RPCRequest *pop_front();
+  // Moves all requests of @o to the back.
+  void splice(RPCRequestList *o);
+};
+
+// Buffers shared by all workers of an RPCServerListener.
+struct RPCServerPools {
+  constexpr static uint32_t kChunksPerCore = 2;
+  constexpr static uint32_t kRequestsPerCore = 64;
+
+  RPCServerPools();
+
+  CachedPool<RPCRecvChunk> chunks;
+  CachedPool<RPCRequest> requests;
+};
+
 // RPCCompletion manages the completion of an inflight request.
 class RPCCompletion {
  public:
@@ -103,14 +221,25 @@ class RPCCompletion {
     }
   }
   RPCCompletion(RPCCallback &&callback)
-      : callback_(std::move(callback)), poll_(!preempt_enabled()) {
+      : return_buf_(nullptr),
+        callback_(std::move(callback)),
+        poll_(!preempt_enabled()) {
     w_.Arm();
   }
+  // Nobody waits for the completion, which frees itself once done.
+  RPCCompletion(RPCAsyncCallback &&async_callback)
+      : return_buf_(&async_return_buf_),
+        async_callback_(std::move(async_callback)),
+        poll_(false) {}
   ~RPCCompletion() {}
 
   // Complete the request by invoking the callback and waking up the blocking
-  // thread.
-  void Done(ssize_t len, rt::TcpConn *c);
+  // thread. An asynchronous request only gets its response stored, and is
+  // completed later by CompleteAsync().
+  void Done(ssize_t len, RPCConn *c);
+  bool is_async() const { return static_cast<bool>(async_callback_); }
+  // Invokes the asynchronous callback and frees the completion.
+  void CompleteAsync();
 
   RPCReturnCode get_return_code() const {
     Poll();
@@ -118,35 +247,95 @@ class RPCCompletion {
   }
 
  private:
+  friend class RPCFlow;
+
   void Poll() const;
 
   RPCReturnCode rc_;
   RPCReturnBuffer *return_buf_;
+  // The TSC when the request was put on the wire, for RTT sampling.
+  uint64_t sent_tsc_;
   RPCCallback callback_;
+  RPCReturnBuffer async_return_buf_;
+  RPCAsyncCallback async_callback_;
   rt::ThreadWaker w_;
   bool poll_;
 };
 
-// RPCFlow encapsulates one of the TCP connections used by an RPCClient.
+// Decides how long an RPCFlow holds back queued requests so that they can
+// share one write. It flushes right away when nothing is inflight, as waiting
+// would only add latency. Otherwise it aims for the smallest batch that keeps
+// the flow within kTargetFlushIntervalUs between writes at the observed
+// arrival rate, and never waits for longer than a fraction of the RTT. Not
+// thread safe; the owning flow serializes the updates.
+class RPCBatchController {
+ public:
+  constexpr static uint32_t kMaxBatchSize = 64;
+  // The throughput target: at most one write per interval under load.
+  constexpr static uint64_t kTargetFlushIntervalUs = 2;
+  constexpr static uint64_t kMaxBatchTimeoutUs = 20;
+  constexpr static uint64_t kRTTFraction = 4;
+  // EWMA weights are 1 / 2^kEWMAShift.
+  constexpr static uint32_t kEWMAShift = 3;
+  // Bucket i counts the batches of [2^i, 2^(i+1)) requests; the last bucket
+  // also takes anything larger.
+  constexpr static uint32_t kNumHistogramBuckets = 8;
+
+  using Histogram = std::array<uint64_t, kNumHistogramBuckets>;
+
+  // Returns whether the flow should write its @queued requests now, given
+  // @inflight unanswered ones and @waited_us since the last write.
+  bool should_flush(std::size_t queued, unsigned int inflight,
+                    uint64_t waited_us) const;
+  // Accounts for a write of @batch_size requests at @now_us.
+  void on_flush(uint32_t batch_size, uint64_t now_us);
+  // Accounts for a response that took @rtt_us.
+  void on_response(uint64_t rtt_us);
+  uint32_t get_batch_target() const { return batch_target_; }
+  uint64_t get_timeout_us() const { return timeout_us_; }
+  uint64_t get_rtt_us() const { return scaled_rtt_us_ >> kEWMAShift; }
+  const Histogram &get_histogram() const { return histogram_; }
+
+ private:
+  // Both averages are scaled by 2^kEWMAShift to keep their precision. The
+  // arrival rate is in requests per ms.
+  uint64_t scaled_arrival_rate_ = 0;
+  uint64_t scaled_rtt_us_ = 0;
+  uint64_t last_flush_us_ = 0;
+  uint32_t batch_target_ = 1;
+  uint64_t timeout_us_ = 0;
+  Histogram histogram_ = {};
+
+  void retune();
+};
+
+// RPCFlow encapsulates one of the connections used by an RPCClient.
 class RPCFlow {
  public:
   constexpr static bool kEnableAdaptiveBatching = true;
-  constexpr static uint64_t kReqBatchSize = 4;
-  constexpr static uint64_t kBatchTimeoutUs = 5;
 
-  RPCFlow(std::unique_ptr<rt::TcpConn> c)
+  RPCFlow(std::unique_ptr<RPCConn> c)
       : close_(false),
         c_(std::move(c)),
         sent_count_(0),
         recv_count_(0),
-        credits_(std::numeric_limits<decltype(credits_)>::max()) {}
+        credits_(std::numeric_limits<decltype(credits_)>::max()),
+        last_sent_us_(0) {}
   ~RPCFlow();
 
   // A factory to create new flows with CPU affinity.
   static std::unique_ptr<RPCFlow> New(unsigned int cpu_affinity, netaddr raddr);
+  // A factory to create new flows over shared memory. Returns nullptr if
+  // @raddr is not served on this host.
+  static std::unique_ptr<RPCFlow> NewShm(netaddr raddr);
 
   // Make an RPC call over this flow.
   void Call(std::span<const std::byte> src, RPCCompletion *c);
+  // Make an RPC call whose request is scattered across @srcs, which are sent
+  // in place.
+  void Call(std::span<const iovec> srcs, RPCCompletion *c);
+  // Returns how many writes carried each range of batch sizes so far.
+  RPCBatchController::Histogram GetBatchSizeHistogram();
 
   // Disable move and copy.
   RPCFlow(const RPCFlow &) = delete;
@@ -156,24 +345,32 @@ class RPCFlow {
   // State for managing inflight requests.
   struct req_ctx {
     std::span<const std::byte> payload;
+    std::span<const iovec> scattered_payload;
     RPCCompletion *completion;
   };
 
-  // Internal worker threads for sending and receiving.
+  // Internal worker threads for sending and receiving. Asynchronous requests
+  // are completed by a third one, so that their callbacks never hold back the
+  // receiver.
   void SendWorker();
   void ReceiveWorker();
+  void CompleteWorker();
   bool EnoughBatching();
+  void StartWorkers();
 
-  rt::Thread sender_, receiver_;
+  rt::Thread sender_, receiver_, completer_;
   rt::Spin lock_;
   bool close_;
   rt::ThreadWaker wake_sender_;
-  std::unique_ptr<rt::TcpConn> c_;
+  rt::ThreadWaker wake_completer_;
+  std::vector<RPCCompletion *> async_completions_;
+  std::unique_ptr<RPCConn> c_;
   unsigned int sent_count_;
   unsigned int recv_count_;
   unsigned int credits_;
   std::queue<req_ctx> reqs_;
   uint64_t last_sent_us_;
+  RPCBatchController batcher_;
 };
 
 }  // namespace rpc_internal
@@ -185,16 +382,32 @@ class RPCClient {
   // Creates an RPC Client and establishes the underlying TCP connections.
   static std::unique_ptr<RPCClient> Dial(netaddr raddr);
 
+  // Creates an RPC Client whose connections are in shared memory. Returns
+  // nullptr if @raddr is not served on this host.
+  static std::unique_ptr<RPCClient> DialShm(netaddr raddr);
+
   // Calls an RPC method, the RPC layer allocates a return buffer and stores
   // response into it.
   RPCReturnCode Call(std::span<const std::byte> args, RPCReturnBuffer *buf);
 
+  // Calls an RPC method whose arguments are scattered across multiple buffers,
+  // which must stay valid until the call returns.
+  RPCReturnCode Call(std::span<const iovec> args, RPCReturnBuffer *buf);
+
   // Calls an RPC method, the RPC layer invokes the callback when the response
-  // is ready on the TCP connection.
+  // is ready on the connection.
   RPCReturnCode Call(std::span<const std::byte> args, RPCCallback &&callback);
 
+  // Issues an RPC call without waiting for it. @args must stay valid until
+  // @callback is invoked.
+  void CallAsync(std::span<const std::byte> args, RPCAsyncCallback &&callback);
+
   netaddr GetAddr() { return raddr_; }
 
+  // Returns the batch-size histogram of each flow.
+  std::vector<rpc_internal::RPCBatchController::Histogram>
+  GetBatchSizeHistograms();
+
   // disable move and copy.
   RPCClient(const RPCClient &) = delete;
   RPCClient &operator=(const RPCClient &) = delete;
@@ -211,19 +424,33 @@ class RPCClient {
   netaddr raddr_;
 };
 
+struct RPCServerStats {
+  uint64_t requests;
+  // Requests share handler threads unless earlier handlers are still running.
+  uint64_t handler_spawns;
+};
+
 // RPCServerListener initializes and runs the RPC server.
 class RPCServerListener {
  public:
   RPCServerListener(uint16_t port, RPCHandler &&handler);
   ~RPCServerListener();
   void dec_ref_cnt() { counter_.dec(); }
+  // Sums the stats of all connections so far.
+  RPCServerStats GetStats();
 
  private:
   RPCHandler handler_;
   std::unique_ptr<rt::TcpQueue> q_;
+  std::unique_ptr<ShmQueue> shm_q_;
   rt::Thread listener_;
+  rt::Thread shm_listener_;
+  rt::Spin workers_lock_;
+  rpc_internal::RPCServerPools pools_;
   std::vector<std::unique_ptr<rpc_internal::RPCServerWorker>> workers_;
   Counter counter_;
+
+  void add_worker(std::unique_ptr<RPCConn> c);
 };
 
 }  // namespace nu
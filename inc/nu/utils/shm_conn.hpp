@@ -0,0 +1,102 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include <net.h>
+
+namespace nu {
+
+struct ShmRing;
+struct ShmConnSegment;
+struct ShmQueueSegment;
+
+// A byte stream between two processes on the same host, built on a pair of
+// single-producer single-consumer rings in shared memory. It mimics the part of
+// rt::TcpConn used by the RPC layer. Caladan uthreads must not block their
+// kthreads, so a waiting side polls: it yields for a short while and then backs
+// off to timer sleeps, trading wakeup latency of idle streams for CPU time.
+// Even then, every idle stream wakes up its core each kMaxSleepUs, which is
+// why the RPC layer doesn't use it by default (see RPCConn).
+class ShmConn {
+ public:
+  constexpr static uint64_t kRingBytes = 256 << 10;  // Be power of 2 for speed.
+  constexpr static uint64_t kSpinUs = 20;
+  constexpr static uint64_t kMinSleepUs = 5;
+  constexpr static uint64_t kMaxSleepUs = 200;
+  constexpr static uint64_t kDialTimeoutUs = 100 * 1000;
+
+  ~ShmConn();
+
+  // Returns nullptr if no live ShmQueue listens on @raddr within this host.
+  static ShmConn *Dial(netaddr raddr);
+  // Returns whether a live ShmQueue listens on @raddr within this host.
+  static bool IsLocal(netaddr raddr);
+
+  netaddr LocalAddr() const { return laddr_; }
+  netaddr RemoteAddr() const { return raddr_; }
+  // Reads up to @len bytes, waiting until at least one byte is available.
+  // Returns 0 if the stream has been closed.
+  ssize_t Read(void *buf, size_t len);
+  // Reads exactly @len bytes. Returns 0 if the stream has been closed.
+  ssize_t ReadFull(void *buf, size_t len);
+  // Writes exactly @len bytes.
+  ssize_t WriteFull(const void *buf, size_t len);
+  // Writes exactly a vector of bytes.
+  ssize_t WritevFull(std::span<const iovec> iov);
+  int Shutdown(int how);
+  void Abort();
+
+  // Disable move and copy.
+  ShmConn(const ShmConn &) = delete;
+  ShmConn &operator=(const ShmConn &) = delete;
+
+ private:
+  friend class ShmQueue;
+
+  ShmConn(ShmConnSegment *seg, bool server, netaddr laddr, netaddr raddr);
+
+  ShmConnSegment *seg_;
+  ShmRing *rx_;
+  ShmRing *tx_;
+  netaddr laddr_;
+  netaddr raddr_;
+};
+
+// Accepts ShmConns dialed to a local address; the shared-memory counterpart of
+// rt::TcpQueue.
+class ShmQueue {
+ public:
+  constexpr static uint32_t kNumSlots = 64;
+  // Dials are rare, so an idle queue backs off to long sleeps.
+  constexpr static uint64_t kMinAcceptSleepUs = 100;
+  constexpr static uint64_t kMaxAcceptSleepUs = 10 * 1000;
+
+  ~ShmQueue();
+
+  // Returns nullptr on failure. Takes over a stale queue left behind by a dead
+  // process with the same address.
+  static ShmQueue *Listen(netaddr laddr);
+
+  // Returns nullptr once the queue has been shut down.
+  ShmConn *Accept();
+  void Shutdown();
+
+  // Disable move and copy.
+  ShmQueue(const ShmQueue &) = delete;
+  ShmQueue &operator=(const ShmQueue &) = delete;
+
+ private:
+  ShmQueue(ShmQueueSegment *seg, std::string name, netaddr laddr);
+
+  ShmQueueSegment *seg_;
+  std::string name_;
+  netaddr laddr_;
+  bool shutdown_;
+};
+
+}  // namespace nu
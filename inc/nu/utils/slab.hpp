@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <bit>
 #include <cstdint>
 #include <functional>
 #include <limits>
@@ -7,6 +9,7 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "nu/commons.hpp"
 #include "nu/utils/caladan.hpp"
@@ -24,13 +27,96 @@ struct PtrHeader {
 constexpr static uint32_t kAlignment = 16;
 static_assert(sizeof(PtrHeader) % kAlignment == 0);
 
+namespace slab_internal {
+
+// Size classes start at 32 B. Above that, each doubling (2^shift,
+// 2^(shift + 1)] is split into 2^kSubClassShift evenly spaced classes (as long
+// as they stay aligned), which bounds internal fragmentation at 25% instead of
+// 50%. Beyond kMaxFineClassShift, there is only one class per doubling.
+constexpr static bool kEnableFineClasses = true;
+constexpr static uint32_t kMinClassShift = 5;       // 32 B.
+constexpr static uint32_t kMaxClassShift = 35;      // 32 GB.
+constexpr static uint32_t kMaxFineClassShift = 16;  // 64 KB.
+constexpr static uint32_t kSubClassShift = kEnableFineClasses ? 2 : 0;
+
+// The classes within (2^shift, 2^(shift + 1)] are spaced by 2^spacing_shift.
+constexpr uint32_t get_spacing_shift(uint32_t shift) {
+  if (shift >= kMaxFineClassShift) {
+    return shift;
+  }
+  return std::max(shift - kSubClassShift,
+                  static_cast<uint32_t>(std::countr_zero(kAlignment)));
+}
+
+// The first class within (2^shift, 2^(shift + 1)].
+constexpr static auto kBaseClasses = [] {
+  std::array<uint32_t, kMaxClassShift + 1> bases{};
+  uint32_t base = 1;
+  for (auto shift = kMinClassShift; shift <= kMaxClassShift; shift++) {
+    bases[shift] = base;
+    base += 1U << (shift - get_spacing_shift(shift));
+  }
+  return bases;
+}();
+
+constexpr static uint32_t kNumClasses = kBaseClasses[kMaxClassShift];
+
+constexpr static auto kClassSizes = [] {
+  std::array<uint64_t, kNumClasses> sizes{};
+  sizes[0] = 1ULL << kMinClassShift;
+  for (auto shift = kMinClassShift; shift < kMaxClassShift; shift++) {
+    auto spacing_shift = get_spacing_shift(shift);
+    for (uint32_t i = 0; i < (1U << (shift - spacing_shift)); i++) {
+      sizes[kBaseClasses[shift] + i] =
+          (1ULL << shift) + ((i + 1ULL) << spacing_shift);
+    }
+  }
+  return sizes;
+}();
+
+static_assert(kClassSizes[kNumClasses - 1] == 1ULL << kMaxClassShift);
+
+}  // namespace slab_internal
+
+struct SlabClassStats {
+  uint64_t class_size;
+  uint64_t num_live;
+  uint64_t num_free;
+  // Bytes requested by the live objects.
+  uint64_t live_bytes;
+  // Bytes lost to rounding the live objects up to the class size.
+  uint64_t internal_frag_bytes;
+};
+
+struct SlabCacheStats {
+  uint64_t num_allocs;
+  // Allocations that found the per-core cache empty and refilled it.
+  uint64_t num_misses;
+  // Frees that overflowed the per-core cache and turned objects in.
+  uint64_t num_overflows;
+  // Acquisitions of the global lock, and those that had to wait for it.
+  uint64_t num_global_locks;
+  uint64_t num_contended_locks;
+  // Cycles spent on refilling the per-core caches, including lock waits.
+  uint64_t miss_cycles;
+};
+
 class SlabAllocator {
  public:
-  constexpr static uint64_t kMaxSlabClassShift = 35;  // 32 GB.
-  constexpr static uint64_t kMinSlabClassShift = 5;   // 32 B.
-  constexpr static uint64_t kMaxNumCacheEntries = 32;
-  constexpr static uint64_t kCacheSizeCutoff = 1024;
+  constexpr static uint64_t kMaxSlabClassShift = slab_internal::kMaxClassShift;
+  constexpr static uint64_t kMinSlabClassShift = slab_internal::kMinClassShift;
+  constexpr static uint32_t kNumSlabClasses = slab_internal::kNumClasses;
+  // The depth of each per-core cache adapts to its class' demand: it doubles
+  // upon every miss, and halves after kMaxNumOverflows overflows in a row.
+  constexpr static uint32_t kMaxNumCacheEntries = 512;
+  constexpr static uint64_t kMaxCacheBytesPerClass = 32 << 10;
+  constexpr static uint32_t kMaxNumOverflows = 3;
+  // Large contiguous runs of free objects can be detached from the free lists
+  // so that their pages need not be touched (e.g., migrated); they get carved
+  // lazily again once their classes run out of free objects.
+  constexpr static uint32_t kMaxNumFreeRuns = 128;
   static_assert((1 << kMinSlabClassShift) % kAlignment == 0);
+  static_assert(kNumSlabClasses <= 64);
 
   SlabAllocator();
   SlabAllocator(SlabId_t slab_id, void *buf, size_t len,
@@ -50,17 +136,49 @@ class SlabAllocator {
   static void *reallocate(const void *ptr, size_t size);
   static void register_slab_by_id(SlabAllocator *slab, SlabId_t slab_id);
   static void deregister_slab_by_id(SlabId_t slab_id);
+  // Returns the size of the class that serves allocations of @size bytes.
+  static uint64_t get_usable_size(size_t size);
+  // Returns the statistics of the classes that have ever been allocated.
+  std::vector<SlabClassStats> get_class_stats() const;
+  // Free and internal fragmentation bytes, i.e., the allocated heap that
+  // holds no requested data (object headers excluded).
+  uint64_t get_wasted_bytes() const;
+  SlabCacheStats get_cache_stats() const;
+  // Returns the cached objects of all cores to the global lists and resets
+  // the cache depths. The caller must ensure that nobody else is using the
+  // slab, e.g., the proclet is paused for migration.
+  void flush_caches();
+  // Detaches the free runs whose page-aligned interiors span at least
+  // @min_run_bytes from the global free lists, largest first. Same
+  // requirement as flush_caches(); call it afterwards to cover cached objects.
+  // Allocates nothing and only holds the lock to detach and reattach the
+  // lists.
+  void release_free_runs(uint64_t page_size, uint64_t min_run_bytes);
+  // Returns the sorted page-aligned extents that hold free runs only. Their
+  // contents are never read, so they can be left unpopulated.
+  std::vector<VAddrRange> get_free_run_extents(uint64_t page_size) const;
+  uint64_t get_free_run_bytes() const;
+  // Returns the sorted addresses of the heap pages that the allocator itself
+  // writes to with preemption disabled, i.e., the ones holding the free lists,
+  // the edges of the free runs and the carving frontier. Same requirement as
+  // flush_caches(); call it afterwards so that no cached object is missed.
+  std::vector<uint64_t> get_metadata_pages(uint64_t page_size) const;
 
  private:
   class FreePtrsLinkedList {
    public:
+    // The leading bytes of a free object that the list might write to.
+    constexpr static uint64_t kNodeSize =
+        (1 << kMinSlabClassShift) + sizeof(PtrHeader);
+
     void push(void *ptr);
     void *pop();
     uint64_t size();
+    template <typename F>
+    void for_each(F &&f) const;
 
    private:
-    constexpr static uint32_t kBatchSize =
-        ((1 << kMinSlabClassShift) + sizeof(PtrHeader)) / sizeof(void *);
+    constexpr static uint32_t kBatchSize = kNodeSize / sizeof(void *);
     struct Batch {
       void *p[kBatchSize];
     };
@@ -70,12 +188,30 @@ class SlabAllocator {
   };
 
   struct alignas(kCacheLineBytes) CoreCache {
-    FreePtrsLinkedList lists[kMaxSlabClassShift];
+    FreePtrsLinkedList lists[kNumSlabClasses];
+    // Might be negative since objects can be freed by other cores.
+    int64_t num_live[kNumSlabClasses];
+    int64_t live_bytes[kNumSlabClasses];
+    uint32_t depths[kNumSlabClasses];
+    uint8_t num_overflows[kNumSlabClasses];
+    SlabCacheStats stats;
+  };
+
+  // Links a free object to the next one while the free runs are searched.
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  // A run of @num contiguous free objects, which are on no free list.
+  struct FreeRun {
+    uint64_t start;
+    uint64_t num;
+    uint32_t slab_class;
   };
 
   struct alignas(kCacheLineBytes) TransferredCoreCache {
     SpinLock spin;
-    FreePtrsLinkedList lists[kMaxSlabClassShift];
+    FreePtrsLinkedList lists[kNumSlabClasses];
   };
 
   static SlabAllocator *slabs_[get_max_slab_id() + 1];
@@ -84,23 +220,37 @@ class SlabAllocator {
   const uint8_t *start_;
   const uint8_t *end_;
   uint8_t *cur_;
-  FreePtrsLinkedList slab_lists_[kMaxSlabClassShift];
+  FreePtrsLinkedList slab_lists_[kNumSlabClasses];
+  uint64_t num_carved_[kNumSlabClasses];
   uint64_t global_free_bytes_;
+  FreeRun free_runs_[kMaxNumFreeRuns];
+  uint32_t num_free_runs_;
+  // Bit i is set iff there are free runs of class i.
+  uint64_t free_run_classes_;
   CoreCache cache_lists_[kNumCores];
   TransferredCoreCache transferred_caches_[kNumCores];
   SpinLock spin_;
 
-  uint32_t get_slab_shift(uint64_t data_size);
-  uint64_t get_slab_size(uint32_t slab_shift);
+  static FreeNode *sort_by_addr(FreeNode *head);
+  static uint32_t get_slab_class(uint64_t data_size);
+  static uint64_t get_class_size(uint32_t slab_class);
+  static uint64_t get_slab_size(uint32_t slab_class);
   void *__allocate(size_t size);
   static void __free(const void *ptr);
   void __do_free(const Caladan::PreemptGuard &g, PtrHeader *ptr,
-                 uint32_t slab_shift);
+                 uint32_t slab_class);
   void free_to_cache_list(const Caladan::PreemptGuard &g, PtrHeader *hdr,
-                          uint32_t slab_shift);
-  void free_to_transferred_cache_list(PtrHeader *hdr, uint32_t slab_shift);
+                          uint32_t slab_class);
+  void free_to_transferred_cache_list(const Caladan::PreemptGuard &g,
+                                      PtrHeader *hdr, uint32_t slab_class);
+  void refill_cache_list(CoreCache *cache, uint32_t slab_class);
+  uint32_t carve_free_runs(FreePtrsLinkedList *list, uint32_t slab_class,
+                           uint32_t num);
+  void lock_global(CoreCache *cache);
+  uint32_t get_max_depth(uint32_t slab_class) const;
+  uint32_t get_initial_depth(uint32_t slab_class) const;
   void drain_transferred_cache(const Caladan::PreemptGuard &g,
-                               uint32_t slab_shift);
+                               uint32_t slab_class);
 };
 }  // namespace nu
 
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "nu/commons.hpp"
+#include "nu/utils/rcu_lock.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+// An open-addressing hash map in the style of Swiss tables, offering the same
+// interface as SyncHashMap except the pointer-returning getters (slots move
+// upon resizing). Slots are grouped by kGroupSize; each group begins with a
+// cache line holding the 7-bit hash tags of its slots, which get matched with
+// SIMD at once. The map is split into partitions, each of which has its own
+// writer lock and version. Readers of trivially-copyable pairs do not lock;
+// they validate their copies against the partition version (seqlock) and
+// fall back to locking only upon repeated conflicts.
+template <size_t NSlots, typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          typename Allocator = std::allocator<std::pair<const K, V>>,
+          typename Lock = SpinLock>
+class SwissHashMap {
+ public:
+  constexpr static uint32_t kGroupSize = 16;
+  constexpr static uint32_t kPowerNumPartitions = 6;
+  constexpr static uint32_t kNumPartitions = 1 << kPowerNumPartitions;
+  constexpr static uint32_t kMaxLoadFactorPercent = 87;
+  constexpr static uint32_t kMaxOptimisticReadTries = 4;
+  constexpr static bool kOptimisticReads =
+      std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>;
+
+  SwissHashMap();
+  ~SwissHashMap();
+  SwissHashMap(const SwissHashMap &) noexcept;
+  SwissHashMap &operator=(const SwissHashMap &) noexcept;
+  SwissHashMap(SwissHashMap &&) noexcept;
+  SwissHashMap &operator=(SwissHashMap &&) noexcept;
+  template <typename K1>
+  std::optional<V> get_copy(K1 &&k);
+  template <typename K1>
+  std::optional<V> get_copy_with_hash(K1 &&k, uint64_t key_hash);
+  template <typename K1, typename V1>
+  void put(K1 k, V1 v);
+  template <typename K1, typename V1>
+  void put_with_hash(K1 k, V1 v, uint64_t key_hash);
+  template <typename K1, typename... Args>
+  bool try_emplace(K1 k, Args... args);
+  template <typename K1, typename... Args>
+  bool try_emplace_with_hash(K1 k, uint64_t key_hash, Args... args);
+  template <typename K1>
+  bool remove(K1 &&k);
+  template <typename K1>
+  bool remove_with_hash(K1 &&k, uint64_t key_hash);
+  template <typename K1, typename RetT, typename... A0s, typename... A1s>
+  RetT apply(K1 &&k, RetT (*fn)(std::pair<const K, V> &, A0s...),
+             A1s &&... args);
+  template <typename K1, typename RetT, typename... A0s, typename... A1s>
+  RetT apply_with_hash(K1 &&k, uint64_t key_hash,
+                       RetT (*fn)(std::pair<const K, V> &, A0s...),
+                       A1s &&... args);
+  template <typename RetT, typename... A0s, typename... A1s>
+  RetT associative_reduce(bool clear, RetT init_val,
+                          void (*reduce_fn)(RetT &, std::pair<const K, V> &,
+                                            A0s...),
+                          A1s &&...args);
+  template <typename K1>
+  std::optional<V> get_and_remove(K1 &&k);
+  std::vector<std::pair<K, V>> get_all_pairs();
+  std::vector<std::pair<uint64_t, K>> get_all_hashes_and_keys();
+  // Appends the pairs (with their hashes) whose hashes satisfy @pred to
+  // @pairs, scanning from the partition at *@cursor and stopping at a partition
+  // boundary once @pairs holds @max_num. Returns false once all partitions have
+  // been scanned. Suits moving pairs out in pieces.
+  template <typename F>
+  bool get_pairs_if(uint64_t *cursor, std::size_t max_num, F &&pred,
+                    std::vector<std::tuple<K, V, uint64_t>> *pairs);
+  // Removes the pairs whose hashes satisfy @pred and returns their number.
+  template <typename F>
+  uint64_t remove_if(F &&pred);
+  uint64_t size() const;
+  template <class Archive>
+  void save(Archive &ar) const;
+  template <class Archive>
+  void load(Archive &ar);
+
+ private:
+  using Pair = std::pair<const K, V>;
+  constexpr static int8_t kEmpty = -128;
+  constexpr static int8_t kDeleted = -2;
+
+  struct Slot {
+    uint64_t key_hash;
+    alignas(Pair) std::byte storage[sizeof(Pair)];
+
+    Pair *pair() const;
+  };
+  struct alignas(kCacheLineBytes) Group {
+    int8_t tags[kGroupSize];
+    Slot slots[kGroupSize];
+  };
+  struct alignas(kCacheLineBytes) Partition {
+    Lock lock;
+    // Odd while being written.
+    uint32_t version;
+    uint64_t num_groups;
+    uint64_t num_full;
+    uint64_t num_deleted;
+    Group *groups;
+  };
+  // The groups replaced by a resizing, to be freed once no reader can see
+  // them.
+  struct RetiredGroups {
+    Group *groups;
+    uint64_t num_groups;
+  };
+  using GroupAllocator =
+      std::allocator_traits<Allocator>::template rebind_alloc<Group>;
+
+  Partition partitions_[kNumPartitions];
+  RCULock rcu_lock_;
+
+  Partition &get_partition(uint64_t key_hash);
+  static int8_t get_tag(uint64_t key_hash);
+  static uint64_t get_group_idx(uint64_t key_hash);
+  static int8_t &get_tag_ref(Group *groups, Slot *slot);
+  static uint32_t match(const Group &group, int8_t tag);
+  static uint32_t match_empty_or_deleted(const Group &group);
+  static Group *allocate_groups(uint64_t num_groups);
+  static void free_groups(Group *groups, uint64_t num_groups);
+  static void begin_write(Partition &partition);
+  static void end_write(Partition &partition);
+  template <typename K1>
+  static Slot *find(Group *groups, uint64_t num_groups, const K1 &k,
+                    uint64_t key_hash);
+  static Slot *find_free(Group *groups, uint64_t num_groups,
+                         uint64_t key_hash);
+  // Returns false if having given up due to conflicts with writers.
+  template <typename K1>
+  bool optimistic_get_copy(Partition &partition, const K1 &k,
+                           uint64_t key_hash, std::optional<V> *ret);
+  template <typename K1, typename F>
+  Slot *insert(Partition &partition, K1 &&k, uint64_t key_hash, F &&make_v,
+               std::optional<RetiredGroups> *retired);
+  void erase(Partition &partition, Slot *slot);
+  std::optional<RetiredGroups> reserve(Partition &partition);
+  void retire(std::optional<RetiredGroups> &retired);
+  // The following ones are invoked within begin_write() and end_write().
+  void clear(Partition &partition);
+  static void destroy_pairs(Group *groups, uint64_t num_groups);
+};
+}  // namespace nu
+
+#include "nu/impl/swiss_hash_map.ipp"
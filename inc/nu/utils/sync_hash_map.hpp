@@ -6,6 +6,7 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -61,6 +62,16 @@ class SyncHashMap {
   std::optional<V> get_and_remove(K1 &&k);
   std::vector<std::pair<K, V>> get_all_pairs();
   std::vector<std::pair<uint64_t, K>> get_all_hashes_and_keys();
+  // Appends the pairs (with their hashes) whose hashes satisfy @pred to
+  // @pairs, scanning from the bucket at *@cursor and stopping at a bucket
+  // boundary once @pairs holds @max_num. Returns false once all buckets have
+  // been scanned. Suits moving pairs out in pieces.
+  template <typename F>
+  bool get_pairs_if(uint64_t *cursor, std::size_t max_num, F &&pred,
+                    std::vector<std::tuple<K, V, uint64_t>> *pairs);
+  // Removes the pairs whose hashes satisfy @pred and returns their number.
+  template <typename F>
+  uint64_t remove_if(F &&pred);
   template <class Archive>
   void save(Archive &ar) const;
   template <class Archive>
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+
+#include "nu/utils/future.hpp"
+
+namespace nu {
+
+template <typename T = void>
+class Task;
+
+namespace task_internal {
+
+template <typename T>
+class PromiseBase {
+ public:
+  PromiseBase();
+  std::suspend_never initial_suspend() noexcept;
+  std::suspend_never final_suspend() noexcept;
+  // Rethrown by the waiters instead of terminating the program.
+  void unhandled_exception();
+
+ protected:
+  Promise<T> *promise_;
+  std::exception_ptr exception_;
+};
+
+template <typename T>
+class TaskPromise : public PromiseBase<T> {
+ public:
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U &&u);
+};
+
+template <>
+class TaskPromise<void> : public PromiseBase<void> {
+ public:
+  Task<void> get_return_object();
+  void return_void();
+};
+
+}  // namespace task_internal
+
+// Suspends the awaiting coroutine until the future is ready, without holding
+// a thread meanwhile. The thread that fulfills the future resumes the
+// coroutine right away if it runs in the coroutine's proclet, e.g., the one
+// that served a run_co() call, since it would exit otherwise. Other threads,
+// e.g., RPC completion workers, hand the coroutine over to a new thread, which
+// lives in their proclet (if any) so that it stays with the coroutine frame
+// across migrations. Awaiting an lvalue future yields a reference to its
+// value, while awaiting an rvalue one moves the value out.
+template <typename F>
+class FutureAwaiter {
+ public:
+  FutureAwaiter(F &&future);
+  bool await_ready();
+  bool await_suspend(std::coroutine_handle<> handle);
+  decltype(auto) await_resume();
+
+ private:
+  F future_;
+  // Whoever of await_suspend() and the continuation gets here second resumes
+  // the coroutine.
+  std::atomic<bool> raced_;
+};
+
+template <typename T, typename Deleter>
+FutureAwaiter<Future<T, Deleter> &> operator co_await(
+    Future<T, Deleter> &future);
+template <typename T, typename Deleter>
+FutureAwaiter<Future<T, Deleter>> operator co_await(
+    Future<T, Deleter> &&future);
+
+// The return type of coroutines. A task starts eagerly and runs in the calling
+// thread until its first suspension. Its frame is heap-allocated and frees
+// itself once the coroutine is done, so an outstanding task costs a frame
+// rather than a thread stack. The result can be awaited by another coroutine
+// or waited for with get().
+template <typename T>
+class Task {
+ public:
+  using promise_type = task_internal::TaskPromise<T>;
+
+  Task(Future<T> &&future);
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  Task(Task &&) = default;
+  Task &operator=(Task &&) = default;
+  bool is_ready();
+  decltype(auto) get();
+  Future<T> get_future() &&;
+  FutureAwaiter<Future<T> &> operator co_await() &;
+  FutureAwaiter<Future<T>> operator co_await() &&;
+
+ private:
+  Future<T> future_;
+};
+
+}  // namespace nu
+
+#include "nu/impl/task.ipp"
@@ -9,13 +9,13 @@
 #include <vector>
 
 #include "nu/commons.hpp"
+#include "nu/utils/hdr_histogram.hpp"
 
 namespace nu {
 
 class TraceLogger {
  public:
-  constexpr static uint32_t kNumBuckets = 11;
-  constexpr static uint32_t kBucketIntervalUs = 50;
+  constexpr static double kPrintedPercentiles[] = {50, 90, 99, 99.9};
   constexpr static auto kDefaultHeaderStr = "***********TraceLogger***********";
 
   TraceLogger(std::string header_str = kDefaultHeaderStr);
@@ -25,14 +25,11 @@ class TraceLogger {
   template <typename Fn>
   std::pair<uint64_t, uint64_t> add_trace(Fn &&fn);
   void add_trace(uint64_t duration_tsc);
+  ConcurrentHdrHistogram &get_histogram();
 
  private:
-  struct alignas(kCacheLineBytes) AlignedCnt {
-    uint64_t cnt;
-  };
-
   std::string header_str_;
-  AlignedCnt aligned_cnts_[kNumCores][kNumBuckets];
+  ConcurrentHdrHistogram histogram_;
   uint32_t print_interval_us_;
   rt::Thread print_thread_;
   bool disabled_;
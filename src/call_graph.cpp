@@ -0,0 +1,148 @@
+#include <cmath>
+#include <cstring>
+
+extern "C" {
+#include <base/time.h>
+#include <runtime/net.h>
+}
+
+#include "nu/runtime.hpp"
+#include "nu/call_graph.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/rpc_client_mgr.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+static inline uint32_t get_slot_idx(ProcletID caller, ProcletID callee) {
+  // Proclet ids are heap addresses whose low bits are all zeros.
+  auto hash = (caller ^ (callee * 0x9E3779B97F4A7C15ULL)) *
+              0xFF51AFD7ED558CCDULL;
+  return (hash >> 32) % CallGraphSampler::kNumSlots;
+}
+
+CallGraphSampler::CallGraphSampler() {
+  memset(cnts_, 0, sizeof(cnts_));
+  memset(slots_, 0, sizeof(slots_));
+}
+
+void CallGraphSampler::__record(ProcletID caller, ProcletID callee) {
+  ScopedLock lock(&spin_);
+
+  auto idx = get_slot_idx(caller, callee);
+  for (uint32_t i = 0; i < kMaxNumProbes; i++) {
+    auto &slot = slots_[(idx + i) % kNumSlots];
+    if (!slot.cnt) {
+      slot.caller = caller;
+      slot.callee = callee;
+    } else if (slot.caller != caller || slot.callee != callee) {
+      continue;
+    }
+    slot.cnt++;
+    return;
+  }
+}
+
+void CallGraphSampler::__record_local(ProcletHeader *caller_header,
+                                      ProcletHeader *callee_header) {
+  auto local_ip = get_cfg_ip();
+  caller_header->get_stats()->peer_traffic.record(local_ip, kSampleInterval);
+  callee_header->get_stats()->peer_traffic.record(local_ip, kSampleInterval);
+  __record(to_proclet_id(caller_header), to_proclet_id(callee_header));
+}
+
+void CallGraphSampler::__record_outgoing(ProcletHeader *caller_header,
+                                         ProcletID callee) {
+  NodeIP callee_ip;
+  {
+    // Might resolve the location through the controller.
+    RuntimeSlabGuard guard;
+    callee_ip = get_runtime()->rpc_client_mgr()->get_ip_by_proclet_id(callee);
+  }
+  caller_header->get_stats()->peer_traffic.record(callee_ip,
+                                                  kSampleInterval);
+  __record(to_proclet_id(caller_header), callee);
+}
+
+void CallGraphSampler::__record_incoming(NodeIP caller_ip,
+                                         ProcletHeader *callee_header) {
+  // The caller samples the edge itself, only the traffic is accounted here.
+  callee_header->get_stats()->peer_traffic.record(caller_ip,
+                                                  kSampleInterval);
+}
+
+std::vector<CallGraphEdge> CallGraphSampler::drain() {
+  std::vector<CallGraphEdge> edges;
+
+  ScopedLock lock(&spin_);
+  for (auto &slot : slots_) {
+    if (slot.cnt) {
+      edges.push_back(slot);
+      edges.back().cnt *= kSampleInterval;
+      slot.cnt = 0;
+    }
+  }
+  return edges;
+}
+
+CallGraph::CallGraph() : last_decay_us_(microtime()) {}
+
+void CallGraph::add_edges(std::span<const CallGraphEdge> edges) {
+  if (microtime() >= last_decay_us_ + kDecayIntervalUs) {
+    decay();
+  }
+
+  for (const auto &edge : edges) {
+    if (edge.caller != edge.callee) {
+      add_weight(edge.caller, edge.callee, edge.cnt);
+      add_weight(edge.callee, edge.caller, edge.cnt);
+    }
+  }
+}
+
+void CallGraph::add_weight(ProcletID from, ProcletID to, float weight) {
+  adjacency_[from][to] += weight;
+}
+
+void CallGraph::remove_proclet(ProcletID id) {
+  auto iter = adjacency_.find(id);
+  if (iter == adjacency_.end()) {
+    return;
+  }
+
+  for (const auto &[peer, _] : iter->second) {
+    auto peer_iter = adjacency_.find(peer);
+    peer_iter->second.erase(id);
+    if (peer_iter->second.empty()) {
+      adjacency_.erase(peer_iter);
+    }
+  }
+  adjacency_.erase(iter);
+}
+
+const CallGraph::Peers *CallGraph::get_peers(ProcletID id) {
+  auto iter = adjacency_.find(id);
+  return iter != adjacency_.end() ? &iter->second : nullptr;
+}
+
+void CallGraph::decay() {
+  auto num_intervals = (microtime() - last_decay_us_) / kDecayIntervalUs;
+  last_decay_us_ += num_intervals * kDecayIntervalUs;
+  auto factor = std::pow(kDecayFactor, num_intervals);
+
+  // Weights are symmetric, so both directions of an edge go away together.
+  for (auto iter = adjacency_.begin(); iter != adjacency_.end();) {
+    auto &peers = iter->second;
+    for (auto peer_iter = peers.begin(); peer_iter != peers.end();) {
+      peer_iter->second *= factor;
+      if (peer_iter->second < kMinWeight) {
+        peer_iter = peers.erase(peer_iter);
+      } else {
+        peer_iter++;
+      }
+    }
+    iter = peers.empty() ? adjacency_.erase(iter) : std::next(iter);
+  }
+}
+
+}  // namespace nu
@@ -22,4 +22,10 @@ uint32_t str_to_ip(std::string ip_str) {
   return MAKE_IP_ADDR(addr0, addr1, addr2, addr3);
 }
 
+std::string ip_to_str(uint32_t ip) {
+  return std::to_string((ip >> 24) & 0xFF) + "." +
+         std::to_string((ip >> 16) & 0xFF) + "." +
+         std::to_string((ip >> 8) & 0xFF) + "." + std::to_string(ip & 0xFF);
+}
+
 }  // namespace nu
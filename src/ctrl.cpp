@@ -14,6 +14,7 @@ extern "C" {
 #include "nu/ctrl.hpp"
 #include "nu/ctrl_server.hpp"
 #include "nu/migrator.hpp"
+#include "nu/placement.hpp"
 #include "nu/proclet_server.hpp"
 #include "nu/rpc_client_mgr.hpp"
 #include "nu/runtime.hpp"
@@ -37,7 +38,7 @@ Controller::Controller() {
   }
 
   auto &highest_bucket =
-      free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1];
+      free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1].segments;
   for (uint64_t start_addr = kMinProcletHeapVAddr;
        start_addr + kMaxProcletHeapSize <= kMaxProcletHeapVAddr;
        start_addr += kMaxProcletHeapSize) {
@@ -54,6 +55,13 @@ Controller::Controller() {
     free_stack_cluster_segments_.push(range);
   }
 
+  if constexpr (kEnableAffinityPlacement) {
+    placement_policy_.reset(
+        new AffinityPlacementPolicy(&call_graph_, &proclet_locations_));
+  } else {
+    placement_policy_.reset(new RoundRobinPlacementPolicy());
+  }
+
   done_ = false;
 }
 
@@ -171,70 +179,118 @@ void Controller::destroy_lp(lpid_t lpid, NodeIP requestor_ip) {
 }
 
 std::optional<std::pair<ProcletID, NodeIP>> Controller::allocate_proclet(
-    uint64_t capacity, lpid_t lpid, NodeIP ip_hint) {
-  ScopedLock lock(&mutex_);
+    uint64_t capacity, lpid_t lpid, NodeIP ip_hint, ProcletID creator_id) {
+  auto proclets =
+      allocate_proclets(capacity, /* num = */ 1, lpid, ip_hint, creator_id);
+  if (unlikely(proclets.empty())) {
+    return std::nullopt;
+  }
+  return proclets.front();
+}
 
-  auto &bucket =
-      free_proclet_heap_segments_[get_proclet_segment_bucket_id(capacity)];
-  if (unlikely(bucket.empty())) {
-    auto &highest_bucket =
-        free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1];
-    if (unlikely(highest_bucket.empty())) {
-      return std::nullopt;
-    }
-    auto max_segment = highest_bucket.top();
-    highest_bucket.pop();
-    for (auto start_addr = max_segment.range.start;
-         start_addr < max_segment.range.end; start_addr += capacity) {
-      VAddrRange range = {.start = start_addr, .end = start_addr + capacity};
-      bucket.push({range, max_segment.prev_host});
+std::vector<std::pair<ProcletID, NodeIP>> Controller::allocate_proclets(
+    uint64_t capacity, uint32_t num, lpid_t lpid, NodeIP ip_hint,
+    ProcletID creator_id) {
+  std::vector<ProcletHeapSegment> segments;
+  pop_proclet_heap_segments(capacity, num, &segments);
+
+  std::vector<std::pair<ProcletID, NodeIP>> proclets;
+  proclets.reserve(segments.size());
+  if (likely(!segments.empty())) {
+    ScopedLock lock(&mutex_);
+
+    for (const auto &segment : segments) {
+      auto node_ip =
+          select_node_for_proclet(lpid, ip_hint, creator_id, capacity, segment);
+      if (unlikely(!node_ip)) {
+        break;
+      }
+      proclets.emplace_back(segment.range.start, node_ip);
     }
   }
 
-  auto segment = bucket.top();
-  bucket.pop();
-  auto start_addr = segment.range.start;
-  auto id = start_addr;
-  auto node_ip = select_node_for_proclet(lpid, ip_hint, segment);
-  if (unlikely(!node_ip)) {
-    return std::nullopt;
+  for (const auto &[id, node_ip] : proclets) {
+    proclet_locations_.exchange(id, node_ip);
   }
-  auto [iter, _] = proclet_id_to_ip_.try_emplace(id);
-  iter->second = node_ip;
-  return std::make_pair(id, node_ip);
+  for (auto i = proclets.size(); i < segments.size(); i++) {
+    push_proclet_heap_segment(segments[i]);
+  }
+  return proclets;
 }
 
-void Controller::destroy_proclet(VAddrRange proclet_segment) {
-  ScopedLock lock(&mutex_);
+void Controller::pop_proclet_heap_segments(
+    uint64_t capacity, uint32_t num,
+    std::vector<ProcletHeapSegment> *segments) {
+  auto bucket_id = get_proclet_segment_bucket_id(capacity);
+  auto &bucket = free_proclet_heap_segments_[bucket_id];
+  auto &highest_bucket =
+      free_proclet_heap_segments_[kNumProcletSegmentBuckets - 1];
+  segments->reserve(num);
+
+  ScopedLock lock(&bucket.spin);
+  while (segments->size() < num) {
+    if (unlikely(bucket.segments.empty())) {
+      if (unlikely(&bucket == &highest_bucket)) {
+        break;
+      }
+      ProcletHeapSegment max_segment;
+      {
+        ScopedLock highest_lock(&highest_bucket.spin);
+        if (unlikely(highest_bucket.segments.empty())) {
+          break;
+        }
+        max_segment = highest_bucket.segments.top();
+        highest_bucket.segments.pop();
+      }
+      for (auto start_addr = max_segment.range.start;
+           start_addr < max_segment.range.end; start_addr += capacity) {
+        VAddrRange range = {.start = start_addr, .end = start_addr + capacity};
+        bucket.segments.push({range, max_segment.prev_host});
+      }
+    }
+    segments->push_back(bucket.segments.top());
+    bucket.segments.pop();
+  }
+}
 
-  auto capacity = proclet_segment.end - proclet_segment.start;
+void Controller::push_proclet_heap_segment(const ProcletHeapSegment &segment) {
+  auto capacity = segment.range.end - segment.range.start;
   auto &bucket =
       free_proclet_heap_segments_[get_proclet_segment_bucket_id(capacity)];
+
+  ScopedLock lock(&bucket.spin);
+  bucket.segments.push(segment);
+}
+
+void Controller::destroy_proclet(VAddrRange proclet_segment) {
   auto proclet_id = proclet_segment.start;
-  auto iter = proclet_id_to_ip_.find(proclet_id);
-  if (unlikely(iter == proclet_id_to_ip_.end())) {
+  auto prev_host = proclet_locations_.exchange(proclet_id, 0);
+  if (unlikely(!prev_host)) {
     WARN();
     return;
   }
-  bucket.push({proclet_segment, iter->second});
-  proclet_id_to_ip_.erase(iter);
+
+  {
+    ScopedLock lock(&mutex_);
+    call_graph_.remove_proclet(proclet_id);
+  }
+  push_proclet_heap_segment({proclet_segment, prev_host});
 }
 
 NodeIP Controller::resolve_proclet(ProcletID id) {
-  ScopedLock lock(&mutex_);
-
-  auto iter = proclet_id_to_ip_.find(id);
-  return iter != proclet_id_to_ip_.end() ? iter->second : 0;
+  return proclet_locations_.get(id);
 }
 
 NodeIP Controller::select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
+                                           ProcletID creator_id,
+                                           uint64_t capacity,
                                            const ProcletHeapSegment &segment) {
-  auto &[node_statuses, rr_iter, _] = lpid_to_info_[lpid];
-  BUG_ON(node_statuses.empty());
+  auto &info = lpid_to_info_[lpid];
+  BUG_ON(info.node_statuses.empty());
 
   if (ip_hint) {
-    auto iter = node_statuses.find(ip_hint);
-    if (unlikely(iter == node_statuses.end())) {
+    auto iter = info.node_statuses.find(ip_hint);
+    if (unlikely(iter == info.node_statuses.end())) {
       return 0;
     }
     return ip_hint;
@@ -244,21 +300,15 @@ NodeIP Controller::select_node_for_proclet(lpid_t lpid, NodeIP ip_hint,
     return segment.prev_host;
   }
 
-  // TODO: adopt a more sophisticated mechanism once we've added more fields.
-  NodeIP ip;
-  do {
-    if (unlikely(rr_iter == node_statuses.end())) {
-      rr_iter = node_statuses.begin();
-    }
-    ip = rr_iter->first;
-  } while (rr_iter++->second.isol);
-
-  return ip;
+  PlacementRequest req;
+  req.capacity = capacity;
+  req.creator_id = creator_id;
+  return placement_policy_->select(&info, req);
 }
 
 std::pair<NodeIP, Resource> Controller::acquire_migration_dest(
-    lpid_t lpid, NodeIP requestor_ip, bool has_mem_pressure,
-    Resource resource) {
+    lpid_t lpid, NodeIP requestor_ip, bool has_mem_pressure, Resource resource,
+    NodeIP preferred_ip) {
   ScopedLock lock(&mutex_);
 
   auto &[node_statuses, rr_iter, destroying] = lpid_to_info_[lpid];
@@ -269,19 +319,38 @@ std::pair<NodeIP, Resource> Controller::acquire_migration_dest(
   auto initial_rr_iter = rr_iter;
   BUG_ON(node_statuses.empty());
 
+  auto is_candidate_fn = [&](NodeIP ip, const NodeStatus &status) {
+    return ip != requestor_ip && !status.isol && !status.acquired;
+  };
+
   auto search_fn = [&](auto filter_fn) {
     do {
       if (unlikely(rr_iter == node_statuses.end())) {
         rr_iter = node_statuses.begin();
       }
-      if (rr_iter->first != requestor_ip && !rr_iter->second.isol &&
-          !rr_iter->second.acquired && filter_fn(rr_iter->second)) {
+      if (is_candidate_fn(rr_iter->first, rr_iter->second) &&
+          filter_fn(rr_iter->second)) {
         return true;
       }
     } while (++rr_iter != initial_rr_iter);
     return false;
   };
 
+  // Round 0: prefer the node hosting most of the proclet's peers, so that the
+  // migration turns RPCs into local calls. It doesn't advance the round robin.
+  if (preferred_ip) {
+    auto iter = node_statuses.find(preferred_ip);
+    if (iter != node_statuses.end() &&
+        is_candidate_fn(iter->first, iter->second)) {
+      auto &status = iter->second;
+      if (status.has_enough_resource(resource) ||
+          (has_mem_pressure && status.has_enough_mem_resource(resource))) {
+        status.acquired = true;
+        return std::pair(iter->first, status.free_resource);
+      }
+    }
+  }
+
   // Round 1: search for any candidate node that has enough resource.
   if (search_fn([&](const auto &node) {
         return node.has_enough_resource(resource);
@@ -334,11 +403,8 @@ void Controller::release_node(lpid_t lpid, NodeIP ip) {
 }
 
 void Controller::update_location(ProcletID id, NodeIP proclet_srv_ip) {
-  ScopedLock lock(&mutex_);
-
-  auto iter = proclet_id_to_ip_.find(id);
-  BUG_ON(iter == proclet_id_to_ip_.end());
-  iter->second = proclet_srv_ip;
+  // The proclet may have been destroyed right after being migrated.
+  proclet_locations_.update(id, proclet_srv_ip);
 }
 
 std::vector<std::pair<NodeIP, Resource>> Controller::report_free_resource(
@@ -369,6 +435,18 @@ std::vector<std::pair<NodeIP, Resource>> Controller::report_free_resource(
   return global_free_resources;
 }
 
+void Controller::report_call_graph(std::span<const CallGraphEdge> edges) {
+  ScopedLock lock(&mutex_);
+
+  call_graph_.add_edges(edges);
+}
+
+void Controller::set_placement_policy(std::unique_ptr<PlacementPolicy> policy) {
+  ScopedLock lock(&mutex_);
+
+  placement_policy_ = std::move(policy);
+}
+
 void NodeStatus::update_free_resource(Resource resource) {
   ewma(kEWMAWeight, &free_resource.cores, resource.cores);
   ewma(kEWMAWeight, &free_resource.mem_mbs, resource.mem_mbs);
@@ -1,3 +1,5 @@
+#include <cstring>
+
 extern "C" {
 #include <net/ip.h>
 #include <runtime/net.h>
@@ -50,11 +52,12 @@ std::optional<std::pair<lpid_t, VAddrRange>> ControllerClient::register_node(
 }
 
 std::optional<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclet(
-    uint64_t capacity, NodeIP ip_hint) {
+    uint64_t capacity, NodeIP ip_hint, ProcletID creator_id) {
   RPCReqAllocateProclet req;
   req.capacity = capacity;
   req.lpid = lpid_;
   req.ip_hint = ip_hint;
+  req.creator_id = creator_id;
   RPCReturnBuffer return_buf;
   BUG_ON(rpc_client_->Call(to_span(req), &return_buf) != kOk);
   auto &resp = from_span<RPCRespAllocateProclet>(return_buf.get_buf());
@@ -67,6 +70,23 @@ std::optional<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclet(
   }
 }
 
+std::vector<std::pair<ProcletID, NodeIP>> ControllerClient::allocate_proclets(
+    uint64_t capacity, uint32_t num, NodeIP ip_hint, ProcletID creator_id) {
+  RPCReqAllocateProclets req;
+  req.capacity = capacity;
+  req.num = num;
+  req.lpid = lpid_;
+  req.ip_hint = ip_hint;
+  req.creator_id = creator_id;
+  RPCReturnBuffer return_buf;
+  BUG_ON(rpc_client_->Call(to_span(req), &return_buf) != kOk);
+  auto resp = return_buf.get_buf();
+  auto *proclets =
+      reinterpret_cast<const std::pair<ProcletID, NodeIP> *>(resp.data());
+  auto num_proclets = resp.size_bytes() / sizeof(*proclets);
+  return {proclets, proclets + num_proclets};
+}
+
 void ControllerClient::destroy_proclet(VAddrRange heap_segment) {
   RPCReqDestroyProclet req;
   req.heap_segment = heap_segment;
@@ -83,8 +103,24 @@ NodeIP ControllerClient::resolve_proclet(ProcletID id) {
   return resp.ip;
 }
 
+std::vector<NodeIP> ControllerClient::resolve_proclets(
+    std::span<const ProcletID> ids) {
+  RPCReqResolveProclets req;
+  req.num_ids = ids.size();
+  const iovec iovecs[] = {
+      {&req, sizeof(req)},
+      {const_cast<ProcletID *>(ids.data()), ids.size_bytes()}};
+  RPCReturnBuffer return_buf;
+  BUG_ON(rpc_client_->Call(std::span(iovecs), &return_buf) != kOk);
+  auto resp = return_buf.get_buf();
+  BUG_ON(resp.size_bytes() != ids.size() * sizeof(NodeIP));
+  std::vector<NodeIP> ips(ids.size());
+  memcpy(ips.data(), resp.data(), resp.size_bytes());
+  return ips;
+}
+
 std::pair<NodeGuard, Resource> ControllerClient::acquire_migration_dest(
-    bool has_mem_pressure, Resource resource) {
+    bool has_mem_pressure, Resource resource, NodeIP preferred_ip) {
   rt::SpinGuard g(&spin_);
 
   RPCReqAcquireMigrationDest req;
@@ -92,6 +128,7 @@ std::pair<NodeGuard, Resource> ControllerClient::acquire_migration_dest(
   req.src_ip = get_cfg_ip();
   req.has_mem_pressure = has_mem_pressure;
   req.resource = resource;
+  req.preferred_ip = preferred_ip;
   BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
                               /* poll = */ true) != sizeof(req));
 
@@ -156,6 +193,29 @@ std::vector<std::pair<NodeIP, Resource>> ControllerClient::report_free_resource(
   return global_free_resources;
 }
 
+void ControllerClient::report_call_graph(
+    std::span<const CallGraphEdge> edges) {
+  rt::SpinGuard g(&spin_);
+
+  RPCReqReportCallGraph req;
+  req.num_edges = edges.size();
+  const iovec iovecs[] = {{&req, sizeof(req)},
+                          {const_cast<CallGraphEdge *>(edges.data()),
+                           edges.size_bytes()}};
+  BUG_ON(tcp_conn_->WritevFull(std::span(iovecs), /* nt = */ false,
+                               /* poll = */ true) < 0);
+}
+
+void ControllerClient::report_metrics(const NodeMetricsSnapshot &snapshot) {
+  rt::SpinGuard g(&spin_);
+
+  RPCReqReportMetrics req;
+  req.ip = get_runtime()->caladan()->get_ip();
+  req.snapshot = snapshot;
+  BUG_ON(tcp_conn_->WriteFull(&req, sizeof(req), /* nt = */ false,
+                              /* poll = */ true) != sizeof(req));
+}
+
 void ControllerClient::release_node(NodeIP ip) {
   rt::SpinGuard g(&spin_);
 
@@ -16,30 +16,40 @@ namespace nu {
 ControllerServer::ControllerServer()
     : num_register_node_(0),
       num_allocate_proclet_(0),
+      num_allocate_proclets_(0),
       num_destroy_proclet_(0),
       num_resolve_proclet_(0),
+      num_resolve_proclets_(0),
       num_acquire_migration_dest_(0),
       num_acquire_node_(0),
       num_release_node_(0),
       num_update_location_(0),
       num_report_free_resource_(0),
+      num_report_call_graph_(0),
+      num_report_metrics_(0),
       num_destroy_ip_(0),
       done_(false) {
   if constexpr (kEnableLogging) {
     logging_thread_ = rt::Thread([&] {
       std::cout
-          << "time_us register_node allocate_proclet destroy_proclet"
-             "resolve_proclet acquire_migration_dest acquire_node release_node"
-             "update_location report_free_resource destroy_ip"
+          << "time_us register_node allocate_proclet allocate_proclets "
+             "destroy_proclet resolve_proclet resolve_proclets "
+             "acquire_migration_dest acquire_node release_node "
+             "update_location report_free_resource report_call_graph "
+             "report_metrics destroy_ip"
           << std::endl;
       while (!rt::access_once(done_)) {
         timer_sleep(kPrintIntervalUs);
         std::cout << microtime() << " " << num_register_node_ << " "
-                  << num_allocate_proclet_ << " " << num_destroy_proclet_ << " "
-                  << num_resolve_proclet_ << " " << num_acquire_migration_dest_
+                  << num_allocate_proclet_ << " " << num_allocate_proclets_
+                  << " " << num_destroy_proclet_ << " " << num_resolve_proclet_
+                  << " " << num_resolve_proclets_ << " "
+                  << num_acquire_migration_dest_
                   << " " << num_acquire_node_ << " " << num_release_node_ << " "
                   << num_update_location_ << " " << num_report_free_resource_
-                  << " " << num_destroy_ip_ << std::endl;
+                  << " " << num_report_call_graph_ << " "
+                  << num_report_metrics_ << " " << num_destroy_ip_
+                  << std::endl;
       }
     });
   }
@@ -119,6 +129,23 @@ void ControllerServer::tcp_loop(rt::TcpConn *c) {
         BUG_ON(c->WritevFull(std::span(iovecs)) < 0);
         break;
       }
+      case kReportCallGraph: {
+        RPCReqReportCallGraph req;
+        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
+        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        std::vector<CallGraphEdge> edges(req.num_edges);
+        ssize_t edges_size = std::span(edges).size_bytes();
+        BUG_ON(c->ReadFull(edges.data(), edges_size) != edges_size);
+        handle_report_call_graph(edges);
+        break;
+      }
+      case kReportMetrics: {
+        RPCReqReportMetrics req;
+        ssize_t data_size = sizeof(req) - sizeof(rpc_type);
+        BUG_ON(c->ReadFull(&req.rpc_type + 1, data_size) != data_size);
+        handle_report_metrics(req);
+        break;
+      }
       default:
         BUG();
     }
@@ -154,7 +181,8 @@ ControllerServer::handle_allocate_proclet(const RPCReqAllocateProclet &req) {
   }
 
   auto resp = std::make_unique_for_overwrite<RPCRespAllocateProclet>();
-  auto optional = ctrl_.allocate_proclet(req.capacity, req.lpid, req.ip_hint);
+  auto optional = ctrl_.allocate_proclet(req.capacity, req.lpid, req.ip_hint,
+                                         req.creator_id);
   if (optional) {
     resp->empty = false;
     resp->id = optional->first;
@@ -165,6 +193,16 @@ ControllerServer::handle_allocate_proclet(const RPCReqAllocateProclet &req) {
   return resp;
 }
 
+std::vector<std::pair<ProcletID, NodeIP>>
+ControllerServer::handle_allocate_proclets(const RPCReqAllocateProclets &req) {
+  if constexpr (kEnableLogging) {
+    num_allocate_proclets_++;
+  }
+
+  return ctrl_.allocate_proclets(req.capacity, req.num, req.lpid, req.ip_hint,
+                                 req.creator_id);
+}
+
 void ControllerServer::handle_destroy_proclet(
     const RPCReqDestroyProclet &req) {
   if constexpr (kEnableLogging) {
@@ -185,6 +223,21 @@ std::unique_ptr<RPCRespResolveProclet> ControllerServer::handle_resolve_proclet(
   return resp;
 }
 
+std::vector<NodeIP> ControllerServer::handle_resolve_proclets(
+    const RPCReqResolveProclets &req) {
+  if constexpr (kEnableLogging) {
+    num_resolve_proclets_++;
+  }
+
+  // Lookups are lock-free, so there's nothing to amortize within the
+  // controller but the round trips.
+  std::vector<NodeIP> ips(req.num_ids);
+  for (uint32_t i = 0; i < req.num_ids; i++) {
+    ips[i] = ctrl_.resolve_proclet(req.ids[i]);
+  }
+  return ips;
+}
+
 void ControllerServer::handle_update_location(const RPCReqUpdateLocation &req) {
   if constexpr (kEnableLogging) {
     num_update_location_++;
@@ -200,8 +253,9 @@ RPCRespAcquireMigrationDest ControllerServer::handle_acquire_migration_dest(
   }
 
   RPCRespAcquireMigrationDest resp;
-  auto pair = ctrl_.acquire_migration_dest(req.lpid, req.src_ip,
-                                           req.has_mem_pressure, req.resource);
+  auto pair =
+      ctrl_.acquire_migration_dest(req.lpid, req.src_ip, req.has_mem_pressure,
+                                   req.resource, req.preferred_ip);
   resp.ip = pair.first;
   resp.resource = pair.second;
   return resp;
@@ -236,6 +290,23 @@ ControllerServer::handle_report_free_resource(
   return ctrl_.report_free_resource(req.lpid, req.ip, req.resource);
 }
 
+void ControllerServer::handle_report_call_graph(
+    std::span<const CallGraphEdge> edges) {
+  if constexpr (kEnableLogging) {
+    num_report_call_graph_++;
+  }
+
+  ctrl_.report_call_graph(edges);
+}
+
+void ControllerServer::handle_report_metrics(const RPCReqReportMetrics &req) {
+  if constexpr (kEnableLogging) {
+    num_report_metrics_++;
+  }
+
+  cluster_metrics_.update(req.ip, req.snapshot);
+}
+
 void ControllerServer::handle_destroy_lp(const RPCReqDestroyLP &req) {
   if constexpr (kEnableLogging) {
     num_destroy_ip_++;
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <tuple>
+
+extern "C" {
+#include <base/assert.h>
+#include <runtime/net.h>
+}
+
+#include "nu/runtime.hpp"
+#include "nu/metrics.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+static const char *kCounterNames[] = {
+    "calls_in", "local_calls_out", "remote_calls_out", "bytes_serialized",
+    "wrong_client_retries"};
+static_assert(std::size(kCounterNames) == kNumMetricCounters);
+
+static std::string with_labels(const std::string &labels,
+                               const std::string &extra = "") {
+  if (labels.empty() && extra.empty()) {
+    return "";
+  }
+  return "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra +
+         "}";
+}
+
+MetricCounters::MetricCounters() { memset(per_cores_, 0, sizeof(per_cores_)); }
+
+ProcletMetricCounters::ProcletMetricCounters() {
+  for (auto &cnt : cnts_) {
+    cnt.store(0, std::memory_order_relaxed);
+  }
+}
+
+MetricHistogram::MetricHistogram() {
+  memset(per_cores_, 0, sizeof(per_cores_));
+}
+
+void MetricHistogram::record(uint64_t val) {
+  auto idx = std::min(static_cast<uint32_t>(std::bit_width(val)),
+                      kNumBuckets - 1);
+  Caladan::PreemptGuard g;
+  auto &per_core = per_cores_[g.read_cpu()];
+  per_core.sum += val;
+  per_core.buckets[idx]++;
+}
+
+MetricHistogram::Buckets MetricHistogram::get_buckets() const {
+  Buckets buckets{};
+  for (const auto &per_core : per_cores_) {
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      buckets[i] += rt::access_once(per_core.buckets[i]);
+    }
+  }
+  return buckets;
+}
+
+uint64_t MetricHistogram::get_sum() const {
+  uint64_t sum = 0;
+  for (const auto &per_core : per_cores_) {
+    sum += rt::access_once(per_core.sum);
+  }
+  return sum;
+}
+
+void NodeMetricsSnapshot::merge(const NodeMetricsSnapshot &o) {
+  for (uint32_t i = 0; i < kNumMetricCounters; i++) {
+    counters[i] += o.counters[i];
+  }
+  for (uint32_t i = 0; i < MetricHistogram::kNumBuckets; i++) {
+    migration_downtime_us_buckets[i] += o.migration_downtime_us_buckets[i];
+  }
+  migration_downtime_us_sum += o.migration_downtime_us_sum;
+  num_proclets += o.num_proclets;
+  heap_bytes += o.heap_bytes;
+  cpu_load += o.cpu_load;
+}
+
+void NodeMetricsSnapshot::render(std::ostringstream *oss,
+                                 const std::string &labels) const {
+  auto l = with_labels(labels);
+  for (uint32_t i = 0; i < kNumMetricCounters; i++) {
+    *oss << "nu_" << kCounterNames[i] << "_total" << l << " " << counters[i]
+         << "\n";
+  }
+
+  // Prometheus buckets are cumulative and keyed by their inclusive bounds.
+  uint64_t cnt = 0;
+  for (uint32_t i = 0; i < MetricHistogram::kNumBuckets - 1; i++) {
+    cnt += migration_downtime_us_buckets[i];
+    auto le = "le=\"" + std::to_string((1ULL << i) - 1) + "\"";
+    *oss << "nu_migration_downtime_us_bucket" << with_labels(labels, le)
+         << " " << cnt << "\n";
+  }
+  cnt += migration_downtime_us_buckets[MetricHistogram::kNumBuckets - 1];
+  *oss << "nu_migration_downtime_us_bucket"
+       << with_labels(labels, "le=\"+Inf\"") << " " << cnt << "\n";
+  *oss << "nu_migration_downtime_us_sum" << l << " "
+       << migration_downtime_us_sum << "\n";
+  *oss << "nu_migration_downtime_us_count" << l << " " << cnt << "\n";
+
+  *oss << "nu_proclets" << l << " " << num_proclets << "\n";
+  *oss << "nu_heap_bytes" << l << " " << heap_bytes << "\n";
+  *oss << "nu_cpu_load" << l << " " << cpu_load << "\n";
+}
+
+ScrapeEndpoint::ScrapeEndpoint(uint16_t port,
+                               std::function<std::string()> render)
+    : render_(std::move(render)) {
+  netaddr laddr{.ip = 0, .port = port};
+  tcp_queue_.reset(rt::TcpQueue::Listen(laddr, kTCPListenBackLog));
+  BUG_ON(!tcp_queue_);
+  th_ = rt::Thread([&] {
+    rt::TcpConn *c;
+    while ((c = tcp_queue_->Accept())) {
+      {
+        ScopedLock lock(&spin_);
+        conns_.insert(c);
+      }
+      wg_.Add(1);
+      rt::Thread([&, c] {
+        serve(c);
+        {
+          ScopedLock lock(&spin_);
+          conns_.erase(c);
+        }
+        delete c;
+        wg_.Done();
+      }).Detach();
+    }
+  });
+}
+
+ScrapeEndpoint::~ScrapeEndpoint() {
+  tcp_queue_->Shutdown();
+  th_.Join();
+  {
+    // Unblocks the connections still waiting for their requests.
+    ScopedLock lock(&spin_);
+    for (auto *c : conns_) {
+      c->Abort();
+    }
+  }
+  wg_.Wait();
+}
+
+void ScrapeEndpoint::serve(rt::TcpConn *c) {
+  // Whatever is requested, e.g., "GET /metrics", gets all the metrics.
+  char req[kMaxReqLen];
+  if (c->Read(req, sizeof(req)) <= 0) {
+    return;
+  }
+
+  auto body = render_();
+  auto header = "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n";
+  const iovec iovecs[] = {{header.data(), header.size()},
+                          {body.data(), body.size()}};
+  c->WritevFull(std::span(iovecs));
+  c->Shutdown(SHUT_RDWR);
+}
+
+MetricsRegistry::MetricsRegistry()
+    : endpoint_(std::make_unique<ScrapeEndpoint>(kPort,
+                                                 [this] { return render(); })) {
+}
+
+void MetricsRegistry::record(ProcletHeader *header, MetricCounter counter,
+                             uint64_t delta) {
+  if (header) {
+    header->get_stats()->metrics.add(counter, delta);
+  }
+  counters_.add(counter, delta);
+}
+
+void MetricsRegistry::record_local_call(ProcletHeader *caller_header,
+                                        ProcletHeader *callee_header) {
+  caller_header->get_stats()->metrics.add(kLocalCallsOut, 1);
+  callee_header->get_stats()->metrics.add(kCallsIn, 1);
+  Caladan::PreemptGuard g;
+  counters_.add(g, kLocalCallsOut, 1);
+  counters_.add(g, kCallsIn, 1);
+}
+
+void MetricsRegistry::record_migration(uint64_t downtime_us) {
+  migration_downtimes_us_.record(downtime_us);
+}
+
+NodeMetricsSnapshot MetricsRegistry::take_snapshot() {
+  NodeMetricsSnapshot snapshot{};
+  for (uint32_t i = 0; i < kNumMetricCounters; i++) {
+    snapshot.counters[i] = counters_.get(static_cast<MetricCounter>(i));
+  }
+  snapshot.migration_downtime_us_buckets =
+      migration_downtimes_us_.get_buckets();
+  snapshot.migration_downtime_us_sum = migration_downtimes_us_.get_sum();
+
+  auto *proclet_mgr = get_runtime()->proclet_manager();
+  for (auto *proclet_base : proclet_mgr->get_all_proclets()) {
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+    auto optional_info = proclet_mgr->get_proclet_info(
+        proclet_header, std::function([&](const ProcletHeader *header) {
+          return std::make_pair(header->heap_size(),
+                                header->cpu_load.get_load());
+        }));
+    if (likely(optional_info)) {
+      snapshot.num_proclets++;
+      snapshot.heap_bytes += optional_info->first;
+      snapshot.cpu_load += optional_info->second;
+    }
+  }
+  return snapshot;
+}
+
+std::string MetricsRegistry::render() {
+  std::ostringstream oss;
+  take_snapshot().render(&oss, "");
+
+  auto *proclet_mgr = get_runtime()->proclet_manager();
+  for (auto *proclet_base : proclet_mgr->get_all_proclets()) {
+    auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+    auto optional_info = proclet_mgr->get_proclet_info(
+        proclet_header, std::function([&](const ProcletHeader *header) {
+          std::array<uint64_t, kNumMetricCounters> counters{};
+          auto *stats = header->peek_stats();
+          for (uint32_t i = 0; stats && i < kNumMetricCounters; i++) {
+            counters[i] = stats->metrics.get(static_cast<MetricCounter>(i));
+          }
+          return std::make_tuple(
+              counters, header->heap_size(), header->slab.get_wasted_bytes(),
+              header->cpu_load.get_load(), header->num_migrations);
+        }));
+    if (unlikely(!optional_info)) {
+      continue;
+    }
+
+    auto &[counters, heap_bytes, wasted_bytes, cpu_load, num_migrations] =
+        *optional_info;
+    auto l = "{proclet=\"" + std::to_string(to_proclet_id(proclet_header)) +
+             "\"}";
+    for (uint32_t i = 0; i < kNumMetricCounters; i++) {
+      oss << "nu_proclet_" << kCounterNames[i] << "_total" << l << " "
+          << counters[i] << "\n";
+    }
+    oss << "nu_proclet_heap_bytes" << l << " " << heap_bytes << "\n";
+    // The part of the heap that holds no requested data.
+    oss << "nu_proclet_heap_wasted_bytes" << l << " " << wasted_bytes << "\n";
+    oss << "nu_proclet_cpu_load" << l << " " << cpu_load << "\n";
+    oss << "nu_proclet_migrations_total" << l << " " << num_migrations << "\n";
+  }
+  return oss.str();
+}
+
+ClusterMetrics::ClusterMetrics()
+    : endpoint_(std::make_unique<ScrapeEndpoint>(kPort,
+                                                 [this] { return render(); })) {
+}
+
+void ClusterMetrics::update(NodeIP ip, const NodeMetricsSnapshot &snapshot) {
+  ScopedLock lock(&spin_);
+  snapshots_[ip] = snapshot;
+}
+
+std::string ClusterMetrics::render() {
+  decltype(snapshots_) snapshots;
+  {
+    ScopedLock lock(&spin_);
+    snapshots = snapshots_;
+  }
+
+  std::ostringstream oss;
+  NodeMetricsSnapshot sum{};
+  for (const auto &[_, snapshot] : snapshots) {
+    sum.merge(snapshot);
+  }
+  oss << "nu_nodes " << snapshots.size() << "\n";
+  sum.render(&oss, "");
+  for (const auto &[ip, snapshot] : snapshots) {
+    snapshot.render(&oss, "node=\"" + ip_to_str(ip) + "\"");
+  }
+  return oss.str();
+}
+
+}  // namespace nu
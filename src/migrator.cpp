@@ -1,10 +1,15 @@
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <limits>
+#include <map>
 #include <memory>
+#include <numeric>
 #include <span>
 #include <syncstream>
 
@@ -19,13 +24,16 @@ extern "C" {
 
 #include "nu/commons.hpp"
 #include "nu/ctrl_client.hpp"
+#include "nu/metrics.hpp"
 #include "nu/migrator.hpp"
 #include "nu/runtime.hpp"
 #include "nu/pressure_handler.hpp"
 #include "nu/proclet_mgr.hpp"
 #include "nu/proclet_server.hpp"
+#include "nu/tracer.hpp"
 #include "nu/utils/cond_var.hpp"
 #include "nu/utils/mutex.hpp"
+#include "nu/utils/page_codec.hpp"
 #include "nu/utils/scoped_lock.hpp"
 #include "nu/utils/thread.hpp"
 
@@ -99,6 +107,15 @@ void MigratorConnManager::put(uint32_t ip, rt::TcpConn *tcp_conn) {
 
 Migrator::Migrator() {
   callback_triggered_ = true;
+  pre_copy_ = kEnablePreCopy;
+  post_copy_ = kEnablePostCopy;
+  sparse_copy_ = kEnableSparseCopy;
+  compression_ = kEnableCompression;
+  forced_compression_ = false;
+  location_push_ = kEnableLocationPush;
+  // Assume the nominal bandwidth until the first measurement.
+  link_rate_ = Utility::kNetBwGbps * 1000 / 8;
+  link_rate_measured_ = false;
   run_background_loop();
 }
 
@@ -107,6 +124,20 @@ Migrator::~Migrator() {
   th_.Join();
 }
 
+static inline void reclaim_stale_proclet(ProcletHeader *proclet_header) {
+  auto status = load_acquire(&proclet_header->status());
+  if (unlikely(status == kDepopulating || status == kCleaning ||
+               status == kPostCopying)) {
+    ScopedLock l(&proclet_header->migration_spin());
+
+    if (proclet_header->status() == kCleaning ||
+        proclet_header->status() == kPostCopying) {
+      std::destroy_at(&proclet_header->slab);
+    }
+    proclet_header->status() = kAbsent;
+  }
+}
+
 void Migrator::handle_copy_proclet(rt::TcpConn *c) {
   ProcletHeader *proclet_header;
   uint64_t start_addr, len;
@@ -116,19 +147,264 @@ void Migrator::handle_copy_proclet(rt::TcpConn *c) {
   BUG_ON(c->ReadvFull(std::span(iovecs), /* nt = */ false, /* poll = */ true) <=
          0);
 
-  auto status = load_acquire(&proclet_header->status());
-  if (unlikely(status == kDepopulating || status == kCleaning)) {
-    ScopedLock l(&proclet_header->migration_spin());
+  reclaim_stale_proclet(proclet_header);
 
-    if (proclet_header->status() == kCleaning) {
-      std::destroy_at(&proclet_header->slab);
+  BUG_ON(c->ReadFull(reinterpret_cast<uint8_t *>(start_addr), len,
+                     /* nt = */ true, /* poll = */ true) <= 0);
+  proclet_header->pending_load_cnt--;
+}
+
+void Migrator::handle_copy_proclet_extents(rt::TcpConn *c, bool compressed) {
+  ProcletHeader *proclet_header;
+  uint64_t num_extents;
+  const iovec iovecs[] = {{&proclet_header, sizeof(proclet_header)},
+                          {&num_extents, sizeof(num_extents)}};
+  BUG_ON(c->ReadvFull(std::span(iovecs), /* nt = */ false, /* poll = */ true) <=
+         0);
+
+  reclaim_stale_proclet(proclet_header);
+
+  auto extents = std::make_unique_for_overwrite<VAddrRange[]>(num_extents);
+  BUG_ON(c->ReadFull(extents.get(), num_extents * sizeof(VAddrRange),
+                     /* nt = */ false, /* poll = */ true) <= 0);
+  if (!compressed) {
+    for (uint64_t i = 0; i < num_extents; i++) {
+      auto [start_addr, end_addr] = extents[i];
+      BUG_ON(c->ReadFull(reinterpret_cast<uint8_t *>(start_addr),
+                         end_addr - start_addr,
+                         /* nt = */ true, /* poll = */ true) <= 0);
     }
-    proclet_header->status() = kAbsent;
+    proclet_header->pending_load_cnt--;
+    return;
   }
 
+  PageCodec codec;
+  for (uint64_t i = 0; i < num_extents; i++) {
+    auto [start_addr, end_addr] = extents[i];
+    for (auto addr = start_addr; addr < end_addr;
+         addr += PageCodec::kBlockSize) {
+      auto len = std::min(end_addr - addr, PageCodec::kBlockSize);
+      PageBlockHeader hdr;
+      BUG_ON(c->ReadFull(&hdr, sizeof(hdr), /* nt = */ false,
+                         /* poll = */ true) <= 0);
+      BUG_ON(hdr.payload_len > PageCodec::kMaxPayloadLen);
+
+      // Stored blocks without zero pages are read in place.
+      auto *dst = reinterpret_cast<std::byte *>(addr);
+      auto *payload = (!hdr.compressed && !hdr.zero_pages)
+                          ? dst
+                          : codec.get_payload_buf();
+      if (hdr.payload_len) {
+        BUG_ON(c->ReadFull(payload, hdr.payload_len, /* nt = */ false,
+                           /* poll = */ true) <= 0);
+      }
+      BUG_ON(!codec.decode(hdr, payload, dst, len));
+    }
+  }
+  proclet_header->pending_load_cnt--;
+}
+
+void Migrator::handle_post_copy_proclet(rt::TcpConn *c) {
+  ProcletHeader *proclet_header;
+  uint64_t start_addr, len, lazy_end_addr;
+  const iovec iovecs[] = {{&proclet_header, sizeof(proclet_header)},
+                          {&start_addr, sizeof(start_addr)},
+                          {&len, sizeof(len)},
+                          {&lazy_end_addr, sizeof(lazy_end_addr)}};
+  BUG_ON(c->ReadvFull(std::span(iovecs), /* nt = */ false, /* poll = */ true) <=
+         0);
+
+  reclaim_stale_proclet(proclet_header);
+
   BUG_ON(c->ReadFull(reinterpret_cast<uint8_t *>(start_addr), len,
                      /* nt = */ true, /* poll = */ true) <= 0);
-  proclet_header->pending_load_cnt--;
+
+  // Must be armed before any thread of the proclet gets loaded.
+  auto session = std::make_unique<PostCopySession>(
+      VAddrRange{start_addr + len, lazy_end_addr});
+
+  uint64_t num_eager_pages;
+  BUG_ON(c->ReadFull(&num_eager_pages, sizeof(num_eager_pages),
+                     /* nt = */ false, /* poll = */ true) <= 0);
+  std::vector<uint64_t> eager_pages(num_eager_pages);
+  if (num_eager_pages) {
+    BUG_ON(c->ReadFull(eager_pages.data(), num_eager_pages * sizeof(uint64_t),
+                       /* nt = */ false, /* poll = */ true) <= 0);
+  }
+  auto page = std::make_unique_for_overwrite<std::byte[]>(kPageSize);
+  for (auto addr : eager_pages) {
+    BUG_ON(c->ReadFull(page.get(), kPageSize, /* nt = */ true,
+                       /* poll = */ true) <= 0);
+    BUG_ON(!session->handler.install(addr, page.get(), kPageSize));
+  }
+  // The free runs are never read, but carving them writes to their objects.
+  for (auto [run_start, run_end] :
+       proclet_header->slab.get_free_run_extents(kPageSize)) {
+    run_start = std::max(run_start, start_addr + len);
+    run_end = std::min(run_end, lazy_end_addr);
+    if (run_start < run_end) {
+      BUG_ON(!session->handler.zero(run_start, run_end - run_start));
+    }
+  }
+
+  rt::SpinGuard guard(&post_copy_spin_);
+  BUG_ON(!post_copy_sessions_.emplace(proclet_header, std::move(session))
+              .second);
+}
+
+bool Migrator::serve_post_copy_faults(rt::TcpConn *c,
+                                      PostCopySession *session) {
+  std::vector<uint64_t> fault_addrs;
+  if (unlikely(!session->handler.poll_faults(&fault_addrs))) {
+    return false;
+  }
+  if (fault_addrs.empty()) {
+    return true;
+  }
+  return c->WriteFull(fault_addrs.data(),
+                      fault_addrs.size() * sizeof(uint64_t)) > 0;
+}
+
+bool Migrator::handle_post_copy_session(rt::TcpConn *c) {
+  ProcletHeader *proclet_header;
+  BUG_ON(c->ReadFull(&proclet_header, sizeof(proclet_header)) <= 0);
+
+  // The session might arrive before the proclet metadata gets loaded.
+  PostCopySession *session = nullptr;
+  while (true) {
+    {
+      rt::SpinGuard guard(&post_copy_spin_);
+      auto it = post_copy_sessions_.find(proclet_header);
+      if (it != post_copy_sessions_.end()) {
+        session = it->second.get();
+      }
+    }
+    if (session) {
+      break;
+    }
+    get_runtime()->caladan()->thread_yield();
+  }
+
+  [[maybe_unused]] auto t0 = microtime();
+  auto buf = std::make_unique_for_overwrite<std::byte[]>(kPostCopyChunkSize);
+  PostCopyChunk chunk;
+  uint64_t recv_len = 0;
+  auto last_recv_us = microtime();
+  bool lost = false;
+
+  while (true) {
+    if (unlikely(!serve_post_copy_faults(c, session))) {
+      lost = true;
+      break;
+    }
+
+    if (!c->HasPendingDataToRead()) {
+      if (unlikely(microtime() - last_recv_us > kPostCopySourceTimeoutUs)) {
+        lost = true;
+        break;
+      }
+      get_runtime()->caladan()->thread_yield();
+      continue;
+    }
+
+    // Only read what has arrived, so that a dead source never blocks us.
+    std::byte *dst;
+    uint64_t remaining;
+    if (recv_len < sizeof(chunk)) {
+      dst = reinterpret_cast<std::byte *>(&chunk) + recv_len;
+      remaining = sizeof(chunk) - recv_len;
+    } else {
+      dst = buf.get() + (recv_len - sizeof(chunk));
+      remaining = sizeof(chunk) + chunk.len - recv_len;
+    }
+    auto ret = c->Read(dst, remaining);
+    if (unlikely(ret <= 0)) {
+      lost = true;
+      break;
+    }
+    recv_len += ret;
+    last_recv_us = microtime();
+
+    if (recv_len < sizeof(chunk)) {
+      continue;
+    }
+    if (!chunk.len) {
+      // All pages have been pushed.
+      break;
+    }
+    BUG_ON(chunk.len > kPostCopyChunkSize);
+    if (recv_len < sizeof(chunk) + chunk.len) {
+      continue;
+    }
+    if (unlikely(!session->handler.install(chunk.start_addr, buf.get(),
+                                           chunk.len))) {
+      lost = true;
+      break;
+    }
+    recv_len = 0;
+  }
+
+  if (likely(!lost)) {
+    // Close the session; the source stops reading fault requests after this.
+    uint64_t end_marker = 0;
+    BUG_ON(c->WriteFull(&end_marker, sizeof(end_marker)) < 0);
+  }
+
+  if constexpr (kEnableLogging) {
+    Caladan::PreemptGuard g;
+
+    std::osyncstream synced_out(std::cout);
+    synced_out << "Post-copy session: addr = " << proclet_header
+               << ", lost = " << lost << ", time_us = " << microtime() - t0
+               << std::endl;
+  }
+
+  finish_post_copy_session(proclet_header, lost);
+  return !lost;
+}
+
+void Migrator::finish_post_copy_session(ProcletHeader *proclet_header,
+                                        bool lost) {
+  std::unique_ptr<PostCopySession> gc;
+  rt::SpinGuard guard(&post_copy_spin_);
+
+  auto it = post_copy_sessions_.find(proclet_header);
+  auto &session = it->second;
+  if (unlikely(lost)) {
+    // Never zero-fill the missing pages. Instead, the threads waiting for them
+    // get terminated, and so do the ones touching them later on.
+    session->handler.abort();
+    session->lost = true;
+    if (!session->loaded) {
+      // Torn down by mark_proclet_loaded().
+      return;
+    }
+    // Invocations from now on fail with kErrLost instead of being retried.
+    get_runtime()->proclet_manager()->remove_for_loss(proclet_header);
+  } else if (session->loaded) {
+    proclet_header->migratable = true;
+  }
+  gc = std::move(session);
+  post_copy_sessions_.erase(it);
+}
+
+void Migrator::mark_proclet_loaded(ProcletHeader *proclet_header) {
+  rt::SpinGuard guard(&post_copy_spin_);
+
+  auto it = post_copy_sessions_.find(proclet_header);
+  if (likely(it == post_copy_sessions_.end())) {
+    proclet_header->migratable = true;
+    return;
+  }
+
+  // Stays unmigratable until all pages have arrived.
+  auto &session = it->second;
+  session->loaded = true;
+  if (unlikely(session->lost)) {
+    get_runtime()->proclet_manager()->remove_for_loss(proclet_header);
+    auto gc = std::move(session);
+    post_copy_sessions_.erase(it);
+  }
 }
 
 inline void Migrator::handle_load(rt::TcpConn *c) {
@@ -160,7 +436,8 @@ void Migrator::run_background_loop() {
       tcp_conns.emplace_back(c);
       ths.emplace_back([&, c] {
         bool poll = false;
-        while (true) {
+        bool alive = true;
+        while (alive) {
           uint8_t type;
           if (unlikely(c->ReadFull(&type, sizeof(type), /* nt = */ false,
                                    poll) <= 0)) {
@@ -170,9 +447,18 @@ void Migrator::run_background_loop() {
             case kCopyProclet:
               handle_copy_proclet(c);
               break;
+            case kCopyProcletExtents:
+              handle_copy_proclet_extents(c, /* compressed = */ false);
+              break;
+            case kCopyProcletCompressedExtents:
+              handle_copy_proclet_extents(c, /* compressed = */ true);
+              break;
             case kMigrate:
               handle_load(c);
               break;
+            case kPostCopySession:
+              alive = handle_post_copy_session(c);
+              break;
             case kEnablePoll:
               poll = true;
               preempt_disable();
@@ -212,8 +498,8 @@ inline void throttle(uint64_t len, uint64_t real_us) {
 }
 
 void Migrator::transmit_proclet(rt::TcpConn *c, ProcletHeader *proclet_header) {
-  constexpr bool kMonitorTime =
-      (kEnableLogging || kMigrationThrottleGBs > 0 || kMigrationDelayUs);
+  constexpr bool kMonitorTime = (kEnableLogging || kMigrationThrottleGBs > 0 ||
+                                 kMigrationDelayUs || kEnableCompression);
   [[maybe_unused]] uint64_t t0, t1;
 
   if constexpr (kMonitorTime) {
@@ -262,6 +548,10 @@ void Migrator::transmit_proclet(rt::TcpConn *c, ProcletHeader *proclet_header) {
     t1 = microtime();
   }
 
+  if constexpr (kEnableCompression) {
+    update_link_rate(len, t1 - t0);
+  }
+
   if constexpr (kMigrationDelayUs) {
     auto remote_ip = c->RemoteAddr().ip;
     auto delayed = delayed_srv_ips_.contains(remote_ip);
@@ -284,6 +574,480 @@ void Migrator::transmit_proclet(rt::TcpConn *c, ProcletHeader *proclet_header) {
   }
 }
 
+uint64_t Migrator::transmit_proclet_extents(
+    rt::TcpConn *c, ProcletHeader *proclet_header,
+    const std::vector<VAddrRange> &extents, bool compress) {
+  std::vector<VAddrRange> per_thread_extents[kTransmitProcletNumThreads];
+  auto t0 = microtime();
+  uint64_t len = 0;
+
+  for (auto [start_addr, end_addr] : extents) {
+    len += end_addr - start_addr;
+    while (start_addr < end_addr) {
+      auto stripe_idx = start_addr / kPreCopyStripeSize;
+      auto stripe_end =
+          std::min(end_addr, (stripe_idx + 1) * kPreCopyStripeSize);
+      auto &thread_extents =
+          per_thread_extents[stripe_idx % kTransmitProcletNumThreads];
+      if (!thread_extents.empty() && thread_extents.back().end == start_addr) {
+        thread_extents.back().end = stripe_end;
+      } else {
+        thread_extents.push_back({start_addr, stripe_end});
+      }
+      start_addr = stripe_end;
+    }
+  }
+
+  uint8_t type = kCopyProcletExtents;
+  uint64_t num_extents[kTransmitProcletNumThreads];
+  uint64_t num_copy_tasks = 0;
+
+  for (uint32_t i = 0; i < kTransmitProcletNumThreads; i++) {
+    auto &thread_extents = per_thread_extents[i];
+    num_extents[i] = thread_extents.size();
+    if (!num_extents[i]) {
+      continue;
+    }
+    num_copy_tasks++;
+
+    if (compress) {
+      auto fn = [this, proclet_header, &thread_extents](rt::TcpConn *c) {
+        transmit_compressed_extents(c, proclet_header, thread_extents);
+      };
+      if (i < PressureHandler::kNumAuxHandlers) {
+        get_runtime()->pressure_handler()->dispatch_aux_tcp_fn_task(
+            i, std::move(fn));
+      } else {
+        fn(c);
+      }
+      continue;
+    }
+
+    std::vector<iovec> task{
+        {&type, sizeof(type)},
+        {&proclet_header, sizeof(proclet_header)},
+        {&num_extents[i], sizeof(num_extents[i])},
+        {thread_extents.data(), num_extents[i] * sizeof(VAddrRange)}};
+    for (auto [start_addr, end_addr] : thread_extents) {
+      task.push_back(
+          {reinterpret_cast<std::byte *>(start_addr), end_addr - start_addr});
+    }
+    if (i < PressureHandler::kNumAuxHandlers) {
+      // Dispatch to aux handler.
+      get_runtime()->pressure_handler()->dispatch_aux_tcp_task(i,
+                                                               std::move(task));
+    } else {
+      // Execute the task itself.
+      BUG_ON(c->WritevFull(std::span<const iovec>(task), /* nt = */ true,
+                           /* poll = */ true) < 0);
+    }
+  }
+
+  get_runtime()->pressure_handler()->wait_aux_tasks();
+
+  if constexpr (kEnableCompression) {
+    if (!compress) {
+      update_link_rate(len, microtime() - t0);
+    }
+  }
+
+  return num_copy_tasks;
+}
+
+void Migrator::transmit_compressed_extents(
+    rt::TcpConn *c, ProcletHeader *proclet_header,
+    const std::vector<VAddrRange> &extents) {
+  uint8_t type = kCopyProcletCompressedExtents;
+  uint64_t num_extents = extents.size();
+  const iovec iovecs[] = {
+      {&type, sizeof(type)},
+      {&proclet_header, sizeof(proclet_header)},
+      {&num_extents, sizeof(num_extents)},
+      {const_cast<VAddrRange *>(extents.data()),
+       num_extents * sizeof(VAddrRange)}};
+  BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ false,
+                       /* poll = */ true) < 0);
+
+  PageCodec codec;
+  for (auto [start_addr, end_addr] : extents) {
+    for (auto addr = start_addr; addr < end_addr;
+         addr += PageCodec::kBlockSize) {
+      auto len = std::min(end_addr - addr, PageCodec::kBlockSize);
+      PageBlockHeader hdr;
+      auto payload =
+          codec.encode(reinterpret_cast<const std::byte *>(addr), len, &hdr);
+      const iovec block_iovecs[] = {
+          {&hdr, sizeof(hdr)},
+          {const_cast<std::byte *>(payload.data()), payload.size()}};
+      BUG_ON(c->WritevFull(std::span(block_iovecs), /* nt = */ false,
+                           /* poll = */ true) < 0);
+    }
+  }
+}
+
+bool Migrator::should_compress(ProcletHeader *proclet_header) {
+  auto start_addr = reinterpret_cast<uint64_t>(proclet_header->slab.get_base());
+  auto len = proclet_header->slab.get_usage();
+  if (len < kMinCompressionHeapSize) {
+    return false;
+  }
+
+  // Probe evenly spaced blocks. The proclet is still running, so the result
+  // is merely an estimate.
+  PageCodec codec;
+  auto stride = len / kNumCompressionProbeBlocks;
+  uint64_t in_bytes = kNumCompressionProbeBlocks * PageCodec::kBlockSize;
+  uint64_t out_bytes = 0;
+  auto t0 = microtime();
+  for (uint32_t i = 0; i < kNumCompressionProbeBlocks; i++) {
+    PageBlockHeader hdr;
+    auto *block = reinterpret_cast<const std::byte *>(start_addr + i * stride);
+    out_bytes +=
+        sizeof(hdr) + codec.encode(block, PageCodec::kBlockSize, &hdr).size();
+  }
+  auto us = std::max(microtime() - t0, static_cast<uint64_t>(1));
+
+  // The copy runs at the pace of the slower of the compressors and the link.
+  auto ratio = static_cast<float>(out_bytes) / in_bytes;
+  auto compress_rate =
+      static_cast<float>(in_bytes) / us * kTransmitProcletNumThreads;
+  auto rate = std::min(compress_rate, link_rate_ / ratio);
+
+  if constexpr (kEnableLogging) {
+    Caladan::PreemptGuard g;
+
+    std::osyncstream synced_out(std::cout);
+    synced_out << "Probe compression: addr = " << proclet_header
+               << ", ratio = " << ratio
+               << ", compress_rate = " << compress_rate
+               << ", link_rate = " << link_rate_ << std::endl;
+  }
+  return rate > link_rate_;
+}
+
+void Migrator::update_link_rate(uint64_t len, uint64_t us) {
+  if (len < kMinLinkRateSampleBytes || !us) {
+    return;
+  }
+  auto rate = static_cast<float>(len) / us;
+  if (unlikely(!link_rate_measured_)) {
+    link_rate_measured_ = true;
+    link_rate_ = rate;
+  } else {
+    link_rate_ += (rate - link_rate_) * kLinkRateEWMAWeight;
+  }
+}
+
+void Migrator::transmit_sparse_proclet(rt::TcpConn *c,
+                                       ProcletHeader *proclet_header,
+                                       bool compress) {
+  auto &slab = proclet_header->slab;
+  auto page_size = proclet_header->page_size();
+  if (sparse_copy_) {
+    slab.release_free_runs(page_size,
+                           std::max(kMinSparseExtentBytes, page_size));
+  }
+
+  auto copy_start = reinterpret_cast<uint64_t>(proclet_header->copy_start);
+  auto end_addr = reinterpret_cast<uint64_t>(slab.get_base()) +
+                  slab.get_usage();
+  auto start_addr = copy_start;
+  std::vector<VAddrRange> extents;
+  for (auto [hole_start, hole_end] : slab.get_free_run_extents(page_size)) {
+    if (start_addr < hole_start) {
+      extents.push_back({start_addr, hole_start});
+    }
+    start_addr = std::max(start_addr, hole_end);
+  }
+  if (start_addr < end_addr) {
+    extents.push_back({start_addr, end_addr});
+  }
+
+  uint8_t type = kCommitSparseCopy;
+  uint64_t num_copy_tasks =
+      transmit_proclet_extents(c, proclet_header, extents, compress);
+  const iovec iovecs[] = {{&type, sizeof(type)},
+                          {&num_copy_tasks, sizeof(num_copy_tasks)}};
+  BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ false,
+                       /* poll = */ true) < 0);
+
+  if constexpr (kEnableLogging) {
+    Caladan::PreemptGuard g;
+
+    auto sent_bytes = std::accumulate(
+        extents.begin(), extents.end(), static_cast<uint64_t>(0),
+        [](uint64_t sum, const VAddrRange &e) {
+          return sum + e.end - e.start;
+        });
+    std::osyncstream synced_out(std::cout);
+    synced_out << "Transmit sparse proclet: addr = " << proclet_header
+               << ", size = " << sent_bytes
+               << ", skipped = " << end_addr - copy_start - sent_bytes
+               << ", compressed = " << compress << std::endl;
+  }
+}
+
+std::vector<VAddrRange> Migrator::collect_dirty_extents(
+    ProcletHeader *proclet_header, PreCopyState *state) {
+  auto tracked_start = reinterpret_cast<uint64_t>(proclet_header);
+  auto copy_start = reinterpret_cast<uint64_t>(proclet_header->copy_start);
+  auto cur_end = reinterpret_cast<uint64_t>(proclet_header->slab.get_base()) +
+                 proclet_header->slab.get_usage();
+
+  // The heap might have grown since the last round. Start tracking the new
+  // part before reading it, so that no later write gets lost.
+  auto new_tracked_end = div_round_up_unchecked(cur_end, kPageSize) * kPageSize;
+  if (new_tracked_end > state->tracked_end) {
+    BUG_ON(!dirty_page_tracker_.start({state->tracked_end, new_tracked_end}));
+    state->tracked_end = new_tracked_end;
+  }
+
+  std::vector<VAddrRange> extents;
+  auto dirty_ranges =
+      dirty_page_tracker_.collect({tracked_start, state->tracked_end});
+  for (auto [start_addr, end_addr] : dirty_ranges) {
+    start_addr = std::max(start_addr, copy_start);
+    end_addr = std::min(end_addr, state->sent_end);
+    if (start_addr < end_addr) {
+      extents.push_back({start_addr, end_addr});
+    }
+  }
+
+  // The newly grown part is always sent as a whole.
+  if (state->sent_end < cur_end) {
+    if (!extents.empty() && extents.back().end == state->sent_end) {
+      extents.back().end = cur_end;
+    } else {
+      extents.push_back({state->sent_end, cur_end});
+    }
+    state->sent_end = cur_end;
+  }
+
+  return extents;
+}
+
+std::optional<PreCopyState> Migrator::pre_copy_proclet(
+    rt::TcpConn *c, ProcletHeader *proclet_header, bool compress) {
+  if (unlikely(!dirty_page_tracker_.is_supported())) {
+    return std::nullopt;
+  }
+
+  auto tracked_start = reinterpret_cast<uint64_t>(proclet_header);
+  auto tracked_end =
+      div_round_up_unchecked(
+          reinterpret_cast<uint64_t>(proclet_header->slab.get_base()) +
+              proclet_header->slab.get_usage(),
+          kPageSize) *
+      kPageSize;
+  if (unlikely(!dirty_page_tracker_.start({tracked_start, tracked_end}))) {
+    return std::nullopt;
+  }
+
+  PreCopyState state{
+      .num_copy_tasks = 0,
+      .compress = compress,
+      .sent_end = reinterpret_cast<uint64_t>(proclet_header->copy_start),
+      .tracked_end = tracked_end};
+  [[maybe_unused]] uint64_t t0 = microtime();
+  [[maybe_unused]] uint64_t total_bytes = 0;
+  [[maybe_unused]] uint32_t num_rounds = 0;
+  auto last_round_bytes = std::numeric_limits<uint64_t>::max();
+
+  while (num_rounds < kMaxPreCopyRounds) {
+    auto extents = collect_dirty_extents(proclet_header, &state);
+    auto round_bytes = std::accumulate(
+        extents.begin(), extents.end(), static_cast<uint64_t>(0),
+        [](uint64_t sum, const VAddrRange &e) {
+          return sum + e.end - e.start;
+        });
+    state.num_copy_tasks +=
+        transmit_proclet_extents(c, proclet_header, extents, compress);
+    total_bytes += round_bytes;
+    num_rounds++;
+
+    // Stop once the dirty set is small enough to be sent during the pause, or
+    // once it no longer shrinks, i.e., the proclet writes faster than we copy.
+    if (round_bytes <= kPreCopyStopBytes || round_bytes >= last_round_bytes) {
+      break;
+    }
+    last_round_bytes = round_bytes;
+  }
+
+  if constexpr (kEnableLogging) {
+    Caladan::PreemptGuard g;
+
+    std::osyncstream synced_out(std::cout);
+    synced_out << "Pre-copy proclet: addr = " << proclet_header
+               << ", rounds = " << num_rounds << ", size = " << total_bytes
+               << ", time_us = " << microtime() - t0 << std::endl;
+  }
+
+  return state;
+}
+
+void Migrator::commit_pre_copy(rt::TcpConn *c, ProcletHeader *proclet_header,
+                               PreCopyState *state) {
+  auto extents = collect_dirty_extents(proclet_header, state);
+  state->num_copy_tasks += transmit_proclet_extents(c, proclet_header,
+                                                     extents, state->compress);
+  dirty_page_tracker_.stop(
+      {reinterpret_cast<uint64_t>(proclet_header), state->tracked_end});
+
+  uint8_t type = kCommitPreCopy;
+  const iovec iovecs[] = {
+      {&type, sizeof(type)},
+      {&state->num_copy_tasks, sizeof(state->num_copy_tasks)}};
+  BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ false,
+                       /* poll = */ true) < 0);
+
+  if constexpr (kEnableLogging) {
+    Caladan::PreemptGuard g;
+
+    auto final_bytes = std::accumulate(
+        extents.begin(), extents.end(), static_cast<uint64_t>(0),
+        [](uint64_t sum, const VAddrRange &e) {
+          return sum + e.end - e.start;
+        });
+    std::osyncstream synced_out(std::cout);
+    synced_out << "Commit pre-copy proclet: addr = " << proclet_header
+               << ", final size = " << final_bytes << std::endl;
+  }
+}
+
+VAddrRange Migrator::get_post_copy_lazy_range(ProcletHeader *proclet_header) {
+  auto base_addr = reinterpret_cast<uint64_t>(proclet_header->slab.get_base());
+  auto heap_end_addr = base_addr + proclet_header->slab.get_usage();
+  auto start_addr = div_round_up_unchecked(base_addr, kPageSize) * kPageSize;
+  auto end_addr = div_round_up_unchecked(heap_end_addr, kPageSize) * kPageSize;
+  return VAddrRange{start_addr, std::max(start_addr, end_addr)};
+}
+
+void Migrator::transmit_post_copy_proclet(rt::TcpConn *c,
+                                          ProcletHeader *proclet_header) {
+  uint8_t type = kPostCopyProclet;
+  auto start_addr = reinterpret_cast<uint64_t>(proclet_header->copy_start);
+  auto lazy_range = get_post_copy_lazy_range(proclet_header);
+  auto len = lazy_range.start - start_addr;
+  const iovec iovecs[] = {
+      {&type, sizeof(type)},
+      {&proclet_header, sizeof(proclet_header)},
+      {&start_addr, sizeof(start_addr)},
+      {&len, sizeof(len)},
+      {&lazy_range.end, sizeof(lazy_range.end)},
+      {reinterpret_cast<std::byte *>(start_addr), len}};
+  BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ true,
+                       /* poll = */ true) < 0);
+
+  // The allocator's own pages go eagerly, as faulting on them with preemption
+  // disabled might stall the core that should be serving the faults.
+  auto eager_pages = proclet_header->slab.get_metadata_pages(kPageSize);
+  std::erase_if(eager_pages, [&](uint64_t addr) {
+    return addr < lazy_range.start || addr >= lazy_range.end;
+  });
+  uint64_t num_eager_pages = eager_pages.size();
+  const iovec eager_iovecs[] = {
+      {&num_eager_pages, sizeof(num_eager_pages)},
+      {eager_pages.data(), num_eager_pages * sizeof(uint64_t)}};
+  BUG_ON(c->WritevFull(std::span(eager_iovecs), /* nt = */ false,
+                       /* poll = */ true) < 0);
+  for (auto addr : eager_pages) {
+    BUG_ON(c->WriteFull(reinterpret_cast<std::byte *>(addr), kPageSize,
+                        /* nt = */ true, /* poll = */ true) < 0);
+  }
+}
+
+void Migrator::push_post_copy_proclet(uint32_t dest_ip,
+                                      ProcletHeader *proclet_header) {
+  auto [start_addr, end_addr] = get_post_copy_lazy_range(proclet_header);
+  auto conn_guard = migrator_conn_mgr_.get(dest_ip);
+  auto *c = conn_guard.get_tcp_conn();
+
+  uint8_t type = kPostCopySession;
+  const iovec iovecs[] = {{&type, sizeof(type)},
+                          {&proclet_header, sizeof(proclet_header)}};
+  BUG_ON(c->WritevFull(std::span(iovecs)) < 0);
+
+  auto num_pages = (end_addr - start_addr) / kPageSize;
+  std::vector<bool> sent(num_pages);
+  auto push = [&](uint64_t page_idx, uint64_t num) {
+    PostCopyChunk chunk{.start_addr = start_addr + page_idx * kPageSize,
+                        .len = num * kPageSize};
+    const iovec iovecs[] = {
+        {&chunk, sizeof(chunk)},
+        {reinterpret_cast<std::byte *>(chunk.start_addr), chunk.len}};
+    BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ true) < 0);
+    std::fill_n(sent.begin() + page_idx, num, true);
+
+    // Release the memory gradually.
+    Caladan::PreemptGuard g;
+    BUG_ON(madvise(reinterpret_cast<void *>(chunk.start_addr), chunk.len,
+                   MADV_DONTNEED) != 0);
+  };
+
+  constexpr auto kMaxNumPagesPerChunk = kPostCopyChunkSize / kPageSize;
+  uint64_t cursor = 0;
+  while (true) {
+    // Demand fetches go first.
+    while (c->HasPendingDataToRead()) {
+      uint64_t fault_addr;
+      BUG_ON(c->ReadFull(&fault_addr, sizeof(fault_addr)) <= 0);
+      BUG_ON(fault_addr < start_addr || fault_addr >= end_addr);
+      auto page_idx = (fault_addr - start_addr) / kPageSize;
+      if (!sent[page_idx]) {
+        push(page_idx, 1);
+      }
+    }
+
+    while (cursor < num_pages && sent[cursor]) {
+      cursor++;
+    }
+    if (cursor == num_pages) {
+      break;
+    }
+    uint64_t num = 1;
+    while (num < kMaxNumPagesPerChunk && cursor + num < num_pages &&
+           !sent[cursor + num]) {
+      num++;
+    }
+    push(cursor, num);
+  }
+
+  PostCopyChunk end_marker{.start_addr = 0, .len = 0};
+  BUG_ON(c->WriteFull(&end_marker, sizeof(end_marker)) < 0);
+  // Drain the stale fault requests till the destination closes the session.
+  while (true) {
+    uint64_t fault_addr;
+    BUG_ON(c->ReadFull(&fault_addr, sizeof(fault_addr)) <= 0);
+    if (!fault_addr) {
+      break;
+    }
+  }
+
+  {
+    ScopedLock l(&proclet_header->migration_spin());
+
+    // Otherwise, it has already migrated back and got reclaimed.
+    if (likely(proclet_header->status() == kPostCopying)) {
+      proclet_header->status() = kCleaning;
+    }
+  }
+  post_migration_cleanup(proclet_header);
+}
+
+void Migrator::abort_pre_copy(rt::TcpConn *c, ProcletHeader *proclet_header,
+                              const PreCopyState &state) {
+  dirty_page_tracker_.stop(
+      {reinterpret_cast<uint64_t>(proclet_header), state.tracked_end});
+
+  uint8_t type = kAbortPreCopy;
+  const iovec iovecs[] = {
+      {&type, sizeof(type)},
+      {const_cast<uint64_t *>(&state.num_copy_tasks),
+       sizeof(state.num_copy_tasks)}};
+  BUG_ON(c->WritevFull(std::span(iovecs), /* nt = */ false,
+                       /* poll = */ true) < 0);
+}
+
 void Migrator::transmit_mutexes(rt::TcpConn *c, std::vector<Mutex *> mutexes) {
   size_t num_mutexes = mutexes.size();
 
@@ -406,7 +1170,7 @@ void Migrator::transmit_threads(rt::TcpConn *c,
 }
 
 void Migrator::transmit_proclet_migration_tasks(
-    rt::TcpConn *c, bool has_mem_pressure,
+    rt::TcpConn *c, bool has_mem_pressure, bool post_copy,
     const std::vector<ProcletMigrationTask> &tasks) {
   uint8_t type = kMigrate;
   uint64_t size = tasks.size();
@@ -414,6 +1178,7 @@ void Migrator::transmit_proclet_migration_tasks(
 
   const iovec iovecs[] = {{&type, sizeof(type)},
                           {&has_mem_pressure, sizeof(has_mem_pressure)},
+                          {&post_copy, sizeof(post_copy)},
                           {&size, sizeof(size)},
                           {const_cast<ProcletMigrationTask *>(tasks.data()),
                            size * sizeof(ProcletMigrationTask)}};
@@ -423,13 +1188,55 @@ void Migrator::transmit_proclet_migration_tasks(
 
 void Migrator::update_proclet_location(rt::TcpConn *c,
                                        ProcletHeader *proclet_header) {
-  get_runtime()->controller_client()->update_location(
-      to_proclet_id(proclet_header), c->RemoteAddr().ip);
+  auto id = to_proclet_id(proclet_header);
+  auto dest_ip = c->RemoteAddr().ip;
+  get_runtime()->controller_client()->update_location(id, dest_ip);
+  get_runtime()->rpc_client_mgr()->update_cache(id, dest_ip);
+  proclet_header->forward_ip() = dest_ip;
+}
+
+void Migrator::push_locations(
+    NodeIP dest_ip, std::map<NodeIP, std::vector<ProcletID>> &&caller_ids) {
+  for (auto &[caller_ip, ids] : caller_ids) {
+    rt::Spawn([caller_ip, dest_ip, ids = std::move(ids)] {
+      RuntimeSlabGuard guard;
+
+      RPCReqPushLocations req;
+      req.src_ip = get_cfg_ip();
+      req.dest_ip = dest_ip;
+      req.num_ids = ids.size();
+      const iovec iovecs[] = {
+          {&req, sizeof(req)},
+          {const_cast<ProcletID *>(ids.data()), std::span(ids).size_bytes()}};
+      RPCReturnBuffer return_buf;
+      auto *client = get_runtime()->rpc_client_mgr()->get_by_ip(caller_ip);
+      BUG_ON(client->Call(std::span(iovecs), &return_buf) != kOk);
+    });
+  }
+}
+
+void Migrator::update_pushed_locations(const RPCReqPushLocations &req) {
+  RuntimeSlabGuard guard;
+
+  for (uint32_t i = 0; i < req.num_ids; i++) {
+    get_runtime()->rpc_client_mgr()->update_cache_if_stale(
+        req.ids[i], req.src_ip, req.dest_ip);
+  }
 }
 
 void Migrator::transmit(rt::TcpConn *c, ProcletHeader *proclet_header,
-                        struct list_head *paused_ths_list) {
-  transmit_proclet(c, proclet_header);
+                        struct list_head *paused_ths_list,
+                        std::optional<PreCopyState> &pre_copy_state,
+                        bool post_copy, bool compress) {
+  if (post_copy) {
+    transmit_post_copy_proclet(c, proclet_header);
+  } else if (pre_copy_state) {
+    commit_pre_copy(c, proclet_header, &*pre_copy_state);
+  } else if (sparse_copy_ || compress) {
+    transmit_sparse_proclet(c, proclet_header, compress);
+  } else {
+    transmit_proclet(c, proclet_header);
+  }
 
   std::vector<thread_t *> ready_threads;
   std::vector<Mutex *> mutexes;
@@ -463,6 +1270,26 @@ void Migrator::transmit(rt::TcpConn *c, ProcletHeader *proclet_header,
   update_proclet_location(c, proclet_header);
 }
 
+bool Migrator::try_pin_proclet(ProcletHeader *proclet_header) {
+  {
+    Caladan::PreemptGuard g;
+    proclet_header->slab_ref_cnt.inc(g);
+  }
+  // Pairs with the destructor, which changes the status before it waits for
+  // the count to drop in ProcletManager::cleanup().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (unlikely(proclet_header->status() != kPresent)) {
+    unpin_proclet(proclet_header);
+    return false;
+  }
+  return true;
+}
+
+void Migrator::unpin_proclet(ProcletHeader *proclet_header) {
+  Caladan::PreemptGuard g;
+  proclet_header->slab_ref_cnt.dec(g);
+}
+
 bool Migrator::try_mark_proclet_migrating(ProcletHeader *proclet_header) {
   if (unlikely(!get_runtime()->proclet_manager()->remove_for_migration(
           proclet_header)))
@@ -522,7 +1349,7 @@ uint32_t Migrator::migrate(
         get_runtime()->pressure_handler()->has_mem_pressure();
     auto [dest_guard, dest_resource] =
         get_runtime()->controller_client()->acquire_migration_dest(
-            has_mem_pressure, it->second);
+            has_mem_pressure, it->second, it->first.peer_ip);
     auto dest_ip = dest_guard.get_ip();
     if (unlikely(!dest_guard || congested_dests.contains(dest_ip))) {
       break;
@@ -531,6 +1358,10 @@ uint32_t Migrator::migrate(
     cur_round_tasks.clear();
     Resource cur_round_resource{.cores = 0, .mem_mbs = 0};
     for (auto tmp = it; tmp != tasks.end(); ++tmp) {
+      // The proclets preferring another node get their own round.
+      if (tmp->first.peer_ip != it->first.peer_ip) {
+        break;
+      }
       cur_round_resource += tmp->second;
       bool too_much = cur_round_resource.mem_mbs > dest_resource.mem_mbs;
       if (!has_mem_pressure) {
@@ -606,7 +1437,9 @@ uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
   auto conn_guard = migrator_conn_mgr_.get(dest_guard.get_ip());
   auto *conn = conn_guard.get_tcp_conn();
   BUG_ON(conn->HasPendingDataToRead());
-  transmit_proclet_migration_tasks(conn, mem_pressure, tasks);
+  bool post_copy = post_copy_ && mem_pressure;
+  transmit_proclet_migration_tasks(conn, mem_pressure, post_copy, tasks);
+  std::map<NodeIP, std::vector<ProcletID>> caller_ids;
 
   bool aux_handlers_enabled = false;
   auto it = tasks.begin();
@@ -618,26 +1451,82 @@ uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
 
     bool has_pressure = mem_pressure ? pressure_handler->has_mem_pressure()
                                      : pressure_handler->has_pressure();
-    if (unlikely(!has_pressure ||
-                 !try_mark_proclet_migrating(proclet_header))) {
+    if (unlikely(!has_pressure)) {
+      skip_proclet(conn, proclet_header);
+      continue;
+    }
+
+    // Its heap is read below while it is still running.
+    if (unlikely(!try_pin_proclet(proclet_header))) {
       skip_proclet(conn, proclet_header);
       continue;
     }
+    bool compress = compression_ && !post_copy &&
+                    (forced_compression_ || should_compress(proclet_header));
+    std::optional<PreCopyState> pre_copy_state;
+    if (pre_copy_ && !post_copy) {
+      if (unlikely(!aux_handlers_enabled)) {
+        aux_handlers_enabled = true;
+        aux_handlers_enable_polling(dest_guard.get_ip());
+      }
+      pre_copy_state = pre_copy_proclet(conn, proclet_header, compress);
+    }
+
+    // Once marked, it can no longer be destructed.
+    bool marked = try_mark_proclet_migrating(proclet_header);
+    unpin_proclet(proclet_header);
+    if (unlikely(!marked)) {
+      if (pre_copy_state) {
+        abort_pre_copy(conn, proclet_header, *pre_copy_state);
+      } else {
+        skip_proclet(conn, proclet_header);
+      }
+      continue;
+    }
 
     if (unlikely(!aux_handlers_enabled)) {
       aux_handlers_enabled = true;
       aux_handlers_enable_polling(dest_guard.get_ip());
     }
 
+    auto trace_start_us = get_runtime()->tracer()->now_us();
+    auto pause_tsc = rdtsc();
     pause_migrating_threads(proclet_header);
     {
       ScopedLock l(&proclet_header->migration_spin());
 
-      transmit(conn, proclet_header, &all_migrating_ths);
+      // Counted before the header gets transmitted.
+      proclet_header->num_migrations++;
+
+      // The proclet is quiescent now; its cached objects will be reused by
+      // whichever cores run it at the destination.
+      proclet_header->slab.flush_caches();
+      transmit(conn, proclet_header, &all_migrating_ths, pre_copy_state,
+               post_copy, compress);
       gc_migrated_threads();
-      proclet_header->status() = kCleaning;
+      auto *stats = proclet_header->peek_stats();
+      if (location_push_ && stats) {
+        for (auto caller_ip : stats->callers.get_recent()) {
+          if (caller_ip != dest_guard.get_ip()) {
+            caller_ids[caller_ip].push_back(to_proclet_id(proclet_header));
+          }
+        }
+      }
+      proclet_header->status() = post_copy ? kPostCopying : kCleaning;
+    }
+    get_runtime()->tracer()->record_migration(to_proclet_id(proclet_header),
+                                              dest_guard.get_ip(),
+                                              trace_start_us);
+    auto downtime_tsc = rdtsc() - pause_tsc;
+    get_runtime()->metrics()->record_migration(downtime_tsc / cycles_per_us);
+    downtime_histogram_.record_tsc(downtime_tsc);
+    if (post_copy) {
+      rt::Spawn([this, dest_ip = dest_guard.get_ip(), proclet_header] {
+        push_post_copy_proclet(dest_ip, proclet_header);
+      });
+    } else {
+      post_migration_cleanup(proclet_header);
     }
-    post_migration_cleanup(proclet_header);
   }
 
   if (aux_handlers_enabled) {
@@ -645,6 +1534,7 @@ uint32_t Migrator::__migrate(const NodeGuard &dest_guard, bool mem_pressure,
   }
 
   receive_approval(conn);
+  push_locations(dest_guard.get_ip(), std::move(caller_ids));
 
   return it - tasks.begin();
 }
@@ -660,21 +1550,48 @@ bool Migrator::load_proclet(rt::TcpConn *c, ProcletHeader *proclet_header,
   }
 
   uint8_t type;
-  BUG_ON(c->ReadFull(&type, sizeof(type), /* nt = */ false,
-                     /* poll = */ true) <= 0);
+  int64_t num_copy_tasks;
+  while (true) {
+    BUG_ON(c->ReadFull(&type, sizeof(type), /* nt = */ false,
+                       /* poll = */ true) <= 0);
+    if (type != kCopyProcletExtents &&
+        type != kCopyProcletCompressedExtents) {
+      break;
+    }
+    // Pre-copy rounds or sparse copies (of the stripes assigned to this
+    // connection).
+    handle_copy_proclet_extents(
+        c, /* compressed = */ type == kCopyProcletCompressedExtents);
+  }
+
   if (unlikely(type == kSkipProclet)) {
     return false;
   }
-  BUG_ON(type != kCopyProclet);
-  handle_copy_proclet(c);
+  if (type == kCommitPreCopy || type == kAbortPreCopy ||
+      type == kCommitSparseCopy) {
+    BUG_ON(c->ReadFull(&num_copy_tasks, sizeof(num_copy_tasks),
+                       /* nt = */ false, /* poll = */ true) <= 0);
+    if (unlikely(type == kAbortPreCopy)) {
+      // Drain the in-flight pre-copy data before the heap gets depopulated.
+      wait_for_copy_tasks(proclet_header, num_copy_tasks);
+      return false;
+    }
+  } else if (type == kPostCopyProclet) {
+    handle_post_copy_proclet(c);
+    num_copy_tasks = 0;
+  } else {
+    BUG_ON(type != kCopyProclet);
+    handle_copy_proclet(c);
+    num_copy_tasks = kTransmitProcletNumThreads;
+  }
 
   get_runtime()->proclet_manager()->setup(proclet_header, capacity,
                                           /* migratable = */ false,
                                           /* from_migration = */ true);
 
-  proclet_header->pending_load_cnt += kTransmitProcletNumThreads;
-  while (proclet_header->pending_load_cnt.load()) {
-    get_runtime()->caladan()->unblock_and_relax();
+  wait_for_copy_tasks(proclet_header, num_copy_tasks);
+  if (type == kCommitSparseCopy) {
+    depopulate_free_runs(proclet_header);
   }
 
   auto *slab = &proclet_header->slab;
@@ -709,6 +1626,14 @@ bool Migrator::load_proclet(rt::TcpConn *c, ProcletHeader *proclet_header,
   return true;
 }
 
+void Migrator::wait_for_copy_tasks(ProcletHeader *proclet_header,
+                                   int64_t num_copy_tasks) {
+  proclet_header->pending_load_cnt += num_copy_tasks;
+  while (proclet_header->pending_load_cnt.load()) {
+    get_runtime()->caladan()->unblock_and_relax();
+  }
+}
+
 thread_t *Migrator::load_one_thread(rt::TcpConn *c,
                                     ProcletHeader *proclet_header) {
   proclet_header->thread_cnt.inc_unsafe();
@@ -838,13 +1763,15 @@ void Migrator::load_threads(rt::TcpConn *c, ProcletHeader *proclet_header) {
   }
 }
 
-std::pair<bool, std::vector<ProcletMigrationTask>>
+std::tuple<bool, bool, std::vector<ProcletMigrationTask>>
 Migrator::load_proclet_migration_tasks(rt::TcpConn *c) {
   bool has_mem_pressure;
+  bool post_copy;
   uint64_t size;
   std::vector<ProcletMigrationTask> tasks;
 
   const iovec iovecs[] = {{&has_mem_pressure, sizeof(has_mem_pressure)},
+                          {&post_copy, sizeof(post_copy)},
                           {&size, sizeof(size)}};
 
   BUG_ON(c->ReadvFull(std::span(iovecs), /* nt = */ false, /* poll = */ true) <=
@@ -855,30 +1782,43 @@ Migrator::load_proclet_migration_tasks(rt::TcpConn *c) {
                      /* nt = */ false,
                      /* poll = */ true) <= 0);
 
-  return std::make_pair(has_mem_pressure, std::move(tasks));
+  return std::make_tuple(has_mem_pressure, post_copy, std::move(tasks));
 }
 
-void Migrator::populate_proclets(std::vector<ProcletMigrationTask> &tasks) {
-  for (auto &[header, _, size] : tasks) {
+void Migrator::populate_proclets(std::vector<ProcletMigrationTask> &tasks,
+                                 bool post_copy) {
+  for (auto &task : tasks) {
+    auto *header = task.header;
     ScopedLock l(&header->migration_spin());
 
-    if (unlikely(header->status() == kCleaning)) {
+    // Must come before anything touches the header, see prepare().
+    get_runtime()->proclet_manager()->prepare(header, task.capacity);
+    if (unlikely(header->status() == kCleaning ||
+                 header->status() == kPostCopying)) {
       std::destroy_at(&header->slab);
     }
     header->status() = kPopulating;
-    header->populate_size = size;
+    header->populate_size = task.size;
+  }
+
+  if (post_copy) {
+    // The heaps must stay unpopulated so that their faults can be intercepted.
+    return;
   }
 
   rt::Spawn([tasks] {
-    for (auto &[header, _, size] : tasks) {
+    for (auto &task : tasks) {
+      auto *header = task.header;
       if (load_acquire(&header->status()) == kPopulating) {
         ScopedLock l(&header->migration_spin());
 
-        if (likely(header->status() == kPopulating)) {
+        if (likely(header->status() == kPopulating &&
+                   header->populate_size)) {
           if (unlikely(get_runtime()->pressure_handler()->has_mem_pressure())) {
             break;
           }
-          get_runtime()->proclet_manager()->madvise_populate(header, size);
+          get_runtime()->proclet_manager()->madvise_populate(
+              header, header->populate_size);
         }
       }
     }
@@ -903,9 +1843,23 @@ void Migrator::depopulate_proclet(ProcletHeader *proclet_header) {
   });
 }
 
+void Migrator::depopulate_free_runs(ProcletHeader *proclet_header) {
+  ScopedLock l(&proclet_header->migration_spin());
+
+  // The free runs never arrived, but they might have been prefaulted already.
+  auto page_size = proclet_header->page_size();
+  for (auto [start_addr, end_addr] :
+       proclet_header->slab.get_free_run_extents(page_size)) {
+    BUG_ON(madvise(reinterpret_cast<void *>(start_addr), end_addr - start_addr,
+                   MADV_DONTNEED) != 0);
+  }
+  // The whole heap has been loaded, stop prefaulting it.
+  proclet_header->populate_size = 0;
+}
+
 void Migrator::load(rt::TcpConn *c) {
-  auto [has_mem_pressure, tasks] = load_proclet_migration_tasks(c);
-  populate_proclets(tasks);
+  auto [has_mem_pressure, post_copy, tasks] = load_proclet_migration_tasks(c);
+  populate_proclets(tasks, post_copy);
 
   bool approval = true;
   for (auto it = tasks.begin(); it != tasks.end(); ++it) {
@@ -923,8 +1877,8 @@ void Migrator::load(rt::TcpConn *c) {
       issue_approval(c, approval);
     }
 
-    auto &[proclet_header, capacity, _] = *it;
-    if (unlikely(!load_proclet(c, proclet_header, capacity))) {
+    auto *proclet_header = it->header;
+    if (unlikely(!load_proclet(c, proclet_header, it->capacity))) {
       depopulate_proclet(proclet_header);
       continue;
     }
@@ -935,7 +1889,7 @@ void Migrator::load(rt::TcpConn *c) {
     load_threads(c, proclet_header);
     // Wakeup the blocked threads.
     proclet_header->cond_var.signal_all();
-    proclet_header->migratable = true;
+    mark_proclet_loaded(proclet_header);
   }
 
   issue_approval(c, true);
@@ -970,6 +1924,36 @@ void Migrator::forward_to_original_server(
   BUG_ON(client->Call(req_span, &return_buf) != kOk);
 }
 
+void Migrator::set_pre_copy(bool enable) { pre_copy_ = enable; }
+
+bool Migrator::is_pre_copy_enabled() const { return pre_copy_; }
+
+void Migrator::set_post_copy(bool enable) { post_copy_ = enable; }
+
+bool Migrator::is_post_copy_enabled() const { return post_copy_; }
+
+void Migrator::set_sparse_copy(bool enable) { sparse_copy_ = enable; }
+
+bool Migrator::is_sparse_copy_enabled() const { return sparse_copy_; }
+
+void Migrator::set_compression(bool enable) { compression_ = enable; }
+
+bool Migrator::is_compression_enabled() const { return compression_; }
+
+void Migrator::set_forced_compression(bool enable) {
+  forced_compression_ = enable;
+}
+
+bool Migrator::is_compression_forced() const { return forced_compression_; }
+
+void Migrator::set_location_push(bool enable) { location_push_ = enable; }
+
+bool Migrator::is_location_push_enabled() const { return location_push_; }
+
+ConcurrentHdrHistogram &Migrator::get_downtime_histogram() {
+  return downtime_histogram_;
+}
+
 void Migrator::forward_to_client(RPCReqForward &req) {
   if (req.payload_len) {
     auto payload_buf =
@@ -1002,7 +1986,8 @@ retry:
   auto rc = rpc_client->Call(req_span, &unused_buf);
 
   if (unlikely(rc == kErrWrongClient)) {
-    get_runtime()->rpc_client_mgr()->invalidate_cache(dest_id, rpc_client);
+    get_runtime()->rpc_client_mgr()->invalidate_cache(dest_id, rpc_client,
+                                                      unused_buf);
     goto retry;
   }
 
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+
+#include "nu/placement.hpp"
+
+namespace nu {
+
+NodeIP RoundRobinPlacementPolicy::select(LPInfo *info,
+                                         const PlacementRequest &req) {
+  auto &[node_statuses, rr_iter, _] = *info;
+
+  NodeIP ip;
+  do {
+    if (unlikely(rr_iter == node_statuses.end())) {
+      rr_iter = node_statuses.begin();
+    }
+    ip = rr_iter->first;
+  } while (rr_iter++->second.isol);
+
+  return ip;
+}
+
+AffinityPlacementPolicy::AffinityPlacementPolicy(
+    CallGraph *call_graph, const ProcletLocationTable *proclet_locations)
+    : call_graph_(call_graph), proclet_locations_(proclet_locations) {}
+
+std::map<NodeIP, float> AffinityPlacementPolicy::compute_affinities(
+    ProcletID creator_id) {
+  std::map<NodeIP, float> affinities;
+
+  if (!creator_id) {
+    return affinities;
+  }
+  auto *peers = call_graph_->get_peers(creator_id);
+  if (!peers) {
+    return affinities;
+  }
+
+  float sum_weights = 0;
+  for (const auto &[peer, weight] : *peers) {
+    if (auto ip = proclet_locations_->get(peer)) {
+      affinities[ip] += weight;
+    }
+    sum_weights += weight;
+  }
+
+  // The new proclet is going to be invoked by its creator, so the creator's
+  // node is preferred as long as the creator communicates at all.
+  if (auto ip = proclet_locations_->get(creator_id)) {
+    affinities[ip] += sum_weights;
+  }
+
+  return affinities;
+}
+
+NodeIP AffinityPlacementPolicy::select(LPInfo *info,
+                                       const PlacementRequest &req) {
+  Resource demand;
+  demand.cores = kEstimatedCores;
+  demand.mem_mbs = std::min(req.capacity / kOneMB, kMaxEstimatedMemMBs);
+
+  auto affinities = compute_affinities(req.creator_id);
+  auto get_affinity = [&](NodeIP ip) {
+    auto iter = affinities.find(ip);
+    return iter != affinities.end() ? iter->second : 0;
+  };
+  auto is_eligible = [&](const NodeStatus &status) {
+    return !status.isol && status.has_enough_resource(demand);
+  };
+
+  float max_affinity = 0;
+  for (const auto &[ip, status] : info->node_statuses) {
+    if (is_eligible(status)) {
+      max_affinity = std::max(max_affinity, get_affinity(ip));
+    }
+  }
+
+  // Bin-pack among the co-locatable nodes: the fewer whole cores are left, the
+  // better; ties are broken by the memory left.
+  auto is_tighter = [](const NodeStatus &a, const NodeStatus &b) {
+    auto a_cores = std::floor(a.free_resource.cores);
+    auto b_cores = std::floor(b.free_resource.cores);
+    if (a_cores != b_cores) {
+      return a_cores < b_cores;
+    }
+    return a.free_resource.mem_mbs < b.free_resource.mem_mbs;
+  };
+
+  NodeIP best_ip = 0;
+  NodeStatus *best_status = nullptr;
+  for (auto &[ip, status] : info->node_statuses) {
+    if (!is_eligible(status) ||
+        get_affinity(ip) < max_affinity * kAffinityTolerance) {
+      continue;
+    }
+    if (!best_status || is_tighter(status, *best_status)) {
+      best_ip = ip;
+      best_status = &status;
+    }
+  }
+
+  if (unlikely(!best_status)) {
+    return fallback_.select(info, req);
+  }
+
+  best_status->free_resource.cores -= demand.cores;
+  best_status->free_resource.mem_mbs -= demand.mem_mbs;
+  return best_ip;
+}
+
+}  // namespace nu
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <type_traits>
 
 #include <sync.h>
@@ -16,6 +18,16 @@ constexpr static bool kEnableLogging = false;
 
 namespace nu {
 
+static PeerTrafficSummary summarize_traffic(const ProcletHeader *header,
+                                            NodeIP local_ip) {
+  auto *stats = header->peek_stats();
+  if (!stats) {
+    return PeerTrafficSummary{
+        .top_remote_ip = 0, .top_remote = 0, .local = 0, .total = 0};
+  }
+  return stats->peer_traffic.summarize(local_ip);
+}
+
 PressureHandler::PressureHandler()
     : active_handlers_{0}, mock_(false), done_(false) {
   register_handlers();
@@ -42,12 +54,27 @@ PressureHandler::~PressureHandler() {
 Utility::Utility() {}
 
 Utility::Utility(ProcletHeader *proclet_header, uint64_t mem_size,
-                 float cpu_load) {
+                 float cpu_load, const PeerTrafficSummary &traffic) {
   header = proclet_header;
   auto time = kFixedCostUs + (mem_size / (kNetBwGbps / 8.0f) / 1000.0f);
 
-  cpu_pressure_util = cpu_load / time;
-  mem_pressure_util = mem_size / time;
+  // Moving the proclet to its top remote peer node turns the calls exchanged
+  // with that node into local ones, and the local calls into RPCs.
+  float traffic_factor = 1;
+  if (kEnableTrafficAwareness && traffic.total) {
+    auto locality_gain = (traffic.top_remote - traffic.local) / traffic.total;
+    traffic_factor += kTrafficWeight * locality_gain;
+  }
+
+  cpu_pressure_util = cpu_load / time * traffic_factor;
+  mem_pressure_util = mem_size / time * traffic_factor;
+}
+
+NodeIP Utility::get_peer_ip(const PeerTrafficSummary &traffic) {
+  if (!kEnableTrafficAwareness || traffic.top_remote <= traffic.local) {
+    return 0;
+  }
+  return traffic.top_remote_ip;
 }
 
 void PressureHandler::update_sorted_proclets() {
@@ -58,20 +85,22 @@ void PressureHandler::update_sorted_proclets() {
   auto new_cpu_pressure_sorted_proclets =
       std::make_shared<decltype(cpu_pressure_sorted_proclets_)::element_type>();
   auto all_proclets = get_runtime()->proclet_manager()->get_all_proclets();
+  auto local_ip = get_cfg_ip();
 
   auto used_budget = 0;
   for (auto *proclet_base : all_proclets) {
     auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
     auto optional_info = get_runtime()->proclet_manager()->get_proclet_info(
-        proclet_header, std::function([](const ProcletHeader *header) {
+        proclet_header, std::function([&](const ProcletHeader *header) {
           return std::make_tuple(header->migratable, header->total_mem_size(),
-                                 header->cpu_load.get_load());
+                                 header->cpu_load.get_load(),
+                                 summarize_traffic(header, local_ip));
         }));
 
     if (likely(optional_info)) {
-      auto [migratable, mem_size, cpu_load] = *optional_info;
+      auto [migratable, mem_size, cpu_load, traffic] = *optional_info;
       if (migratable) {
-        Utility u(proclet_header, mem_size, cpu_load);
+        Utility u(proclet_header, mem_size, cpu_load, traffic);
         new_cpu_pressure_sorted_proclets->insert(u);
         new_mem_pressure_sorted_proclets->insert(u);
       }
@@ -184,6 +213,17 @@ void PressureHandler::dispatch_aux_tcp_task(
   store_release(&state.task_pending, true);
 }
 
+void PressureHandler::dispatch_aux_tcp_fn_task(
+    uint32_t handler_id,
+    std::move_only_function<void(rt::TcpConn *)> &&tcp_fn_task) {
+  auto &state = aux_handler_states_[handler_id];
+  while (rt::access_once(state.task_pending)) {
+    get_runtime()->caladan()->unblock_and_relax();
+  }
+  state.tcp_fn_task = std::move(tcp_fn_task);
+  store_release(&state.task_pending, true);
+}
+
 void PressureHandler::dispatch_aux_pause_task(uint32_t handler_id) {
   auto &state = aux_handler_states_[handler_id];
   while (rt::access_once(state.task_pending)) {
@@ -200,6 +240,9 @@ void PressureHandler::__aux_handler(AuxHandlerState *state) {
       if (state->pause) {
         pause_migrating_ths_aux();
         store_release(&state->pause, false);
+      } else if (state->tcp_fn_task) {
+        state->tcp_fn_task(state->conn.get_tcp_conn());
+        state->tcp_fn_task = nullptr;
       } else {
         auto *c = state->conn.get_tcp_conn();
         BUG_ON(c->WritevFull(std::span<const iovec>(state->tcp_write_task),
@@ -237,19 +280,23 @@ PressureHandler::pick_tasks(uint32_t min_num_proclets, uint32_t min_mem_mbs) {
   uint32_t total_mem_mbs = 0;
   std::vector<std::pair<ProcletMigrationTask, Resource>> picked_tasks;
   std::set<ProcletHeader *> dedupper;
+  auto local_ip = get_cfg_ip();
 
   auto pick_fn = [&](ProcletHeader *header) {
     auto optional = get_runtime()->proclet_manager()->get_proclet_info(
         header, std::function([&](const ProcletHeader *header) {
           return std::make_tuple(header->migratable, header->capacity,
                                  header->heap_size(), header->total_mem_size(),
-                                 header->cpu_load.get_load());
+                                 header->cpu_load.get_load(),
+                                 summarize_traffic(header, local_ip));
         }));
     if (likely(optional)) {
-      auto &[migratable, capacity, heap_size, mem_size, cpu_load] = *optional;
+      auto &[migratable, capacity, heap_size, mem_size, cpu_load, traffic] =
+          *optional;
       if (likely(migratable && !dedupper.contains(header))) {
         dedupper.insert(header);
-        ProcletMigrationTask task(header, capacity, heap_size);
+        ProcletMigrationTask task(header, capacity, heap_size,
+                                  Utility::get_peer_ip(traffic));
         auto mem_mbs = mem_size / static_cast<float>(kOneMB);
         Resource resource(cpu_load, mem_mbs);
         picked_tasks.emplace_back(std::move(task), std::move(resource));
@@ -293,6 +340,18 @@ PressureHandler::pick_tasks(uint32_t min_num_proclets, uint32_t min_mem_mbs) {
     }
   }
 
+  // Keep the proclets sharing the same peer node adjacent (in the order their
+  // first member got picked), so that the migrator moves them there together.
+  std::map<NodeIP, uint32_t> peer_ip_ranks;
+  for (const auto &[task, _] : picked_tasks) {
+    peer_ip_ranks.try_emplace(task.peer_ip, peer_ip_ranks.size());
+  }
+  std::stable_sort(picked_tasks.begin(), picked_tasks.end(),
+                   [&](const auto &x, const auto &y) {
+                     return peer_ip_ranks[x.first.peer_ip] <
+                            peer_ip_ranks[y.first.peer_ip];
+                   });
+
   return picked_tasks;
 }
 
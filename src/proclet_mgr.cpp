@@ -17,6 +17,7 @@ namespace nu {
 
 uint8_t proclet_statuses[kMaxNumProclets];
 SpinLock proclet_migration_spin[kMaxNumProclets];
+NodeIP proclet_forward_ips[kMaxNumProclets];
 
 ProcletManager::ProcletManager() {
   num_present_proclets_ = 0;
@@ -33,9 +34,21 @@ ProcletManager::ProcletManager() {
   }
 }
 
+void ProcletManager::prepare(void *proclet_base, uint64_t capacity) {
+  auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+  bool huge_pages = kEnableHugePageHeaps && capacity >= kMinHugePageHeapSize;
+  if (huge_pages) {
+    // Otherwise the first touch of the header would fault in a 4 KB page.
+    BUG_ON(madvise(proclet_base, capacity, MADV_HUGEPAGE) != 0);
+  }
+  proclet_header->huge_pages = huge_pages;
+}
+
 void ProcletManager::madvise_populate(void *proclet_base,
                                       uint64_t populate_len) {
-  populate_len = ((populate_len - 1) / kPageSize + 1) * kPageSize;
+  auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+  auto page_size = proclet_header->page_size();
+  populate_len = ((populate_len - 1) / page_size + 1) * page_size;
   madvise(proclet_base, populate_len, MADV_POPULATE_WRITE);
 }
 
@@ -52,12 +65,20 @@ void ProcletManager::cleanup(void *proclet_base, bool for_migration) {
   // Deregister its slab ID.
   std::destroy_at(&proclet_header->slab);
 
+  auto *stats = proclet_header->stats.exchange(nullptr);
+  if (stats) {
+    std::destroy_at(stats);
+    SlabAllocator::free(stats);
+  }
+
   bool defer = !for_migration;
   depopulate(proclet_base, proclet_header->heap_size(), defer);
 }
 
 void ProcletManager::depopulate(void *proclet_base, uint64_t size, bool defer) {
-  size = ((size - 1) / kPageSize + 1) * kPageSize;
+  auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
+  auto page_size = proclet_header->page_size();
+  size = ((size - 1) / page_size + 1) * page_size;
 
   if (defer) {
     // Try to keep the memory for future reuses.
@@ -76,16 +97,20 @@ void ProcletManager::setup(void *proclet_base, uint64_t capacity,
   RuntimeSlabGuard guard;
   auto *proclet_header = reinterpret_cast<ProcletHeader *>(proclet_base);
 
+  prepare(proclet_base, capacity);
   proclet_header->capacity = capacity;
   std::construct_at(&proclet_header->cpu_load);
+  std::construct_at(&proclet_header->stats, nullptr);
   std::construct_at(&proclet_header->spin_lock);
   std::construct_at(&proclet_header->cond_var);
   std::construct_at(&proclet_header->blocked_syncer);
   std::construct_at(&proclet_header->time);
   proclet_header->migratable = migratable;
+  proclet_header->forward_ip() = 0;
 
   if (!from_migration) {
     proclet_header->ref_cnt = 1;
+    proclet_header->num_migrations = 0;
     std::construct_at(&proclet_header->rcu_lock);
     std::construct_at(&proclet_header->slab_ref_cnt);
     auto slab_region_size = capacity - sizeof(ProcletHeader);
@@ -94,6 +119,20 @@ void ProcletManager::setup(void *proclet_base, uint64_t capacity,
   }
 }
 
+ProcletStats *ProcletHeader::alloc_stats() {
+  auto *mem = get_runtime()->runtime_slab()->allocate(sizeof(ProcletStats));
+  BUG_ON(!mem);
+  auto *new_stats = new (mem) ProcletStats();
+  ProcletStats *old_stats = nullptr;
+  if (likely(stats.compare_exchange_strong(old_stats, new_stats))) {
+    return new_stats;
+  }
+  // Lost the race to a concurrent recorder.
+  std::destroy_at(new_stats);
+  SlabAllocator::free(new_stats);
+  return old_stats;
+}
+
 std::vector<void *> ProcletManager::get_all_proclets() {
   ScopedLock lock(&spin_);
   auto iter = present_proclets_.begin();
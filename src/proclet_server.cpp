@@ -16,6 +16,7 @@ extern "C" {
 #include "nu/migrator.hpp"
 #include "nu/proclet_mgr.hpp"
 #include "nu/proclet_server.hpp"
+#include "nu/tracer.hpp"
 
 constexpr static bool kEnableLogging = false;
 constexpr static uint32_t kPrintLoggingIntervalUs = 200 * 1000;
@@ -42,20 +43,32 @@ void ProcletServer::parse_and_run_handler(std::span<std::byte> args,
   auto &[args_ss, ia] = *ia_sstream;
   args_ss.span({reinterpret_cast<char *>(args.data()), args.size()});
 
+  // Serve the call within the trace of its caller, if it's sampled.
+  bool traced = get_runtime()->tracer()->load_call_ctx(ia_sstream->ia);
   GenericHandler handler;
   ia_sstream->ia >> handler;
 
-  if constexpr (kEnableLogging) {
-    trace_logger_.add_trace([&] { handler(ia_sstream, returner); });
-  } else {
-    handler(ia_sstream, returner);
+  auto start_tsc = rdtsc();
+  handler(ia_sstream, returner);
+  // The TSCs of different nodes aren't comparable, so skip the calls whose
+  // threads have been migrated along with their proclets meanwhile.
+  if (likely(!get_runtime()->caladan()->thread_has_been_migrated())) {
+    trace_logger_.add_trace(rdtsc() - start_tsc);
   }
 
   get_runtime()->archive_pool()->put_ia_sstream(ia_sstream);
+  // Don't leak it into the next call served by this thread.
+  if (unlikely(traced)) {
+    *get_runtime()->tracer()->get_thread_ctx() = TraceContext{};
+  }
 
   ref_cnt_.dec();
 }
 
 void ProcletServer::dec_ref_cnt() { ref_cnt_.dec(); }
 
+ConcurrentHdrHistogram &ProcletServer::get_latency_histogram() {
+  return trace_logger_.get_histogram();
+}
+
 }  // namespace nu
@@ -6,13 +6,16 @@ extern "C" {
 #include <sync.h>
 
 #include "nu/runtime.hpp"
+#include "nu/call_graph.hpp"
 #include "nu/commons.hpp"
 #include "nu/ctrl_client.hpp"
+#include "nu/metrics.hpp"
 #include "nu/resource_reporter.hpp"
 
 namespace nu {
 
-ResourceReporter::ResourceReporter() : done_(false) {
+ResourceReporter::ResourceReporter()
+    : done_(false), last_metrics_report_us_(0) {
   th_ = rt::Thread([&] {
     set_resource_reporting_handler(thread_self());
 
@@ -46,6 +49,16 @@ void ResourceReporter::report_resource() {
   resource.mem_mbs = rt::RuntimeFreeMemMbs();
   auto global_free_resources =
       get_runtime()->controller_client()->report_free_resource(resource);
+  auto edges = get_runtime()->call_graph_sampler()->drain();
+  if (!edges.empty()) {
+    get_runtime()->controller_client()->report_call_graph(edges);
+  }
+  auto now_us = microtime();
+  if (now_us - last_metrics_report_us_ >= kMetricsReportIntervalUs) {
+    last_metrics_report_us_ = now_us;
+    auto snapshot = get_runtime()->metrics()->take_snapshot();
+    get_runtime()->controller_client()->report_metrics(snapshot);
+  }
   {
     rt::ScopedLock lock(&spin_);
 
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "nu/rpc_client_mgr.hpp"
 #include "nu/ctrl_client.hpp"
 
@@ -22,7 +24,13 @@ RPCClient *RPCClientMgr::get_client(NodeInfo info) {
   if (unlikely(!client)) {
     rt::ScopedLock<rt::Mutex> guard(&mutex_);
     if (likely(!client)) {
-      client = RPCClient::Dial(netaddr(info.ip, port_));
+      auto raddr = netaddr(info.ip, port_);
+      if constexpr (RPCConn::kEnableShmTransport) {
+        client = RPCClient::DialShm(raddr);
+      }
+      if (!client) {
+        client = RPCClient::Dial(raddr);
+      }
     }
   }
 
@@ -82,11 +90,24 @@ NodeIP RPCClientMgr::get_ip_by_proclet_id(ProcletID proclet_id) {
   return get_info(proclet_id).ip;
 }
 
-void RPCClientMgr::invalidate_cache(ProcletID proclet_id, RPCClient *old_client) {
+void RPCClientMgr::invalidate_cache(ProcletID proclet_id,
+                                    RPCClient *old_client,
+                                    const RPCReturnBuffer &resp) {
+  auto old_ip = old_client->GetAddr().ip;
+  NodeIP redirect_ip = 0;
+  auto resp_span = resp.get_buf();
+  if (resp_span.size_bytes() == sizeof(redirect_ip)) {
+    memcpy(&redirect_ip, resp_span.data(), sizeof(redirect_ip));
+  }
+  if (redirect_ip && redirect_ip != old_ip) {
+    update_cache_if_stale(proclet_id, old_ip, redirect_ip);
+    return;
+  }
+
   auto slab_id = to_slab_id(proclet_id);
   auto &info_ref = rem_id_to_node_info_[slab_id];
   if (info_ref.raw) {
-    if (info_ref.ip != old_client->GetAddr().ip) {
+    if (info_ref.ip != old_ip) {
       return;
     } else {
       info_ref.raw = 0;
@@ -103,4 +124,22 @@ void RPCClientMgr::update_cache(ProcletID proclet_id, NodeIP ip) {
   info.id = get_node_id_by_node_ip(ip);
 }
 
+void RPCClientMgr::update_cache_if_stale(ProcletID proclet_id,
+                                         NodeIP stale_ip, NodeIP ip) {
+  auto slab_id = to_slab_id(proclet_id);
+  rt::MutexGuard g(&node_info_mutexes_[slab_id]);
+
+  auto &info = rem_id_to_node_info_[slab_id];
+  if (!info.raw || info.ip == stale_ip) {
+    NodeInfo new_info;
+    new_info.ip = ip;
+    new_info.id = get_node_id_by_node_ip(ip);
+    info = new_info;
+  }
+}
+
+ConcurrentHdrHistogram &RPCClientMgr::get_rtt_histogram() {
+  return rtt_histogram_;
+}
+
 }  // namespace nu
@@ -31,11 +31,22 @@ void RPCServer::handler_fn(std::span<std::byte> args, RPCReturner *returner) {
       returner->Return(kOk);
       break;
     }
+    case kPushLocations: {
+      auto &req = from_span<RPCReqPushLocations>(args);
+      get_runtime()->migrator()->update_pushed_locations(req);
+      returner->Return(kOk);
+      break;
+    }
     case kMigrateThreadAndRetVal: {
       auto &req = from_span<RPCReqMigrateThreadAndRetVal>(args);
       auto rc = req.handler(req.dest_proclet_header, req.dest_ret_val_ptr,
                             req.payload_len, req.payload);
-      returner->Return(rc);
+      if (unlikely(rc == kErrWrongClient)) {
+        get_runtime()->send_rpc_resp_wrong_client(req.dest_proclet_header,
+                                                  returner);
+      } else {
+        returner->Return(rc);
+      }
       break;
     }
     // Controller
@@ -54,6 +65,14 @@ void RPCServer::handler_fn(std::span<std::byte> args, RPCReturner *returner) {
       returner->Return(kOk, span, [resp = std::move(resp)] {});
       break;
     }
+    case kAllocateProclets: {
+      auto &req = from_span<RPCReqAllocateProclets>(args);
+      auto proclets =
+          get_runtime()->controller_server()->handle_allocate_proclets(req);
+      auto span = std::as_bytes(std::span(proclets));
+      returner->Return(kOk, span, [proclets = std::move(proclets)] {});
+      break;
+    }
     case kDestroyProclet: {
       auto &req = from_span<RPCReqDestroyProclet>(args);
       get_runtime()->controller_server()->handle_destroy_proclet(req);
@@ -68,6 +87,14 @@ void RPCServer::handler_fn(std::span<std::byte> args, RPCReturner *returner) {
       returner->Return(kOk, span, [resp = std::move(resp)] {});
       break;
     }
+    case kResolveProclets: {
+      auto &req = from_span<RPCReqResolveProclets>(args);
+      auto ips =
+          get_runtime()->controller_server()->handle_resolve_proclets(req);
+      auto span = std::as_bytes(std::span(ips));
+      returner->Return(kOk, span, [ips = std::move(ips)] {});
+      break;
+    }
     case kDestroyLP: {
       auto &req = from_span<RPCReqDestroyLP>(args);
       get_runtime()->controller_server()->handle_destroy_lp(req);
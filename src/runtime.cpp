@@ -18,9 +18,11 @@ extern "C" {
 #include <runtime.h>
 #include <thread.h>
 
+#include "nu/call_graph.hpp"
 #include "nu/command_line.hpp"
 #include "nu/ctrl_client.hpp"
 #include "nu/ctrl_server.hpp"
+#include "nu/metrics.hpp"
 #include "nu/migrator.hpp"
 #include "nu/pressure_handler.hpp"
 #include "nu/proclet.hpp"
@@ -29,6 +31,7 @@ extern "C" {
 #include "nu/rpc_client_mgr.hpp"
 #include "nu/rpc_server.hpp"
 #include "nu/runtime.hpp"
+#include "nu/tracer.hpp"
 #include "nu/utils/slab.hpp"
 
 namespace nu {
@@ -85,6 +88,9 @@ void Runtime::init_as_server(uint32_t remote_ctrl_ip, lpid_t lpid, bool isol) {
       new ControllerClient(remote_ctrl_ip, kServer, lpid, isol);
   proclet_manager_ = new ProcletManager();
   pressure_handler_ = new PressureHandler();
+  call_graph_sampler_ = new CallGraphSampler();
+  tracer_ = new Tracer();
+  metrics_ = new MetricsRegistry();
   resource_reporter_ = new ResourceReporter();
   stack_manager_ = new StackManager(controller_client_->get_stack_cluster());
   archive_pool_ = new ArchivePool<>();
@@ -123,9 +129,15 @@ void Runtime::send_rpc_resp_ok(ArchivePool<>::OASStream *oa_sstream,
   }
 }
 
-void Runtime::send_rpc_resp_wrong_client(RPCReturner *returner) {
+void Runtime::send_rpc_resp_wrong_client(ProcletHeader *proclet_header,
+                                         RPCReturner *returner) {
   BUG_ON(caladan_->thread_has_been_migrated());
-  returner->Return(kErrWrongClient);
+  if (unlikely(rt::access_once(proclet_header->status()) == kLost)) {
+    returner->Return(kErrLost);
+    return;
+  }
+  // Spare the caller a controller round trip if the proclet has left us.
+  returner->ReturnWrongClient(rt::access_once(proclet_header->forward_ip()));
 }
 
 void Runtime::shutdown(RPCReturner *returner) {
@@ -140,6 +152,9 @@ void Runtime::shutdown(RPCReturner *returner) {
 void Runtime::destroy() {
   delete stack_manager_;
   delete resource_reporter_;
+  delete metrics_;
+  delete tracer_;
+  delete call_graph_sampler_;
   delete pressure_handler_;
   delete proclet_manager_;
   delete migrator_;
@@ -0,0 +1,199 @@
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+extern "C" {
+#include <base/assert.h>
+#include <runtime/net.h>
+}
+
+#include "nu/runtime.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/rpc_client_mgr.hpp"
+#include "nu/tracer.hpp"
+#include "nu/utils/caladan.hpp"
+
+namespace nu {
+
+static const char *get_kind_name(TraceSpanKind kind) {
+  switch (kind) {
+    case kFastPathCall:
+      return "fast_path_call";
+    case kSlowPathCall:
+      return "slow_path_call";
+    case kServeCall:
+      return "serve_call";
+    case kForwardCall:
+      return "forward_call";
+    case kMigrateProclet:
+      return "migrate_proclet";
+    default:
+      BUG();
+  }
+}
+
+// The proclet whose timeline the span belongs to.
+static ProcletID get_tid(const TraceSpan &span) {
+  return span.kind == kServeCall || span.kind == kMigrateProclet ? span.callee
+                                                                 : span.caller;
+}
+
+Tracer::Tracer() : sample_interval_(0) {
+  for (auto &per_core : per_cores_) {
+    per_core.calls = per_core.next_seq = per_core.head = 0;
+    per_core.spans = std::make_unique<TraceSpan[]>(kNumSpansPerCore);
+  }
+  auto wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+  epoch_us_ = static_cast<double>(wall_us) - now_us();
+}
+
+void Tracer::set_sample_interval(uint32_t interval) {
+  rt::access_once(sample_interval_) = interval;
+}
+
+uint64_t Tracer::new_span_id(uint32_t core) {
+  // Unique across nodes and never zero.
+  auto seq = per_cores_[core].next_seq++ * kNumCores + core;
+  return (static_cast<uint64_t>(get_cfg_ip()) << 32) |
+         static_cast<uint32_t>(seq);
+}
+
+void Tracer::record_on_core(uint32_t core, const TraceSpan &span) {
+  auto &per_core = per_cores_[core];
+  per_core.spans[per_core.head % kNumSpansPerCore] = span;
+  std::atomic_ref(per_core.head).store(per_core.head + 1,
+                                       std::memory_order_release);
+}
+
+void Tracer::record(const TraceSpan &span) {
+  Caladan::PreemptGuard g;
+  record_on_core(g.read_cpu(), span);
+}
+
+void Tracer::record_forward(ProcletID callee) {
+  auto *ctx = get_thread_ctx();
+  if (likely(!ctx->trace_id)) {
+    return;
+  }
+  // Where the call is resent to; might consult the controller.
+  auto *rpc_client_mgr = get_runtime()->rpc_client_mgr();
+  auto dest_ip = rpc_client_mgr->get_ip_by_proclet_id(callee);
+
+  Caladan::PreemptGuard g;
+  auto core = g.read_cpu();
+  TraceSpan span;
+  span.trace_id = ctx->trace_id;
+  span.span_id = new_span_id(core);
+  span.parent_span_id = ctx->span_id;
+  span.start_us = span.end_us = now_us();
+  span.caller = to_proclet_id(get_runtime()->get_current_proclet_header());
+  span.callee = callee;
+  span.peer_ip = dest_ip;
+  span.kind = kForwardCall;
+  record_on_core(core, span);
+}
+
+void Tracer::record_migration(ProcletID id, NodeIP dest_ip, double start_us) {
+  if (likely(!enabled())) {
+    return;
+  }
+
+  Caladan::PreemptGuard g;
+  auto core = g.read_cpu();
+  TraceSpan span;
+  span.trace_id = 0;
+  span.span_id = new_span_id(core);
+  span.parent_span_id = 0;
+  span.start_us = start_us;
+  span.end_us = now_us();
+  span.caller = 0;
+  span.callee = id;
+  span.peer_ip = dest_ip;
+  span.kind = kMigrateProclet;
+  record_on_core(core, span);
+}
+
+bool Tracer::export_chrome_trace(const std::string &path) {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    return false;
+  }
+
+  auto local_ip = get_cfg_ip();
+  ofs << std::fixed << std::setprecision(3);
+  ofs << "{\"traceEvents\":[\n";
+  ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << local_ip
+      << ",\"args\":{\"name\":\"node " << ip_to_str(local_ip) << "\"}}";
+
+  for (auto &per_core : per_cores_) {
+    auto head = std::atomic_ref(per_core.head).load(std::memory_order_acquire);
+    auto tail = head > kNumSpansPerCore ? head - kNumSpansPerCore : 0;
+    for (auto i = tail; i < head; i++) {
+      auto span = per_core.spans[i % kNumSpansPerCore];
+      auto tid = get_tid(span);
+      auto instant = span.kind == kForwardCall;
+
+      ofs << ",\n{\"name\":\"" << get_kind_name(span.kind)
+          << "\",\"cat\":\"nu\",\"ph\":\"" << (instant ? "i" : "X")
+          << "\",\"ts\":" << span.start_us;
+      if (instant) {
+        ofs << ",\"s\":\"t\"";
+      } else {
+        ofs << ",\"dur\":" << span.end_us - span.start_us;
+      }
+      ofs << ",\"pid\":" << local_ip << ",\"tid\":" << tid
+          << ",\"args\":{\"trace_id\":" << span.trace_id
+          << ",\"span_id\":" << span.span_id
+          << ",\"parent_span_id\":" << span.parent_span_id
+          << ",\"caller\":" << span.caller << ",\"callee\":" << span.callee
+          << ",\"peer\":\"" << ip_to_str(span.peer_ip) << "\"}}";
+
+      // Link the remote calls to their serving spans on the other nodes.
+      if (span.kind == kSlowPathCall) {
+        ofs << ",\n{\"name\":\"rpc\",\"cat\":\"nu\",\"ph\":\"s\",\"id\":"
+            << span.span_id << ",\"ts\":" << span.start_us
+            << ",\"pid\":" << local_ip << ",\"tid\":" << tid << "}";
+      } else if (span.kind == kServeCall) {
+        ofs << ",\n{\"name\":\"rpc\",\"cat\":\"nu\",\"ph\":\"f\",\"bp\":\"e\""
+            << ",\"id\":" << span.parent_span_id << ",\"ts\":" << span.start_us
+            << ",\"pid\":" << local_ip << ",\"tid\":" << tid << "}";
+      }
+    }
+  }
+  ofs << "\n]}\n";
+  return static_cast<bool>(ofs);
+}
+
+void TraceScope::begin() {
+  auto *tracer = get_runtime()->tracer();
+  if (span_.kind == kSlowPathCall) {
+    // Might resolve the location through the controller.
+    RuntimeSlabGuard guard;
+    auto *rpc_client_mgr = get_runtime()->rpc_client_mgr();
+    span_.peer_ip = rpc_client_mgr->get_ip_by_proclet_id(span_.callee);
+  }
+  auto *ctx = tracer->get_thread_ctx();
+
+  Caladan::PreemptGuard g;
+  span_.span_id = tracer->new_span_id(g.read_cpu());
+  span_.parent_span_id = ctx->trace_id ? ctx->span_id : 0;
+  span_.trace_id = ctx->trace_id ? ctx->trace_id : span_.span_id;
+  span_.start_us = tracer->now_us();
+  ctx->trace_id = span_.trace_id;
+  ctx->span_id = span_.span_id;
+}
+
+void TraceScope::end() {
+  auto *tracer = get_runtime()->tracer();
+  // The thread might have been migrated, so fetch its context again.
+  auto *ctx = tracer->get_thread_ctx();
+  ctx->trace_id = span_.parent_span_id ? span_.trace_id : 0;
+  ctx->span_id = span_.parent_span_id;
+  span_.end_us = tracer->now_us();
+  tracer->record(span_);
+}
+
+}  // namespace nu
@@ -0,0 +1,45 @@
+#include "nu/utils/caller_set.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+CallerSet::CallerSet() {
+  for (auto &slot : slots_) {
+    slot.ip = 0;
+    slot.last_us = 0;
+  }
+}
+
+void CallerSet::insert(NodeIP ip, uint64_t now_us) {
+  ScopedLock lock(&spin_);
+
+  auto *victim = &slots_[0];
+  for (auto &slot : slots_) {
+    // Raced with another insertion of the same caller.
+    if (slot.ip.load(std::memory_order_relaxed) == ip) {
+      return;
+    }
+    if (slot.last_us.load(std::memory_order_relaxed) <
+        victim->last_us.load(std::memory_order_relaxed)) {
+      victim = &slot;
+    }
+  }
+  victim->last_us.store(now_us, std::memory_order_relaxed);
+  victim->ip.store(ip, std::memory_order_relaxed);
+}
+
+std::vector<NodeIP> CallerSet::get_recent() const {
+  std::vector<NodeIP> callers;
+  auto now_us = microtime();
+
+  for (const auto &slot : slots_) {
+    auto ip = slot.ip.load(std::memory_order_relaxed);
+    auto last_us = slot.last_us.load(std::memory_order_relaxed);
+    if (ip && last_us + kRecentUs > now_us) {
+      callers.push_back(ip);
+    }
+  }
+  return callers;
+}
+
+}  // namespace nu
@@ -0,0 +1,162 @@
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <base/assert.h>
+}
+
+#include "nu/utils/caladan.hpp"
+#include "nu/utils/dirty_page_tracker.hpp"
+
+// Older uapi headers lack the definitions below (introduced in Linux 6.7).
+// They are part of the stable kernel ABI, so defining them here is safe; the
+// runtime feature check in the constructor handles older kernels.
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN (1 << 1)
+#define PM_SCAN_WP_MATCHING (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+
+struct page_region {
+  __u64 start;
+  __u64 end;
+  __u64 categories;
+};
+
+struct pm_scan_arg {
+  __u64 size;
+  __u64 flags;
+  __u64 start;
+  __u64 end;
+  __u64 walk_end;
+  __u64 vec;
+  __u64 vec_len;
+  __u64 max_pages;
+  __u64 category_inverted;
+  __u64 category_mask;
+  __u64 category_anyof_mask;
+  __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+namespace nu {
+
+constexpr static uint64_t kRequiredUffdFeatures =
+    UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+
+DirtyPageTracker::DirtyPageTracker() : uffd_(-1), pagemap_fd_(-1) {
+  Caladan::PreemptGuard g;
+
+  uffd_ = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  if (uffd_ < 0) {
+    return;
+  }
+
+  uffdio_api api = {.api = UFFD_API, .features = kRequiredUffdFeatures};
+  if (ioctl(uffd_, UFFDIO_API, &api) < 0 ||
+      (api.features & kRequiredUffdFeatures) != kRequiredUffdFeatures) {
+    close(uffd_);
+    uffd_ = -1;
+    return;
+  }
+
+  pagemap_fd_ = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (pagemap_fd_ < 0) {
+    close(uffd_);
+    uffd_ = -1;
+    return;
+  }
+
+  regions_ = std::make_unique<page_region[]>(kMaxRegionsPerScan);
+}
+
+DirtyPageTracker::~DirtyPageTracker() {
+  if (pagemap_fd_ >= 0) {
+    close(pagemap_fd_);
+  }
+  if (uffd_ >= 0) {
+    close(uffd_);
+  }
+}
+
+bool DirtyPageTracker::is_supported() const { return uffd_ >= 0; }
+
+bool DirtyPageTracker::start(VAddrRange range) {
+  BUG_ON(!is_supported());
+  Caladan::PreemptGuard g;
+
+  uffdio_register reg = {
+      .range = {.start = range.start, .len = range.end - range.start},
+      .mode = UFFDIO_REGISTER_MODE_WP};
+  if (ioctl(uffd_, UFFDIO_REGISTER, &reg) < 0) {
+    return false;
+  }
+
+  uffdio_writeprotect wp = {
+      .range = {.start = range.start, .len = range.end - range.start},
+      .mode = UFFDIO_WRITEPROTECT_MODE_WP};
+  if (ioctl(uffd_, UFFDIO_WRITEPROTECT, &wp) < 0) {
+    BUG_ON(ioctl(uffd_, UFFDIO_UNREGISTER, &reg.range) < 0);
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<VAddrRange> DirtyPageTracker::collect(VAddrRange range) {
+  std::vector<VAddrRange> dirty_ranges;
+
+  auto start = range.start;
+  while (start < range.end) {
+    pm_scan_arg arg = {.size = sizeof(arg),
+                       .flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC,
+                       .start = start,
+                       .end = range.end,
+                       .walk_end = 0,
+                       .vec = reinterpret_cast<uint64_t>(regions_.get()),
+                       .vec_len = kMaxRegionsPerScan,
+                       .max_pages = 0,
+                       .category_inverted = 0,
+                       .category_mask = PAGE_IS_WRITTEN,
+                       .category_anyof_mask = 0,
+                       .return_mask = PAGE_IS_WRITTEN};
+    int num_regions;
+    {
+      Caladan::PreemptGuard g;
+      num_regions = ioctl(pagemap_fd_, PAGEMAP_SCAN, &arg);
+    }
+    BUG_ON(num_regions < 0);
+
+    for (int i = 0; i < num_regions; i++) {
+      dirty_ranges.emplace_back(regions_[i].start, regions_[i].end);
+    }
+    start = arg.walk_end;
+  }
+
+  return dirty_ranges;
+}
+
+void DirtyPageTracker::stop(VAddrRange range) {
+  Caladan::PreemptGuard g;
+
+  uffdio_range uffd_range = {.start = range.start,
+                             .len = range.end - range.start};
+  BUG_ON(ioctl(uffd_, UFFDIO_UNREGISTER, &uffd_range) < 0);
+}
+
+}  // namespace nu
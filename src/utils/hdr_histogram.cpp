@@ -0,0 +1,101 @@
+#include <cmath>
+
+#include "nu/utils/hdr_histogram.hpp"
+
+namespace nu {
+
+HdrHistogram::HdrHistogram()
+    : counts_(kNumCounts), count_(0), sum_(0), max_(0) {}
+
+void HdrHistogram::merge(const HdrHistogram &o) {
+  for (uint32_t i = 0; i < kNumCounts; i++) {
+    counts_[i] += o.counts_[i];
+  }
+  count_ += o.count_;
+  sum_ += o.sum_;
+  max_ = std::max(max_, o.max_);
+}
+
+void HdrHistogram::subtract(const HdrHistogram &o) {
+  for (uint32_t i = 0; i < kNumCounts; i++) {
+    counts_[i] -= o.counts_[i];
+  }
+  count_ -= o.count_;
+  sum_ -= o.sum_;
+  // Keeps the overall max, which get_max() narrows down to the remaining
+  // buckets.
+}
+
+void HdrHistogram::reset() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = sum_ = max_ = 0;
+}
+
+uint64_t HdrHistogram::get_count() const { return count_; }
+
+uint64_t HdrHistogram::get_sum() const { return sum_; }
+
+uint64_t HdrHistogram::get_max() const {
+  for (uint32_t i = kNumCounts; i > 0; i--) {
+    if (counts_[i - 1]) {
+      return std::min(lowest_of(i - 1) + width_of(i - 1) - 1, max_);
+    }
+  }
+  return 0;
+}
+
+double HdrHistogram::get_mean() const {
+  return count_ ? static_cast<double>(sum_) / count_ : 0;
+}
+
+uint64_t HdrHistogram::value_of(uint32_t idx) const {
+  return std::min(lowest_of(idx) + width_of(idx) / 2, max_);
+}
+
+uint64_t HdrHistogram::get_nth(double nth) const {
+  if (unlikely(!count_)) {
+    return 0;
+  }
+
+  auto target = std::max(
+      static_cast<uint64_t>(std::ceil(nth / 100.0 * count_)),
+      static_cast<uint64_t>(1));
+  uint64_t cnt = 0;
+  for (uint32_t i = 0; i < kNumCounts; i++) {
+    cnt += counts_[i];
+    if (cnt >= target) {
+      return value_of(i);
+    }
+  }
+  return get_max();
+}
+
+ConcurrentHdrHistogram::ConcurrentHdrHistogram()
+    : shards_(new Shard[kNumCores]()) {}
+
+HdrHistogram ConcurrentHdrHistogram::snapshot() const {
+  HdrHistogram histogram;
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    const auto &shard = shards_[i];
+    for (uint32_t j = 0; j < HdrHistogram::kNumCounts; j++) {
+      auto cnt = rt::access_once(shard.counts[j]);
+      histogram.counts_[j] += cnt;
+      histogram.count_ += cnt;
+    }
+    histogram.sum_ += rt::access_once(shard.sum);
+    uint64_t max = rt::access_once(shard.max);
+    histogram.max_ = std::max(histogram.max_, max);
+  }
+  return histogram;
+}
+
+HdrHistogram ConcurrentHdrHistogram::interval_snapshot() {
+  rt::ScopedLock<rt::Mutex> lock(&mutex_);
+  auto cur = snapshot();
+  auto interval = cur;
+  interval.subtract(last_);
+  last_ = std::move(cur);
+  return interval;
+}
+
+}  // namespace nu
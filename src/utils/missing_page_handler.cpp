@@ -0,0 +1,217 @@
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <base/assert.h>
+#include <base/log.h>
+}
+#include <thread.h>
+
+#include "nu/utils/caladan.hpp"
+#include "nu/utils/missing_page_handler.hpp"
+#include "nu/utils/spin_lock.hpp"
+
+namespace nu {
+
+namespace {
+
+VAddrRange aborted_ranges[MissingPageHandler::kMaxNumAbortedRanges];
+uint32_t num_aborted_ranges;
+SpinLock aborted_ranges_spin;
+
+// The threads touching an aborted range would otherwise see pages that never
+// arrived. They belong to a lost proclet, so they are terminated in place;
+// their stacks are leaked along with the proclet.
+void handle_sigsegv(int sig, siginfo_t *si, void *) {
+  auto addr = reinterpret_cast<uint64_t>(si->si_addr);
+  auto num = load_acquire(&num_aborted_ranges);
+  for (uint32_t i = 0; i < num; i++) {
+    if (addr >= aborted_ranges[i].start && addr < aborted_ranges[i].end) {
+      rt::Exit();
+    }
+  }
+  // Not ours, so take the default action once the fault recurs.
+  signal(sig, SIG_DFL);
+}
+
+}  // namespace
+
+MissingPageHandler::MissingPageHandler(VAddrRange range)
+    : uffd_(-1), range_(range) {
+  if (range_.start == range_.end) {
+    return;
+  }
+
+  Caladan::PreemptGuard g;
+
+  // The range must be unpopulated, or its stale pages would be seen instead of
+  // triggering faults.
+  BUG_ON(madvise(reinterpret_cast<void *>(range_.start),
+                 range_.end - range_.start, MADV_DONTNEED) != 0);
+
+  uffd_ = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+  BUG_ON(uffd_ < 0);
+
+  uffdio_api api = {.api = UFFD_API, .features = 0};
+  BUG_ON(ioctl(uffd_, UFFDIO_API, &api) < 0);
+
+  uffdio_register reg = {
+      .range = {.start = range_.start, .len = range_.end - range_.start},
+      .mode = UFFDIO_REGISTER_MODE_MISSING};
+  BUG_ON(ioctl(uffd_, UFFDIO_REGISTER, &reg) < 0);
+  BUG_ON(!(reg.ioctls & (1ULL << _UFFDIO_COPY)));
+  BUG_ON(!(reg.ioctls & (1ULL << _UFFDIO_ZEROPAGE)));
+}
+
+MissingPageHandler::~MissingPageHandler() { close_uffd(); }
+
+void MissingPageHandler::close_uffd() {
+  if (uffd_ < 0) {
+    return;
+  }
+
+  Caladan::PreemptGuard g;
+
+  uffdio_range uffd_range = {.start = range_.start,
+                             .len = range_.end - range_.start};
+  if (unlikely(ioctl(uffd_, UFFDIO_UNREGISTER, &uffd_range) < 0)) {
+    // Closing the uffd unregisters the range anyway.
+    log_err("MissingPageHandler: UFFDIO_UNREGISTER failed, errno = %d",
+            errno);
+  }
+  close(uffd_);
+  uffd_ = -1;
+}
+
+VAddrRange MissingPageHandler::range() const { return range_; }
+
+bool MissingPageHandler::poll_faults(std::vector<uint64_t> *fault_addrs) {
+  if (uffd_ < 0) {
+    return true;
+  }
+
+  uffd_msg msgs[kMaxFaultsPerPoll];
+  ssize_t len;
+  int err;
+  {
+    Caladan::PreemptGuard g;
+    len = read(uffd_, msgs, sizeof(msgs));
+    err = errno;
+  }
+  if (len < 0) {
+    return err == EAGAIN;
+  }
+
+  auto num_msgs = len / sizeof(uffd_msg);
+  for (size_t i = 0; i < num_msgs; i++) {
+    if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+      fault_addrs->push_back(msgs[i].arg.pagefault.address &
+                             ~(kPageSize - 1));
+    }
+  }
+  return true;
+}
+
+bool MissingPageHandler::install(uint64_t addr, const void *src,
+                                 uint64_t len) {
+  auto src_addr = reinterpret_cast<uint64_t>(src);
+  return fill(addr, len, [&](uint64_t dst, uint64_t n, int64_t *done) {
+    uffdio_copy copy = {.dst = dst,
+                        .src = src_addr + (dst - addr),
+                        .len = n,
+                        .mode = 0,
+                        .copy = 0};
+    auto ret = ioctl(uffd_, UFFDIO_COPY, &copy);
+    *done = copy.copy;
+    return ret;
+  });
+}
+
+bool MissingPageHandler::zero(uint64_t addr, uint64_t len) {
+  return fill(addr, len, [&](uint64_t dst, uint64_t n, int64_t *done) {
+    uffdio_zeropage zeropage = {
+        .range = {.start = dst, .len = n}, .mode = 0, .zeropage = 0};
+    auto ret = ioctl(uffd_, UFFDIO_ZEROPAGE, &zeropage);
+    *done = zeropage.zeropage;
+    return ret;
+  });
+}
+
+template <typename F>
+bool MissingPageHandler::fill(uint64_t addr, uint64_t len, F &&op) {
+  while (len) {
+    int64_t done;
+    int ret, err;
+    {
+      Caladan::PreemptGuard g;
+      ret = op(addr, len, &done);
+      err = errno;
+    }
+
+    if (done > 0) {
+      // Partially done.
+    } else if (!ret) {
+      done = len;
+    } else if (done == -EEXIST || err == EEXIST) {
+      // Installed by an earlier transfer.
+      done = kPageSize;
+    } else if (done == -EAGAIN || err == EAGAIN) {
+      // The address space is changing, retry.
+      done = 0;
+    } else {
+      log_err("MissingPageHandler: filling %lx failed, errno = %d", addr,
+              err);
+      return false;
+    }
+    addr += done;
+    len -= done;
+  }
+  return true;
+}
+
+void MissingPageHandler::abort() {
+  if (uffd_ < 0) {
+    return;
+  }
+
+  register_aborted_range(range_);
+
+  Caladan::PreemptGuard g;
+
+  auto *start = reinterpret_cast<void *>(range_.start);
+  auto len = range_.end - range_.start;
+  // The waiters retry their accesses once woken up, which then fault with
+  // SIGSEGV instead of blocking again.
+  BUG_ON(mprotect(start, len, PROT_NONE) != 0);
+  uffdio_range uffd_range = {.start = range_.start, .len = len};
+  BUG_ON(ioctl(uffd_, UFFDIO_WAKE, &uffd_range) < 0);
+  BUG_ON(madvise(start, len, MADV_DONTNEED) != 0);
+  close_uffd();
+}
+
+void MissingPageHandler::register_aborted_range(VAddrRange range) {
+  ScopedLock l(&aborted_ranges_spin);
+
+  if (!num_aborted_ranges) {
+    struct sigaction act = {};
+    act.sa_sigaction = handle_sigsegv;
+    act.sa_flags = SA_SIGINFO | SA_NODEFER;
+    BUG_ON(sigemptyset(&act.sa_mask) != 0);
+    BUG_ON(sigaction(SIGSEGV, &act, nullptr) != 0);
+  }
+  // Ranges are only ever added, so that the handler can read them lock-free.
+  BUG_ON(num_aborted_ranges == kMaxNumAbortedRanges);
+  aborted_ranges[num_aborted_ranges] = range;
+  store_release(&num_aborted_ranges, num_aborted_ranges + 1);
+}
+
+}  // namespace nu
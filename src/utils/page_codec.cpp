@@ -0,0 +1,138 @@
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <base/assert.h>
+#include <base/compiler.h>
+}
+
+#include "nu/utils/page_codec.hpp"
+
+namespace nu {
+
+constexpr static int kMaxCompressedLen = PageCodec::kMaxPayloadLen;
+static_assert(kMaxCompressedLen == LZ4_COMPRESSBOUND(PageCodec::kBlockSize));
+
+static inline bool is_zero(const std::byte *p, uint64_t len) {
+  return p[0] == std::byte{0} && !memcmp(p, p + 1, len - 1);
+}
+
+static inline uint32_t get_page_len(uint32_t page_idx, uint32_t len) {
+  return std::min(static_cast<uint64_t>(len - page_idx * kPageSize),
+                  kPageSize);
+}
+
+PageCodec::PageCodec()
+    : state_(std::make_unique_for_overwrite<std::byte[]>(LZ4_sizeofState())),
+      gather_buf_(std::make_unique_for_overwrite<std::byte[]>(kBlockSize)),
+      out_buf_(
+          std::make_unique_for_overwrite<std::byte[]>(kMaxCompressedLen)) {}
+
+uint32_t PageCodec::get_non_zero_len(uint32_t zero_pages, uint32_t len) {
+  uint32_t non_zero_len = 0;
+  auto num_pages = div_round_up_unchecked(static_cast<uint64_t>(len),
+                                          kPageSize);
+  for (uint32_t i = 0; i < num_pages; i++) {
+    if (!((zero_pages >> i) & 1)) {
+      non_zero_len += get_page_len(i, len);
+    }
+  }
+  return non_zero_len;
+}
+
+std::span<const std::byte> PageCodec::encode(const std::byte *src,
+                                             uint32_t len,
+                                             PageBlockHeader *hdr) {
+  BUG_ON(!len || len > kBlockSize);
+  auto num_pages = div_round_up_unchecked(static_cast<uint64_t>(len),
+                                          kPageSize);
+  hdr->zero_pages = 0;
+  for (uint32_t i = 0; i < num_pages; i++) {
+    if (is_zero(src + i * kPageSize, get_page_len(i, len))) {
+      hdr->zero_pages |= 1U << i;
+    }
+  }
+
+  // Only gather the non-zero pages if there's anything to elide.
+  const std::byte *in = src;
+  uint32_t in_len = len;
+  if (hdr->zero_pages) {
+    in = gather_buf_.get();
+    in_len = 0;
+    for (uint32_t i = 0; i < num_pages; i++) {
+      if (!((hdr->zero_pages >> i) & 1)) {
+        auto page_len = get_page_len(i, len);
+        memcpy(gather_buf_.get() + in_len, src + i * kPageSize, page_len);
+        in_len += page_len;
+      }
+    }
+  }
+  if (!in_len) {
+    hdr->payload_len = 0;
+    hdr->compressed = false;
+    return {};
+  }
+
+  auto out_len = LZ4_compress_fast_extState(
+      state_.get(), reinterpret_cast<const char *>(in),
+      reinterpret_cast<char *>(out_buf_.get()), in_len, kMaxCompressedLen,
+      kAcceleration);
+  hdr->compressed = out_len > 0 && static_cast<uint32_t>(out_len) < in_len;
+  if (!hdr->compressed) {
+    hdr->payload_len = in_len;
+    return {in, in_len};
+  }
+  hdr->payload_len = out_len;
+  return {out_buf_.get(), static_cast<size_t>(out_len)};
+}
+
+std::byte *PageCodec::get_payload_buf() { return out_buf_.get(); }
+
+bool PageCodec::decode(const PageBlockHeader &hdr, const std::byte *payload,
+                       std::byte *dst, uint32_t len) {
+  auto non_zero_len = get_non_zero_len(hdr.zero_pages, len);
+  if (unlikely(hdr.payload_len > kMaxCompressedLen ||
+               (!hdr.compressed && hdr.payload_len != non_zero_len))) {
+    return false;
+  }
+
+  const std::byte *non_zero = payload;
+  if (hdr.compressed) {
+    // Decompress straight into the destination if nothing was elided.
+    auto *buf = hdr.zero_pages ? gather_buf_.get() : dst;
+    auto ret = LZ4_decompress_safe(reinterpret_cast<const char *>(payload),
+                                   reinterpret_cast<char *>(buf),
+                                   hdr.payload_len, non_zero_len);
+    if (unlikely(ret < 0 || static_cast<uint32_t>(ret) != non_zero_len)) {
+      return false;
+    }
+    if (!hdr.zero_pages) {
+      return true;
+    }
+    non_zero = buf;
+  } else if (!hdr.zero_pages) {
+    if (payload != dst) {
+      memcpy(dst, payload, len);
+    }
+    return true;
+  }
+
+  // The destination page might hold stale data (e.g., from a pre-copy round).
+  auto num_pages = div_round_up_unchecked(static_cast<uint64_t>(len),
+                                          kPageSize);
+  uint32_t off = 0;
+  for (uint32_t i = 0; i < num_pages; i++) {
+    auto page_len = get_page_len(i, len);
+    if ((hdr.zero_pages >> i) & 1) {
+      memset(dst + i * kPageSize, 0, page_len);
+    } else {
+      memcpy(dst + i * kPageSize, non_zero + off, page_len);
+      off += page_len;
+    }
+  }
+  return true;
+}
+
+}  // namespace nu
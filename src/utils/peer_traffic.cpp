@@ -0,0 +1,68 @@
+#include <cmath>
+#include <cstring>
+
+extern "C" {
+#include <base/time.h>
+}
+
+#include "nu/utils/peer_traffic.hpp"
+#include "nu/utils/scoped_lock.hpp"
+
+namespace nu {
+
+PeerTraffic::PeerTraffic() : last_decay_us_(microtime()) {
+  memset(slots_, 0, sizeof(slots_));
+}
+
+void PeerTraffic::record(NodeIP ip, uint32_t cnt) {
+  ScopedLock lock(&spin_);
+
+  auto now_us = microtime();
+  if (unlikely(now_us >= last_decay_us_ + kDecayIntervalUs)) {
+    decay(now_us);
+  }
+
+  auto *victim = &slots_[0];
+  for (auto &slot : slots_) {
+    if (slot.ip == ip) {
+      slot.cnt += cnt;
+      return;
+    }
+    if (slot.cnt < victim->cnt) {
+      victim = &slot;
+    }
+  }
+  // Inherit the victim's count so that a newcomer cannot keep evicting the
+  // slot of a frequent peer.
+  victim->ip = ip;
+  victim->cnt += cnt;
+}
+
+PeerTrafficSummary PeerTraffic::summarize(NodeIP local_ip) const {
+  PeerTrafficSummary summary{
+      .top_remote_ip = 0, .top_remote = 0, .local = 0, .total = 0};
+
+  ScopedLock lock(&spin_);
+  for (const auto &slot : slots_) {
+    summary.total += slot.cnt;
+    if (slot.ip == local_ip) {
+      summary.local += slot.cnt;
+    } else if (slot.ip && slot.cnt > summary.top_remote) {
+      summary.top_remote_ip = slot.ip;
+      summary.top_remote = slot.cnt;
+    }
+  }
+  return summary;
+}
+
+void PeerTraffic::decay(uint64_t now_us) {
+  auto num_intervals = (now_us - last_decay_us_) / kDecayIntervalUs;
+  last_decay_us_ += num_intervals * kDecayIntervalUs;
+  auto factor = std::pow(kDecayFactor, num_intervals);
+
+  for (auto &slot : slots_) {
+    slot.cnt *= factor;
+  }
+}
+
+}  // namespace nu
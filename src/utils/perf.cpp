@@ -6,15 +6,51 @@ extern "C" {
 
 #include <algorithm>
 #include <cmath>
+#include <fstream>
 #include <numeric>
 #include <optional>
 #include <random>
+#include <sstream>
 #include <vector>
 
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/vector.hpp>
+
 #include "nu/utils/perf.hpp"
 
 namespace nu {
 
+static void write_histogram(rt::TcpConn *c, const HdrHistogram &histogram) {
+  std::stringstream ss;
+  {
+    cereal::BinaryOutputArchive oa(ss);
+    oa << histogram;
+  }
+  auto str = ss.str();
+  uint64_t size = str.size();
+  BUG_ON(c->WriteFull(&size, sizeof(size)) != sizeof(size));
+  BUG_ON(c->WriteFull(str.data(), size) != static_cast<ssize_t>(size));
+}
+
+static HdrHistogram read_histogram(rt::TcpConn *c) {
+  uint64_t size;
+  BUG_ON(c->ReadFull(&size, sizeof(size)) != sizeof(size));
+  std::string str(size, '\0');
+  BUG_ON(c->ReadFull(str.data(), size) != static_cast<ssize_t>(size));
+  std::stringstream ss(str);
+  HdrHistogram histogram;
+  {
+    cereal::BinaryInputArchive ia(ss);
+    ia >> histogram;
+  }
+  return histogram;
+}
+
+static double get_mops(const PerfInterval &interval) {
+  return static_cast<double>(interval.num_reqs) /
+         std::max(interval.duration_us, static_cast<uint64_t>(1));
+}
+
 Perf::Perf(PerfAdapter &adapter)
     : adapter_(adapter), trace_format_(kUnsorted), real_mops_(0) {}
 
@@ -22,6 +58,8 @@ void Perf::reset() {
   traces_.clear();
   trace_format_ = kUnsorted;
   real_mops_ = 0;
+  lat_histogram_.reset();
+  intervals_.clear();
 }
 
 void Perf::gen_reqs(
@@ -57,9 +95,11 @@ void Perf::gen_reqs(
 std::vector<Trace> Perf::benchmark(
     std::vector<PerfRequestWithTime> *all_reqs,
     const std::vector<std::unique_ptr<PerfThreadState>> &thread_states,
-    uint32_t num_threads, std::optional<uint64_t> miss_ddl_thresh_us) {
+    uint32_t num_threads, std::optional<uint64_t> miss_ddl_thresh_us,
+    HdrHistogram *lat_histogram) {
   std::vector<rt::Thread> threads;
   std::vector<Trace> all_traces[num_threads];
+  std::vector<HdrHistogram> all_histograms(num_threads);
 
   for (uint32_t i = 0; i < num_threads; i++) {
     all_traces[i].reserve(all_reqs[i].size());
@@ -67,6 +107,7 @@ std::vector<Trace> Perf::benchmark(
 
   for (uint32_t i = 0; i < num_threads; i++) {
     threads.emplace_back([&, &reqs = all_reqs[i], &traces = all_traces[i],
+                          &histogram = all_histograms[i],
                           thread_state = thread_states[i].get()] {
       auto start_us = microtime();
 
@@ -81,10 +122,13 @@ std::vector<Trace> Perf::benchmark(
         Trace trace;
         trace.absl_start_us = microtime();
         trace.start_us = trace.absl_start_us - start_us;
+        auto start_tsc = rdtsc();
         bool ok = adapter_.serve_req(thread_state, req.req.get());
+        auto duration_tsc = rdtsc() - start_tsc;
         trace.duration_us = microtime() - start_us - trace.start_us;
         if (ok) {
           traces.push_back(trace);
+          histogram.record(duration_tsc * 1000 / cycles_per_us);
         }
       }
     });
@@ -98,6 +142,7 @@ std::vector<Trace> Perf::benchmark(
   for (uint32_t i = 0; i < num_threads; i++) {
     gathered_traces.insert(gathered_traces.end(), all_traces[i].begin(),
                            all_traces[i].end());
+    lat_histogram->merge(all_histograms[i]);
   }
   return gathered_traces;
 }
@@ -126,46 +171,145 @@ void Perf::run_multi_clients(std::span<const netaddr> client_addrs,
   std::vector<PerfRequestWithTime> all_perf_reqs[num_threads];
   gen_reqs(all_warmup_reqs, thread_states, num_threads, target_mops, warmup_us);
   gen_reqs(all_perf_reqs, thread_states, num_threads, target_mops, duration_us);
-  benchmark(all_warmup_reqs, thread_states, num_threads, std::nullopt);
-  tcp_barrier(client_addrs);
-  traces_ = move(
-      benchmark(all_perf_reqs, thread_states, num_threads, miss_ddl_thresh_us));
+  HdrHistogram warmup_lat_histogram;
+  benchmark(all_warmup_reqs, thread_states, num_threads, std::nullopt,
+            &warmup_lat_histogram);
+  auto conns = tcp_connect(client_addrs);
+  tcp_barrier(client_addrs, conns);
+  reset();
+  traces_ = move(benchmark(all_perf_reqs, thread_states, num_threads,
+                           miss_ddl_thresh_us, &lat_histogram_));
   auto real_duration_us =
       std::accumulate(traces_.begin(), traces_.end(), static_cast<uint64_t>(0),
                       [](uint64_t ret, Trace t) {
                         return std::max(ret, t.start_us + t.duration_us);
                       });
   real_mops_ = static_cast<double>(traces_.size()) / real_duration_us;
+  tcp_merge(client_addrs, conns, &lat_histogram_);
+  tcp_close(client_addrs, conns);
 }
 
-void Perf::tcp_barrier(std::span<const netaddr> participant_addrs) {
+void Perf::open_loop_benchmark(
+    const std::vector<std::unique_ptr<PerfThreadState>> &thread_states,
+    uint32_t num_threads, double target_mops, uint64_t duration_us,
+    uint64_t interval_us, HdrHistogram *lat_histogram,
+    std::vector<PerfInterval> *intervals) {
+  BUG_ON(!interval_us);
+  ConcurrentHdrHistogram histogram;
+  std::vector<rt::Thread> threads;
+  auto begin_tsc = rdtsc();
+  auto begin_us = microtime();
+
+  for (uint32_t i = 0; i < num_threads; i++) {
+    threads.emplace_back([&, thread_state = thread_states[i].get()] {
+      std::random_device rd;
+      std::mt19937 gen(rd());
+      std::exponential_distribution<double> d(target_mops / num_threads);
+
+      for (auto send_us = d(gen); send_us < duration_us; send_us += d(gen)) {
+        auto req = adapter_.gen_req(thread_state);
+        auto relative_us = microtime() - begin_us;
+        if (send_us > relative_us) {
+          timer_sleep(send_us - relative_us);
+        }
+        // Charged from when it should have been sent, even if this thread
+        // was still busy with the previous requests back then.
+        if (adapter_.serve_req(thread_state, req.get())) {
+          auto send_tsc =
+              begin_tsc + static_cast<uint64_t>(send_us * cycles_per_us);
+          auto now_tsc = rdtsc();
+          histogram.record_tsc(now_tsc - std::min(now_tsc, send_tsc));
+        }
+      }
+    });
+  }
+
+  uint64_t last_us = 0;
+  auto report = [&](uint64_t end_us) {
+    auto snapshot = histogram.interval_snapshot();
+    if (intervals) {
+      intervals->push_back(PerfInterval{.start_us = last_us,
+                                        .duration_us = end_us - last_us,
+                                        .num_reqs = snapshot.get_count(),
+                                        .mean_ns = snapshot.get_mean(),
+                                        .p50_ns = snapshot.get_nth(50),
+                                        .p90_ns = snapshot.get_nth(90),
+                                        .p99_ns = snapshot.get_nth(99),
+                                        .p999_ns = snapshot.get_nth(99.9),
+                                        .max_ns = snapshot.get_max()});
+    }
+    lat_histogram->merge(snapshot);
+    last_us = end_us;
+  };
+  for (auto end_us = interval_us; end_us < duration_us; end_us += interval_us) {
+    timer_sleep_until(begin_us + end_us);
+    report(end_us);
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  // Takes in the stragglers.
+  report(microtime() - begin_us);
+}
+
+void Perf::run_open_loop(uint32_t num_threads, double target_mops,
+                         uint64_t duration_us, uint64_t warmup_us,
+                         uint64_t interval_us) {
+  run_open_loop_multi_clients(std::span<const netaddr>(), num_threads,
+                              target_mops, duration_us, warmup_us,
+                              interval_us);
+}
+
+void Perf::run_open_loop_multi_clients(std::span<const netaddr> client_addrs,
+                                       uint32_t num_threads,
+                                       double target_mops,
+                                       uint64_t duration_us,
+                                       uint64_t warmup_us,
+                                       uint64_t interval_us) {
+  std::vector<std::unique_ptr<PerfThreadState>> thread_states;
+  create_thread_states(&thread_states, num_threads);
+  HdrHistogram warmup_lat_histogram;
+  open_loop_benchmark(thread_states, num_threads, target_mops, warmup_us,
+                      interval_us, &warmup_lat_histogram,
+                      /* intervals = */ nullptr);
+  auto conns = tcp_connect(client_addrs);
+  tcp_barrier(client_addrs, conns);
+  reset();
+  auto start_us = microtime();
+  open_loop_benchmark(thread_states, num_threads, target_mops, duration_us,
+                      interval_us, &lat_histogram_, &intervals_);
+  auto real_duration_us = microtime() - start_us;
+  real_mops_ =
+      static_cast<double>(lat_histogram_.get_count()) / real_duration_us;
+  tcp_merge(client_addrs, conns, &lat_histogram_);
+  tcp_close(client_addrs, conns);
+}
+
+bool Perf::is_tcp_sink(std::span<const netaddr> participant_addrs) {
+  return get_cfg_ip() == participant_addrs.front().ip;
+}
+
+Perf::TcpConns Perf::tcp_connect(std::span<const netaddr> participant_addrs) {
+  TcpConns conns;
   if (participant_addrs.empty()) {
-    return;
+    return conns;
   }
 
   auto sink_addr = participant_addrs.front();
   auto num_workers = participant_addrs.size() - 1;
-  bool dummy;
 
-  if (get_cfg_ip() == sink_addr.ip) {
+  if (is_tcp_sink(participant_addrs)) {
     if (num_workers) {
       auto *q = rt::TcpQueue::Listen(sink_addr, num_workers);
       BUG_ON(!q);
       auto q_gc = std::unique_ptr<rt::TcpQueue>(q);
 
-      std::vector<rt::TcpConn *> conns;
       while (num_workers) {
         auto *c = q->Accept();
         BUG_ON(!c);
-        conns.push_back(c);
+        conns.emplace_back(c);
         num_workers--;
       }
-
-      for (auto *c : conns) {
-        auto c_gc = std::unique_ptr<rt::TcpConn>(c);
-        BUG_ON(c->WriteFull(&dummy, sizeof(dummy)) != sizeof(dummy));
-        BUG_ON(c->Shutdown(SHUT_RDWR) != 0);
-      }
       q->Shutdown();
     }
   } else {
@@ -177,9 +321,55 @@ void Perf::tcp_barrier(std::span<const netaddr> participant_addrs) {
     }
     BUG_ON(!matched_addr);
     auto *c = rt::TcpConn::Dial(*matched_addr, sink_addr);
-    auto c_gc = std::unique_ptr<rt::TcpConn>(c);
     BUG_ON(!c);
-    BUG_ON(c->ReadFull(&dummy, sizeof(dummy)) != sizeof(dummy));
+    conns.emplace_back(c);
+  }
+  return conns;
+}
+
+void Perf::tcp_barrier(std::span<const netaddr> participant_addrs,
+                       const TcpConns &conns) {
+  if (participant_addrs.empty()) {
+    return;
+  }
+
+  bool dummy;
+  if (is_tcp_sink(participant_addrs)) {
+    for (auto &c : conns) {
+      BUG_ON(c->WriteFull(&dummy, sizeof(dummy)) != sizeof(dummy));
+    }
+  } else {
+    BUG_ON(conns.front()->ReadFull(&dummy, sizeof(dummy)) != sizeof(dummy));
+  }
+}
+
+void Perf::tcp_merge(std::span<const netaddr> participant_addrs,
+                     const TcpConns &conns, HdrHistogram *histogram) {
+  if (participant_addrs.empty()) {
+    return;
+  }
+
+  if (is_tcp_sink(participant_addrs)) {
+    for (auto &c : conns) {
+      histogram->merge(read_histogram(c.get()));
+    }
+    for (auto &c : conns) {
+      write_histogram(c.get(), *histogram);
+    }
+  } else {
+    write_histogram(conns.front().get(), *histogram);
+    *histogram = read_histogram(conns.front().get());
+  }
+}
+
+void Perf::tcp_close(std::span<const netaddr> participant_addrs,
+                     const TcpConns &conns) {
+  if (participant_addrs.empty() || !is_tcp_sink(participant_addrs)) {
+    return;
+  }
+
+  for (auto &c : conns) {
+    BUG_ON(c->Shutdown(SHUT_RDWR) != 0);
   }
 }
 
@@ -246,4 +436,52 @@ double Perf::get_real_mops() const { return real_mops_; }
 
 const std::vector<Trace> &Perf::get_traces() const { return traces_; }
 
+const HdrHistogram &Perf::get_lat_histogram() const { return lat_histogram_; }
+
+const std::vector<PerfInterval> &Perf::get_intervals() const {
+  return intervals_;
+}
+
+bool Perf::write_intervals_csv(const std::string &path) const {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    return false;
+  }
+
+  ofs << "start_us,duration_us,num_reqs,mops,mean_ns,p50_ns,p90_ns,p99_ns,"
+         "p999_ns,max_ns\n";
+  for (const auto &interval : intervals_) {
+    ofs << interval.start_us << "," << interval.duration_us << ","
+        << interval.num_reqs << "," << get_mops(interval) << ","
+        << interval.mean_ns << "," << interval.p50_ns << ","
+        << interval.p90_ns << "," << interval.p99_ns << ","
+        << interval.p999_ns << "," << interval.max_ns << "\n";
+  }
+  return static_cast<bool>(ofs);
+}
+
+bool Perf::write_intervals_json(const std::string &path) const {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    return false;
+  }
+
+  ofs << "[";
+  for (std::size_t i = 0; i < intervals_.size(); i++) {
+    const auto &interval = intervals_[i];
+    ofs << (i ? ",\n" : "\n") << "{\"start_us\":" << interval.start_us
+        << ",\"duration_us\":" << interval.duration_us
+        << ",\"num_reqs\":" << interval.num_reqs
+        << ",\"mops\":" << get_mops(interval)
+        << ",\"mean_ns\":" << interval.mean_ns
+        << ",\"p50_ns\":" << interval.p50_ns
+        << ",\"p90_ns\":" << interval.p90_ns
+        << ",\"p99_ns\":" << interval.p99_ns
+        << ",\"p999_ns\":" << interval.p999_ns
+        << ",\"max_ns\":" << interval.max_ns << "}";
+  }
+  ofs << "\n]\n";
+  return static_cast<bool>(ofs);
+}
+
 }  // namespace nu
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <type_traits>
 
 extern "C" {
@@ -8,6 +11,7 @@ extern "C" {
 
 #include "nu/utils/rpc.hpp"
 #include "nu/runtime.hpp"
+#include "nu/rpc_client_mgr.hpp"
 
 namespace nu {
 
@@ -64,9 +68,20 @@ void RPCCompletion::Poll() const {
   }
 }
 
-void RPCCompletion::Done(ssize_t len, rt::TcpConn *c) {
+void RPCCompletion::Done(ssize_t len, RPCConn *c) {
   if (unlikely(len < 0)) {
     rc_ = static_cast<RPCReturnCode>(len);
+    if (rc_ == kErrWrongClient) {
+      auto buf = std::make_unique_for_overwrite<std::byte[]>(sizeof(uint32_t));
+      auto ret = c->ReadFull(buf.get(), sizeof(uint32_t));
+      if (unlikely(ret <= 0)) {
+        log_err("rpc: ReadFull failed, err = %ld", ret);
+      }
+      if (return_buf_) {
+        auto span = std::span<const std::byte>(buf.get(), sizeof(uint32_t));
+        return_buf_->Reset(span, [buf = std::move(buf)] {});
+      }
+    }
   } else {
     rc_ = kOk;
 
@@ -83,16 +98,38 @@ void RPCCompletion::Done(ssize_t len, rt::TcpConn *c) {
     }
   }
 
+  if (async_callback_) {
+    return;
+  }
+
   poll_ = false;
   w_.Wake();
 }
 
-RPCServerWorker::RPCServerWorker(std::unique_ptr<rt::TcpConn> c,
-                                 nu::RPCHandler &handler, Counter &counter)
+void RPCCompletion::CompleteAsync() {
+  auto callback = std::move(async_callback_);
+  auto rc = rc_;
+  auto return_buf = std::move(async_return_buf_);
+  delete this;
+  callback(rc, std::move(return_buf));
+}
+
+RPCServerPools::RPCServerPools()
+    : chunks([] { return new RPCRecvChunk; },
+             [](RPCRecvChunk *chunk) { delete chunk; }, kChunksPerCore),
+      requests([] { return new RPCRequest; },
+               [](RPCRequest *req) { delete req; }, kRequestsPerCore) {}
+
+RPCServerWorker::RPCServerWorker(std::unique_ptr<RPCConn> c,
+                                 nu::RPCHandler &handler, Counter &counter,
+                                 RPCServerPools &pools)
     : c_(std::move(c)),
       handler_(handler),
       close_(false),
       counter_(counter),
+      pools_(pools),
+      num_idle_handlers_(0),
+      stats_{},
       sender_([this] { SendWorker(); }),
       receiver_([this] { ReceiveWorker(); }) {}
 
@@ -135,6 +172,11 @@ void RPCServerWorker::SendWorker() {
       hdrs.emplace_back(MakeCallResponse(
           credits_, c.rc == kOk ? span.size_bytes() : c.rc, c.completion_data));
       iovecs.emplace_back(&hdrs.back(), sizeof(decltype(hdrs)::value_type));
+      if (c.rc == kErrWrongClient) {
+        iovecs.emplace_back(const_cast<uint32_t *>(&c.redirect_ip),
+                            sizeof(c.redirect_ip));
+        continue;
+      }
       if (span.size_bytes() == 0) continue;
       iovecs.emplace_back(const_cast<std::byte *>(span.data()),
                           span.size_bytes());
@@ -151,53 +193,201 @@ void RPCServerWorker::SendWorker() {
   if (WARN_ON(c_->Shutdown(SHUT_WR))) c_->Abort();
 }
 
+RPCRecvChunk *RPCServerWorker::GetChunk() {
+  auto *chunk = pools_.chunks.get();
+  chunk->refs.store(1, std::memory_order_relaxed);
+  return chunk;
+}
+
+void RPCServerWorker::PutChunk(RPCRecvChunk *chunk) {
+  if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    pools_.chunks.put(chunk);
+  }
+}
+
+void RPCServerWorker::Dispatch(std::size_t completion_data,
+                               std::span<std::byte> args, RPCRecvChunk *chunk,
+                               std::unique_ptr<std::byte[]> heap_args,
+                               RPCRequestList *batch) {
+  auto *req = pools_.requests.get();
+  req->completion_data = completion_data;
+  req->chunk = nullptr;
+
+  if (args.empty() || heap_args) {
+    req->args = args;
+    req->heap_args = std::move(heap_args);
+  } else if (reinterpret_cast<uintptr_t>(args.data()) %
+                 alignof(std::max_align_t) ==
+             0) {
+    // Handlers get the same alignment as from operator new.
+    req->args = args;
+    req->chunk = chunk;
+    chunk->refs.fetch_add(1, std::memory_order_relaxed);
+  } else if (args.size() <= RPCRequest::kInlineArgBytes) {
+    memcpy(req->inline_args, args.data(), args.size());
+    req->args = std::span(req->inline_args, args.size());
+  } else {
+    req->heap_args = std::make_unique_for_overwrite<std::byte[]>(args.size());
+    memcpy(req->heap_args.get(), args.data(), args.size());
+    req->args = std::span(req->heap_args.get(), args.size());
+  }
+
+  counter_.inc();
+  batch->push_back(req);
+}
+
+// Spawning a thread per request would cost more than most handlers, so the
+// requests of a batch go to the threads that are idle, if any.
+void RPCServerWorker::Submit(RPCRequestList *batch) {
+  if (!batch->size) {
+    return;
+  }
+
+  bool spawn;
+  {
+    rt::SpinGuard guard(&dispatch_lock_);
+    stats_.requests += batch->size;
+    pending_.splice(batch);
+    spawn = !num_idle_handlers_;
+    if (spawn) {
+      num_idle_handlers_++;
+      stats_.handler_spawns++;
+    }
+  }
+  if (spawn) {
+    SpawnHandler();
+  }
+}
+
+void RPCServerWorker::SpawnHandler() {
+  // Holds off the listener's destruction until the thread is done with this
+  // worker.
+  counter_.inc();
+  // Captures a single pointer to stay within the inline storage of the
+  // thread's std::move_only_function.
+  rt::Spawn([this] { RunHandlers(); });
+}
+
+void RPCServerWorker::RunHandlers() {
+  RPCRequest *req = nullptr;
+
+  while (true) {
+    bool spawn = false;
+    {
+      rt::SpinGuard guard(&dispatch_lock_);
+      if (req) {
+        num_idle_handlers_++;
+      }
+      req = pending_.pop_front();
+      if (!req) {
+        num_idle_handlers_--;
+        break;
+      }
+      // Leaves an idle thread behind for the remaining requests, which the
+      // handler might wait for.
+      if (pending_.size && num_idle_handlers_ == 1) {
+        spawn = true;
+        stats_.handler_spawns++;
+      } else {
+        num_idle_handlers_--;
+      }
+    }
+    if (spawn) {
+      SpawnHandler();
+    }
+    Handle(req);
+  }
+  counter_.dec();
+}
+
+void RPCServerWorker::Handle(RPCRequest *req) {
+  auto returner = RPCReturner(this, req->completion_data);
+  handler_(req->args, &returner);
+
+  if (req->chunk) {
+    PutChunk(req->chunk);
+  }
+  req->heap_args.reset();
+  pools_.requests.put(req);
+  counter_.dec();
+}
+
+RPCServerStats RPCServerWorker::GetStats() {
+  rt::SpinGuard guard(&dispatch_lock_);
+  return stats_;
+}
+
 void RPCServerWorker::ReceiveWorker() {
+  auto *chunk = GetChunk();
+  std::size_t head = 0, tail = 0;
+  RPCRequestList batch;
+
   while (true) {
-    // Read the request header.
-    rpc_req_hdr hdr;
-    ssize_t ret = c_->ReadFull(&hdr, sizeof(hdr));
+    // Drain all bytes available on the connection into the chunk.
+    ssize_t ret = c_->Read(chunk->data + tail, RPCRecvChunk::kBytes - tail);
     if (unlikely(ret == 0)) break;
     if (unlikely(ret < 0)) {
-      log_err("rpc: ReadFull failed, err = %ld", ret);
+      log_err("rpc: Read failed, err = %ld", ret);
       break;
     }
+    tail += ret;
+
+    // Parse and dispatch all complete requests in place.
+    std::size_t need = sizeof(rpc_req_hdr);
+    while (tail - head >= sizeof(rpc_req_hdr)) {
+      // The header might be misaligned.
+      rpc_req_hdr hdr;
+      memcpy(&hdr, chunk->data + head, sizeof(hdr));
+      std::size_t len = hdr.cmd == rpc_cmd::call ? hdr.len : 0;
+      need = sizeof(hdr) + len;
+
+      if (tail - head < need) {
+        if (need <= RPCRecvChunk::kBytes) break;
+
+        // Too large for any chunk, read the rest into a dedicated buffer.
+        auto buf = std::make_unique_for_overwrite<std::byte[]>(len);
+        auto partial_len = tail - head - sizeof(hdr);
+        memcpy(buf.get(), chunk->data + head + sizeof(hdr), partial_len);
+        ret = c_->ReadFull(buf.get() + partial_len, len - partial_len);
+        if (unlikely(ret <= 0)) {
+          if (ret < 0) log_err("rpc: ReadFull failed, err = %ld", ret);
+          break;
+        }
+        demand_ = hdr.demand;
+        auto args = std::span(buf.get(), len);
+        Dispatch(hdr.completion_data, args, nullptr, std::move(buf), &batch);
+        head = tail;
+        need = sizeof(hdr);
+        break;
+      }
 
-    // Parse the request header.
-    std::size_t completion_data = hdr.completion_data;
-    demand_ = hdr.demand;
-    if (hdr.cmd != rpc_cmd::call) continue;
-
-    // Spawn a handler with no argument data provided.
-    if (hdr.len == 0) {
-      counter_.inc();
-      // TODO: avoid dynamic memory allocation.
-      rt::Spawn([this, completion_data]() {
-        auto returner = RPCReturner(this, completion_data);
-        handler_(std::span<std::byte>{}, &returner);
-        counter_.dec();
-      });
-      continue;
+      demand_ = hdr.demand;
+      if (hdr.cmd == rpc_cmd::call) {
+        auto args = std::span(chunk->data + head + sizeof(hdr), len);
+        Dispatch(hdr.completion_data, args, chunk, nullptr, &batch);
+      }
+      head += need;
+      need = sizeof(rpc_req_hdr);
     }
-
-    // Allocate and fill a buffer with the argument data.
-    auto buf = std::make_unique_for_overwrite<std::byte[]>(hdr.len);
-    ret = c_->ReadFull(buf.get(), hdr.len);
-    if (unlikely(ret == 0)) break;
-    if (unlikely(ret < 0)) {
-      log_err("rpc: ReadFull failed, err = %ld", ret);
-      return;
+    Submit(&batch);
+    if (unlikely(ret <= 0)) break;
+
+    // Make room for the next read.
+    if (head == tail && chunk->refs.load(std::memory_order_acquire) == 1) {
+      // No handler refers to the chunk anymore, rewind it.
+      head = tail = 0;
+    } else if (head && (head + need > RPCRecvChunk::kBytes ||
+                        RPCRecvChunk::kBytes - tail < kMinReadBytes)) {
+      // Carry the partial request over to a fresh chunk.
+      auto *new_chunk = GetChunk();
+      memcpy(new_chunk->data, chunk->data + head, tail - head);
+      PutChunk(chunk);
+      chunk = new_chunk;
+      tail -= head;
+      head = 0;
     }
-
-    // Spawn a handler with argument data provided.
-    counter_.inc();
-    // TODO: avoid dynamic memory allocation.
-    rt::Spawn(
-        [this, completion_data, b = std::move(buf), len = hdr.len]() mutable {
-          auto returner = RPCReturner(this, completion_data);
-          handler_(std::span<std::byte>{b.get(), len}, &returner);
-          counter_.dec();
-        });
   }
+  PutChunk(chunk);
 
   // Wake the sender to close the connection.
   {
@@ -212,14 +402,63 @@ RPCFlow::~RPCFlow() {
     rt::SpinGuard guard(&lock_);
     close_ = true;
     wake_sender_.Wake();
+    wake_completer_.Wake();
   }
   sender_.Join();
   receiver_.Join();
+  completer_.Join();
+}
+
+bool RPCBatchController::should_flush(std::size_t queued,
+                                      unsigned int inflight,
+                                      uint64_t waited_us) const {
+  // Park right away if there's nothing to send, and don't hold back requests
+  // from an idle connection.
+  if (!queued || !inflight) return true;
+  return queued >= batch_target_ || waited_us >= timeout_us_;
+}
+
+void RPCBatchController::on_flush(uint32_t batch_size, uint64_t now_us) {
+  auto elapsed_us = std::max(now_us - last_flush_us_, static_cast<uint64_t>(1));
+  auto rate = batch_size * 1000 / elapsed_us;
+  scaled_arrival_rate_ += rate - (scaled_arrival_rate_ >> kEWMAShift);
+  last_flush_us_ = now_us;
+
+  auto bucket = static_cast<uint32_t>(std::bit_width(batch_size)) - 1;
+  histogram_[std::min(bucket, kNumHistogramBuckets - 1)]++;
+  retune();
+}
+
+void RPCBatchController::on_response(uint64_t rtt_us) {
+  if (unlikely(!scaled_rtt_us_)) {
+    scaled_rtt_us_ = rtt_us << kEWMAShift;
+  } else {
+    scaled_rtt_us_ += rtt_us - (scaled_rtt_us_ >> kEWMAShift);
+  }
+  retune();
+}
+
+void RPCBatchController::retune() {
+  // The smallest batch that meets the throughput target at the arrival rate.
+  auto target = div_round_up_unchecked(
+      (scaled_arrival_rate_ >> kEWMAShift) * kTargetFlushIntervalUs,
+      static_cast<uint64_t>(1000));
+  batch_target_ = std::clamp(target, static_cast<uint64_t>(1),
+                             static_cast<uint64_t>(kMaxBatchSize));
+  // A lone request is never worth waiting for.
+  timeout_us_ = batch_target_ > 1
+                    ? std::min(get_rtt_us() / kRTTFraction, kMaxBatchTimeoutUs)
+                    : 0;
 }
 
 inline bool RPCFlow::EnoughBatching() {
-  return reqs_.size() >= kReqBatchSize ||
-         microtime() - last_sent_us_ >= kBatchTimeoutUs;
+  return batcher_.should_flush(reqs_.size(), sent_count_ - recv_count_,
+                               microtime() - last_sent_us_);
+}
+
+RPCBatchController::Histogram RPCFlow::GetBatchSizeHistogram() {
+  rt::SpinGuard guard(&lock_);
+  return batcher_.get_histogram();
 }
 
 void RPCFlow::SendWorker() {
@@ -229,6 +468,7 @@ void RPCFlow::SendWorker() {
 
   while (true) {
     unsigned int demand, inflight;
+    uint64_t now_tsc, now_us;
     bool close;
 
     // adapative batching.
@@ -247,13 +487,18 @@ void RPCFlow::SendWorker() {
       }
 
       // gather queued requests up to the credit limit.
-      last_sent_us_ = microtime();
+      now_tsc = rdtsc();
+      now_us = (now_tsc - start_tsc) / cycles_per_us;
+      last_sent_us_ = now_us;
       while (!reqs_.empty() && inflight < credits_) {
         reqs.emplace_back(reqs_.front());
         reqs_.pop();
         inflight++;
       }
       sent_count_ += reqs.size();
+      if (kEnableAdaptiveBatching && !reqs.empty()) {
+        batcher_.on_flush(reqs.size(), now_us);
+      }
       close = close_ && reqs_.empty();
       demand = inflight;
     }
@@ -266,6 +511,20 @@ void RPCFlow::SendWorker() {
     hdrs.clear();
     hdrs.reserve(reqs.size());
     for (const auto &r : reqs) {
+      r.completion->sent_tsc_ = now_tsc;
+      if (!r.scattered_payload.empty()) {
+        std::size_t len = 0;
+        for (const auto &iov : r.scattered_payload) len += iov.iov_len;
+        hdrs.emplace_back(
+            MakeCallRequest(demand, len,
+                            reinterpret_cast<std::size_t>(r.completion)));
+        iovecs.emplace_back(&hdrs.back(), sizeof(decltype(hdrs)::value_type));
+        for (const auto &iov : r.scattered_payload) {
+          if (iov.iov_len) iovecs.push_back(iov);
+        }
+        continue;
+      }
+
       auto &span = r.payload;
       hdrs.emplace_back(
           MakeCallRequest(demand, span.size_bytes(),
@@ -299,30 +558,81 @@ void RPCFlow::ReceiveWorker() {
       return;
     }
 
+    auto *completion = reinterpret_cast<RPCCompletion *>(hdr.completion_data);
+    bool is_call = hdr.cmd == rpc_cmd::call;
+    uint64_t rtt_tsc = is_call ? rdtsc() - completion->sent_tsc_ : 0;
+    uint64_t rtt_us = rtt_tsc / cycles_per_us;
+    if (is_call) {
+      get_runtime()->rpc_client_mgr()->get_rtt_histogram().record_tsc(rtt_tsc);
+    }
+
     // Check if we should wake the sender.
     {
       rt::SpinGuard guard(&lock_);
       unsigned int inflight = sent_count_ - ++recv_count_;
       // credits_ = hdr.credits;
       if (credits_ > inflight && !reqs_.empty()) wake_sender_.Wake();
+      if (kEnableAdaptiveBatching && is_call) batcher_.on_response(rtt_us);
     }
 
-    if (hdr.cmd != rpc_cmd::call) continue;
+    if (!is_call) continue;
 
-    // Check if there is no return data.
-    auto *completion = reinterpret_cast<RPCCompletion *>(hdr.completion_data);
+    // Check if there is no return data. A synchronous completion might be
+    // gone once done.
+    bool is_async = completion->is_async();
     completion->Done(hdr.len, c_.get());
+    if (is_async) {
+      rt::SpinGuard guard(&lock_);
+      async_completions_.push_back(completion);
+      wake_completer_.Wake();
+    }
   }
 }
 
+void RPCFlow::CompleteWorker() {
+  std::vector<RPCCompletion *> completions;
+
+  while (true) {
+    {
+      rt::SpinGuard guard(&lock_);
+      while (async_completions_.empty() && !close_) {
+        guard.Park(&wake_completer_);
+      }
+      if (unlikely(close_ && async_completions_.empty())) break;
+      std::swap(completions, async_completions_);
+    }
+
+    for (auto *completion : completions) {
+      completion->CompleteAsync();
+    }
+    completions.clear();
+  }
+}
+
+void RPCFlow::StartWorkers() {
+  sender_ = rt::Thread([this] { SendWorker(); });
+  receiver_ = rt::Thread([this] { ReceiveWorker(); });
+  completer_ = rt::Thread([this] { CompleteWorker(); });
+}
+
 std::unique_ptr<RPCFlow> RPCFlow::New(unsigned int cpu_affinity,
                                       netaddr raddr) {
-  std::unique_ptr<rt::TcpConn> c(
-      rt::TcpConn::DialAffinity(cpu_affinity, raddr));
-  BUG_ON(!c);
+  auto *tcp_conn = rt::TcpConn::DialAffinity(cpu_affinity, raddr);
+  BUG_ON(!tcp_conn);
+  auto c = std::make_unique<RPCConn>(tcp_conn);
   std::unique_ptr<RPCFlow> f = std::make_unique<RPCFlow>(std::move(c));
-  f->sender_ = rt::Thread([f = f.get()] { f->SendWorker(); });
-  f->receiver_ = rt::Thread([f = f.get()] { f->ReceiveWorker(); });
+  f->StartWorkers();
+  return f;
+}
+
+std::unique_ptr<RPCFlow> RPCFlow::NewShm(netaddr raddr) {
+  auto *shm_conn = ShmConn::Dial(raddr);
+  if (!shm_conn) {
+    return nullptr;
+  }
+  auto c = std::make_unique<RPCConn>(shm_conn);
+  std::unique_ptr<RPCFlow> f = std::make_unique<RPCFlow>(std::move(c));
+  f->StartWorkers();
   return f;
 }
 
@@ -336,6 +646,27 @@ std::unique_ptr<RPCClient> RPCClient::Dial(netaddr raddr) {
   return std::unique_ptr<RPCClient>(new RPCClient(std::move(v), raddr));
 }
 
+std::unique_ptr<RPCClient> RPCClient::DialShm(netaddr raddr) {
+  std::vector<std::unique_ptr<RPCFlow>> v;
+  // Still one flow per kthread, so that each ring has a single producer.
+  for (unsigned int i = 0; i < rt::RuntimeMaxCores(); ++i) {
+    auto f = RPCFlow::NewShm(raddr);
+    if (!f) {
+      return nullptr;
+    }
+    v.emplace_back(std::move(f));
+  }
+  return std::unique_ptr<RPCClient>(new RPCClient(std::move(v), raddr));
+}
+
+std::vector<rpc_internal::RPCBatchController::Histogram>
+RPCClient::GetBatchSizeHistograms() {
+  std::vector<rpc_internal::RPCBatchController::Histogram> histograms;
+  histograms.reserve(flows_.size());
+  for (auto &f : flows_) histograms.emplace_back(f->GetBatchSizeHistogram());
+  return histograms;
+}
+
 RPCServerListener::RPCServerListener(uint16_t port, RPCHandler &&handler)
     : handler_(std::move(handler)) {
   q_.reset(rt::TcpQueue::Listen({0, port}, 4096));
@@ -344,15 +675,50 @@ RPCServerListener::RPCServerListener(uint16_t port, RPCHandler &&handler)
   listener_ = rt::Thread([&]() mutable {
     rt::TcpConn *c;
     while ((c = q_->Accept())) {
-      workers_.emplace_back(new rpc_internal::RPCServerWorker(
-          std::unique_ptr<rt::TcpConn>(c), handler_, counter_));
+      add_worker(std::make_unique<RPCConn>(c));
     }
   });
+
+  // Co-located clients find this queue and bypass the network stack.
+  if constexpr (RPCConn::kEnableShmTransport) {
+    shm_q_.reset(ShmQueue::Listen({0, port}));
+  }
+  if (shm_q_) {
+    shm_listener_ = rt::Thread([&]() mutable {
+      ShmConn *c;
+      while ((c = shm_q_->Accept())) {
+        add_worker(std::make_unique<RPCConn>(c));
+      }
+    });
+  }
+}
+
+RPCServerStats RPCServerListener::GetStats() {
+  RPCServerStats stats{};
+  rt::SpinGuard guard(&workers_lock_);
+  for (auto &worker : workers_) {
+    auto worker_stats = worker->GetStats();
+    stats.requests += worker_stats.requests;
+    stats.handler_spawns += worker_stats.handler_spawns;
+  }
+  return stats;
+}
+
+void RPCServerListener::add_worker(std::unique_ptr<RPCConn> c) {
+  std::unique_ptr<rpc_internal::RPCServerWorker> worker(
+      new rpc_internal::RPCServerWorker(std::move(c), handler_, counter_,
+                                        pools_));
+  rt::SpinGuard guard(&workers_lock_);
+  workers_.emplace_back(std::move(worker));
 }
 
 RPCServerListener::~RPCServerListener() {
   q_->Shutdown();
   listener_.Join();
+  if (shm_q_) {
+    shm_q_->Shutdown();
+    shm_listener_.Join();
+  }
 
   while (counter_.get()) {
     rt::Yield();
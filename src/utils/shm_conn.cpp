@@ -0,0 +1,382 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <base/compiler.h>
+#include <base/time.h>
+#include <runtime/net.h>
+#include <runtime/timer.h>
+}
+#include <sync.h>
+#include <thread.h>
+
+#include "nu/commons.hpp"
+#include "nu/utils/shm_conn.hpp"
+
+namespace nu {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint8_t>::is_always_lock_free);
+
+struct ShmRing {
+  alignas(kCacheLineBytes) std::atomic<uint64_t> head;  // Owned by the reader.
+  alignas(kCacheLineBytes) std::atomic<uint64_t> tail;  // Owned by the writer.
+  alignas(kCacheLineBytes) std::atomic<bool> closed;
+  alignas(kCacheLineBytes) std::byte data[ShmConn::kRingBytes];
+};
+
+struct ShmConnSegment {
+  NodeIP client_ip;
+  std::atomic<bool> accepted;
+  ShmRing to_server;
+  ShmRing to_client;
+};
+
+enum ShmSlotState : uint8_t { kFree = 0, kClaimed, kPosted };
+
+struct ShmQueueSegment {
+  constexpr static uint32_t kMaxNameLen = 64;
+
+  struct Slot {
+    std::atomic<uint8_t> state;
+    char conn_name[kMaxNameLen];
+  };
+
+  std::atomic<pid_t> pid;
+  Slot slots[ShmQueue::kNumSlots];
+};
+
+// Segments are zero-filled on creation, which is a valid initial state.
+template <typename T>
+static T *map_segment(const std::string &name, bool create) {
+  auto flags = create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR;
+  int fd = shm_open(name.c_str(), flags, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  bool sized = create ? !ftruncate(fd, sizeof(T))
+                      : !fstat(fd, &st) &&
+                            static_cast<size_t>(st.st_size) >= sizeof(T);
+  void *addr = MAP_FAILED;
+  if (likely(sized)) {
+    addr = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (unlikely(addr == MAP_FAILED)) {
+    if (create) {
+      shm_unlink(name.c_str());
+    }
+    return nullptr;
+  }
+  return reinterpret_cast<T *>(addr);
+}
+
+template <typename T>
+static void unmap_segment(T *seg) {
+  munmap(seg, sizeof(T));
+}
+
+static std::string get_queue_name(netaddr addr) {
+  return "/nu_shm_q." + std::to_string(addr.ip) + "." +
+         std::to_string(addr.port);
+}
+
+// Returns nullptr unless a live process listens on @addr.
+static ShmQueueSegment *open_queue(netaddr addr) {
+  auto *seg = map_segment<ShmQueueSegment>(get_queue_name(addr), false);
+  if (!seg) {
+    return nullptr;
+  }
+  auto pid = seg->pid.load(std::memory_order_acquire);
+  if (pid <= 0 || kill(pid, 0)) {
+    unmap_segment(seg);
+    return nullptr;
+  }
+  return seg;
+}
+
+// Waits for the peer: yields for a while, then sleeps with exponential backoff
+// to bound the cost of idle connections.
+class ShmPoller {
+ public:
+  void wait() {
+    auto now_us = microtime();
+    if (!start_us_) {
+      start_us_ = now_us;
+      sleep_us_ = ShmConn::kMinSleepUs;
+    }
+    if (now_us - start_us_ < ShmConn::kSpinUs) {
+      rt::Yield();
+    } else {
+      timer_sleep(sleep_us_);
+      sleep_us_ = std::min(sleep_us_ * 2, ShmConn::kMaxSleepUs);
+    }
+  }
+  void reset() { start_us_ = 0; }
+
+ private:
+  uint64_t start_us_ = 0;
+  uint64_t sleep_us_;
+};
+
+static inline void copy_to_ring(ShmRing *ring, uint64_t pos,
+                                const std::byte *src, uint64_t len) {
+  auto off = pos % ShmConn::kRingBytes;
+  auto first_len = std::min(len, ShmConn::kRingBytes - off);
+  memcpy(ring->data + off, src, first_len);
+  memcpy(ring->data, src + first_len, len - first_len);
+}
+
+static inline void copy_from_ring(ShmRing *ring, uint64_t pos, std::byte *dst,
+                                  uint64_t len) {
+  auto off = pos % ShmConn::kRingBytes;
+  auto first_len = std::min(len, ShmConn::kRingBytes - off);
+  memcpy(dst, ring->data + off, first_len);
+  memcpy(dst + first_len, ring->data, len - first_len);
+}
+
+ShmConn::ShmConn(ShmConnSegment *seg, bool server, netaddr laddr,
+                 netaddr raddr)
+    : seg_(seg),
+      rx_(server ? &seg->to_server : &seg->to_client),
+      tx_(server ? &seg->to_client : &seg->to_server),
+      laddr_(laddr),
+      raddr_(raddr) {}
+
+ShmConn::~ShmConn() {
+  // Like a TCP reset, so that the peer doesn't wait on us forever.
+  Abort();
+  unmap_segment(seg_);
+}
+
+bool ShmConn::IsLocal(netaddr raddr) {
+  auto *q_seg = open_queue(raddr);
+  if (!q_seg) {
+    return false;
+  }
+  unmap_segment(q_seg);
+  return true;
+}
+
+ShmConn *ShmConn::Dial(netaddr raddr) {
+  static std::atomic<uint64_t> next_conn_id;
+
+  auto *q_seg = open_queue(raddr);
+  if (!q_seg) {
+    return nullptr;
+  }
+
+  auto conn_name = "/nu_shm_c." + std::to_string(getpid()) + "." +
+                   std::to_string(next_conn_id++);
+  BUG_ON(conn_name.size() >= ShmQueueSegment::kMaxNameLen);
+  auto *seg = map_segment<ShmConnSegment>(conn_name, true);
+  if (unlikely(!seg)) {
+    unmap_segment(q_seg);
+    return nullptr;
+  }
+  seg->client_ip = get_cfg_ip();
+
+  ShmConn *c = nullptr;
+  ShmQueueSegment::Slot *slot = nullptr;
+  auto deadline_us = microtime() + kDialTimeoutUs;
+  ShmPoller poller;
+
+  while (!slot) {
+    for (auto &s : q_seg->slots) {
+      uint8_t expected = kFree;
+      if (s.state.compare_exchange_strong(expected, kClaimed)) {
+        slot = &s;
+        break;
+      }
+    }
+    if (!slot) {
+      if (unlikely(microtime() >= deadline_us)) {
+        goto out;
+      }
+      poller.wait();
+    }
+  }
+  strcpy(slot->conn_name, conn_name.c_str());
+  slot->state.store(kPosted, std::memory_order_release);
+
+  poller.reset();
+  while (!seg->accepted.load(std::memory_order_acquire)) {
+    if (unlikely(microtime() >= deadline_us)) {
+      goto out;
+    }
+    poller.wait();
+  }
+  c = new ShmConn(seg, /* server = */ false, {get_cfg_ip(), 0}, raddr);
+
+out:
+  // Both sides have mapped the segment (or never will), drop its name.
+  shm_unlink(conn_name.c_str());
+  unmap_segment(q_seg);
+  if (unlikely(!c)) {
+    // The listener might still accept it late; make it see a closed stream.
+    seg->to_server.closed = true;
+    seg->to_client.closed = true;
+    unmap_segment(seg);
+  }
+  return c;
+}
+
+ssize_t ShmConn::Read(void *buf, size_t len) {
+  auto head = rx_->head.load(std::memory_order_relaxed);
+  ShmPoller poller;
+  uint64_t avail;
+
+  while (!(avail = rx_->tail.load(std::memory_order_acquire) - head)) {
+    if (rx_->closed.load(std::memory_order_acquire)) {
+      // The writer might have appended its last bytes before closing.
+      if (rx_->tail.load(std::memory_order_acquire) == head) {
+        return 0;
+      }
+      continue;
+    }
+    poller.wait();
+  }
+
+  auto size = std::min(avail, len);
+  copy_from_ring(rx_, head, reinterpret_cast<std::byte *>(buf), size);
+  rx_->head.store(head + size, std::memory_order_release);
+  return size;
+}
+
+ssize_t ShmConn::ReadFull(void *buf, size_t len) {
+  auto *pos = reinterpret_cast<std::byte *>(buf);
+  size_t n = 0;
+
+  while (n < len) {
+    auto ret = Read(pos + n, len - n);
+    if (unlikely(ret <= 0)) {
+      return n ? -ECONNRESET : ret;
+    }
+    n += ret;
+  }
+  return n;
+}
+
+ssize_t ShmConn::WriteFull(const void *buf, size_t len) {
+  auto *pos = reinterpret_cast<const std::byte *>(buf);
+  auto tail = tx_->tail.load(std::memory_order_relaxed);
+  ShmPoller poller;
+  size_t n = 0;
+
+  while (n < len) {
+    if (unlikely(tx_->closed.load(std::memory_order_relaxed))) {
+      return -EPIPE;
+    }
+    auto space =
+        kRingBytes - (tail - tx_->head.load(std::memory_order_acquire));
+    if (!space) {
+      poller.wait();
+      continue;
+    }
+    poller.reset();
+
+    auto size = std::min(space, len - n);
+    copy_to_ring(tx_, tail, pos + n, size);
+    tail += size;
+    n += size;
+    tx_->tail.store(tail, std::memory_order_release);
+  }
+  return n;
+}
+
+ssize_t ShmConn::WritevFull(std::span<const iovec> iov) {
+  ssize_t n = 0;
+  for (const auto &v : iov) {
+    auto ret = WriteFull(v.iov_base, v.iov_len);
+    if (unlikely(ret < 0)) {
+      return ret;
+    }
+    n += ret;
+  }
+  return n;
+}
+
+int ShmConn::Shutdown(int how) {
+  if (how == SHUT_RD || how == SHUT_RDWR) {
+    rx_->closed.store(true, std::memory_order_release);
+  }
+  if (how == SHUT_WR || how == SHUT_RDWR) {
+    tx_->closed.store(true, std::memory_order_release);
+  }
+  return 0;
+}
+
+void ShmConn::Abort() { Shutdown(SHUT_RDWR); }
+
+ShmQueue::ShmQueue(ShmQueueSegment *seg, std::string name, netaddr laddr)
+    : seg_(seg), name_(std::move(name)), laddr_(laddr), shutdown_(false) {}
+
+ShmQueue::~ShmQueue() {
+  Shutdown();
+  unmap_segment(seg_);
+}
+
+ShmQueue *ShmQueue::Listen(netaddr laddr) {
+  if (!laddr.ip) {
+    laddr.ip = get_cfg_ip();
+  }
+
+  if (auto *live_seg = open_queue(laddr)) {
+    unmap_segment(live_seg);
+    return nullptr;
+  }
+  auto name = get_queue_name(laddr);
+  shm_unlink(name.c_str());
+  auto *seg = map_segment<ShmQueueSegment>(name, true);
+  if (unlikely(!seg)) {
+    return nullptr;
+  }
+  seg->pid.store(getpid(), std::memory_order_release);
+  return new ShmQueue(seg, std::move(name), laddr);
+}
+
+ShmConn *ShmQueue::Accept() {
+  auto sleep_us = kMinAcceptSleepUs;
+
+  while (!rt::access_once(shutdown_)) {
+    for (auto &slot : seg_->slots) {
+      if (slot.state.load(std::memory_order_acquire) != kPosted) {
+        continue;
+      }
+      std::string conn_name(slot.conn_name);
+      slot.state.store(kFree, std::memory_order_release);
+
+      auto *conn_seg = map_segment<ShmConnSegment>(conn_name, false);
+      if (unlikely(!conn_seg)) {
+        // The dialer has timed out.
+        continue;
+      }
+      conn_seg->accepted.store(true, std::memory_order_release);
+      return new ShmConn(conn_seg, /* server = */ true, laddr_,
+                         {conn_seg->client_ip, 0});
+    }
+    timer_sleep(sleep_us);
+    sleep_us = std::min(sleep_us * 2, kMaxAcceptSleepUs);
+  }
+  return nullptr;
+}
+
+void ShmQueue::Shutdown() {
+  if (!rt::access_once(shutdown_)) {
+    rt::access_once(shutdown_) = true;
+    shm_unlink(name_.c_str());
+  }
+}
+
+}  // namespace nu
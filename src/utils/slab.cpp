@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <bit>
 
 #include "nu/utils/slab.hpp"
 #include "nu/utils/scoped_lock.hpp"
@@ -7,6 +8,51 @@ namespace nu {
 
 SlabAllocator *SlabAllocator::slabs_[get_max_slab_id() + 1];
 
+// Sorts the nodes by address with a bottom-up merge sort, which needs no
+// space other than the nodes themselves.
+SlabAllocator::FreeNode *SlabAllocator::sort_by_addr(FreeNode *head) {
+  auto addr = [](FreeNode *node) { return reinterpret_cast<uint64_t>(node); };
+
+  for (uint64_t width = 1; head; width *= 2) {
+    auto *p = head;
+    FreeNode *tail = nullptr;
+    uint64_t num_merges = 0;
+    head = nullptr;
+
+    while (p) {
+      num_merges++;
+      auto *q = p;
+      uint64_t p_size = 0;
+      for (; q && p_size < width; p_size++) {
+        q = q->next;
+      }
+      auto q_size = width;
+
+      while (p_size || (q_size && q)) {
+        FreeNode *node;
+        if (p_size && (!q_size || !q || addr(p) < addr(q))) {
+          node = p;
+          p = p->next;
+          p_size--;
+        } else {
+          node = q;
+          q = q->next;
+          q_size--;
+        }
+        (tail ? tail->next : head) = node;
+        tail = node;
+      }
+      p = q;
+    }
+    tail->next = nullptr;
+
+    if (num_merges <= 1) {
+      break;
+    }
+  }
+  return head;
+}
+
 void *SlabAllocator::FreePtrsLinkedList::pop() {
   size_--;
   BUG_ON(!head_);
@@ -42,89 +88,142 @@ void SlabAllocator::FreePtrsLinkedList::push(void *ptr) {
   std::fill(std::begin(head_->p) + 1, std::end(head_->p), nullptr);
 }
 
-// TODO: should be dynamic.
-inline uint32_t get_max_num_cache_entries(bool aggressive_caching,
-                                          uint32_t slab_shift) {
-  switch (slab_shift) {
-    case 4:  // 32 B
-      return 128;
-    case 5:  // 64 B
-      return 128;
-    case 6:  // 128 B
-      return 64;
-    case 7:  // 256 B
-      return 32;
-    case 8:  // 512 B
-      return 16;
-    case 9:  // 1024 B
-      return 8;
-    case 10:  // 2048 B
-      return 4;
-    case 11:  // 4096 B
-      return 2;
-    case 12:  // 8192 B
-      return 1;
-    default:
-      return aggressive_caching && slab_shift <= 20;  // 2 MiB
+uint32_t SlabAllocator::get_max_depth(uint32_t slab_class) const {
+  auto class_size = get_class_size(slab_class);
+  if (class_size <= kMaxCacheBytesPerClass) {
+    return std::min(static_cast<uint64_t>(kMaxNumCacheEntries),
+                    kMaxCacheBytesPerClass / class_size);
+  }
+  return aggressive_caching_ && class_size <= 2 * kOneMB;
+}
+
+// Caches start shallow so that idle classes hold little memory.
+uint32_t SlabAllocator::get_initial_depth(uint32_t slab_class) const {
+  return std::min(get_max_depth(slab_class), static_cast<uint32_t>(1));
+}
+
+inline void SlabAllocator::lock_global(CoreCache *cache) {
+  cache->stats.num_global_locks++;
+  if (unlikely(!spin_.try_lock())) {
+    cache->stats.num_contended_locks++;
+    spin_.lock();
   }
 }
 
 inline void SlabAllocator::drain_transferred_cache(
-    const Caladan::PreemptGuard &g, uint32_t slab_shift) {
+    const Caladan::PreemptGuard &g, uint32_t slab_class) {
   auto &transferred_cache = transferred_caches_[g.read_cpu()];
-  auto &list = transferred_cache.lists[slab_shift];
+  auto &list = transferred_cache.lists[slab_class];
 
   if (list.size()) {
     ScopedLock l(&transferred_cache.spin);
 
     while (list.size()) {
       auto *hdr = reinterpret_cast<PtrHeader *>(list.pop());
-      free_to_cache_list(g, hdr, slab_shift);
+      free_to_cache_list(g, hdr, slab_class);
+    }
+  }
+}
+
+void SlabAllocator::refill_cache_list(CoreCache *cache, uint32_t slab_class) {
+  // A miss means the cache is too shallow for the current demand.
+  auto &depth = cache->depths[slab_class];
+  depth = std::min(get_max_depth(slab_class),
+                   std::max(depth * 2, static_cast<uint32_t>(1)));
+  cache->num_overflows[slab_class] = 0;
+  cache->stats.num_misses++;
+
+  auto &cache_list = cache->lists[slab_class];
+  auto &slab_list = slab_lists_[slab_class];
+  auto slab_size = get_slab_size(slab_class);
+  auto target = std::max(depth, static_cast<uint32_t>(1));
+
+  lock_global(cache);
+  while (slab_list.size() && cache_list.size() < target) {
+    cache_list.push(slab_list.pop());
+    global_free_bytes_ -= slab_size;
+  }
+  if (unlikely((free_run_classes_ >> slab_class) & 1) &&
+      cache_list.size() < target) {
+    carve_free_runs(&cache_list, slab_class, target - cache_list.size());
+  }
+
+  auto remaining = target - cache_list.size();
+  if (remaining) {
+    remaining = std::min(remaining, (end_ - cur_) / slab_size);
+    cur_ += slab_size * remaining;
+    num_carved_[slab_class] += remaining;
+    auto tmp = cur_;
+    for (uint32_t i = 0; i < remaining; i++) {
+      tmp -= slab_size;
+      cache_list.push(tmp);
+    }
+  }
+  spin_.unlock();
+}
+
+// Must be called with spin_ held.
+uint32_t SlabAllocator::carve_free_runs(FreePtrsLinkedList *list,
+                                        uint32_t slab_class, uint32_t num) {
+  auto slab_size = get_slab_size(slab_class);
+  uint32_t num_carved = 0;
+  bool has_more = false;
+
+  for (uint32_t i = 0; i < num_free_runs_;) {
+    auto &run = free_runs_[i];
+    if (run.slab_class != slab_class) {
+      i++;
+      continue;
+    }
+    if (num_carved == num) {
+      has_more = true;
+      break;
+    }
+
+    auto n = std::min(run.num, static_cast<uint64_t>(num - num_carved));
+    for (uint64_t j = 0; j < n; j++) {
+      list->push(reinterpret_cast<void *>(run.start));
+      run.start += slab_size;
     }
+    run.num -= n;
+    num_carved += n;
+    if (run.num) {
+      has_more = true;
+      break;
+    }
+    run = free_runs_[--num_free_runs_];
+  }
+
+  global_free_bytes_ -= slab_size * num_carved;
+  if (!has_more) {
+    free_run_classes_ &= ~(1ULL << slab_class);
   }
+  return num_carved;
 }
 
 void *SlabAllocator::__allocate(size_t size) {
   void *ret = nullptr;
   int cpu;
-  auto slab_shift = get_slab_shift(size);
+  auto slab_class = get_slab_class(size);
 
-  if (likely(slab_shift < kMaxSlabClassShift)) {
+  if (likely(slab_class < kNumSlabClasses)) {
     Caladan::PreemptGuard g;
 
-    drain_transferred_cache(g, slab_shift);
+    drain_transferred_cache(g, slab_class);
     cpu = g.read_cpu();
-    auto &cache_list = cache_lists_[cpu].lists[slab_shift];
-    if (likely(cache_list.size())) {
-      ret = cache_list.pop();
+    auto &cache = cache_lists_[cpu];
+    auto &cache_list = cache.lists[slab_class];
+    if (unlikely(!cache_list.size())) {
+      auto start_tsc = rdtsc();
+      refill_cache_list(&cache, slab_class);
+      cache.stats.miss_cycles += rdtsc() - start_tsc;
     }
 
-    if (unlikely(!ret)) {
-      ScopedLock lock(&spin_);
-      auto &slab_list = slab_lists_[slab_shift];
-      auto max_num_cache_entries =
-          std::max(static_cast<uint32_t>(1),
-                   get_max_num_cache_entries(aggressive_caching_, slab_shift));
-      while (slab_list.size() && cache_list.size() < max_num_cache_entries) {
-        cache_list.push(slab_list.pop());
-        global_free_bytes_ -= get_slab_size(slab_shift);
-      }
-
-      auto remaining = max_num_cache_entries - cache_list.size();
-      if (remaining) {
-        auto slab_size = get_slab_size(slab_shift);
-        remaining = std::min(remaining, (end_ - cur_) / slab_size);
-        cur_ += slab_size * remaining;
-        auto tmp = cur_;
-        for (uint32_t i = 0; i < remaining; i++) {
-          tmp -= slab_size;
-          cache_list.push(tmp);
-        }
-      }
-
-      if (likely(cache_list.size())) {
-        ret = cache_list.pop();
-      }
+    if (likely(cache_list.size())) {
+      ret = cache_list.pop();
+      cache.stats.num_allocs++;
+      cache.num_live[slab_class]++;
+      cache.live_bytes[slab_class] += size;
     }
   }
 
@@ -151,12 +250,17 @@ void SlabAllocator::__free(const void *_ptr) {
   assert(reinterpret_cast<const uint8_t *>(_ptr) < slab->cur_);
 
   auto size = hdr->size;
-  auto slab_shift = slab->get_slab_shift(size);
-
-  if (likely(slab_shift < slab->kMaxSlabClassShift)) {
+  auto slab_class = slab->get_slab_class(size);
+
+  if (likely(slab_class < slab->kNumSlabClasses)) {
+    // The object might become a free list node. Fault in its tail now rather
+    // than with preemption disabled, e.g., while its heap is being post-copied.
+    auto *node_tail = reinterpret_cast<uint8_t *>(hdr) +
+                      FreePtrsLinkedList::kNodeSize - 1;
+    [[maybe_unused]] uint8_t tail = rt::access_once(*node_tail);
     Caladan::PreemptGuard g;
 
-    slab->__do_free(g, hdr, slab_shift);
+    slab->__do_free(g, hdr, slab_class);
   }
 }
 
@@ -169,9 +273,9 @@ void *SlabAllocator::reallocate(const void *_ptr, size_t new_size) {
   assert(reinterpret_cast<const uint8_t *>(_ptr) < slab->cur_);
 
   auto size = hdr->size;
-  auto slab_shift = slab->get_slab_shift(size);
+  auto slab_class = slab->get_slab_class(size);
 
-  BUG_ON(slab_shift >= slab->kMaxSlabClassShift);
+  BUG_ON(slab_class >= slab->kNumSlabClasses);
 
   auto *new_ptr = slab->allocate(new_size);
   if (unlikely(!new_ptr)) {
@@ -181,64 +285,326 @@ void *SlabAllocator::reallocate(const void *_ptr, size_t new_size) {
 
   {
     Caladan::PreemptGuard g;
-    slab->__do_free(g, hdr, slab_shift);
+    slab->__do_free(g, hdr, slab_class);
   }
 
   return new_ptr;
 }
 
 inline void SlabAllocator::__do_free(const Caladan::PreemptGuard &g,
-                                     PtrHeader *hdr, uint32_t slab_shift) {
-  drain_transferred_cache(g, slab_shift);
+                                     PtrHeader *hdr, uint32_t slab_class) {
+  auto &cache = cache_lists_[g.read_cpu()];
+  cache.num_live[slab_class]--;
+  cache.live_bytes[slab_class] -= hdr->size;
+  drain_transferred_cache(g, slab_class);
 
   if (likely(g.read_cpu() == hdr->core_id)) {
-    free_to_cache_list(g, hdr, slab_shift);
+    free_to_cache_list(g, hdr, slab_class);
   } else {
-    free_to_transferred_cache_list(hdr, slab_shift);
+    free_to_transferred_cache_list(g, hdr, slab_class);
   }
 }
 
 void SlabAllocator::free_to_cache_list(const Caladan::PreemptGuard &g,
-                                       PtrHeader *hdr, uint32_t slab_shift) {
-  auto max_num_cache_entries =
-      get_max_num_cache_entries(aggressive_caching_, slab_shift);
-  auto &cache_list = cache_lists_[g.read_cpu()].lists[slab_shift];
+                                       PtrHeader *hdr, uint32_t slab_class) {
+  auto &cache = cache_lists_[g.read_cpu()];
+  auto &cache_list = cache.lists[slab_class];
+  auto &depth = cache.depths[slab_class];
   cache_list.push(hdr);
 
-  if (unlikely(cache_list.size() > max_num_cache_entries)) {
-    auto &slab_list = slab_lists_[slab_shift];
-    ScopedLock lock(&spin_);
-
-    while (cache_list.size() > max_num_cache_entries / 2) {
+  if (unlikely(cache_list.size() > depth)) {
+    cache.stats.num_overflows++;
+    auto &slab_list = slab_lists_[slab_class];
+    lock_global(&cache);
+    while (cache_list.size() > depth / 2) {
       slab_list.push(cache_list.pop());
-      global_free_bytes_ += get_slab_size(slab_shift);
+      global_free_bytes_ += get_slab_size(slab_class);
+    }
+    spin_.unlock();
+
+    // The core keeps freeing more than it allocates, shrink its cache.
+    if (++cache.num_overflows[slab_class] >= kMaxNumOverflows) {
+      depth = std::max(depth / 2, get_initial_depth(slab_class));
+      cache.num_overflows[slab_class] = 0;
     }
   }
 }
 
-void SlabAllocator::free_to_transferred_cache_list(PtrHeader *hdr,
-                                                   uint32_t slab_shift) {
+void SlabAllocator::free_to_transferred_cache_list(
+    const Caladan::PreemptGuard &g, PtrHeader *hdr, uint32_t slab_class) {
   auto max_num_cache_entries =
-      get_max_num_cache_entries(aggressive_caching_, slab_shift);
+      rt::access_once(cache_lists_[hdr->core_id].depths[slab_class]);
   auto &transferred_cache = transferred_caches_[hdr->core_id];
-  auto &transferred_cache_list = transferred_cache.lists[slab_shift];
-  auto &cache_list = cache_lists_[hdr->core_id].lists[slab_shift];
+  auto &transferred_cache_list = transferred_cache.lists[slab_class];
+  auto &cache_list = cache_lists_[hdr->core_id].lists[slab_class];
 
   ScopedLock lock(&transferred_cache.spin);
-  transferred_cache.lists[slab_shift].push(hdr);
+  transferred_cache.lists[slab_class].push(hdr);
 
   auto total_num = transferred_cache_list.size() + cache_list.size();
   if (unlikely(total_num > max_num_cache_entries)) {
     auto num_to_turn_in = std::min(transferred_cache_list.size(),
                                    total_num - max_num_cache_entries / 2);
-    auto &slab_list = slab_lists_[slab_shift];
-    ScopedLock lock(&spin_);
+    auto &slab_list = slab_lists_[slab_class];
+    lock_global(&cache_lists_[g.read_cpu()]);
 
     while (num_to_turn_in--) {
       slab_list.push(transferred_cache_list.pop());
-      global_free_bytes_ += get_slab_size(slab_shift);
+      global_free_bytes_ += get_slab_size(slab_class);
+    }
+    spin_.unlock();
+  }
+}
+
+std::vector<SlabClassStats> SlabAllocator::get_class_stats() const {
+  std::vector<SlabClassStats> stats;
+
+  for (uint32_t i = 0; i < kNumSlabClasses; i++) {
+    uint64_t num_carved = rt::access_once(num_carved_[i]);
+    if (!num_carved) {
+      continue;
     }
+
+    // The per-core counters are read racily, so clamp the sums.
+    int64_t num_live = 0;
+    int64_t live_bytes = 0;
+    for (const auto &cache : cache_lists_) {
+      num_live += rt::access_once(cache.num_live[i]);
+      live_bytes += rt::access_once(cache.live_bytes[i]);
+    }
+    auto class_size = get_class_size(i);
+    auto live = std::min(static_cast<uint64_t>(std::max(num_live, int64_t{0})),
+                         num_carved);
+    auto bytes =
+        std::min(static_cast<uint64_t>(std::max(live_bytes, int64_t{0})),
+                 live * class_size);
+    stats.push_back(SlabClassStats{.class_size = class_size,
+                                   .num_live = live,
+                                   .num_free = num_carved - live,
+                                   .live_bytes = bytes,
+                                   .internal_frag_bytes =
+                                       live * class_size - bytes});
   }
+
+  return stats;
+}
+
+uint64_t SlabAllocator::get_wasted_bytes() const {
+  uint64_t wasted_bytes = 0;
+  for (const auto &stats : get_class_stats()) {
+    wasted_bytes +=
+        stats.internal_frag_bytes + stats.num_free * stats.class_size;
+  }
+  return wasted_bytes;
+}
+
+SlabCacheStats SlabAllocator::get_cache_stats() const {
+  SlabCacheStats sum{};
+  for (const auto &cache : cache_lists_) {
+    const auto &stats = cache.stats;
+    sum.num_allocs += rt::access_once(stats.num_allocs);
+    sum.num_misses += rt::access_once(stats.num_misses);
+    sum.num_overflows += rt::access_once(stats.num_overflows);
+    sum.num_global_locks += rt::access_once(stats.num_global_locks);
+    sum.num_contended_locks += rt::access_once(stats.num_contended_locks);
+    sum.miss_cycles += rt::access_once(stats.miss_cycles);
+  }
+  return sum;
+}
+
+void SlabAllocator::flush_caches() {
+  for (uint32_t i = 0; i < kNumCores; i++) {
+    auto &cache = cache_lists_[i];
+    auto &transferred_cache = transferred_caches_[i];
+    ScopedLock transferred_lock(&transferred_cache.spin);
+    ScopedLock lock(&spin_);
+
+    for (uint32_t j = 0; j < kNumSlabClasses; j++) {
+      auto slab_size = get_slab_size(j);
+      for (auto *list : {&cache.lists[j], &transferred_cache.lists[j]}) {
+        while (list->size()) {
+          slab_lists_[j].push(list->pop());
+          global_free_bytes_ += slab_size;
+        }
+      }
+      cache.depths[j] = get_initial_depth(j);
+      cache.num_overflows[j] = 0;
+    }
+  }
+}
+
+void SlabAllocator::release_free_runs(uint64_t page_size,
+                                      uint64_t min_run_bytes) {
+  FreePtrsLinkedList lists[kNumSlabClasses];
+  {
+    // Remote frees might turn objects in meanwhile, so the lists are detached
+    // rather than worked on in place.
+    ScopedLock lock(&spin_);
+    for (uint32_t i = 0; i < kNumSlabClasses; i++) {
+      std::swap(lists[i], slab_lists_[i]);
+    }
+  }
+
+  auto get_interior_bytes = [&](const FreeRun &run) -> uint64_t {
+    auto run_end = run.start + run.num * get_slab_size(run.slab_class);
+    auto interior_start =
+        div_round_up_unchecked(run.start, page_size) * page_size;
+    auto interior_end = run_end / page_size * page_size;
+    return interior_end > interior_start ? interior_end - interior_start : 0;
+  };
+  auto put_back = [&](const FreeRun &run) {
+    auto slab_size = get_slab_size(run.slab_class);
+    for (uint64_t j = 0; j < run.num; j++) {
+      lists[run.slab_class].push(
+          reinterpret_cast<void *>(run.start + j * slab_size));
+    }
+  };
+
+  // The picked runs form a min-heap in the unused part of the table, so only
+  // the largest ones are kept.
+  auto *picked = free_runs_ + num_free_runs_;
+  uint32_t num_picked = 0;
+  uint32_t max_num_picked = kMaxNumFreeRuns - num_free_runs_;
+  auto larger = [&](const FreeRun &x, const FreeRun &y) {
+    return get_interior_bytes(x) > get_interior_bytes(y);
+  };
+  auto offer = [&](const FreeRun &run) {
+    if (get_interior_bytes(run) < min_run_bytes || !max_num_picked) {
+      put_back(run);
+    } else if (num_picked < max_num_picked) {
+      picked[num_picked++] = run;
+      std::push_heap(picked, picked + num_picked, larger);
+    } else if (larger(run, picked[0])) {
+      std::pop_heap(picked, picked + num_picked, larger);
+      put_back(picked[num_picked - 1]);
+      picked[num_picked - 1] = run;
+      std::push_heap(picked, picked + num_picked, larger);
+    } else {
+      put_back(run);
+    }
+  };
+
+  for (uint32_t i = 0; i < kNumSlabClasses; i++) {
+    auto &list = lists[i];
+    if (!list.size()) {
+      continue;
+    }
+
+    FreeNode *head = nullptr;
+    while (list.size()) {
+      auto *node = reinterpret_cast<FreeNode *>(list.pop());
+      node->next = head;
+      head = node;
+    }
+    head = sort_by_addr(head);
+
+    // Objects only get put back after being walked past, as pushing them
+    // might overwrite their links.
+    auto slab_size = get_slab_size(i);
+    FreeRun run{.start = 0, .num = 0, .slab_class = i};
+    for (auto *node = head; node;) {
+      auto *next = node->next;
+      auto addr = reinterpret_cast<uint64_t>(node);
+      if (run.num && run.start + run.num * slab_size == addr) {
+        run.num++;
+      } else {
+        if (run.num) {
+          offer(run);
+        }
+        run.start = addr;
+        run.num = 1;
+      }
+      node = next;
+    }
+    offer(run);
+  }
+
+  ScopedLock lock(&spin_);
+  for (uint32_t i = 0; i < kNumSlabClasses; i++) {
+    while (slab_lists_[i].size()) {
+      lists[i].push(slab_lists_[i].pop());
+    }
+    slab_lists_[i] = lists[i];
+  }
+  for (uint32_t i = 0; i < num_picked; i++) {
+    free_run_classes_ |= 1ULL << picked[i].slab_class;
+  }
+  num_free_runs_ += num_picked;
+}
+
+std::vector<VAddrRange> SlabAllocator::get_free_run_extents(
+    uint64_t page_size) const {
+  std::vector<VAddrRange> ranges;
+  for (uint32_t i = 0; i < num_free_runs_; i++) {
+    const auto &run = free_runs_[i];
+    ranges.push_back(
+        {run.start, run.start + run.num * get_slab_size(run.slab_class)});
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  // Adjacent runs (of different classes) together might cover more pages.
+  std::vector<VAddrRange> extents;
+  for (uint64_t i = 0; i < ranges.size();) {
+    auto [start, end] = ranges[i];
+    for (i++; i < ranges.size() && ranges[i].start == end; i++) {
+      end = ranges[i].end;
+    }
+    start = div_round_up_unchecked(start, page_size) * page_size;
+    end = end / page_size * page_size;
+    if (start < end) {
+      extents.push_back({start, end});
+    }
+  }
+  return extents;
+}
+
+uint64_t SlabAllocator::get_free_run_bytes() const {
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < num_free_runs_; i++) {
+    bytes += free_runs_[i].num * get_slab_size(free_runs_[i].slab_class);
+  }
+  return bytes;
+}
+
+std::vector<uint64_t> SlabAllocator::get_metadata_pages(
+    uint64_t page_size) const {
+  std::vector<uint64_t> pages;
+  auto add_pages = [&](uint64_t start, uint64_t end) {
+    for (auto addr = start / page_size * page_size; addr < end;
+         addr += page_size) {
+      pages.push_back(addr);
+    }
+  };
+
+  for (const auto &slab_list : slab_lists_) {
+    slab_list.for_each([&](const void *ptr) {
+      auto addr = reinterpret_cast<uint64_t>(ptr);
+      add_pages(addr, addr + FreePtrsLinkedList::kNodeSize);
+    });
+  }
+  // Carving writes to every object of a run. Its interior pages are covered by
+  // get_free_run_extents() instead.
+  for (uint32_t i = 0; i < num_free_runs_; i++) {
+    const auto &run = free_runs_[i];
+    auto end = run.start + run.num * get_slab_size(run.slab_class);
+    auto interior_start =
+        div_round_up_unchecked(run.start, page_size) * page_size;
+    auto interior_end = end / page_size * page_size;
+    if (interior_start < interior_end) {
+      add_pages(run.start, interior_start);
+      add_pages(interior_end, end);
+    } else {
+      add_pages(run.start, end);
+    }
+  }
+  auto cur = reinterpret_cast<uint64_t>(cur_);
+  if (cur % page_size) {
+    add_pages(cur, cur + 1);
+  }
+
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+  return pages;
 }
 
 void *SlabAllocator::yield(size_t size) {
@@ -1,4 +1,3 @@
-#include <cstring>
 #include <iostream>
 
 extern "C" {
@@ -25,9 +24,6 @@ TraceLogger::~TraceLogger() {
 
 void TraceLogger::print_thread_fn() {
   auto old_us = microtime();
-  uint64_t old_sum = 0;
-  uint64_t old_bucket_sum[kNumBuckets];
-  memset(old_bucket_sum, 0, sizeof(old_bucket_sum));
 
   while (true) {
     check_disabled();
@@ -38,19 +34,8 @@ void TraceLogger::print_thread_fn() {
     timer_sleep(rt::access_once(print_interval_us_));
     auto cur_us = microtime();
     auto diff_us = cur_us - old_us;
-
-    uint64_t cur_sum = 0;
-    uint64_t cur_bucket_sum[kNumBuckets];
-    __builtin_memset(cur_bucket_sum, 0, sizeof(cur_bucket_sum));
-    for (uint32_t i = 0; i < kNumCores; i++) {
-      for (uint32_t j = 0; j < kNumBuckets; j++) {
-        cur_bucket_sum[j] += rt::access_once(aligned_cnts_[i][j].cnt);
-      }
-    }
-    for (uint32_t i = 0; i < kNumBuckets; i++) {
-      cur_sum += cur_bucket_sum[i];
-    }
-    auto diff_sum = cur_sum - old_sum;
+    auto histogram = histogram_.interval_snapshot();
+    auto diff_sum = histogram.get_count();
 
     {
       rt::Preempt p;
@@ -60,19 +45,14 @@ void TraceLogger::print_thread_fn() {
       std::cout << "diff_us = " << diff_us << ", diff_sum = " << diff_sum
                 << ", mops = " << diff_sum / static_cast<double>(diff_us)
                 << std::endl;
-      for (uint32_t i = 0; i < kNumBuckets; i++) {
-        std::cout << i * kBucketIntervalUs << "-";
-        if (i + 1 != kNumBuckets) {
-          std::cout << (i + 1) * kBucketIntervalUs;
-        } else {
-          std::cout << "inf";
-        }
-        std::cout << ": " << cur_bucket_sum[i] - old_bucket_sum[i] << std::endl;
-        old_bucket_sum[i] = cur_bucket_sum[i];
+      std::cout << "mean_us = " << histogram.get_mean() / 1000;
+      for (auto nth : kPrintedPercentiles) {
+        std::cout << ", p" << nth
+                  << "_us = " << histogram.get_nth(nth) / 1000.0;
       }
+      std::cout << ", max_us = " << histogram.get_max() / 1000.0 << std::endl;
     }
     old_us = cur_us;
-    old_sum = cur_sum;
   }
 }
 
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/task.hpp"
+#include "nu/utils/time.hpp"
+
+constexpr uint32_t kNumShards = 16;
+constexpr uint32_t kNumTasks = 1024;
+constexpr uint64_t kDelayUs = 100 * 1000;
+
+namespace nu {
+class Shard {
+ public:
+  Shard(int id) : id_(id) {}
+  int get_id() { return id_; }
+  int delayed_get_id(uint64_t delay_us) {
+    Time::sleep(delay_us);
+    return id_;
+  }
+
+ private:
+  int id_;
+};
+
+class Aggregator {
+ public:
+  Aggregator(std::vector<Proclet<Shard>> shards) : shards_(std::move(shards)) {}
+
+  int sum_ids() { return sum_ids_co().get(); }
+
+  // Suspended across the migration of this proclet.
+  Task<int> sum_ids_co() {
+    int sum = 0;
+    for (auto &shard : shards_) {
+      sum += co_await shard.run_co(&Shard::delayed_get_id, kDelayUs);
+    }
+    co_return sum;
+  }
+
+  void migrate() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+ private:
+  std::vector<Proclet<Shard>> shards_;
+};
+}  // namespace nu
+
+nu::Task<int> sum_ids(std::vector<nu::Proclet<nu::Shard>> &shards) {
+  std::vector<nu::Future<int>> futures;
+  for (auto &shard : shards) {
+    futures.emplace_back(shard.run_co(&nu::Shard::get_id).get_future());
+  }
+  co_await nu::when_all(futures);
+
+  int sum = 0;
+  for (auto &future : futures) {
+    sum += co_await future;
+  }
+  co_return sum;
+}
+
+bool test_fan_out(std::vector<nu::Proclet<nu::Shard>> &shards) {
+  std::vector<nu::Task<int>> tasks;
+  for (uint32_t i = 0; i < kNumTasks; i++) {
+    tasks.emplace_back(sum_ids(shards));
+  }
+  int expected = kNumShards * (kNumShards - 1) / 2;
+  for (auto &task : tasks) {
+    if (task.get() != expected) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The call is still outstanding once the coroutine awaits it, so the coroutine
+// is always suspended and then resumed by the call's completion.
+nu::Task<int> await_delayed(nu::Proclet<nu::Shard> &shard) {
+  co_return co_await shard.run_co(&nu::Shard::delayed_get_id, kDelayUs);
+}
+
+bool test_suspension(std::vector<nu::Proclet<nu::Shard>> &shards) {
+  for (uint32_t i = 0; i < kNumShards; i++) {
+    auto task = await_delayed(shards[i]);
+    if (task.is_ready() || task.get() != static_cast<int>(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The exception thrown after a suspension surfaces from get().
+nu::Task<int> throw_after_call(nu::Proclet<nu::Shard> &shard) {
+  co_await shard.run_co(&nu::Shard::get_id);
+  throw std::runtime_error("expected");
+}
+
+bool test_exception(std::vector<nu::Proclet<nu::Shard>> &shards) {
+  auto task = throw_after_call(shards[0]);
+  try {
+    task.get();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+bool test_migration(std::vector<nu::Proclet<nu::Shard>> &shards) {
+  auto aggregator =
+      nu::make_proclet<nu::Aggregator>(std::forward_as_tuple(shards));
+  auto future = aggregator.run_async(&nu::Aggregator::sum_ids);
+  nu::Time::sleep(200 * 1000);
+  aggregator.run(&nu::Aggregator::migrate);
+  return future.get() == static_cast<int>(kNumShards * (kNumShards - 1) / 2);
+}
+
+bool run_all_tests() {
+  std::vector<nu::Proclet<nu::Shard>> shards;
+  for (uint32_t i = 0; i < kNumShards; i++) {
+    shards.emplace_back(nu::make_proclet<nu::Shard>(std::forward_as_tuple(i)));
+  }
+  return test_suspension(shards) && test_fan_out(shards) &&
+         test_exception(shards) && test_migration(shards);
+}
+
+int main(int argc, char **argv) {
+  return nu::runtime_main_init(argc, argv, [](int, char **) {
+    if (run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
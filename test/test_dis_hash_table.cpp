@@ -4,6 +4,8 @@
 #include <memory>
 #include <numeric>
 #include <random>
+#include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -17,6 +19,7 @@ extern "C" {
 #include "nu/proclet.hpp"
 #include "nu/runtime.hpp"
 #include "nu/utils/farmhash.hpp"
+#include "nu/utils/thread.hpp"
 
 using namespace nu;
 
@@ -122,8 +125,227 @@ bool run_test() {
   return true;
 }
 
+bool run_multi_test() {
+  auto hash_table = make_dis_hash_table<std::string, std::string>(5);
+  std::vector<std::pair<K, V>> pairs;
+  for (uint32_t i = 0; i < kNumPairs; i++) {
+    pairs.emplace_back(random_str(kKeyLen), random_str(kValLen));
+  }
+  hash_table.multi_put_async(pairs).get();
+
+  // Half of the keys are absent.
+  std::vector<K> keys;
+  for (auto &[k, _] : pairs) {
+    keys.push_back(k);
+    keys.push_back(random_str(kKeyLen + 1));
+  }
+  auto vals = hash_table.multi_get(keys);
+  if (vals.size() != keys.size()) {
+    return false;
+  }
+  for (uint32_t i = 0; i < pairs.size(); i++) {
+    if (vals[2 * i] != pairs[i].second || vals[2 * i + 1]) {
+      return false;
+    }
+  }
+
+  auto removed = hash_table.multi_remove_async(keys).get();
+  for (uint32_t i = 0; i < pairs.size(); i++) {
+    if (!removed[2 * i] || removed[2 * i + 1]) {
+      return false;
+    }
+  }
+  vals = hash_table.multi_get_async(keys).get();
+  return std::none_of(vals.begin(), vals.end(),
+                      [](const auto &val) { return val.has_value(); });
+}
+
+bool run_split_test() {
+  constexpr uint32_t kNumSplits = 8;
+
+  auto hash_table = make_dis_hash_table<std::string, std::string>(1);
+  std::unordered_map<std::string, std::string> std_map;
+  for (uint32_t i = 0; i < kNumPairs; i++) {
+    std_map[random_str(kKeyLen)] = random_str(kValLen);
+  }
+  for (auto &[k, v] : std_map) {
+    hash_table.put(k, v);
+  }
+
+  // Its shard map turns stale after the splits below.
+  auto stale_hash_table = hash_table;
+  auto it = std_map.begin();
+  for (uint32_t i = 0; i < kNumSplits; i++, ++it) {
+    hash_table.split_shard(it->first);
+  }
+  if (hash_table.get_num_shards() != 2 + kNumSplits) {
+    return false;
+  }
+
+  for (auto &[k, v] : std_map) {
+    auto optional = stale_hash_table.get(k);
+    if (!optional || v != *optional) {
+      return false;
+    }
+  }
+  return hash_table.get_all_pairs().size() == std_map.size();
+}
+
+// std::hash<uint64_t> is the identity, which leaves the top bits (that pick
+// the shard) zero for most keys; this one mixes all bits into them.
+struct MixedHash {
+  uint64_t operator()(uint64_t k) const {
+    k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    k = (k ^ (k >> 27)) * 0x94d049bb133111ebULL;
+    return k ^ (k >> 31);
+  }
+};
+
+bool run_swiss_test() {
+  constexpr uint32_t kNumSplits = 4;
+
+  auto hash_table =
+      make_dis_hash_table<uint64_t, uint64_t, MixedHash,
+                          std::equal_to<uint64_t>, 32768, SwissHashMap>(2);
+  std::mt19937_64 mt64(rd());
+  std::unordered_map<uint64_t, uint64_t> std_map;
+  for (uint32_t i = 0; i < kNumPairs; i++) {
+    std_map[mt64()] = mt64();
+  }
+  for (auto &[k, v] : std_map) {
+    hash_table.put(k, v);
+  }
+  auto it = std_map.begin();
+  for (uint32_t i = 0; i < kNumSplits; i++, ++it) {
+    hash_table.split_shard(it->first);
+  }
+  auto num_shards = hash_table.get_num_shards();
+  if (num_shards != 4 + kNumSplits) {
+    return false;
+  }
+
+  for (auto &[k, v] : std_map) {
+    hash_table.apply(
+        k, +[](std::pair<const uint64_t, uint64_t> &p) { p.second++; });
+  }
+  // Every key is readable, and the keys are served by all shards.
+  auto hash_table2 = hash_table;
+  std::unordered_set<ProcletID> shard_ids;
+  for (auto &[k, v] : std_map) {
+    bool is_local;
+    ProcletID shard_id;
+    auto optional = hash_table2.get(k, &is_local, &shard_id);
+    if (!optional || v + 1 != *optional) {
+      return false;
+    }
+    shard_ids.insert(shard_id);
+  }
+  if (shard_ids.size() != num_shards) {
+    return false;
+  }
+
+  for (auto &[k, _] : std_map) {
+    if (!hash_table.remove(k)) {
+      return false;
+    }
+  }
+  return hash_table.get_all_pairs().empty();
+}
+
+// Keeps putting, overwriting and removing keys while the shards split, first
+// under heap pressure and then on request, which must lose no update.
+bool run_concurrent_split_test() {
+  constexpr uint32_t kNumThreads = 4;
+  constexpr uint32_t kNumSplits = 4;
+  // Each round fills more than the initial shard's heap.
+  constexpr uint32_t kNumKeysPerRound = 10240;
+  constexpr uint32_t kLargeValLen = 4096;
+
+  auto hash_table = make_dis_hash_table<std::string, std::string>(0);
+  // Per thread, the expected values of the keys, or 0 if removed. Values are
+  // repeats of a single char so that only it has to be kept here.
+  std::vector<std::unordered_map<std::string, char>> expected(kNumThreads);
+  bool succeeded[kNumThreads];
+  std::fill_n(succeeded, kNumThreads, true);
+
+  auto get_key = [](uint32_t tid, uint32_t idx) {
+    return std::to_string(tid) + "-" + std::to_string(idx);
+  };
+  auto put = [&](uint32_t tid, uint32_t idx, char c) {
+    auto k = get_key(tid, idx);
+    hash_table.put(k, std::string(kLargeValLen, c));
+    expected[tid][k] = c;
+  };
+  auto run_round = [&](uint32_t round, auto &&split) {
+    std::vector<Thread> threads;
+    for (uint32_t tid = 0; tid < kNumThreads; tid++) {
+      threads.emplace_back([&, tid] {
+        auto begin = round * kNumKeysPerRound;
+        for (auto i = begin; i < begin + kNumKeysPerRound; i++) {
+          put(tid, i, 'a' + i % 26);
+          if (i % 4 == 2) {
+            put(tid, i - 2, 'A' + i % 26);
+          } else if (i % 4 == 3) {
+            auto k = get_key(tid, i - 1);
+            succeeded[tid] = succeeded[tid] && hash_table.remove(k);
+            expected[tid][k] = 0;
+          }
+        }
+      });
+    }
+    split();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  };
+
+  run_round(/* round = */ 0, [] {});
+  auto num_shards = hash_table.get_num_shards();
+  if (num_shards < 2) {
+    return false;
+  }
+  run_round(/* round = */ 1, [&] {
+    for (uint32_t i = 0; i < kNumSplits; i++) {
+      hash_table.split_shard(get_key(i % kNumThreads, i));
+    }
+  });
+  if (hash_table.get_num_shards() < num_shards + kNumSplits) {
+    return false;
+  }
+  if (!std::all_of(succeeded, succeeded + kNumThreads,
+                   [](bool b) { return b; })) {
+    return false;
+  }
+
+  uint64_t num_pairs = 0;
+  for (auto &std_map : expected) {
+    for (auto &[k, c] : std_map) {
+      auto optional = hash_table.get(k);
+      if (!c) {
+        if (optional) {
+          return false;
+        }
+        continue;
+      }
+      if (!optional || *optional != std::string(kLargeValLen, c)) {
+        return false;
+      }
+      num_pairs++;
+    }
+  }
+  auto num_scanned = hash_table.associative_reduce(
+      /* clear = */ false, /* init_val = */ uint64_t{0},
+      /* reduce_fn = */
+      +[](uint64_t &cnt, std::pair<const K, V> &) { cnt++; },
+      /* merge_fn = */ +[](uint64_t &cnt, uint64_t &partition) {
+        cnt += partition;
+      });
+  return num_scanned == num_pairs;
+}
+
 void do_work() {
-  if (run_test()) {
+  if (run_test() && run_multi_test() && run_split_test() &&
+      run_swiss_test() && run_concurrent_split_test()) {
     std::cout << "Passed" << std::endl;
   } else {
     std::cout << "Failed" << std::endl;
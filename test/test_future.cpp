@@ -0,0 +1,123 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/future.hpp"
+#include "nu/utils/time.hpp"
+
+constexpr uint32_t kNumShards = 64;
+constexpr uint32_t kNumCallsPerShard = 32;
+
+namespace nu {
+class Shard {
+ public:
+  Shard(int id) : id_(id) {}
+  int get_id() { return id_; }
+  int delayed_get_id(uint64_t delay_us) {
+    Time::sleep(delay_us);
+    return id_;
+  }
+
+ private:
+  int id_;
+};
+}  // namespace nu
+
+bool test_then() {
+  auto future = nu::async([] { return 1; });
+  auto chained = std::move(future)
+                     .then([](int &x) { return x + 1; })
+                     .then([](int &x) { return x * 10; });
+  return chained.get() == 20;
+}
+
+bool test_exception() {
+  auto future = nu::async([]() -> int { throw std::runtime_error("test"); });
+  auto chained = std::move(future).then([](int &x) { return x + 1; });
+  try {
+    chained.get();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+bool test_when_all() {
+  std::vector<nu::Future<int>> futures;
+  for (int i = 0; i < 16; i++) {
+    futures.emplace_back(nu::async([i] { return i; }));
+  }
+  nu::when_all(futures).get();
+  for (int i = 0; i < 16; i++) {
+    if (!futures[i].is_ready() || futures[i].get() != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_when_any() {
+  std::vector<nu::Future<int>> futures;
+  futures.emplace_back(nu::async([] {
+    nu::Time::sleep(1000 * 1000);
+    return 0;
+  }));
+  futures.emplace_back(nu::async([] { return 1; }));
+  return nu::when_any(futures).get() == 1;
+}
+
+bool test_remote_fan_out() {
+  std::vector<nu::Proclet<nu::Shard>> shards;
+  for (uint32_t i = 0; i < kNumShards; i++) {
+    shards.emplace_back(nu::make_proclet<nu::Shard>(std::forward_as_tuple(i)));
+  }
+
+  std::vector<nu::Future<int>> futures;
+  for (uint32_t i = 0; i < kNumCallsPerShard; i++) {
+    for (auto &shard : shards) {
+      futures.emplace_back(shard.run_async(&nu::Shard::get_id));
+    }
+  }
+  nu::when_all(futures).get();
+  int sum = 0;
+  for (auto &future : futures) {
+    sum += future.get();
+  }
+  int expected = kNumCallsPerShard * kNumShards * (kNumShards - 1) / 2;
+  if (sum != expected) {
+    return false;
+  }
+
+  auto delayed = shards[0]
+                     .run_async(&nu::Shard::delayed_get_id,
+                                static_cast<uint64_t>(1000))
+                     .then([](int &id) { return id + 1; });
+  if (delayed.get() != 1) {
+    return false;
+  }
+
+  // Continuations might block, as they never run in the RPC receiver.
+  auto *shard = &shards[1];
+  auto chained =
+      shards[0].run_async(&nu::Shard::get_id).then([shard](int &id) {
+        return id + shard->run(&nu::Shard::get_id);
+      });
+  return chained.get() == 1;
+}
+
+bool run_all_tests() {
+  return test_then() && test_exception() && test_when_all() &&
+         test_when_any() && test_remote_fan_out();
+}
+
+int main(int argc, char **argv) {
+  return nu::runtime_main_init(argc, argv, [](int, char **) {
+    if (run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -0,0 +1,96 @@
+#include <cmath>
+#include <iostream>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/hdr_histogram.hpp"
+#include "nu/utils/thread.hpp"
+
+constexpr uint64_t kNumVals = 100000;
+constexpr uint32_t kNumThreads = 4;
+constexpr double kMaxError = 0.01;
+
+namespace nu {
+
+bool close_to(uint64_t x, uint64_t y) {
+  return std::abs(static_cast<double>(x) - static_cast<double>(y)) <=
+         kMaxError * y;
+}
+
+class Test {
+ public:
+  bool run_index_test() {
+    for (uint32_t i = 0; i < HdrHistogram::kNumCounts; i++) {
+      auto lowest = HdrHistogram::lowest_of(i);
+      auto highest = lowest + HdrHistogram::width_of(i) - 1;
+      if (HdrHistogram::index_of(lowest) != i ||
+          HdrHistogram::index_of(highest) != i) {
+        return false;
+      }
+    }
+    return HdrHistogram::index_of(HdrHistogram::kMaxValue + 1) ==
+           HdrHistogram::kNumCounts - 1;
+  }
+
+  bool run_percentile_test() {
+    HdrHistogram histogram;
+    for (uint64_t i = 1; i <= kNumVals; i++) {
+      histogram.record(i);
+    }
+    if (histogram.get_count() != kNumVals ||
+        histogram.get_sum() != kNumVals * (kNumVals + 1) / 2) {
+      return false;
+    }
+    for (double nth : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+      if (!close_to(histogram.get_nth(nth), nth / 100 * kNumVals)) {
+        return false;
+      }
+    }
+    return close_to(histogram.get_max(), kNumVals) &&
+           histogram.get_nth(100) <= kNumVals;
+  }
+
+  bool run_concurrent_test() {
+    ConcurrentHdrHistogram histogram;
+    std::vector<Thread> threads;
+    for (uint32_t i = 0; i < kNumThreads; i++) {
+      threads.emplace_back([&] {
+        for (uint64_t j = 1; j <= kNumVals; j++) {
+          histogram.record(j);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    auto snapshot = histogram.interval_snapshot();
+    if (snapshot.get_count() != kNumThreads * kNumVals ||
+        !close_to(snapshot.get_nth(50), kNumVals / 2)) {
+      return false;
+    }
+
+    // Only the values recorded since the last interval are left.
+    histogram.record(kOneSecond * 1000);
+    snapshot = histogram.interval_snapshot();
+    return snapshot.get_count() == 1 &&
+           close_to(snapshot.get_nth(50), kOneSecond * 1000) &&
+           histogram.snapshot().get_count() == kNumThreads * kNumVals + 1;
+  }
+
+  bool run_all_tests() {
+    return run_index_test() && run_percentile_test() && run_concurrent_test();
+  }
+};
+
+}  // namespace nu
+
+int main(int argc, char **argv) {
+  return nu::runtime_main_init(argc, argv, [](int, char **) {
+    nu::Test test;
+    if (test.run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <string>
+
+#include "nu/metrics.hpp"
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/time.hpp"
+
+constexpr uint32_t kNumCalls = 1000;
+constexpr uint32_t kMagic = 0x12345678;
+
+namespace nu {
+
+uint64_t get_counter(MetricCounter counter) {
+  auto *header = get_runtime()->get_current_proclet_header();
+  auto *stats = header->peek_stats();
+  return stats ? stats->metrics.get(counter) : 0;
+}
+
+uint64_t get_num_migrations() {
+  return get_runtime()->get_current_proclet_header()->num_migrations;
+}
+
+class CalleeObj {
+ public:
+  uint32_t foo() { return kMagic; }
+  uint64_t get(MetricCounter counter) { return get_counter(counter); }
+  uint64_t get_num_migrations() { return nu::get_num_migrations(); }
+};
+
+class CallerObj {
+ public:
+  bool call(Proclet<CalleeObj> callee, uint32_t num) {
+    for (uint32_t i = 0; i < num; i++) {
+      if (callee.run(&CalleeObj::foo) != kMagic) {
+        return false;
+      }
+    }
+    return true;
+  }
+  uint64_t get(MetricCounter counter) { return get_counter(counter); }
+};
+
+class Test {
+ public:
+  bool run_histogram_test() {
+    MetricHistogram histogram;
+    histogram.record(0);
+    histogram.record(1);
+    histogram.record(5);
+    histogram.record(7);
+    histogram.record(1ULL << 60);
+    auto buckets = histogram.get_buckets();
+    return buckets[0] == 1 && buckets[1] == 1 && buckets[3] == 2 &&
+           buckets[MetricHistogram::kNumBuckets - 1] == 1 &&
+           histogram.get_sum() == 13 + (1ULL << 60);
+  }
+
+  bool run_call_counters_test() {
+    auto local_ip = get_cfg_ip();
+    auto caller = make_proclet<CallerObj>(true, std::nullopt, local_ip);
+    auto callee = make_proclet<CalleeObj>(true, std::nullopt, local_ip);
+    auto *registry = get_runtime()->metrics();
+    auto remote_calls = registry->take_snapshot().counters[kRemoteCallsOut];
+
+    // Through the fast path, as both proclets are local.
+    if (!caller.run(&CallerObj::call, callee, kNumCalls)) {
+      return false;
+    }
+    if (caller.run(&CallerObj::get, kLocalCallsOut) != kNumCalls) {
+      return false;
+    }
+    // The calls issued outside of any proclet always take the slow path.
+    for (uint32_t i = 0; i < kNumCalls; i++) {
+      if (callee.run(&CalleeObj::foo) != kMagic) {
+        return false;
+      }
+    }
+    if (callee.run(&CalleeObj::get, kCallsIn) != 2 * kNumCalls + 1) {
+      return false;
+    }
+    auto snapshot = registry->take_snapshot();
+    if (snapshot.counters[kRemoteCallsOut] - remote_calls <
+            kNumCalls + 2 ||
+        !snapshot.counters[kBytesSerialized] || snapshot.num_proclets < 2) {
+      return false;
+    }
+
+    auto text = registry->render();
+    auto line = "nu_proclet_calls_in_total{proclet=\"" +
+                std::to_string(callee.get_id()) + "\"}";
+    return text.find(line) != std::string::npos;
+  }
+
+  bool run_migration_test() {
+    auto callee = make_proclet<CalleeObj>();
+    auto *registry = get_runtime()->metrics();
+    auto old_snapshot = registry->take_snapshot();
+    callee.run(+[](CalleeObj &_) { Test::migrate(); });
+    delay_us(500 * 1000);
+
+    auto snapshot = registry->take_snapshot();
+    uint64_t num_migrations = 0;
+    for (uint32_t i = 0; i < MetricHistogram::kNumBuckets; i++) {
+      num_migrations += snapshot.migration_downtime_us_buckets[i] -
+                        old_snapshot.migration_downtime_us_buckets[i];
+    }
+    return num_migrations >= 1 &&
+           callee.run(&CalleeObj::get_num_migrations) == 1;
+  }
+
+  bool run_all_tests() {
+    return run_histogram_test() && run_call_counters_test() &&
+           run_migration_test();
+  }
+
+  static void migrate() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+};
+
+}  // namespace nu
+
+int main(int argc, char **argv) {
+  return nu::runtime_main_init(argc, argv, [](int, char **) {
+    nu::Test test;
+    if (test.run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
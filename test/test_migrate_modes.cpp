@@ -0,0 +1,164 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <net/ip.h>
+}
+#include <runtime.h>
+
+#include "nu/migrator.hpp"
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kChunkSize = 4000;
+constexpr uint64_t kNumChunks = (64ULL << 20) / kChunkSize;
+// Every other block gets freed, which leaves free runs of about 2 MB.
+constexpr uint64_t kBlockChunks = 512;
+// Every few chunks are left zeroed for the zero page elision.
+constexpr uint64_t kZeroChunkInterval = 4;
+constexpr uint64_t kProcletCapacity = 1ULL << 30;
+constexpr uint64_t kTimeoutUs = 10 * kOneSecond;
+
+struct Mode {
+  const char *name;
+  bool sparse_copy;
+  bool compression;
+};
+
+constexpr Mode kModes[] = {{"dense", false, false},
+                           {"sparse", true, false},
+                           {"compressed", false, true},
+                           {"sparse compressed", true, true}};
+
+namespace nu {
+
+// Fills a fragmented heap with a pattern that tells every chunk apart, so
+// that a page sent to the wrong place or dropped is caught.
+class PatternTest {
+ public:
+  PatternTest() : chunks_(kNumChunks), seq_(0) {
+    for (uint64_t i = 0; i < kNumChunks; i++) {
+      chunks_[i] = std::make_unique<uint8_t[]>(kChunkSize);
+      fill(i);
+    }
+    free_blocks();
+  }
+
+  void migrate(bool sparse_copy, bool compression) {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_pre_copy(false);
+    get_runtime()->migrator()->set_post_copy(false);
+    get_runtime()->migrator()->set_sparse_copy(sparse_copy);
+    get_runtime()->migrator()->set_compression(compression);
+    get_runtime()->migrator()->set_forced_compression(compression);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  // Also refills the freed blocks, which get carved out of the free runs that
+  // the destination never populated, and frees them again for the next mode.
+  bool check() {
+    for (uint64_t i = 0; i < kNumChunks; i++) {
+      if (chunks_[i] && !check_chunk(i)) {
+        return false;
+      }
+    }
+
+    seq_++;
+    for (uint64_t i = 0; i < kNumChunks; i++) {
+      if (!chunks_[i]) {
+        chunks_[i] = std::make_unique<uint8_t[]>(kChunkSize);
+        fill(i);
+      }
+    }
+    for (uint64_t i = 0; i < kNumChunks; i++) {
+      if (!check_chunk(i)) {
+        return false;
+      }
+    }
+    free_blocks();
+    return true;
+  }
+
+ private:
+  std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+  uint64_t seq_;
+
+  bool is_zero(uint64_t idx) const { return idx % kZeroChunkInterval == 0; }
+
+  uint64_t get_word(uint64_t idx, uint64_t off) const {
+    // Small words repeat within a chunk, so that the chunks compress.
+    return (seq_ << 48) | (idx << 16) | (off % 64);
+  }
+
+  void fill(uint64_t idx) {
+    if (is_zero(idx)) {
+      return;
+    }
+    auto *words = reinterpret_cast<uint64_t *>(chunks_[idx].get());
+    for (uint64_t j = 0; j < kChunkSize / sizeof(uint64_t); j++) {
+      words[j] = get_word(idx, j);
+    }
+  }
+
+  bool check_chunk(uint64_t idx) const {
+    auto *words = reinterpret_cast<const uint64_t *>(chunks_[idx].get());
+    for (uint64_t j = 0; j < kChunkSize / sizeof(uint64_t); j++) {
+      if (words[j] != (is_zero(idx) ? 0 : get_word(idx, j))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void free_blocks() {
+    for (uint64_t i = 0; i < kNumChunks; i++) {
+      if ((i / kBlockChunks) % 2) {
+        chunks_[i].reset();
+      }
+    }
+  }
+};
+
+}  // namespace nu
+
+bool run_test() {
+  auto proclet = make_proclet<PatternTest>(false, kProcletCapacity);
+
+  for (const auto &mode : kModes) {
+    auto src_ip = proclet.run(&PatternTest::get_ip);
+    proclet.run(&PatternTest::migrate, mode.sparse_copy, mode.compression);
+
+    auto start_us = microtime();
+    while (proclet.run(&PatternTest::get_ip) == src_ip) {
+      if (microtime() - start_us > kTimeoutUs) {
+        std::cout << mode.name << ": not migrated" << std::endl;
+        return false;
+      }
+      delay_ms(10);
+    }
+    if (!proclet.run(&PatternTest::check)) {
+      std::cout << mode.name << ": corrupted" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    if (run_test()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "nu/runtime.hpp"
+#include "nu/utils/page_codec.hpp"
+
+using namespace nu;
+
+constexpr static uint32_t kNumBlocks = 2000;
+
+enum Pattern { kRandom, kSomeZeroPages, kRepeated, kAllZeros, kNumPatterns };
+
+void fill(std::mt19937 &mt, Pattern pattern, std::vector<std::byte> *block) {
+  for (uint32_t i = 0; i < block->size(); i++) {
+    auto page_idx = i / kPageSize;
+    std::byte b;
+    switch (pattern) {
+      case kRandom:
+        b = std::byte(mt());
+        break;
+      case kSomeZeroPages:
+        b = (page_idx % 3) ? std::byte(mt()) : std::byte{0};
+        break;
+      case kRepeated:
+        b = (page_idx % 2) ? std::byte{0} : std::byte(i % 7);
+        break;
+      default:
+        b = std::byte{0};
+    }
+    (*block)[i] = b;
+  }
+}
+
+bool run() {
+  PageCodec encoder;
+  PageCodec decoder;
+  std::mt19937 mt(0);
+  uint64_t raw_bytes[kNumPatterns] = {};
+  uint64_t encoded_bytes[kNumPatterns] = {};
+
+  for (uint32_t i = 0; i < kNumBlocks; i++) {
+    auto pattern = static_cast<Pattern>(i % kNumPatterns);
+    // Include partial pages at the tail.
+    uint32_t len = 1 + mt() % PageCodec::kBlockSize;
+    std::vector<std::byte> src(len);
+    fill(mt, pattern, &src);
+    // The destination holds stale data, as after a pre-copy round.
+    std::vector<std::byte> dst(len, std::byte{0xff});
+
+    PageBlockHeader hdr;
+    auto payload = encoder.encode(src.data(), len, &hdr);
+    if (payload.size() != hdr.payload_len ||
+        hdr.payload_len > PageCodec::kMaxPayloadLen) {
+      return false;
+    }
+    std::vector<std::byte> wire(payload.begin(), payload.end());
+    if (!decoder.decode(hdr, wire.data(), dst.data(), len) ||
+        memcmp(src.data(), dst.data(), len)) {
+      return false;
+    }
+    raw_bytes[pattern] += len;
+    encoded_bytes[pattern] += sizeof(hdr) + hdr.payload_len;
+  }
+
+  // Random data must not expand beyond the headers, zeros must vanish.
+  return encoded_bytes[kRandom] <=
+             raw_bytes[kRandom] + kNumBlocks * sizeof(PageBlockHeader) &&
+         encoded_bytes[kSomeZeroPages] < raw_bytes[kSomeZeroPages] &&
+         encoded_bytes[kRepeated] * 10 < raw_bytes[kRepeated] &&
+         encoded_bytes[kAllZeros] ==
+             kNumBlocks / kNumPatterns * sizeof(PageBlockHeader);
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    if (run()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
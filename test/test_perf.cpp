@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -7,6 +8,7 @@ extern "C" {
 #include <runtime/runtime.h>
 }
 #include <runtime.h>
+#include <timer.h>
 
 #include "nu/commons.hpp"
 #include "nu/runtime.hpp"
@@ -17,6 +19,9 @@ using namespace nu;
 constexpr static uint32_t kNumThreads = 100;
 constexpr static double kTargetMops = 10;
 constexpr static uint32_t kNumSeconds = 5;
+constexpr static uint32_t kNumStallThreads = 2;
+constexpr static double kStallTargetMops = 0.1;
+constexpr static uint64_t kStallUs = 100 * 1000;
 
 class FakeWorkAdapter : public PerfAdapter {
  public:
@@ -33,6 +38,21 @@ class FakeWorkAdapter : public PerfAdapter {
   }
 };
 
+// Stalls the first request served, holding up the ones queued behind it on
+// the same thread.
+class StallAdapter : public FakeWorkAdapter {
+ public:
+  bool serve_req(PerfThreadState *state, const PerfRequest *req) override {
+    if (!stalled_.exchange(true)) {
+      rt::Sleep(kStallUs);
+    }
+    return true;
+  }
+
+ private:
+  std::atomic<bool> stalled_{false};
+};
+
 namespace nu {
 
 class Test {
@@ -53,6 +73,48 @@ class Test {
 
     return true;
   }
+
+  bool run_open_loop() {
+    FakeWorkAdapter fake_work_adapter;
+    Perf perf(fake_work_adapter);
+    perf.run_open_loop(kNumThreads, kTargetMops,
+                       /* duration_us = */ kNumSeconds * kOneSecond,
+                       /* warmup_us = */ kOneSecond,
+                       /* interval_us = */ kOneSecond);
+    auto real_mops = perf.get_real_mops();
+    if (std::abs(real_mops / kTargetMops - 1) > 0.05) {
+      return false;
+    }
+    auto &histogram = perf.get_lat_histogram();
+
+    // The last interval also takes in the stragglers.
+    auto &intervals = perf.get_intervals();
+    if (intervals.size() != kNumSeconds) {
+      return false;
+    }
+    uint64_t num_reqs = 0;
+    for (auto &interval : intervals) {
+      num_reqs += interval.num_reqs;
+    }
+    return num_reqs == histogram.get_count();
+  }
+
+  // Whatever queues up behind a stall must be charged from its intended send
+  // time. About 5K requests pile up on the stalled thread, with latencies
+  // spread over [0, kStallUs], so 2.5% of the 100K requests sent take over
+  // kStallUs / 2. Were they charged from their actual send times, only the
+  // stalled one would. Slower machines only make the latencies higher.
+  bool run_open_loop_stall() {
+    StallAdapter stall_adapter;
+    Perf perf(stall_adapter);
+    perf.run_open_loop(kNumStallThreads, kStallTargetMops,
+                       /* duration_us = */ kOneSecond,
+                       /* warmup_us = */ 0,
+                       /* interval_us = */ kOneSecond);
+    auto &histogram = perf.get_lat_histogram();
+    return histogram.get_max() >= kStallUs * 1000 &&
+           histogram.get_nth(99) >= kStallUs / 2 * 1000;
+  }
 };
 
 }  // namespace nu
@@ -60,7 +122,7 @@ class Test {
 int main(int argc, char **argv) {
   return runtime_main_init(argc, argv, [](int, char **) {
     Test test;
-    if (test.run()) {
+    if (test.run() && test.run_open_loop() && test.run_open_loop_stall()) {
       std::cout << "Passed" << std::endl;
     } else {
       std::cout << "Failed" << std::endl;
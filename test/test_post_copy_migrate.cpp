@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <net/ip.h>
+}
+#include <runtime.h>
+
+#include "nu/exception.hpp"
+#include "nu/migrator.hpp"
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/proclet_mgr.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/thread.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kSrcIP = MAKE_IP_ADDR(18, 18, 1, 2);
+constexpr uint32_t kDestIP = MAKE_IP_ADDR(18, 18, 1, 3);
+constexpr uint64_t kNumElems = (256ULL << 20) / sizeof(uint64_t);
+constexpr uint64_t kProcletCapacity = 1ULL << 30;
+constexpr uint64_t kMagic = 0x9E3779B97F4A7C15ULL;
+constexpr uint64_t kTimeoutUs = 10 * kOneSecond;
+
+namespace nu {
+
+class Victim {
+ public:
+  Victim() : elems_(kNumElems) {
+    for (uint64_t i = 0; i < elems_.size(); i++) {
+      elems_[i] = i * kMagic;
+    }
+  }
+
+  void migrate() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_post_copy(true);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  bool check() {
+    for (uint64_t i = 0; i < elems_.size(); i++) {
+      if (elems_[i] != i * kMagic) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::vector<uint64_t> elems_;
+};
+
+// Pinned at the source. Kills it once the victim starts post-copying.
+class Killer {
+ public:
+  void arm(ProcletID victim_id) {
+    Thread([victim_id] {
+      auto *header = to_proclet_header(victim_id);
+      while (rt::access_once(header->status()) != kPostCopying) {
+        get_runtime()->caladan()->thread_yield();
+      }
+      _Exit(0);
+    }).detach();
+  }
+};
+
+// Pinned at the destination.
+class Inspector {
+ public:
+  uint8_t get_status(ProcletID id) { return to_proclet_header(id)->status(); }
+};
+
+}  // namespace nu
+
+bool run_post_copy_test() {
+  auto victim = make_proclet<Victim>(false, kProcletCapacity, kSrcIP);
+  victim.run(&Victim::migrate);
+
+  auto start_us = microtime();
+  while (victim.run(&Victim::get_ip) != kDestIP) {
+    if (microtime() - start_us > kTimeoutUs) {
+      return false;
+    }
+    delay_ms(10);
+  }
+  return victim.run(&Victim::check);
+}
+
+bool run_source_death_test() {
+  auto inspector = make_proclet<Inspector>(true, std::nullopt, kDestIP);
+  // Their handles are leaked on purpose, as the source never comes back.
+  auto *victim = new Proclet<Victim>(
+      make_proclet<Victim>(false, kProcletCapacity, kSrcIP));
+  auto *killer = new Proclet<Killer>(
+      make_proclet<Killer>(true, std::nullopt, kSrcIP));
+  auto victim_id = victim->get_id();
+  killer->run(&Killer::arm, victim_id);
+  victim->run(&Victim::migrate);
+
+  // The partially arrived proclet must be marked lost rather than resumed with
+  // zero-filled pages, and the destination must stay alive.
+  auto start_us = microtime();
+  while (inspector.run(&Inspector::get_status, victim_id) != kLost) {
+    if (microtime() - start_us > kTimeoutUs) {
+      return false;
+    }
+    delay_ms(10);
+  }
+  // Its callers must fail rather than retry forever.
+  try {
+    victim->run(&Victim::check);
+    return false;
+  } catch (const ProcletLost &) {
+  }
+  auto survivor = make_proclet<Victim>(false, kProcletCapacity, kDestIP);
+  return survivor.run(&Victim::check);
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    // The source dies in the latter test, so it must go last.
+    bool passed = run_post_copy_test() && run_source_death_test();
+
+    if (passed) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -0,0 +1,115 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <base/time.h>
+#include <net/ip.h>
+}
+#include <runtime.h>
+#include <thread.h>
+
+#include "nu/migrator.hpp"
+#include "nu/pressure_handler.hpp"
+#include "nu/proclet.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/thread.hpp"
+
+using namespace nu;
+
+constexpr uint32_t kSrcIP = MAKE_IP_ADDR(18, 18, 1, 2);
+constexpr uint32_t kDestIP = MAKE_IP_ADDR(18, 18, 1, 3);
+constexpr uint64_t kNumElems = (64ULL << 20) / sizeof(uint64_t);
+constexpr uint64_t kYieldInterval = 4096;
+constexpr uint64_t kProcletCapacity = 1ULL << 30;
+constexpr uint64_t kMagic = 0x9E3779B97F4A7C15ULL;
+constexpr uint64_t kTimeoutUs = 10 * kOneSecond;
+
+namespace nu {
+
+// Keeps rewriting its heap throughout the migration, so that every pre-copy
+// round finds dirty pages.
+class Writer {
+ public:
+  Writer() : elems_(kNumElems), num_rounds_(0), done_(false) {
+    th_ = Thread([&] { write(); });
+  }
+
+  void migrate() {
+    rt::Preempt p;
+    rt::PreemptGuard g(&p);
+    get_runtime()->migrator()->set_pre_copy(true);
+    get_runtime()->pressure_handler()->mock_set_pressure();
+  }
+
+  NodeIP get_ip() { return get_cfg_ip(); }
+
+  uint64_t get_num_rounds() { return rt::access_once(num_rounds_); }
+
+  // Every element must hold what the last completed round wrote, i.e., no
+  // write made while the proclet was being copied got lost.
+  bool stop_and_check() {
+    done_ = true;
+    th_.join();
+    for (uint64_t i = 0; i < elems_.size(); i++) {
+      if (elems_[i] != num_rounds_ * kMagic + i) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::vector<uint64_t> elems_;
+  uint64_t num_rounds_;
+  bool done_;
+  Thread th_;
+
+  void write() {
+    while (!rt::access_once(done_)) {
+      auto round = num_rounds_ + 1;
+      for (uint64_t i = 0; i < elems_.size(); i++) {
+        elems_[i] = round * kMagic + i;
+        if (i % kYieldInterval == 0) {
+          rt::Yield();
+        }
+      }
+      num_rounds_ = round;
+    }
+  }
+};
+
+}  // namespace nu
+
+bool run_test() {
+  auto writer = make_proclet<Writer>(false, kProcletCapacity, kSrcIP);
+  writer.run(&Writer::migrate);
+
+  auto start_us = microtime();
+  while (writer.run(&Writer::get_ip) != kDestIP) {
+    if (microtime() - start_us > kTimeoutUs) {
+      return false;
+    }
+    delay_ms(10);
+  }
+
+  // The writer must have kept going at the destination.
+  auto migrated_num_rounds = writer.run(&Writer::get_num_rounds);
+  while (writer.run(&Writer::get_num_rounds) == migrated_num_rounds) {
+    if (microtime() - start_us > kTimeoutUs) {
+      return false;
+    }
+    delay_ms(10);
+  }
+  return writer.run(&Writer::stop_and_check);
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    if (run_test()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
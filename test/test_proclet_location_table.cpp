@@ -0,0 +1,132 @@
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <net/ip.h>
+}
+#include <thread.h>
+
+#include "nu/ctrl.hpp"
+#include "nu/runtime.hpp"
+#include "nu/utils/thread.hpp"
+
+constexpr uint32_t kNumProclets = 1024;
+constexpr uint32_t kNumThreads = 4;
+constexpr uint32_t kIP0 = MAKE_IP_ADDR(18, 18, 1, 2);
+constexpr uint32_t kIP1 = MAKE_IP_ADDR(18, 18, 1, 3);
+
+namespace nu {
+
+class Test {
+ public:
+  Test() : table_(std::make_unique<ProcletLocationTable>()) {}
+
+  bool run_insert_test() {
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      if (table_->get(get_id(i)) || table_->exchange(get_id(i), kIP0)) {
+        return false;
+      }
+    }
+    // The last slot must not alias any other.
+    auto last_id = kMaxProcletHeapVAddr - kMinProcletHeapSize;
+    if (table_->exchange(last_id, kIP1) ||
+        table_->exchange(last_id, 0) != kIP1) {
+      return false;
+    }
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      if (table_->get(get_id(i)) != kIP0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool run_update_test() {
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      if (!table_->update(get_id(i), kIP1) || table_->get(get_id(i)) != kIP1) {
+        return false;
+      }
+    }
+    // Proclets that don't exist are left alone.
+    auto id = get_id(kNumProclets);
+    return !table_->update(id, kIP1) && !table_->get(id);
+  }
+
+  bool run_remove_test() {
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      if (table_->exchange(get_id(i), 0) != kIP1 || table_->get(get_id(i)) ||
+          table_->update(get_id(i), kIP0)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Migrations keep relocating the proclets while they get destroyed, which
+  // must neither fail nor bring any of them back.
+  bool run_concurrent_destroy_test() {
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      table_->exchange(get_id(i), kIP0);
+    }
+
+    std::vector<Thread> threads;
+    for (uint32_t i = 0; i < kNumThreads; i++) {
+      threads.emplace_back([&, i] {
+        for (uint32_t j = 0; j < kNumProclets; j++) {
+          auto id = get_id(j);
+          while (table_->update(id, i % 2 ? kIP0 : kIP1)) {
+            rt::Yield();
+          }
+        }
+      });
+    }
+
+    bool destroyed = true;
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      auto prev_ip = table_->exchange(get_id(i), 0);
+      destroyed &= (prev_ip == kIP0 || prev_ip == kIP1);
+      rt::Yield();
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    if (!destroyed) {
+      return false;
+    }
+
+    for (uint32_t i = 0; i < kNumProclets; i++) {
+      if (table_->get(get_id(i))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool run_all_tests() {
+    return run_insert_test() && run_update_test() && run_remove_test() &&
+           run_concurrent_destroy_test();
+  }
+
+ private:
+  // Too large for the stack.
+  std::unique_ptr<ProcletLocationTable> table_;
+
+  ProcletID get_id(uint32_t idx) {
+    return kMinProcletHeapVAddr + idx * kMinProcletHeapSize;
+  }
+};
+
+}  // namespace nu
+
+int main(int argc, char **argv) {
+  return nu::runtime_main_init(argc, argv, [](int, char **) {
+    nu::Test test;
+    if (test.run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include "nu/runtime.hpp"
+#include "nu/sharded_deque.hpp"
+#include "nu/sharded_queue.hpp"
+#include "nu/sharded_vector.hpp"
+
+using namespace nu;
+
+constexpr uint64_t kNumElements = 100000;
+constexpr uint64_t kMaxShardSize = 4096;
+constexpr uint64_t kBatchSize = 1000;
+
+bool run_vector_test() {
+  auto vec = make_sharded_vector<uint64_t>(kMaxShardSize);
+  for (uint64_t i = 0; i < kNumElements; i += kBatchSize) {
+    std::vector<uint64_t> batch(kBatchSize);
+    std::iota(batch.begin(), batch.end(), i);
+    vec.push_back_batch(std::move(batch));
+  }
+  if (vec.size() != kNumElements ||
+      vec.get_num_shards() < kNumElements / kMaxShardSize) {
+    return false;
+  }
+
+  vec.for_all(+[](const uint64_t &idx, uint64_t &val, uint64_t delta) {
+    val += idx + delta;
+  }, static_cast<uint64_t>(1));
+  for (uint64_t i = 0; i < kNumElements; i += kNumElements / 100) {
+    auto optional = vec.get(i);
+    if (!optional || *optional != 2 * i + 1) {
+      return false;
+    }
+  }
+  if (vec.get(kNumElements) || !vec.set(0, 0) || *vec.get(0) != 0) {
+    return false;
+  }
+
+  // Sums where the data is and only ships the partial sums.
+  auto sums = vec.compute(+[](VectorImpl<uint64_t> &impl) {
+    uint64_t sum = 0;
+    impl.for_all(+[](const uint64_t &, uint64_t &val, uint64_t *sum) {
+      *sum += val;
+    }, &sum);
+    return sum;
+  });
+  auto sum = std::accumulate(sums.begin(), sums.end(), 0ULL);
+  // The first value has been reset from 1 to 0.
+  return sum == kNumElements * kNumElements - 1;
+}
+
+bool run_queue_test() {
+  auto queue = make_sharded_queue<uint64_t>(kMaxShardSize);
+  for (uint64_t i = 0; i < kNumElements; i++) {
+    queue.push_back(i);
+  }
+
+  // Drains the queue across shards, which are recycled along the way.
+  uint64_t expected = 0;
+  while (true) {
+    auto vals = queue.try_pop_front(kBatchSize + 1);
+    if (vals.empty()) {
+      break;
+    }
+    for (auto val : vals) {
+      if (val != expected++) {
+        return false;
+      }
+    }
+  }
+  if (expected != kNumElements || !queue.empty() ||
+      queue.get_num_shards() != 1) {
+    return false;
+  }
+
+  queue.push_back(kNumElements);
+  auto vals = queue.try_pop_front(kBatchSize);
+  return vals.size() == 1 && vals[0] == kNumElements;
+}
+
+bool run_deque_test() {
+  auto deque = make_sharded_deque<uint64_t>(kMaxShardSize);
+  std::vector<uint64_t> batch(kNumElements);
+  std::iota(batch.begin(), batch.end(), 0);
+  deque.push_front_batch(batch);
+  deque.push_back_batch(batch);
+  auto all_data = deque.get_all_data();
+  if (all_data.size() != 2 * kNumElements) {
+    return false;
+  }
+  for (uint64_t i = 0; i < kNumElements; i++) {
+    if (all_data[i] != kNumElements - 1 - i ||
+        all_data[kNumElements + i] != i) {
+      return false;
+    }
+  }
+
+  auto front_vals = deque.try_pop_front(kNumElements);
+  auto back_vals = deque.try_pop_back(kNumElements);
+  for (uint64_t i = 0; i < kNumElements; i++) {
+    if (front_vals[i] != kNumElements - 1 - i ||
+        back_vals[i] != kNumElements - 1 - i) {
+      return false;
+    }
+  }
+  return deque.empty();
+}
+
+bool run_pass_test() {
+  auto queue = make_sharded_queue<uint64_t>(kMaxShardSize);
+  auto proclet = make_proclet<ErasedType>();
+  proclet.run(
+      +[](ErasedType &, ShardedQueue<uint64_t> queue) {
+        for (uint64_t i = 0; i < kNumElements; i++) {
+          queue.push_back(i);
+        }
+      },
+      queue);
+  return queue.size() == kNumElements;
+}
+
+bool run_all_tests() {
+  return run_vector_test() && run_queue_test() && run_deque_test() &&
+         run_pass_test();
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    if (run_all_tests()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
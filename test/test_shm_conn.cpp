@@ -0,0 +1,108 @@
+#include <net.h>
+#include <runtime.h>
+#include <thread.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "nu/runtime.hpp"
+#include "nu/proclet.hpp"
+#include "nu/utils/shm_conn.hpp"
+
+using namespace nu;
+
+constexpr static uint32_t kPingPongTimes = 400000;
+constexpr static uint32_t kBulkBytes = 4 * ShmConn::kRingBytes + 17;
+constexpr uint32_t kServerIP = MAKE_IP_ADDR(18, 18, 1, 2);
+constexpr uint32_t kClientIP = MAKE_IP_ADDR(18, 18, 1, 3);
+constexpr uint32_t kPort = 8090;
+
+class Server {
+ public:
+  bool run() {
+    netaddr laddr = {.ip = 0, .port = kPort};
+    auto *q = ShmQueue::Listen(laddr);
+    std::unique_ptr<ShmQueue> gc_q(q);
+    BUG_ON(!q);
+    ShmConn *c = q->Accept();
+    std::unique_ptr<ShmConn> gc_c(c);
+    BUG_ON(c->RemoteAddr().ip != kClientIP);
+    for (uint32_t i = 0; i < kPingPongTimes; i++) {
+      int num;
+      BUG_ON(c->ReadFull(&num, sizeof(num)) <= 0);
+      num++;
+      BUG_ON(c->WriteFull(&num, sizeof(num)) < 0);
+    }
+
+    std::vector<uint8_t> bulk(kBulkBytes);
+    BUG_ON(c->ReadFull(bulk.data(), bulk.size()) <= 0);
+    for (uint32_t i = 0; i < kBulkBytes; i++) {
+      if (bulk[i] != static_cast<uint8_t>(i * 7)) {
+        return false;
+      }
+    }
+    // The client has shut down its write side.
+    uint8_t dummy;
+    BUG_ON(c->ReadFull(&dummy, sizeof(dummy)) != 0);
+    BUG_ON(c->Shutdown(SHUT_RDWR) != 0);
+    q->Shutdown();
+    return true;
+  }
+};
+
+class Client {
+ public:
+  uint64_t run() {
+    netaddr raddr = {.ip = kServerIP, .port = kPort};
+    BUG_ON(!ShmConn::IsLocal(raddr));
+    auto *c = ShmConn::Dial(raddr);
+    std::unique_ptr<ShmConn> gc_c(c);
+    BUG_ON(!c);
+    int num = 0;
+    auto start_us = microtime();
+    for (uint32_t i = 0; i < kPingPongTimes; i++) {
+      BUG_ON(c->WriteFull(&num, sizeof(num)) < 0);
+      int new_num;
+      BUG_ON(c->ReadFull(&new_num, sizeof(new_num)) <= 0);
+      BUG_ON(num + 1 != new_num);
+      num = new_num;
+    }
+    auto end_us = microtime();
+
+    // Larger than the ring and split unevenly, so that it wraps around.
+    std::vector<uint8_t> bulk(kBulkBytes);
+    for (uint32_t i = 0; i < kBulkBytes; i++) {
+      bulk[i] = i * 7;
+    }
+    iovec iovecs[] = {{bulk.data(), 1000},
+                      {bulk.data() + 1000, kBulkBytes - 1000}};
+    BUG_ON(c->WritevFull(std::span<const iovec>(iovecs)) != kBulkBytes);
+    BUG_ON(c->Shutdown(SHUT_WR) != 0);
+    return end_us - start_us;
+  }
+};
+
+bool run() {
+  auto server_proclet = make_proclet<Server>(true, std::nullopt, kServerIP);
+  auto future0 = server_proclet.run_async(&Server::run);
+  delay_us(100 * 1000);
+
+  auto client_proclet = make_proclet<Client>(true, std::nullopt, kClientIP);
+  auto future1 = client_proclet.run_async(&Client::run);
+
+  std::cout << future1.get() << std::endl;
+  return future0.get();
+}
+
+int main(int argc, char **argv) {
+  return runtime_main_init(argc, argv, [](int, char **) {
+    if (run()) {
+      std::cout << "Passed" << std::endl;
+    } else {
+      std::cout << "Failed" << std::endl;
+    }
+  });
+}
@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include <sync.h>
 
@@ -53,7 +54,8 @@ bool run_with_size(uint64_t obj_size, uint64_t class_size) {
 bool run_min_size() { return run_with_size(1, kMinSlabClassSize); }
 
 bool run_mid_size() {
-  return run_with_size(110, 128) & run_with_size(200, 256);
+  return run_with_size(33, 48) & run_with_size(110, 112) &
+         run_with_size(200, 224) & run_with_size(5000, 5120);
 }
 
 bool run_max_size() {
@@ -75,9 +77,137 @@ bool run_more_than_buf_size() {
   return true;
 }
 
+bool run_class_stats() {
+  rt::Preempt p;
+  rt::PreemptGuard g(&p);
+
+  constexpr uint64_t kNumObjs = 1000;
+  constexpr uint64_t kObjSize = 33;
+  constexpr uint64_t kClassSize = 48;
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  std::vector<void *> ptrs;
+  for (uint64_t i = 0; i < kNumObjs; i++) {
+    ptrs.push_back(slab->allocate(kObjSize));
+  }
+  for (uint64_t i = 0; i < kNumObjs / 2; i++) {
+    slab->free(ptrs[i]);
+  }
+
+  auto stats = slab->get_class_stats();
+  if (stats.size() != 1 || stats[0].class_size != kClassSize) {
+    return false;
+  }
+  auto num_live = kNumObjs - kNumObjs / 2;
+  if (stats[0].num_live != num_live ||
+      stats[0].live_bytes != num_live * kObjSize ||
+      stats[0].internal_frag_bytes != num_live * (kClassSize - kObjSize)) {
+    return false;
+  }
+  return slab->get_wasted_bytes() ==
+         stats[0].internal_frag_bytes + stats[0].num_free * kClassSize;
+}
+
+bool run_adaptive_cache() {
+  rt::Preempt p;
+  rt::PreemptGuard g(&p);
+
+  constexpr uint64_t kNumObjs = 10000;
+  constexpr uint64_t kObjSize = 64;
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  std::vector<void *> ptrs;
+  for (uint64_t i = 0; i < kNumObjs; i++) {
+    ptrs.push_back(slab->allocate(kObjSize));
+  }
+  // The cache deepens upon misses, so they grow only logarithmically at first.
+  auto stats = slab->get_cache_stats();
+  if (stats.num_allocs != kNumObjs ||
+      stats.num_misses > kNumObjs / SlabAllocator::kMaxNumCacheEntries + 16) {
+    return false;
+  }
+
+  for (auto *ptr : ptrs) {
+    slab->free(ptr);
+  }
+  slab->flush_caches();
+  auto wasted_bytes = slab->get_wasted_bytes();
+  auto class_stats = slab->get_class_stats();
+  return class_stats.size() == 1 && class_stats[0].num_live == 0 &&
+         wasted_bytes == class_stats[0].num_free * kObjSize &&
+         slab->get_cur_usage() == 0;
+}
+
+bool run_free_runs() {
+  rt::Preempt p;
+  rt::PreemptGuard g(&p);
+
+  constexpr uint64_t kNumObjs = 40000;
+  constexpr uint64_t kObjSize = 1008;
+  constexpr uint64_t kSlabSize = 1024 + sizeof(PtrHeader);
+  constexpr uint64_t kLiveStride = 1000;
+  auto *buf = new uint8_t[kBufSize];
+  std::unique_ptr<uint8_t[]> buf_gc(buf);
+  auto slab = std::make_unique<SlabAllocator>(slab_id++, buf, kBufSize);
+
+  std::vector<uint64_t> live_addrs;
+  std::vector<void *> ptrs;
+  for (uint64_t i = 0; i < kNumObjs; i++) {
+    ptrs.push_back(slab->allocate(kObjSize));
+  }
+  for (uint64_t i = 0; i < kNumObjs; i++) {
+    if (i % kLiveStride) {
+      slab->free(ptrs[i]);
+    } else {
+      live_addrs.push_back(reinterpret_cast<uint64_t>(ptrs[i]) -
+                           sizeof(PtrHeader));
+    }
+  }
+  slab->flush_caches();
+  auto cur_usage = slab->get_cur_usage();
+  slab->release_free_runs(kPageSize, 16 * kPageSize);
+
+  // The extents must be page aligned and hold no live object.
+  auto extents = slab->get_free_run_extents(kPageSize);
+  if (extents.empty() || slab->get_cur_usage() != cur_usage ||
+      slab->get_free_run_bytes() < 16 * kPageSize) {
+    return false;
+  }
+  for (auto [start, end] : extents) {
+    if (start % kPageSize || end % kPageSize || start >= end) {
+      return false;
+    }
+    for (auto addr : live_addrs) {
+      if (addr < end && start < addr + kSlabSize) {
+        return false;
+      }
+    }
+  }
+
+  // The runs get carved again once the free lists run out.
+  for (uint64_t i = 0; i < kNumObjs - live_addrs.size(); i++) {
+    auto addr = reinterpret_cast<uint64_t>(slab->allocate(kObjSize)) -
+                sizeof(PtrHeader);
+    for (auto live_addr : live_addrs) {
+      if (addr == live_addr) {
+        return false;
+      }
+    }
+  }
+  slab->flush_caches();
+  return slab->get_free_run_bytes() == 0 &&
+         slab->get_free_run_extents(kPageSize).empty() &&
+         slab->get_cur_usage() == kNumObjs * kSlabSize;
+}
+
 bool run() {
   return run_min_size() & run_mid_size() & run_max_size() &
-         run_more_than_buf_size();
+         run_more_than_buf_size() & run_class_stats() & run_adaptive_cache() &
+         run_free_runs();
 }
 
 int main(int argc, char **argv) {